@@ -0,0 +1,60 @@
+/* bench.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+#include <image/image.h>
+
+#include <foundation/foundation.h>
+
+typedef struct bench_scaling_result_t bench_scaling_result_t;
+
+//! Result of one workload at one thread count in the scaling benchmark
+struct bench_scaling_result_t {
+	string_const_t workload;
+	string_const_t format;
+	unsigned int threads;
+	//! Number of images processed
+	size_t images;
+	//! Wall clock time in seconds
+	double seconds;
+	double images_per_second;
+	//! Throughput relative to the single thread run
+	double speedup;
+	//! Speedup divided by thread count
+	double efficiency;
+	//! Share of total thread time spent allocating image storage
+	double allocate_share;
+	//! Average time per image spent allocating image storage
+	double allocate_seconds;
+	//! Average time per image in each load stage
+	double stage_seconds[IMAGE_LOAD_STAGE_COUNT];
+	//! Average decode time per image relative to the single thread run, above one indicates serialization
+	double decode_inflation;
+	//! Average allocation time per image relative to the single thread run. Above one is an estimate of
+	//! allocator lock contention, the lock wait itself is internal to the memory system and not measured
+	double allocate_inflation;
+};
+
+extern bench_scaling_result_t* bench_scaling_results;
+
+void
+bench_image_generate(image_t* image, const image_pixelformat_t* pixelformat, unsigned int width, unsigned int height);
+
+void
+bench_scaling_run(unsigned int max_threads, bool quick);
@@ -0,0 +1,520 @@
+/* main.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <image/image.h>
+#include <image/native.h>
+
+#include <foundation/foundation.h>
+
+#include "bench.h"
+
+typedef bool (*bench_fn)(void* arg);
+
+typedef struct bench_result_t bench_result_t;
+typedef struct bench_load_t bench_load_t;
+typedef struct bench_convert_t bench_convert_t;
+typedef struct bench_compress_t bench_compress_t;
+typedef struct bench_mipmap_t bench_mipmap_t;
+
+//! Result of a single benchmark case
+struct bench_result_t {
+	string_const_t name;
+	string_const_t variant;
+	unsigned int width;
+	unsigned int height;
+	//! Number of measured iterations
+	size_t iterations;
+	//! Total measured time in seconds
+	double seconds;
+	//! Fastest iteration in seconds
+	double best;
+	double images_per_second;
+	//! Uncompressed image data processed per second
+	double megabytes_per_second;
+	//! Average time per iteration in each load stage, only set for load benchmarks
+	double stage_seconds[IMAGE_LOAD_STAGE_COUNT];
+	bool failed;
+};
+
+struct bench_load_t {
+	stream_t* stream;
+	image_t image;
+};
+
+struct bench_convert_t {
+	const image_t* source;
+	image_t destination;
+	//! Target channel type for channel conversion, blit to the destination format if zero bit depth
+	image_datatype_t data_type;
+	unsigned int bitdepth;
+};
+
+struct bench_compress_t {
+	const image_t* source;
+	image_t destination;
+	image_file_format_t file_format;
+	image_save_options_t options;
+	image_pixelformat_t astc_format;
+	stream_t* stream;
+};
+
+struct bench_mipmap_t {
+	image_t image;
+	image_mipmap_mode_t mode;
+	unsigned int flags;
+};
+
+static bench_result_t* bench_results;
+static double bench_min_time = 0.5;
+static size_t bench_max_iterations = 10000;
+static bool bench_quick;
+
+static const unsigned int bench_sizes[] = {64, 512, 2048};
+static const unsigned int bench_sizes_quick[] = {64, 256};
+
+//! Generate a deterministic image with smooth gradients and low amplitude noise, so
+//! compression ratios are representative of real content
+void
+bench_image_generate(image_t* image, const image_pixelformat_t* pixelformat, unsigned int width, unsigned int height) {
+	image_initialize(image);
+	image_allocate_storage(image, pixelformat, width, height, 1, 1);
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * width, 0, MEMORY_PERSISTENT);
+	size_t row_size = ((size_t)pixelformat->bits_per_pixel * width) / 8;
+	uint32_t seed = 0x9E3779B9U ^ width ^ (height << 16);
+	for (unsigned int y = 0; y < height; ++y) {
+		for (unsigned int x = 0; x < width; ++x) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			float32_t noise = (float32_t)(seed & 0xF) / 255.0f;
+			float32_t* pixel = rgba + x * 4;
+			pixel[0] = (float32_t)x / (float32_t)width + noise;
+			pixel[1] = (float32_t)y / (float32_t)height + noise;
+			pixel[2] = (float32_t)((x ^ y) & 0xFF) / 255.0f;
+			pixel[3] = 1.0f - (float32_t)((x / 16 + y / 16) & 1) * 0.5f;
+			for (unsigned int ich = 0; ich < 4; ++ich)
+				pixel[ich] = (pixel[ich] > 1.0f) ? 1.0f : pixel[ich];
+		}
+		image_pixel_write(pixelformat, image->data + row_size * y, width, rgba);
+	}
+	memory_deallocate(rgba);
+}
+
+static bench_result_t*
+bench_measure(string_const_t name, string_const_t variant, unsigned int width, unsigned int height, size_t bytes,
+              bench_fn fn, void* arg) {
+	bench_result_t result;
+	memset(&result, 0, sizeof(result));
+	result.name = name;
+	result.variant = variant;
+	result.width = width;
+	result.height = height;
+
+	// Warm up caches and lazily initialized state before measuring
+	if (!fn(arg)) {
+		result.failed = true;
+		log_warnf(HASH_IMAGE, WARNING_SUSPICIOUS, STRING_CONST("Benchmark %.*s/%.*s %ux%u failed, skipped"),
+		          STRING_FORMAT(name), STRING_FORMAT(variant), width, height);
+		array_push_memcpy(bench_results, &result);
+		return bench_results + (array_size(bench_results) - 1);
+	}
+
+	tick_t start = time_current();
+	result.best = 0;
+	while ((result.iterations < bench_max_iterations) && (result.seconds < bench_min_time)) {
+		tick_t iteration_start = time_current();
+		fn(arg);
+		double seconds = time_ticks_to_seconds(time_elapsed_ticks(iteration_start));
+		if (!result.iterations || (seconds < result.best))
+			result.best = seconds;
+		++result.iterations;
+		result.seconds = time_ticks_to_seconds(time_elapsed_ticks(start));
+	}
+	if (result.seconds > 0) {
+		result.images_per_second = (double)result.iterations / result.seconds;
+		result.megabytes_per_second =
+		    ((double)bytes * (double)result.iterations) / (result.seconds * 1024.0 * 1024.0);
+	}
+
+	log_infof(HASH_IMAGE, STRING_CONST("%-10.*s %-16.*s %5ux%-5u %10.1f img/s %10.1f MB/s"), STRING_FORMAT(name),
+	          STRING_FORMAT(variant), width, height, result.images_per_second, result.megabytes_per_second);
+	array_push_memcpy(bench_results, &result);
+	return bench_results + (array_size(bench_results) - 1);
+}
+
+static bool
+bench_load(void* arg) {
+	bench_load_t* load = arg;
+	stream_seek(load->stream, 0, STREAM_SEEK_BEGIN);
+	return image_load(&load->image, load->stream);
+}
+
+static bool
+bench_convert(void* arg) {
+	bench_convert_t* convert = arg;
+	const image_t* source = convert->source;
+	image_t* destination = &convert->destination;
+	if (!convert->bitdepth)
+		return image_blit(destination, 0, 0, 0, source, 0, 0);
+	// Channel conversion is in place, so each iteration restores a copy of the source first.
+	// The copy is a plain memcpy and small next to the per channel conversion
+	image_allocate_storage(destination, &source->format, source->width, source->height, 1, 1);
+	memcpy(destination->data, source->data, image_data_size(source));
+	return image_convert_channels(destination, convert->data_type, convert->bitdepth);
+}
+
+static bool
+bench_compress(void* arg) {
+	bench_compress_t* compress = arg;
+	if (compress->astc_format.compression != IMAGE_COMPRESSION_NONE)
+		return image_astc_encode(&compress->destination, compress->source, &compress->astc_format, 50);
+	stream_seek(compress->stream, 0, STREAM_SEEK_BEGIN);
+	return image_save(compress->source, compress->stream, compress->file_format, &compress->options);
+}
+
+static bool
+bench_decompress(void* arg) {
+	bench_compress_t* compress = arg;
+	return image_astc_decode(&compress->destination, compress->source);
+}
+
+static bool
+bench_mipmap(void* arg) {
+	bench_mipmap_t* mipmap = arg;
+	// Generation replaces any existing levels from the first level, so iterations rebuild the same chain
+	return image_mipmap_generate(&mipmap->image, mipmap->mode, mipmap->flags);
+}
+
+static void
+bench_run_load(const image_t* source) {
+	static const struct {
+		image_file_format_t file_format;
+		image_load_format_t load_format;
+		string_const_t name;
+	} formats[] = {{IMAGE_FILE_FORMAT_PNG, IMAGE_LOAD_FORMAT_PNG, {STRING_CONST("png")}},
+	               {IMAGE_FILE_FORMAT_TGA, IMAGE_LOAD_FORMAT_TGA, {STRING_CONST("tga")}},
+	               {IMAGE_FILE_FORMAT_DDS, IMAGE_LOAD_FORMAT_DDS, {STRING_CONST("dds")}},
+	               {IMAGE_FILE_FORMAT_NATIVE, IMAGE_LOAD_FORMAT_NATIVE, {STRING_CONST("native")}}};
+
+	size_t bytes = image_buffer_size(&source->format, source->width, source->height, 1, 1);
+	for (size_t iformat = 0; iformat < sizeof(formats) / sizeof(formats[0]); ++iformat) {
+		bench_load_t load;
+		load.stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+		image_initialize(&load.image);
+		if (!image_save(source, load.stream, formats[iformat].file_format, 0)) {
+			stream_deallocate(load.stream);
+			continue;
+		}
+
+		image_load_statistics_reset();
+		bench_result_t* result = bench_measure(string_const(STRING_CONST("load")), formats[iformat].name,
+		                                       source->width, source->height, bytes, bench_load, &load);
+
+		image_load_statistics_t statistics;
+		image_load_statistics(formats[iformat].load_format, &statistics);
+		if (!result->failed && statistics.loads) {
+			for (int istage = 0; istage < IMAGE_LOAD_STAGE_COUNT; ++istage)
+				result->stage_seconds[istage] =
+				    ((double)statistics.stage_ns[istage] / (double)statistics.loads) / 1000000000.0;
+
+			// The copy stage is the flip and repack loop from the decoder output into image storage
+			double copy_seconds = (double)statistics.stage_ns[IMAGE_LOAD_STAGE_COPY] / 1000000000.0;
+			bench_result_t repack;
+			memset(&repack, 0, sizeof(repack));
+			repack.name = string_const(STRING_CONST("repack"));
+			repack.variant = formats[iformat].name;
+			repack.width = source->width;
+			repack.height = source->height;
+			repack.iterations = (size_t)statistics.loads;
+			repack.seconds = copy_seconds;
+			if (copy_seconds > 0) {
+				repack.images_per_second = (double)statistics.loads / copy_seconds;
+				repack.megabytes_per_second =
+				    ((double)bytes * (double)statistics.loads) / (copy_seconds * 1024.0 * 1024.0);
+			}
+			array_push_memcpy(bench_results, &repack);
+		}
+
+		image_finalize(&load.image);
+		stream_deallocate(load.stream);
+	}
+}
+
+static void
+bench_run_convert(unsigned int width, unsigned int height) {
+	image_pixelformat_t format[4];
+	image_pixelformat_initialize(&format[0], IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+	image_pixelformat_initialize(&format[1], IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+	image_pixelformat_initialize(&format[2], IMAGE_DATATYPE_UNSIGNED_INT, 16, 4, IMAGE_COLORSPACE_LINEAR);
+	image_pixelformat_initialize(&format[3], IMAGE_DATATYPE_UNSIGNED_INT, 8, 3, IMAGE_COLORSPACE_LINEAR);
+
+	static const struct {
+		unsigned int source;
+		unsigned int destination;
+		string_const_t name;
+	} conversions[] = {{0, 1, {STRING_CONST("rgba8-rgba32f")}},
+	                   {1, 2, {STRING_CONST("rgba32f-rgba16")}},
+	                   {2, 0, {STRING_CONST("rgba16-rgba8")}},
+	                   {3, 0, {STRING_CONST("rgb8-rgba8")}}};
+
+	image_t source[4];
+	for (unsigned int iformat = 0; iformat < 4; ++iformat)
+		bench_image_generate(&source[iformat], &format[iformat], width, height);
+
+	for (size_t iconv = 0; iconv < sizeof(conversions) / sizeof(conversions[0]); ++iconv) {
+		const image_pixelformat_t* target = &format[conversions[iconv].destination];
+		bench_convert_t convert;
+		convert.source = &source[conversions[iconv].source];
+		image_initialize(&convert.destination);
+		// Conversions keeping the channel count go through image_convert_channels, the
+		// channel count change goes through image_blit
+		bool channels = (convert.source->format.channels_count == target->channels_count);
+		convert.data_type = target->channel[0].data_type;
+		convert.bitdepth = channels ? target->channel[0].bits_per_pixel : 0;
+		if (!channels)
+			image_allocate_storage(&convert.destination, target, width, height, 1, 1);
+		size_t bytes = image_buffer_size(&convert.source->format, width, height, 1, 1) +
+		               image_buffer_size(target, width, height, 1, 1);
+		string_const_t name = channels ? string_const(STRING_CONST("convert")) : string_const(STRING_CONST("blit"));
+		bench_measure(name, conversions[iconv].name, width, height, bytes, bench_convert, &convert);
+		image_finalize(&convert.destination);
+	}
+
+	for (unsigned int iformat = 0; iformat < 4; ++iformat)
+		image_finalize(&source[iformat]);
+}
+
+static void
+bench_run_compress(const image_t* source) {
+	size_t bytes = image_buffer_size(&source->format, source->width, source->height, 1, 1);
+
+	bench_compress_t compress;
+	memset(&compress, 0, sizeof(compress));
+	compress.source = source;
+	compress.stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+
+	compress.file_format = IMAGE_FILE_FORMAT_PNG;
+	bench_measure(string_const(STRING_CONST("compress")), string_const(STRING_CONST("png")), source->width,
+	              source->height, bytes, bench_compress, &compress);
+	compress.options.compression_level = 1;
+	bench_measure(string_const(STRING_CONST("compress")), string_const(STRING_CONST("png-fast")), source->width,
+	              source->height, bytes, bench_compress, &compress);
+	compress.options.compression_level = 0;
+	compress.file_format = IMAGE_FILE_FORMAT_TGA;
+	bench_measure(string_const(STRING_CONST("compress")), string_const(STRING_CONST("tga-rle")), source->width,
+	              source->height, bytes, bench_compress, &compress);
+
+	// ASTC encoding evaluates many block modes per block, keep it to the smaller sizes
+	if (source->width <= 512) {
+		image_initialize(&compress.destination);
+		image_astc_pixelformat(&compress.astc_format, IMAGE_COMPRESSION_ASTC_LDR, IMAGE_COLORSPACE_LINEAR, 4, 4);
+		bench_measure(string_const(STRING_CONST("compress")), string_const(STRING_CONST("astc-4x4")),
+		              source->width, source->height, bytes, bench_compress, &compress);
+
+		bench_compress_t decompress;
+		memset(&decompress, 0, sizeof(decompress));
+		decompress.source = &compress.destination;
+		image_initialize(&decompress.destination);
+		if (compress.destination.data)
+			bench_measure(string_const(STRING_CONST("decompress")), string_const(STRING_CONST("astc-4x4")),
+			              source->width, source->height, bytes, bench_decompress, &decompress);
+		image_finalize(&decompress.destination);
+		image_finalize(&compress.destination);
+	}
+
+	stream_deallocate(compress.stream);
+}
+
+static void
+bench_run_mipmap(const image_t* source) {
+	image_pixelformat_t float_format;
+	image_pixelformat_initialize(&float_format, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+
+	static const struct {
+		image_mipmap_mode_t mode;
+		unsigned int flags;
+		bool float_format;
+		string_const_t name;
+	} variants[] = {{IMAGE_MIPMAP_BOX, 0, false, {STRING_CONST("box-rgba8")}},
+	                {IMAGE_MIPMAP_BOX, 0, true, {STRING_CONST("box-rgba32f")}},
+	                {IMAGE_MIPMAP_NORMALMAP, 0, false, {STRING_CONST("normal-rgba8")}},
+	                {IMAGE_MIPMAP_NORMALMAP, IMAGE_MIPMAP_TOKSVIG_ALPHA, false, {STRING_CONST("toksvig-rgba8")}}};
+
+	for (size_t ivariant = 0; ivariant < sizeof(variants) / sizeof(variants[0]); ++ivariant) {
+		const image_pixelformat_t* format = variants[ivariant].float_format ? &float_format : &source->format;
+		bench_mipmap_t mipmap;
+		mipmap.mode = variants[ivariant].mode;
+		mipmap.flags = variants[ivariant].flags;
+		bench_image_generate(&mipmap.image, format, source->width, source->height);
+		// Bytes of the first level read to build the chain
+		size_t bytes = image_buffer_size(format, source->width, source->height, 1, 1);
+		bench_measure(string_const(STRING_CONST("mipmap")), variants[ivariant].name, source->width, source->height,
+		              bytes, bench_mipmap, &mipmap);
+		image_finalize(&mipmap.image);
+	}
+}
+
+static bool
+bench_write_results(string_const_t path) {
+	stream_t* stream = stream_open(STRING_ARGS(path), STREAM_OUT | STREAM_CREATE | STREAM_TRUNCATE);
+	if (!stream) {
+		log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Unable to open result file: %.*s"),
+		          STRING_FORMAT(path));
+		return false;
+	}
+
+	stream_write_format(stream, STRING_CONST("{\n\t\"benchmark\": \"bench-image\",\n\t\"quick\": %s,\n"),
+	                    bench_quick ? "true" : "false");
+	stream_write_format(stream, STRING_CONST("\t\"threads\": %u,\n\t\"results\": ["),
+	                    (unsigned int)system_hardware_threads());
+	for (size_t iresult = 0, rsize = array_size(bench_results); iresult < rsize; ++iresult) {
+		const bench_result_t* result = bench_results + iresult;
+		stream_write_format(stream,
+		                    STRING_CONST("%s\n\t\t{\"name\": \"%.*s\", \"variant\": \"%.*s\", \"width\": %u, "
+		                                 "\"height\": %u, \"failed\": %s, \"iterations\": %" PRIsize
+		                                 ", \"seconds\": %.6f, \"best\": %.9f, "),
+		                    iresult ? "," : "", STRING_FORMAT(result->name), STRING_FORMAT(result->variant),
+		                    result->width, result->height, result->failed ? "true" : "false", result->iterations,
+		                    result->seconds, result->best);
+		stream_write_format(stream,
+		                    STRING_CONST("\"images_per_second\": %.3f, \"megabytes_per_second\": %.3f, "
+		                                 "\"stage_seconds\": [%.9f, %.9f, %.9f, %.9f]}"),
+		                    result->images_per_second, result->megabytes_per_second,
+		                    result->stage_seconds[IMAGE_LOAD_STAGE_PROBE],
+		                    result->stage_seconds[IMAGE_LOAD_STAGE_DECODE],
+		                    result->stage_seconds[IMAGE_LOAD_STAGE_ALLOCATE],
+		                    result->stage_seconds[IMAGE_LOAD_STAGE_COPY]);
+	}
+	stream_write_format(stream, STRING_CONST("\n\t],\n\t\"scaling\": ["));
+	for (size_t iresult = 0, rsize = array_size(bench_scaling_results); iresult < rsize; ++iresult) {
+		const bench_scaling_result_t* result = bench_scaling_results + iresult;
+		stream_write_format(stream,
+		                    STRING_CONST("%s\n\t\t{\"workload\": \"%.*s\", \"format\": \"%.*s\", \"threads\": %u, "
+		                                 "\"images\": %" PRIsize ", \"seconds\": %.6f, \"images_per_second\": %.3f, "),
+		                    iresult ? "," : "", STRING_FORMAT(result->workload), STRING_FORMAT(result->format),
+		                    result->threads, result->images, result->seconds, result->images_per_second);
+		stream_write_format(stream,
+		                    STRING_CONST("\"speedup\": %.4f, \"efficiency\": %.4f, \"allocate_share\": %.4f, "
+		                                 "\"allocate_seconds\": %.9f, \"allocate_inflation\": %.4f, "
+		                                 "\"decode_inflation\": %.4f, "),
+		                    result->speedup, result->efficiency, result->allocate_share, result->allocate_seconds,
+		                    result->allocate_inflation, result->decode_inflation);
+		stream_write_format(stream, STRING_CONST("\"stage_seconds\": [%.9f, %.9f, %.9f, %.9f]}"),
+		                    result->stage_seconds[IMAGE_LOAD_STAGE_PROBE],
+		                    result->stage_seconds[IMAGE_LOAD_STAGE_DECODE],
+		                    result->stage_seconds[IMAGE_LOAD_STAGE_ALLOCATE],
+		                    result->stage_seconds[IMAGE_LOAD_STAGE_COPY]);
+	}
+	stream_write_format(stream, STRING_CONST("\n\t]\n}\n"));
+	stream_deallocate(stream);
+	return true;
+}
+
+int
+main_initialize(void) {
+	foundation_config_t config;
+	image_config_t image_config;
+	application_t application;
+
+	memset(&config, 0, sizeof(config));
+	memset(&image_config, 0, sizeof(image_config));
+
+	memset(&application, 0, sizeof(application));
+	application.name = string_const(STRING_CONST("Image library benchmarks"));
+	application.short_name = string_const(STRING_CONST("bench_image"));
+	application.company = string_const(STRING_CONST(""));
+	application.version = foundation_version();
+	application.flags = APPLICATION_UTILITY;
+
+	log_set_suppress(0, ERRORLEVEL_DEBUG);
+	log_set_suppress(HASH_IMAGE, ERRORLEVEL_DEBUG);
+
+	if (foundation_initialize(memory_system_malloc(), application, config) < 0)
+		return -1;
+
+	return image_module_initialize(image_config);
+}
+
+int
+main_run(void* main_arg) {
+	FOUNDATION_UNUSED(main_arg);
+
+	string_const_t output = {0, 0};
+	bool scaling = false;
+	unsigned int max_threads = 0;
+	const string_const_t* cmdline = environment_command_line();
+	for (size_t iarg = 0, asize = array_size(cmdline); iarg < asize; ++iarg) {
+		if (string_equal(STRING_ARGS(cmdline[iarg]), STRING_CONST("--quick"))) {
+			bench_quick = true;
+		} else if (string_equal(STRING_ARGS(cmdline[iarg]), STRING_CONST("--output")) && (iarg + 1 < asize)) {
+			output = cmdline[++iarg];
+		} else if (string_equal(STRING_ARGS(cmdline[iarg]), STRING_CONST("--min-time")) && (iarg + 1 < asize)) {
+			++iarg;
+			bench_min_time = (double)string_to_uint(STRING_ARGS(cmdline[iarg]), false) / 1000.0;
+		} else if (string_equal(STRING_ARGS(cmdline[iarg]), STRING_CONST("--scaling"))) {
+			scaling = true;
+		} else if (string_equal(STRING_ARGS(cmdline[iarg]), STRING_CONST("--threads")) && (iarg + 1 < asize)) {
+			++iarg;
+			max_threads = string_to_uint(STRING_ARGS(cmdline[iarg]), false);
+		} else if (string_equal(STRING_ARGS(cmdline[iarg]), STRING_CONST("--help"))) {
+			log_info(HASH_IMAGE, STRING_CONST("Usage: bench-image [--quick] [--min-time <ms>] [--scaling] "
+			                                  "[--threads <n>] [--output <file>]\n"
+			                                  "  --quick          Run fewer and smaller cases\n"
+			                                  "  --min-time <ms>  Minimum measured time per case, default 500\n"
+			                                  "  --scaling        Run the multi-core scaling benchmark instead\n"
+			                                  "  --threads <n>    Maximum thread count for scaling, default all\n"
+			                                  "  --output <file>  Write results as JSON to file"));
+			return 0;
+		}
+	}
+	if (bench_quick)
+		bench_min_time = (bench_min_time < 0.1) ? bench_min_time : 0.1;
+
+	const unsigned int* sizes = bench_quick ? bench_sizes_quick : bench_sizes;
+	size_t sizes_count = bench_quick ? sizeof(bench_sizes_quick) / sizeof(bench_sizes_quick[0]) :
+	                                   sizeof(bench_sizes) / sizeof(bench_sizes[0]);
+
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+	if (scaling) {
+		bench_scaling_run(max_threads, bench_quick);
+		sizes_count = 0;
+	}
+	for (size_t isize = 0; isize < sizes_count; ++isize) {
+		image_t source;
+		bench_image_generate(&source, &format, sizes[isize], sizes[isize]);
+		bench_run_load(&source);
+		bench_run_convert(sizes[isize], sizes[isize]);
+		bench_run_compress(&source);
+		bench_run_mipmap(&source);
+		image_finalize(&source);
+	}
+
+	int result = 0;
+	if (output.length && !bench_write_results(output))
+		result = -1;
+	array_deallocate(bench_results);
+	array_deallocate(bench_scaling_results);
+	return result;
+}
+
+void
+main_finalize(void) {
+	image_module_finalize();
+	foundation_finalize();
+}
@@ -0,0 +1,314 @@
+/* scaling.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <image/image.h>
+
+#include <foundation/foundation.h>
+
+#include "bench.h"
+
+#define BENCH_SCALING_MAX_THREADS 256
+
+typedef struct bench_corpus_item_t bench_corpus_item_t;
+typedef struct bench_scaling_t bench_scaling_t;
+typedef struct bench_scaling_worker_t bench_scaling_worker_t;
+
+typedef enum bench_workload_t {
+	//! Load images from the in-memory corpus
+	BENCH_WORKLOAD_LOAD = 0,
+	//! Load images and run per-image conversion and encoding
+	BENCH_WORKLOAD_PROCESS,
+	//! Allocate and release image sized blocks only, isolating allocator contention
+	BENCH_WORKLOAD_ALLOCATE,
+
+	BENCH_WORKLOAD_COUNT
+} bench_workload_t;
+
+struct bench_corpus_item_t {
+	void* buffer;
+	size_t size;
+	unsigned int width;
+	unsigned int height;
+};
+
+struct bench_scaling_t {
+	bench_workload_t workload;
+	const bench_corpus_item_t* corpus;
+	size_t corpus_count;
+	//! Total number of images to process, divided dynamically between threads
+	size_t total;
+	atomic32_t next;
+};
+
+struct bench_scaling_worker_t {
+	bench_scaling_t* scaling;
+	thread_t thread;
+	size_t processed;
+	size_t failed;
+	//! Time spent allocating image storage outside of image_load
+	tick_t allocate;
+	//! Time from start to exit of the worker
+	tick_t busy;
+	float32_t* rgba;
+	stream_t* output;
+};
+
+bench_scaling_result_t* bench_scaling_results;
+
+static const string_const_t bench_workload_names[BENCH_WORKLOAD_COUNT] = {
+    {STRING_CONST("load")}, {STRING_CONST("process")}, {STRING_CONST("allocate")}};
+
+static void
+bench_scaling_process(bench_scaling_worker_t* worker, const image_t* image) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t converted;
+	image_initialize(&converted);
+	tick_t allocate_start = time_current();
+	image_allocate_storage(&converted, &format, image->width, image->height, 1, 1);
+	worker->allocate += time_elapsed_ticks(allocate_start);
+
+	size_t source_row_size = ((size_t)image->format.bits_per_pixel * image->width) / 8;
+	size_t row_size = ((size_t)format.bits_per_pixel * image->width) / 8;
+	for (unsigned int y = 0; y < image->height; ++y) {
+		image_pixel_read(&image->format, image->data + source_row_size * y, image->width, worker->rgba);
+		image_pixel_write(&format, converted.data + row_size * y, converted.width, worker->rgba);
+	}
+
+	// TGA encoding runs on the calling thread, unlike PNG which is itself parallel
+	stream_seek(worker->output, 0, STREAM_SEEK_BEGIN);
+	if (!image_save(&converted, worker->output, IMAGE_FILE_FORMAT_TGA, 0))
+		++worker->failed;
+	image_finalize(&converted);
+}
+
+static void
+bench_scaling_allocate(bench_scaling_worker_t* worker, const bench_corpus_item_t* item) {
+	size_t size = (size_t)item->width * item->height * 4;
+	tick_t allocate_start = time_current();
+	uint8_t* block = memory_allocate(HASH_IMAGE, size, 0, MEMORY_PERSISTENT);
+	// Touch every page so the cost of faulting in fresh memory is included
+	for (size_t offset = 0; offset < size; offset += 4096)
+		block[offset] = (uint8_t)offset;
+	memory_deallocate(block);
+	worker->allocate += time_elapsed_ticks(allocate_start);
+}
+
+static void*
+bench_scaling_thread(void* arg) {
+	bench_scaling_worker_t* worker = arg;
+	bench_scaling_t* scaling = worker->scaling;
+	tick_t start = time_current();
+	while (true) {
+		size_t index = (size_t)(atomic_incr32(&scaling->next, memory_order_relaxed) - 1);
+		if (index >= scaling->total)
+			break;
+		const bench_corpus_item_t* item = scaling->corpus + (index % scaling->corpus_count);
+		if (scaling->workload == BENCH_WORKLOAD_ALLOCATE) {
+			bench_scaling_allocate(worker, item);
+			++worker->processed;
+			continue;
+		}
+
+		stream_t* stream = buffer_stream_allocate(item->buffer, STREAM_IN | STREAM_BINARY, item->size, item->size,
+		                                          false, false);
+		image_t image;
+		image_initialize(&image);
+		if (image_load(&image, stream)) {
+			if (scaling->workload == BENCH_WORKLOAD_PROCESS)
+				bench_scaling_process(worker, &image);
+			++worker->processed;
+		} else {
+			++worker->failed;
+		}
+		image_finalize(&image);
+		stream_deallocate(stream);
+	}
+	worker->busy = time_elapsed_ticks(start);
+	return 0;
+}
+
+static void
+bench_scaling_measure(bench_scaling_t* scaling, bench_scaling_worker_t* worker, unsigned int thread_count,
+                      string_const_t format, const bench_scaling_result_t* baseline) {
+	atomic_store32(&scaling->next, 0, memory_order_release);
+	image_load_statistics_reset();
+	for (unsigned int ithread = 0; ithread < thread_count; ++ithread) {
+		worker[ithread].scaling = scaling;
+		worker[ithread].processed = 0;
+		worker[ithread].failed = 0;
+		worker[ithread].allocate = 0;
+		worker[ithread].busy = 0;
+	}
+
+	tick_t start = time_current();
+	for (unsigned int ithread = 0; ithread < thread_count; ++ithread) {
+		thread_initialize(&worker[ithread].thread, bench_scaling_thread, &worker[ithread],
+		                  STRING_CONST("bench_scaling"), THREAD_PRIORITY_NORMAL, 0);
+		thread_start(&worker[ithread].thread);
+	}
+	for (unsigned int ithread = 0; ithread < thread_count; ++ithread) {
+		thread_join(&worker[ithread].thread);
+		thread_finalize(&worker[ithread].thread);
+	}
+	tick_t elapsed = time_elapsed_ticks(start);
+
+	bench_scaling_result_t result;
+	memset(&result, 0, sizeof(result));
+	result.workload = bench_workload_names[scaling->workload];
+	result.format = format;
+	result.threads = thread_count;
+	result.seconds = time_ticks_to_seconds(elapsed);
+
+	size_t failed = 0;
+	double busy = 0;
+	double allocate = 0;
+	for (unsigned int ithread = 0; ithread < thread_count; ++ithread) {
+		result.images += worker[ithread].processed;
+		failed += worker[ithread].failed;
+		busy += time_ticks_to_seconds(worker[ithread].busy);
+		allocate += time_ticks_to_seconds(worker[ithread].allocate);
+	}
+	if (failed)
+		log_warnf(HASH_IMAGE, WARNING_SUSPICIOUS, STRING_CONST("Scaling %.*s: %u images failed"),
+		          STRING_FORMAT(result.workload), (unsigned int)failed);
+
+	image_load_statistics_t statistics;
+	image_load_statistics(IMAGE_LOAD_FORMAT_COUNT, &statistics);
+	if (statistics.loads) {
+		for (int istage = 0; istage < IMAGE_LOAD_STAGE_COUNT; ++istage)
+			result.stage_seconds[istage] =
+			    ((double)statistics.stage_ns[istage] / (double)statistics.loads) / 1000000000.0;
+		allocate += (double)statistics.stage_ns[IMAGE_LOAD_STAGE_ALLOCATE] / 1000000000.0;
+	}
+	if (result.seconds > 0)
+		result.images_per_second = (double)result.images / result.seconds;
+	if (busy > 0)
+		result.allocate_share = allocate / busy;
+
+	if (result.images)
+		result.allocate_seconds = allocate / (double)result.images;
+	if (baseline) {
+		if (baseline->images_per_second > 0)
+			result.speedup = result.images_per_second / baseline->images_per_second;
+		if (baseline->stage_seconds[IMAGE_LOAD_STAGE_DECODE] > 0)
+			result.decode_inflation =
+			    result.stage_seconds[IMAGE_LOAD_STAGE_DECODE] / baseline->stage_seconds[IMAGE_LOAD_STAGE_DECODE];
+		if (baseline->allocate_seconds > 0)
+			result.allocate_inflation = result.allocate_seconds / baseline->allocate_seconds;
+	} else {
+		result.speedup = 1.0;
+		result.decode_inflation = (result.stage_seconds[IMAGE_LOAD_STAGE_DECODE] > 0) ? 1.0 : 0;
+		result.allocate_inflation = 1.0;
+	}
+	result.efficiency = result.speedup / (double)thread_count;
+
+	log_infof(HASH_IMAGE,
+	          STRING_CONST("%-8.*s %-6.*s %3u threads %10.1f img/s %6.2fx %5.1f%% eff %5.1f%% alloc "
+	                       "%5.2fx alloc %5.2fx decode"),
+	          STRING_FORMAT(result.workload), STRING_FORMAT(format), thread_count, result.images_per_second,
+	          result.speedup, result.efficiency * 100.0, result.allocate_share * 100.0, result.allocate_inflation,
+	          result.decode_inflation);
+	array_push_memcpy(bench_scaling_results, &result);
+}
+
+void
+bench_scaling_run(unsigned int max_threads, bool quick) {
+	if (!max_threads)
+		max_threads = (unsigned int)system_hardware_threads();
+	if (max_threads > BENCH_SCALING_MAX_THREADS)
+		max_threads = BENCH_SCALING_MAX_THREADS;
+	if (!max_threads)
+		max_threads = 1;
+
+	// In-memory corpus of mixed sizes, encoded as PNG when FreeImage can decode it so the
+	// load path includes the FreeImage backend, otherwise in the native format
+	size_t corpus_count = quick ? 16 : 64;
+	bench_corpus_item_t* corpus =
+	    memory_allocate(HASH_IMAGE, sizeof(bench_corpus_item_t) * corpus_count, 0, MEMORY_PERSISTENT);
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+	image_file_format_t file_format = IMAGE_FILE_FORMAT_PNG;
+	string_const_t format_name = string_const(STRING_CONST("png"));
+	unsigned int max_width = 0;
+	for (size_t iitem = 0; iitem < corpus_count; ++iitem) {
+		unsigned int dim = quick ? 128 : (128U << (iitem % 3));
+		image_t source;
+		bench_image_generate(&source, &format, dim, dim);
+		stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+		image_save(&source, stream, file_format, 0);
+		if (!iitem) {
+			image_t probe;
+			image_initialize(&probe);
+			stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+			if (!image_load(&probe, stream)) {
+				file_format = IMAGE_FILE_FORMAT_NATIVE;
+				format_name = string_const(STRING_CONST("native"));
+				stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+				image_save(&source, stream, file_format, 0);
+			}
+			image_finalize(&probe);
+		}
+		corpus[iitem].size = stream_tell(stream);
+		corpus[iitem].buffer = memory_allocate(HASH_IMAGE, corpus[iitem].size, 0, MEMORY_PERSISTENT);
+		corpus[iitem].width = dim;
+		corpus[iitem].height = dim;
+		stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+		stream_read(stream, corpus[iitem].buffer, corpus[iitem].size);
+		stream_deallocate(stream);
+		image_finalize(&source);
+		if (dim > max_width)
+			max_width = dim;
+	}
+
+	bench_scaling_worker_t* worker =
+	    memory_allocate(HASH_IMAGE, sizeof(bench_scaling_worker_t) * max_threads, 0, MEMORY_PERSISTENT);
+	for (unsigned int ithread = 0; ithread < max_threads; ++ithread) {
+		worker[ithread].rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * max_width, 0, MEMORY_PERSISTENT);
+		worker[ithread].output =
+		    buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	}
+
+	bench_scaling_t scaling;
+	memset(&scaling, 0, sizeof(scaling));
+	scaling.corpus = corpus;
+	scaling.corpus_count = corpus_count;
+	scaling.total = corpus_count * (quick ? 2 : 8);
+	for (int iworkload = 0; iworkload < BENCH_WORKLOAD_COUNT; ++iworkload) {
+		scaling.workload = (bench_workload_t)iworkload;
+		size_t baseline = array_size(bench_scaling_results);
+		// Doubling thread counts up to and including the maximum
+		for (unsigned int thread_count = 1; thread_count <= max_threads;) {
+			bench_scaling_measure(&scaling, worker, thread_count, format_name,
+			                      (thread_count > 1) ? bench_scaling_results + baseline : 0);
+			if (thread_count == max_threads)
+				break;
+			thread_count = (thread_count * 2 < max_threads) ? thread_count * 2 : max_threads;
+		}
+	}
+
+	for (unsigned int ithread = 0; ithread < max_threads; ++ithread) {
+		memory_deallocate(worker[ithread].rgba);
+		stream_deallocate(worker[ithread].output);
+	}
+	memory_deallocate(worker);
+	for (size_t iitem = 0; iitem < corpus_count; ++iitem)
+		memory_deallocate(corpus[iitem].buffer);
+	memory_deallocate(corpus);
+}
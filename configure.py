@@ -17,10 +17,13 @@ writer = generator.writer
 toolchain = generator.toolchain
 extrasources = []
 
-image_sources = ['freeimage.c', 'image.c', 'version.c']
+image_sources = ['astc.c', 'async.c', 'atlas.c', 'batch.c', 'blit.c', 'cache.c', 'compare.c', 'convolve.c', 'cubemap.c', 'dds.c', 'dedup.c', 'deflate.c', 'derived.c', 'freeimage.c', 'image.c', 'ktx.c', 'loadevent.c', 'metrics.c', 'mipmap.c', 'native.c', 'normalmap.c', 'parallel.c', 'pixel.c', 'png.c', 'sdf.c', 'statistics.c', 'storage.c', 'tga.c', 'trace.c', 'transform.c', 'version.c']
 
 image_lib = generator.lib(module = 'image', sources = image_sources + extrasources)
 
+if not target.is_ios() and not target.is_android() and not target.is_tizen():
+  generator.bin(module = 'image', sources = ['main.c', 'scaling.c'], binname = 'bench-image', basepath = 'bench', implicit_deps = [image_lib], libs = dependlibs, dependlibs = dependlibs)
+
 #if not target.is_ios() and not target.is_android() and not target.is_tizen():
 #  configs = [config for config in toolchain.configs if config not in ['profile', 'deploy']]
 #  if not configs == []:
@@ -0,0 +1,2003 @@
+/* astc.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "astc.h"
+#include "pixel.h"
+#include "parallel.h"
+
+void
+image_astc_initialize(void);
+
+#define ASTC_BLOCK_BYTES 16
+#define ASTC_BLOCK_MODES 2048
+#define ASTC_MAX_TEXELS 144
+#define ASTC_MAX_WEIGHTS 64
+#define ASTC_MIN_WEIGHT_BITS 24
+#define ASTC_MAX_WEIGHT_BITS 96
+#define ASTC_MAX_COLOR_VALUES 18
+#define ASTC_QUANT_COUNT 21
+#define ASTC_WEIGHT_QUANT_COUNT 12
+#define ASTC_COLOR_QUANT_MIN 4
+#define ASTC_COLOR_QUANT_MAX 20
+
+// Quantization ranges, index into these tables is the quantization level used
+// for both color endpoints and weights (weights use the first 12 levels)
+static const unsigned int astc_quant_levels[ASTC_QUANT_COUNT] = {2,  3,  4,  5,  6,  8,   10,  12,  16,  20, 24,
+                                                                 32, 40, 48, 64, 80, 96, 128, 160, 192, 256};
+static const uint8_t astc_quant_trits[ASTC_QUANT_COUNT] = {0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1,
+                                                           0, 0, 1, 0, 0, 1, 0, 0, 1, 0};
+static const uint8_t astc_quant_quints[ASTC_QUANT_COUNT] = {0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0,
+                                                            0, 1, 0, 0, 1, 0, 0, 1, 0, 0};
+static const uint8_t astc_quant_bits[ASTC_QUANT_COUNT] = {1, 0, 2, 0, 1, 3, 1, 2, 4, 2, 3,
+                                                          5, 3, 4, 6, 4, 5, 7, 5, 6, 8};
+
+typedef struct astc_block_mode_t astc_block_mode_t;
+typedef struct astc_infill_t astc_infill_t;
+typedef struct astc_candidate_t astc_candidate_t;
+typedef struct astc_encoder_t astc_encoder_t;
+typedef struct astc_block_t astc_block_t;
+
+struct astc_block_mode_t {
+	bool valid;
+	bool dual_plane;
+	uint8_t x_weights;
+	uint8_t y_weights;
+	uint8_t weight_quant;
+	uint8_t weight_bits;
+};
+
+//! Weight grid to texel infill, four grid weights and factors per texel
+struct astc_infill_t {
+	uint8_t index[ASTC_MAX_TEXELS][4];
+	uint8_t factor[ASTC_MAX_TEXELS][4];
+};
+
+//! Decoded block, 16-bit endpoint interpolated colors per texel
+struct astc_block_t {
+	uint16_t color[ASTC_MAX_TEXELS][4];
+	//! Per partition bitmask of components which are HDR (LNS) values
+	uint8_t hdr_mask[4];
+	uint8_t partition[ASTC_MAX_TEXELS];
+	bool void_extent;
+	bool void_extent_hdr;
+	bool error;
+};
+
+struct astc_candidate_t {
+	unsigned int mode;
+	unsigned int x_weights;
+	unsigned int y_weights;
+	unsigned int weight_quant;
+	unsigned int weight_count;
+	unsigned int weight_bits;
+	//! Color quantization level for 2, 4, 6 and 8 color values
+	unsigned int color_quant[4];
+	astc_infill_t infill;
+};
+
+struct astc_encoder_t {
+	unsigned int block_width;
+	unsigned int block_height;
+	bool hdr;
+	bool srgb;
+	astc_candidate_t* candidate;
+	unsigned int candidate_count;
+	//! Candidate evaluation order per color value count
+	unsigned int* order[4];
+	unsigned int order_count[4];
+	unsigned int evaluate_count[4];
+};
+
+static astc_block_mode_t astc_block_mode[ASTC_BLOCK_MODES];
+static uint8_t astc_trit_decode[256][5];
+static uint8_t astc_quint_decode[128][3];
+static uint8_t astc_trit_encode[243];
+static uint8_t astc_quint_encode[125];
+static uint8_t astc_color_unquant[ASTC_QUANT_COUNT][256];
+static uint8_t astc_color_quant[ASTC_QUANT_COUNT][256];
+static uint8_t astc_weight_unquant[ASTC_WEIGHT_QUANT_COUNT][32];
+static uint8_t astc_weight_quant[ASTC_WEIGHT_QUANT_COUNT][65];
+
+static unsigned int
+astc_bits_read(const uint8_t* data, unsigned int pos, unsigned int count) {
+	if (!count || (pos >= 128))
+		return 0;
+	unsigned int byte = pos >> 3;
+	uint32_t value = 0;
+	for (unsigned int ibyte = 0; (ibyte < 4) && (byte + ibyte < ASTC_BLOCK_BYTES); ++ibyte)
+		value |= (uint32_t)data[byte + ibyte] << (ibyte * 8);
+	value >>= (pos & 7);
+	return value & ((1U << count) - 1);
+}
+
+static void
+astc_bits_write(uint8_t* data, unsigned int pos, unsigned int count, unsigned int value) {
+	for (unsigned int ibit = 0; ibit < count; ++ibit, ++pos) {
+		if ((pos < 128) && ((value >> ibit) & 1))
+			data[pos >> 3] |= (uint8_t)(1 << (pos & 7));
+	}
+}
+
+static void
+astc_bits_reverse(const uint8_t* data, uint8_t* reversed) {
+	for (unsigned int ibyte = 0; ibyte < ASTC_BLOCK_BYTES; ++ibyte) {
+		uint8_t byte = data[ASTC_BLOCK_BYTES - 1 - ibyte];
+		byte = (uint8_t)(((byte & 0xF0) >> 4) | ((byte & 0x0F) << 4));
+		byte = (uint8_t)(((byte & 0xCC) >> 2) | ((byte & 0x33) << 2));
+		byte = (uint8_t)(((byte & 0xAA) >> 1) | ((byte & 0x55) << 1));
+		reversed[ibyte] = byte;
+	}
+}
+
+static unsigned int
+astc_ise_size(unsigned int count, unsigned int quant) {
+	unsigned int size = count * astc_quant_bits[quant];
+	if (astc_quant_trits[quant])
+		size += (count * 8 + 4) / 5;
+	else if (astc_quant_quints[quant])
+		size += (count * 7 + 2) / 3;
+	return size;
+}
+
+//! Read bits of an integer sequence, bits past the end of the sequence read as zero
+static unsigned int
+astc_ise_read(const uint8_t* data, unsigned int* pos, unsigned int end, unsigned int count) {
+	unsigned int begin = *pos;
+	*pos += count;
+	if (begin >= end)
+		return 0;
+	if (begin + count > end)
+		count = end - begin;
+	return astc_bits_read(data, begin, count);
+}
+
+static void
+astc_ise_write(uint8_t* data, unsigned int* pos, unsigned int end, unsigned int count, unsigned int value) {
+	unsigned int begin = *pos;
+	*pos += count;
+	if (begin >= end)
+		return;
+	if (begin + count > end)
+		count = end - begin;
+	astc_bits_write(data, begin, count, value);
+}
+
+static void
+astc_ise_decode(const uint8_t* data, unsigned int pos, unsigned int count, unsigned int quant, uint8_t* values) {
+	unsigned int bits = astc_quant_bits[quant];
+	unsigned int end = pos + astc_ise_size(count, quant);
+	if (astc_quant_trits[quant]) {
+		for (unsigned int ival = 0; ival < count; ival += 5) {
+			unsigned int m[5];
+			unsigned int packed;
+			m[0] = astc_ise_read(data, &pos, end, bits);
+			packed = astc_ise_read(data, &pos, end, 2);
+			m[1] = astc_ise_read(data, &pos, end, bits);
+			packed |= astc_ise_read(data, &pos, end, 2) << 2;
+			m[2] = astc_ise_read(data, &pos, end, bits);
+			packed |= astc_ise_read(data, &pos, end, 1) << 4;
+			m[3] = astc_ise_read(data, &pos, end, bits);
+			packed |= astc_ise_read(data, &pos, end, 2) << 5;
+			m[4] = astc_ise_read(data, &pos, end, bits);
+			packed |= astc_ise_read(data, &pos, end, 1) << 7;
+			for (unsigned int itrit = 0; (itrit < 5) && (ival + itrit < count); ++itrit)
+				values[ival + itrit] = (uint8_t)((astc_trit_decode[packed][itrit] << bits) | m[itrit]);
+		}
+	} else if (astc_quant_quints[quant]) {
+		for (unsigned int ival = 0; ival < count; ival += 3) {
+			unsigned int m[3];
+			unsigned int packed;
+			m[0] = astc_ise_read(data, &pos, end, bits);
+			packed = astc_ise_read(data, &pos, end, 3);
+			m[1] = astc_ise_read(data, &pos, end, bits);
+			packed |= astc_ise_read(data, &pos, end, 2) << 3;
+			m[2] = astc_ise_read(data, &pos, end, bits);
+			packed |= astc_ise_read(data, &pos, end, 2) << 5;
+			for (unsigned int iquint = 0; (iquint < 3) && (ival + iquint < count); ++iquint)
+				values[ival + iquint] = (uint8_t)((astc_quint_decode[packed][iquint] << bits) | m[iquint]);
+		}
+	} else {
+		for (unsigned int ival = 0; ival < count; ++ival)
+			values[ival] = (uint8_t)astc_ise_read(data, &pos, end, bits);
+	}
+}
+
+static void
+astc_ise_encode(uint8_t* data, unsigned int pos, unsigned int count, unsigned int quant, const uint8_t* values) {
+	unsigned int bits = astc_quant_bits[quant];
+	unsigned int mask = (1U << bits) - 1;
+	unsigned int end = pos + astc_ise_size(count, quant);
+	if (astc_quant_trits[quant]) {
+		for (unsigned int ival = 0; ival < count; ival += 5) {
+			unsigned int m[5] = {0, 0, 0, 0, 0};
+			unsigned int t[5] = {0, 0, 0, 0, 0};
+			for (unsigned int itrit = 0; (itrit < 5) && (ival + itrit < count); ++itrit) {
+				m[itrit] = values[ival + itrit] & mask;
+				t[itrit] = values[ival + itrit] >> bits;
+			}
+			unsigned int packed = astc_trit_encode[t[0] + 3 * t[1] + 9 * t[2] + 27 * t[3] + 81 * t[4]];
+			astc_ise_write(data, &pos, end, bits, m[0]);
+			astc_ise_write(data, &pos, end, 2, packed & 3);
+			astc_ise_write(data, &pos, end, bits, m[1]);
+			astc_ise_write(data, &pos, end, 2, (packed >> 2) & 3);
+			astc_ise_write(data, &pos, end, bits, m[2]);
+			astc_ise_write(data, &pos, end, 1, (packed >> 4) & 1);
+			astc_ise_write(data, &pos, end, bits, m[3]);
+			astc_ise_write(data, &pos, end, 2, (packed >> 5) & 3);
+			astc_ise_write(data, &pos, end, bits, m[4]);
+			astc_ise_write(data, &pos, end, 1, (packed >> 7) & 1);
+		}
+	} else if (astc_quant_quints[quant]) {
+		for (unsigned int ival = 0; ival < count; ival += 3) {
+			unsigned int m[3] = {0, 0, 0};
+			unsigned int q[3] = {0, 0, 0};
+			for (unsigned int iquint = 0; (iquint < 3) && (ival + iquint < count); ++iquint) {
+				m[iquint] = values[ival + iquint] & mask;
+				q[iquint] = values[ival + iquint] >> bits;
+			}
+			unsigned int packed = astc_quint_encode[q[0] + 5 * q[1] + 25 * q[2]];
+			astc_ise_write(data, &pos, end, bits, m[0]);
+			astc_ise_write(data, &pos, end, 3, packed & 7);
+			astc_ise_write(data, &pos, end, bits, m[1]);
+			astc_ise_write(data, &pos, end, 2, (packed >> 3) & 3);
+			astc_ise_write(data, &pos, end, bits, m[2]);
+			astc_ise_write(data, &pos, end, 2, (packed >> 5) & 3);
+		}
+	} else {
+		for (unsigned int ival = 0; ival < count; ++ival)
+			astc_ise_write(data, &pos, end, bits, values[ival]);
+	}
+}
+
+static void
+astc_trit_unpack(unsigned int packed, uint8_t* trit) {
+	unsigned int c;
+	if (((packed >> 2) & 7) == 7) {
+		c = (((packed >> 5) & 7) << 2) | (packed & 3);
+		trit[4] = 2;
+		trit[3] = 2;
+	} else {
+		c = packed & 0x1F;
+		if (((packed >> 5) & 3) == 3) {
+			trit[4] = 2;
+			trit[3] = (packed >> 7) & 1;
+		} else {
+			trit[4] = (packed >> 7) & 1;
+			trit[3] = (packed >> 5) & 3;
+		}
+	}
+	if ((c & 3) == 3) {
+		trit[2] = 2;
+		trit[1] = (c >> 4) & 1;
+		trit[0] = (uint8_t)((((c >> 3) & 1) << 1) | (((c >> 2) & 1) & ~((c >> 3) & 1)));
+	} else if (((c >> 2) & 3) == 3) {
+		trit[2] = 2;
+		trit[1] = 2;
+		trit[0] = c & 3;
+	} else {
+		trit[2] = (c >> 4) & 1;
+		trit[1] = (c >> 2) & 3;
+		trit[0] = (uint8_t)((((c >> 1) & 1) << 1) | ((c & 1) & ~((c >> 1) & 1)));
+	}
+}
+
+static void
+astc_quint_unpack(unsigned int packed, uint8_t* quint) {
+	if ((((packed >> 1) & 3) == 3) && (((packed >> 5) & 3) == 0)) {
+		unsigned int low = packed & 1;
+		quint[2] = (uint8_t)((low << 2) | ((((packed >> 4) & 1) & ~low) << 1) | (((packed >> 3) & 1) & ~low));
+		quint[1] = 4;
+		quint[0] = 4;
+		return;
+	}
+	unsigned int c;
+	if (((packed >> 1) & 3) == 3) {
+		quint[2] = 4;
+		c = (((packed >> 3) & 3) << 3) | (((~packed >> 5) & 3) << 1) | (packed & 1);
+	} else {
+		quint[2] = (packed >> 5) & 3;
+		c = packed & 0x1F;
+	}
+	if ((c & 7) == 5) {
+		quint[1] = 4;
+		quint[0] = (c >> 3) & 3;
+	} else {
+		quint[1] = (c >> 3) & 3;
+		quint[0] = c & 7;
+	}
+}
+
+static unsigned int
+astc_color_unquantize(unsigned int quant, unsigned int value) {
+	unsigned int bits = astc_quant_bits[quant];
+	if (!astc_quant_trits[quant] && !astc_quant_quints[quant]) {
+		// Bit replication to 8 bits
+		unsigned int result = 0;
+		int shift = 8;
+		while (shift > 0) {
+			shift -= (int)bits;
+			result |= (shift >= 0) ? (value << shift) : (value >> -shift);
+		}
+		return result & 0xFF;
+	}
+
+	unsigned int d = value >> bits;
+	unsigned int a = (value & 1) ? 0x1FF : 0;
+	unsigned int b = (value >> 1) & 1;
+	unsigned int c = (value >> 2) & 1;
+	unsigned int e = (value >> 3) & 1;
+	unsigned int f = (value >> 4) & 1;
+	unsigned int g = (value >> 5) & 1;
+	unsigned int base = 0;
+	unsigned int scale = 0;
+	if (astc_quant_trits[quant]) {
+		switch (bits) {
+			case 1:
+				scale = 204;
+				break;
+			case 2:
+				base = (b << 8) | (b << 4) | (b << 2) | (b << 1);
+				scale = 93;
+				break;
+			case 3:
+				base = (c << 8) | (b << 7) | (c << 3) | (b << 2) | (c << 1) | b;
+				scale = 44;
+				break;
+			case 4:
+				base = (e << 8) | (c << 7) | (b << 6) | (e << 2) | (c << 1) | b;
+				scale = 22;
+				break;
+			case 5:
+				base = (f << 8) | (e << 7) | (c << 6) | (b << 5) | (f << 1) | e;
+				scale = 11;
+				break;
+			case 6:
+				base = (g << 8) | (f << 7) | (e << 6) | (c << 5) | (b << 4) | g;
+				scale = 5;
+				break;
+			default:
+				break;
+		}
+	} else {
+		switch (bits) {
+			case 1:
+				scale = 113;
+				break;
+			case 2:
+				base = (b << 8) | (b << 3) | (b << 2);
+				scale = 54;
+				break;
+			case 3:
+				base = (c << 8) | (b << 7) | (c << 2) | (b << 1) | c;
+				scale = 26;
+				break;
+			case 4:
+				base = (e << 8) | (c << 7) | (b << 6) | (e << 1) | c;
+				scale = 13;
+				break;
+			case 5:
+				base = (f << 8) | (e << 7) | (c << 6) | (b << 5) | f;
+				scale = 6;
+				break;
+			default:
+				break;
+		}
+	}
+	unsigned int t = d * scale + base;
+	t ^= a;
+	return ((a & 0x80) | (t >> 2)) & 0xFF;
+}
+
+static unsigned int
+astc_weight_unquantize(unsigned int quant, unsigned int value) {
+	unsigned int bits = astc_quant_bits[quant];
+	unsigned int result;
+	if (!astc_quant_trits[quant] && !astc_quant_quints[quant]) {
+		result = 0;
+		int shift = 6;
+		while (shift > 0) {
+			shift -= (int)bits;
+			result |= (shift >= 0) ? (value << shift) : (value >> -shift);
+		}
+		result &= 0x3F;
+	} else if (!bits) {
+		static const uint8_t trit_values[3] = {0, 32, 63};
+		static const uint8_t quint_values[5] = {0, 16, 32, 47, 63};
+		result = astc_quant_trits[quant] ? trit_values[value] : quint_values[value];
+	} else {
+		unsigned int d = value >> bits;
+		unsigned int a = (value & 1) ? 0x7F : 0;
+		unsigned int b = (value >> 1) & 1;
+		unsigned int c = (value >> 2) & 1;
+		unsigned int base = 0;
+		unsigned int scale = 0;
+		if (astc_quant_trits[quant]) {
+			if (bits == 1) {
+				scale = 50;
+			} else if (bits == 2) {
+				base = (b << 6) | (b << 2) | b;
+				scale = 23;
+			} else {
+				base = (c << 6) | (b << 5) | (c << 1) | b;
+				scale = 11;
+			}
+		} else {
+			if (bits == 1) {
+				scale = 28;
+			} else {
+				base = (b << 6) | (b << 1);
+				scale = 13;
+			}
+		}
+		unsigned int t = d * scale + base;
+		t ^= a;
+		result = ((a & 0x20) | (t >> 2)) & 0x3F;
+	}
+	return (result > 32) ? result + 1 : result;
+}
+
+static bool
+astc_block_mode_decode(unsigned int mode, astc_block_mode_t* block_mode) {
+	unsigned int quant = (mode >> 4) & 1;
+	unsigned int precision = (mode >> 9) & 1;
+	unsigned int dual = (mode >> 10) & 1;
+	unsigned int a = (mode >> 5) & 3;
+	unsigned int x_weights = 0;
+	unsigned int y_weights = 0;
+
+	memset(block_mode, 0, sizeof(astc_block_mode_t));
+
+	if (mode & 3) {
+		quant |= (mode & 3) << 1;
+		unsigned int b = (mode >> 7) & 3;
+		switch ((mode >> 2) & 3) {
+			case 0:
+				x_weights = b + 4;
+				y_weights = a + 2;
+				break;
+			case 1:
+				x_weights = b + 8;
+				y_weights = a + 2;
+				break;
+			case 2:
+				x_weights = a + 2;
+				y_weights = b + 8;
+				break;
+			default:
+				b &= 1;
+				if (mode & 0x100) {
+					x_weights = b + 2;
+					y_weights = a + 2;
+				} else {
+					x_weights = a + 2;
+					y_weights = b + 6;
+				}
+				break;
+		}
+	} else {
+		quant |= ((mode >> 2) & 3) << 1;
+		if (((mode >> 2) & 3) == 0)
+			return false;
+		unsigned int b = (mode >> 9) & 3;
+		switch ((mode >> 7) & 3) {
+			case 0:
+				x_weights = 12;
+				y_weights = a + 2;
+				break;
+			case 1:
+				x_weights = a + 2;
+				y_weights = 12;
+				break;
+			case 2:
+				x_weights = a + 6;
+				y_weights = b + 6;
+				dual = 0;
+				precision = 0;
+				break;
+			default:
+				if (a == 0) {
+					x_weights = 6;
+					y_weights = 10;
+				} else if (a == 1) {
+					x_weights = 10;
+					y_weights = 6;
+				} else {
+					return false;
+				}
+				break;
+		}
+	}
+
+	unsigned int weight_quant = (quant - 2) + 6 * precision;
+	unsigned int weight_count = x_weights * y_weights * (dual + 1);
+	unsigned int weight_bits = astc_ise_size(weight_count, weight_quant);
+	if ((weight_count > ASTC_MAX_WEIGHTS) || (weight_bits < ASTC_MIN_WEIGHT_BITS) ||
+	    (weight_bits > ASTC_MAX_WEIGHT_BITS))
+		return false;
+
+	block_mode->valid = true;
+	block_mode->dual_plane = (dual != 0);
+	block_mode->x_weights = (uint8_t)x_weights;
+	block_mode->y_weights = (uint8_t)y_weights;
+	block_mode->weight_quant = (uint8_t)weight_quant;
+	block_mode->weight_bits = (uint8_t)weight_bits;
+	return true;
+}
+
+void
+image_astc_initialize(void) {
+	memset(astc_trit_encode, 0xFF, sizeof(astc_trit_encode));
+	for (unsigned int packed = 0; packed < 256; ++packed) {
+		uint8_t* trit = astc_trit_decode[packed];
+		astc_trit_unpack(packed, trit);
+		unsigned int index = trit[0] + 3 * trit[1] + 9 * trit[2] + 27 * trit[3] + 81 * trit[4];
+		// Keep the lowest encoding, which guarantees trailing zero values can be truncated
+		if (astc_trit_encode[index] == 0xFF)
+			astc_trit_encode[index] = (uint8_t)packed;
+	}
+	memset(astc_quint_encode, 0xFF, sizeof(astc_quint_encode));
+	for (unsigned int packed = 0; packed < 128; ++packed) {
+		uint8_t* quint = astc_quint_decode[packed];
+		astc_quint_unpack(packed, quint);
+		unsigned int index = quint[0] + 5 * quint[1] + 25 * quint[2];
+		if (astc_quint_encode[index] == 0xFF)
+			astc_quint_encode[index] = (uint8_t)packed;
+	}
+
+	for (unsigned int quant = 0; quant < ASTC_QUANT_COUNT; ++quant) {
+		unsigned int levels = astc_quant_levels[quant];
+		for (unsigned int value = 0; value < levels; ++value)
+			astc_color_unquant[quant][value] = (uint8_t)astc_color_unquantize(quant, value);
+		for (unsigned int target = 0; target < 256; ++target) {
+			unsigned int best = 0;
+			int best_diff = 0x7FFFFFFF;
+			for (unsigned int value = 0; value < levels; ++value) {
+				int diff = (int)astc_color_unquant[quant][value] - (int)target;
+				diff = (diff < 0) ? -diff : diff;
+				if (diff < best_diff) {
+					best_diff = diff;
+					best = value;
+				}
+			}
+			astc_color_quant[quant][target] = (uint8_t)best;
+		}
+	}
+
+	for (unsigned int quant = 0; quant < ASTC_WEIGHT_QUANT_COUNT; ++quant) {
+		unsigned int levels = astc_quant_levels[quant];
+		for (unsigned int value = 0; value < levels; ++value)
+			astc_weight_unquant[quant][value] = (uint8_t)astc_weight_unquantize(quant, value);
+		for (unsigned int target = 0; target <= 64; ++target) {
+			unsigned int best = 0;
+			int best_diff = 0x7FFFFFFF;
+			for (unsigned int value = 0; value < levels; ++value) {
+				int diff = (int)astc_weight_unquant[quant][value] - (int)target;
+				diff = (diff < 0) ? -diff : diff;
+				if (diff < best_diff) {
+					best_diff = diff;
+					best = value;
+				}
+			}
+			astc_weight_quant[quant][target] = (uint8_t)best;
+		}
+	}
+
+	for (unsigned int mode = 0; mode < ASTC_BLOCK_MODES; ++mode)
+		astc_block_mode_decode(mode, astc_block_mode + mode);
+}
+
+static void
+astc_infill_build(unsigned int block_width, unsigned int block_height, unsigned int x_weights,
+                  unsigned int y_weights, astc_infill_t* infill) {
+	unsigned int ds = (1024 + block_width / 2) / (block_width - 1);
+	unsigned int dt = (1024 + block_height / 2) / (block_height - 1);
+	unsigned int texel = 0;
+	for (unsigned int t = 0; t < block_height; ++t) {
+		for (unsigned int s = 0; s < block_width; ++s, ++texel) {
+			unsigned int gs = (ds * s * (x_weights - 1) + 32) >> 6;
+			unsigned int gt = (dt * t * (y_weights - 1) + 32) >> 6;
+			unsigned int js = gs >> 4;
+			unsigned int fs = gs & 0xF;
+			unsigned int jt = gt >> 4;
+			unsigned int ft = gt & 0xF;
+			unsigned int w11 = (fs * ft + 8) >> 4;
+			unsigned int js1 = (js + 1 < x_weights) ? js + 1 : js;
+			unsigned int jt1 = (jt + 1 < y_weights) ? jt + 1 : jt;
+			infill->index[texel][0] = (uint8_t)(js + jt * x_weights);
+			infill->index[texel][1] = (uint8_t)(js1 + jt * x_weights);
+			infill->index[texel][2] = (uint8_t)(js + jt1 * x_weights);
+			infill->index[texel][3] = (uint8_t)(js1 + jt1 * x_weights);
+			infill->factor[texel][0] = (uint8_t)(16 - fs - ft + w11);
+			infill->factor[texel][1] = (uint8_t)(fs - w11);
+			infill->factor[texel][2] = (uint8_t)(ft - w11);
+			infill->factor[texel][3] = (uint8_t)w11;
+		}
+	}
+}
+
+static unsigned int
+astc_partition_hash(unsigned int seed) {
+	uint32_t p = seed;
+	p ^= p >> 15;
+	p -= p << 17;
+	p += p << 7;
+	p += p << 4;
+	p ^= p >> 5;
+	p += p << 16;
+	p ^= p >> 7;
+	p ^= p >> 3;
+	p ^= p << 6;
+	p ^= p >> 17;
+	return p;
+}
+
+static unsigned int
+astc_partition_select(unsigned int seed, unsigned int x, unsigned int y, unsigned int z, unsigned int count,
+                      bool small_block) {
+	if (small_block) {
+		x <<= 1;
+		y <<= 1;
+		z <<= 1;
+	}
+	seed += (count - 1) * 1024;
+	uint32_t rnum = astc_partition_hash(seed);
+	unsigned int s[12];
+	s[0] = rnum & 0xF;
+	s[1] = (rnum >> 4) & 0xF;
+	s[2] = (rnum >> 8) & 0xF;
+	s[3] = (rnum >> 12) & 0xF;
+	s[4] = (rnum >> 16) & 0xF;
+	s[5] = (rnum >> 20) & 0xF;
+	s[6] = (rnum >> 24) & 0xF;
+	s[7] = (rnum >> 28) & 0xF;
+	s[8] = (rnum >> 18) & 0xF;
+	s[9] = (rnum >> 22) & 0xF;
+	s[10] = (rnum >> 26) & 0xF;
+	s[11] = ((rnum >> 30) | (rnum << 2)) & 0xF;
+	for (unsigned int iseed = 0; iseed < 12; ++iseed)
+		s[iseed] *= s[iseed];
+
+	unsigned int sh1, sh2;
+	if (seed & 1) {
+		sh1 = (seed & 2) ? 4 : 5;
+		sh2 = (count == 3) ? 6 : 5;
+	} else {
+		sh1 = (count == 3) ? 6 : 5;
+		sh2 = (seed & 2) ? 4 : 5;
+	}
+	unsigned int sh3 = (seed & 0x10) ? sh1 : sh2;
+	for (unsigned int iseed = 0; iseed < 8; ++iseed)
+		s[iseed] >>= (iseed & 1) ? sh2 : sh1;
+	for (unsigned int iseed = 8; iseed < 12; ++iseed)
+		s[iseed] >>= sh3;
+
+	unsigned int a = (s[0] * x + s[1] * y + s[10] * z + (rnum >> 14)) & 0x3F;
+	unsigned int b = (s[2] * x + s[3] * y + s[11] * z + (rnum >> 10)) & 0x3F;
+	unsigned int c = (s[4] * x + s[5] * y + s[8] * z + (rnum >> 6)) & 0x3F;
+	unsigned int d = (s[6] * x + s[7] * y + s[9] * z + (rnum >> 2)) & 0x3F;
+	if (count <= 3)
+		d = 0;
+	if (count <= 2)
+		c = 0;
+	if ((a >= b) && (a >= c) && (a >= d))
+		return 0;
+	if ((b >= c) && (b >= d))
+		return 1;
+	if (c >= d)
+		return 2;
+	return 3;
+}
+
+static int
+astc_clamp_unorm8(int value) {
+	return (value < 0) ? 0 : ((value > 255) ? 255 : value);
+}
+
+static int
+astc_clamp_unorm12(int value) {
+	return (value < 0) ? 0 : ((value > 0xFFF) ? 0xFFF : value);
+}
+
+static void
+astc_bit_transfer_signed(int* a, int* b) {
+	*b >>= 1;
+	*b |= *a & 0x80;
+	*a >>= 1;
+	*a &= 0x3F;
+	if (*a & 0x20)
+		*a -= 0x40;
+}
+
+static void
+astc_blue_contract(int* color) {
+	color[0] = (color[0] + color[2]) >> 1;
+	color[1] = (color[1] + color[2]) >> 1;
+}
+
+static void
+astc_hdr_rgb_scale_unpack(const int* v, int* e0, int* e1) {
+	int modeval = ((v[0] & 0xC0) >> 6) | (((v[1] & 0x80) >> 7) << 2) | (((v[2] & 0x80) >> 7) << 3);
+	int majcomp, mode;
+	if ((modeval & 0xC) != 0xC) {
+		majcomp = modeval >> 2;
+		mode = modeval & 3;
+	} else if (modeval != 0xF) {
+		majcomp = modeval & 3;
+		mode = 4;
+	} else {
+		majcomp = 0;
+		mode = 5;
+	}
+
+	int red = v[0] & 0x3F;
+	int green = v[1] & 0x1F;
+	int blue = v[2] & 0x1F;
+	int scale = v[3] & 0x1F;
+	int bit0 = (v[1] >> 6) & 1;
+	int bit1 = (v[1] >> 5) & 1;
+	int bit2 = (v[2] >> 6) & 1;
+	int bit3 = (v[2] >> 5) & 1;
+	int bit4 = (v[3] >> 7) & 1;
+	int bit5 = (v[3] >> 6) & 1;
+	int bit6 = (v[3] >> 5) & 1;
+
+	int ohcomp = 1 << mode;
+	if (ohcomp & 0x30)
+		green |= bit0 << 6;
+	if (ohcomp & 0x3A)
+		green |= bit1 << 5;
+	if (ohcomp & 0x30)
+		blue |= bit2 << 6;
+	if (ohcomp & 0x3A)
+		blue |= bit3 << 5;
+	if (ohcomp & 0x3D)
+		scale |= bit6 << 5;
+	if (ohcomp & 0x2D)
+		scale |= bit5 << 6;
+	if (ohcomp & 0x04)
+		scale |= bit4 << 7;
+	if (ohcomp & 0x3B)
+		red |= bit4 << 6;
+	if (ohcomp & 0x04)
+		red |= bit3 << 6;
+	if (ohcomp & 0x10)
+		red |= bit5 << 7;
+	if (ohcomp & 0x0F)
+		red |= bit2 << 7;
+	if (ohcomp & 0x05)
+		red |= bit1 << 8;
+	if (ohcomp & 0x0A)
+		red |= bit0 << 8;
+	if (ohcomp & 0x05)
+		red |= bit0 << 9;
+	if (ohcomp & 0x02)
+		red |= bit6 << 9;
+	if (ohcomp & 0x01)
+		red |= bit3 << 10;
+	if (ohcomp & 0x02)
+		red |= bit5 << 10;
+
+	static const int shamts[6] = {1, 1, 2, 3, 4, 5};
+	int shamt = shamts[mode];
+	red <<= shamt;
+	green <<= shamt;
+	blue <<= shamt;
+	scale <<= shamt;
+	if (mode != 5) {
+		green = red - green;
+		blue = red - blue;
+	}
+
+	int color[3] = {red, green, blue};
+	if (majcomp == 1) {
+		color[0] = green;
+		color[1] = red;
+	} else if (majcomp == 2) {
+		color[0] = blue;
+		color[2] = red;
+	}
+	for (int ic = 0; ic < 3; ++ic) {
+		e1[ic] = astc_clamp_unorm12(color[ic]) << 4;
+		e0[ic] = astc_clamp_unorm12(color[ic] - scale) << 4;
+	}
+	e0[3] = 0x7800;
+	e1[3] = 0x7800;
+}
+
+static void
+astc_hdr_rgb_unpack(const int* v, int* e0, int* e1) {
+	int modeval = ((v[1] & 0x80) >> 7) | (((v[2] & 0x80) >> 7) << 1) | (((v[3] & 0x80) >> 7) << 2);
+	int majcomp = ((v[4] & 0x80) >> 7) | (((v[5] & 0x80) >> 7) << 1);
+
+	e0[3] = 0x7800;
+	e1[3] = 0x7800;
+	if (majcomp == 3) {
+		e0[0] = v[0] << 8;
+		e0[1] = v[2] << 8;
+		e0[2] = (v[4] & 0x7F) << 9;
+		e1[0] = v[1] << 8;
+		e1[1] = v[3] << 8;
+		e1[2] = (v[5] & 0x7F) << 9;
+		return;
+	}
+
+	int a = v[0] | ((v[1] & 0x40) << 2);
+	int b0 = v[2] & 0x3F;
+	int b1 = v[3] & 0x3F;
+	int c = v[1] & 0x3F;
+	int d0 = v[4] & 0x7F;
+	int d1 = v[5] & 0x7F;
+
+	static const int dbits_table[8] = {7, 6, 7, 6, 5, 6, 5, 6};
+	int dbits = dbits_table[modeval];
+
+	int bit0 = (v[2] >> 6) & 1;
+	int bit1 = (v[3] >> 6) & 1;
+	int bit2 = (v[4] >> 6) & 1;
+	int bit3 = (v[5] >> 6) & 1;
+	int bit4 = (v[4] >> 5) & 1;
+	int bit5 = (v[5] >> 5) & 1;
+
+	int ohmod = 1 << modeval;
+	if (ohmod & 0xA4)
+		a |= bit0 << 9;
+	if (ohmod & 0x8)
+		a |= bit2 << 9;
+	if (ohmod & 0x50)
+		a |= bit4 << 9;
+	if (ohmod & 0x50)
+		a |= bit5 << 10;
+	if (ohmod & 0xA0)
+		a |= bit1 << 10;
+	if (ohmod & 0xC0)
+		a |= bit2 << 11;
+	if (ohmod & 0x4)
+		c |= bit1 << 6;
+	if (ohmod & 0xE8)
+		c |= bit3 << 6;
+	if (ohmod & 0x20)
+		c |= bit2 << 7;
+	if (ohmod & 0x5B)
+		b0 |= bit0 << 6;
+	if (ohmod & 0x5B)
+		b1 |= bit1 << 6;
+	if (ohmod & 0x12)
+		b0 |= bit2 << 7;
+	if (ohmod & 0x12)
+		b1 |= bit3 << 7;
+	if (ohmod & 0xAF)
+		d0 |= bit4 << 5;
+	if (ohmod & 0xAF)
+		d1 |= bit5 << 5;
+	if (ohmod & 0x5)
+		d0 |= bit2 << 6;
+	if (ohmod & 0x5)
+		d1 |= bit3 << 6;
+
+	// Sign extend the d values
+	if (d0 & (1 << (dbits - 1)))
+		d0 -= (1 << dbits);
+	if (d1 & (1 << (dbits - 1)))
+		d1 -= (1 << dbits);
+
+	int shamt = (modeval >> 1) ^ 3;
+	a <<= shamt;
+	b0 <<= shamt;
+	b1 <<= shamt;
+	c <<= shamt;
+	d0 <<= shamt;
+	d1 <<= shamt;
+
+	int color1[3] = {a, a - b0, a - b1};
+	int color0[3] = {a - c, a - b0 - c - d0, a - b1 - c - d1};
+	int swap_index = (majcomp == 1) ? 1 : ((majcomp == 2) ? 2 : 0);
+	if (swap_index) {
+		int temp = color0[0];
+		color0[0] = color0[swap_index];
+		color0[swap_index] = temp;
+		temp = color1[0];
+		color1[0] = color1[swap_index];
+		color1[swap_index] = temp;
+	}
+	for (int ic = 0; ic < 3; ++ic) {
+		e0[ic] = astc_clamp_unorm12(color0[ic]) << 4;
+		e1[ic] = astc_clamp_unorm12(color1[ic]) << 4;
+	}
+}
+
+static void
+astc_hdr_alpha_unpack(int v6, int v7, int* a0, int* a1) {
+	int selector = ((v6 >> 7) & 1) | ((v7 >> 6) & 2);
+	v6 &= 0x7F;
+	v7 &= 0x7F;
+	if (selector == 3) {
+		*a0 = v6 << 5;
+		*a1 = v7 << 5;
+	} else {
+		v6 |= (v7 << (selector + 1)) & 0x780;
+		v7 &= (0x3F >> selector);
+		v7 ^= 32 >> selector;
+		v7 -= 32 >> selector;
+		v6 <<= (4 - selector);
+		v7 <<= (4 - selector);
+		v7 += v6;
+		*a0 = v6;
+		*a1 = astc_clamp_unorm12(v7);
+	}
+	*a0 <<= 4;
+	*a1 <<= 4;
+}
+
+//! Unpack color endpoints to 16-bit values, returns bitmask of HDR components
+static unsigned int
+astc_endpoints_unpack(unsigned int cem, const uint8_t* values, bool srgb, uint16_t* endpoint0,
+                      uint16_t* endpoint1) {
+	int v[8];
+	int e0[4] = {0, 0, 0, 0xFF};
+	int e1[4] = {0, 0, 0, 0xFF};
+	unsigned int hdr_mask = 0;
+	unsigned int value_count = ((cem >> 2) + 1) * 2;
+	for (unsigned int ival = 0; ival < value_count; ++ival)
+		v[ival] = values[ival];
+
+	switch (cem) {
+		case 0:
+			e0[0] = e0[1] = e0[2] = v[0];
+			e1[0] = e1[1] = e1[2] = v[1];
+			break;
+		case 1: {
+			int l0 = (v[0] >> 2) | (v[1] & 0xC0);
+			int l1 = astc_clamp_unorm8(l0 + (v[1] & 0x3F));
+			e0[0] = e0[1] = e0[2] = l0;
+			e1[0] = e1[1] = e1[2] = l1;
+			break;
+		}
+		case 2: {
+			int y0, y1;
+			if (v[1] >= v[0]) {
+				y0 = v[0] << 4;
+				y1 = v[1] << 4;
+			} else {
+				y0 = (v[1] << 4) + 8;
+				y1 = (v[0] << 4) - 8;
+			}
+			e0[0] = e0[1] = e0[2] = y0 << 4;
+			e1[0] = e1[1] = e1[2] = y1 << 4;
+			e0[3] = e1[3] = 0x7800;
+			hdr_mask = 0xF;
+			break;
+		}
+		case 3: {
+			int y0, y1;
+			if (v[0] & 0x80) {
+				y0 = ((v[1] & 0xE0) << 4) | ((v[0] & 0x7F) << 2);
+				y1 = (v[1] & 0x1F) << 2;
+			} else {
+				y0 = ((v[1] & 0xF0) << 4) | ((v[0] & 0x7F) << 1);
+				y1 = (v[1] & 0x0F) << 1;
+			}
+			y1 = astc_clamp_unorm12(y0 + y1);
+			e0[0] = e0[1] = e0[2] = y0 << 4;
+			e1[0] = e1[1] = e1[2] = y1 << 4;
+			e0[3] = e1[3] = 0x7800;
+			hdr_mask = 0xF;
+			break;
+		}
+		case 4:
+			e0[0] = e0[1] = e0[2] = v[0];
+			e1[0] = e1[1] = e1[2] = v[1];
+			e0[3] = v[2];
+			e1[3] = v[3];
+			break;
+		case 5:
+			astc_bit_transfer_signed(&v[1], &v[0]);
+			astc_bit_transfer_signed(&v[3], &v[2]);
+			e0[0] = e0[1] = e0[2] = v[0];
+			e1[0] = e1[1] = e1[2] = astc_clamp_unorm8(v[0] + v[1]);
+			e0[3] = v[2];
+			e1[3] = astc_clamp_unorm8(v[2] + v[3]);
+			break;
+		case 6:
+		case 10:
+			e0[0] = (v[0] * v[3]) >> 8;
+			e0[1] = (v[1] * v[3]) >> 8;
+			e0[2] = (v[2] * v[3]) >> 8;
+			e1[0] = v[0];
+			e1[1] = v[1];
+			e1[2] = v[2];
+			if (cem == 10) {
+				e0[3] = v[4];
+				e1[3] = v[5];
+			}
+			break;
+		case 7:
+			astc_hdr_rgb_scale_unpack(v, e0, e1);
+			hdr_mask = 0xF;
+			break;
+		case 8:
+		case 12:
+			if (cem == 12) {
+				e0[3] = v[6];
+				e1[3] = v[7];
+			}
+			if (v[1] + v[3] + v[5] >= v[0] + v[2] + v[4]) {
+				e0[0] = v[0];
+				e0[1] = v[2];
+				e0[2] = v[4];
+				e1[0] = v[1];
+				e1[1] = v[3];
+				e1[2] = v[5];
+			} else {
+				int alpha = e0[3];
+				e0[0] = v[1];
+				e0[1] = v[3];
+				e0[2] = v[5];
+				e0[3] = e1[3];
+				e1[0] = v[0];
+				e1[1] = v[2];
+				e1[2] = v[4];
+				e1[3] = alpha;
+				astc_blue_contract(e0);
+				astc_blue_contract(e1);
+			}
+			break;
+		case 9:
+		case 13:
+			astc_bit_transfer_signed(&v[1], &v[0]);
+			astc_bit_transfer_signed(&v[3], &v[2]);
+			astc_bit_transfer_signed(&v[5], &v[4]);
+			if (cem == 13) {
+				astc_bit_transfer_signed(&v[7], &v[6]);
+				e0[3] = v[6];
+				e1[3] = astc_clamp_unorm8(v[6] + v[7]);
+			}
+			if (v[1] + v[3] + v[5] >= 0) {
+				e0[0] = v[0];
+				e0[1] = v[2];
+				e0[2] = v[4];
+				e1[0] = astc_clamp_unorm8(v[0] + v[1]);
+				e1[1] = astc_clamp_unorm8(v[2] + v[3]);
+				e1[2] = astc_clamp_unorm8(v[4] + v[5]);
+			} else {
+				int alpha = e0[3];
+				e0[0] = v[0] + v[1];
+				e0[1] = v[2] + v[3];
+				e0[2] = v[4] + v[5];
+				e0[3] = e1[3];
+				e1[0] = v[0];
+				e1[1] = v[2];
+				e1[2] = v[4];
+				e1[3] = alpha;
+				astc_blue_contract(e0);
+				astc_blue_contract(e1);
+				for (int ic = 0; ic < 3; ++ic) {
+					e0[ic] = astc_clamp_unorm8(e0[ic]);
+					e1[ic] = astc_clamp_unorm8(e1[ic]);
+				}
+			}
+			break;
+		case 11:
+			astc_hdr_rgb_unpack(v, e0, e1);
+			hdr_mask = 0xF;
+			break;
+		case 14:
+			astc_hdr_rgb_unpack(v, e0, e1);
+			e0[3] = v[6];
+			e1[3] = v[7];
+			hdr_mask = 0x7;
+			break;
+		default:
+			astc_hdr_rgb_unpack(v, e0, e1);
+			astc_hdr_alpha_unpack(v[6], v[7], &e0[3], &e1[3]);
+			hdr_mask = 0xF;
+			break;
+	}
+
+	for (unsigned int ic = 0; ic < 4; ++ic) {
+		if (hdr_mask & (1U << ic)) {
+			endpoint0[ic] = (uint16_t)e0[ic];
+			endpoint1[ic] = (uint16_t)e1[ic];
+		} else if (srgb && (ic < 3)) {
+			endpoint0[ic] = (uint16_t)((e0[ic] << 8) | 0x80);
+			endpoint1[ic] = (uint16_t)((e1[ic] << 8) | 0x80);
+		} else {
+			endpoint0[ic] = (uint16_t)(e0[ic] * 257);
+			endpoint1[ic] = (uint16_t)(e1[ic] * 257);
+		}
+	}
+	return hdr_mask;
+}
+
+//! Convert a 16-bit logarithmic HDR value to half float
+static uint16_t
+astc_lns_to_half(unsigned int value) {
+	unsigned int mantissa = value & 0x7FF;
+	unsigned int exponent = value >> 11;
+	unsigned int transformed;
+	if (mantissa < 512)
+		transformed = 3 * mantissa;
+	else if (mantissa < 1536)
+		transformed = 4 * mantissa - 512;
+	else
+		transformed = 5 * mantissa - 2048;
+	unsigned int result = (exponent << 10) | (transformed >> 3);
+	return (uint16_t)((result > 0x7BFF) ? 0x7BFF : result);
+}
+
+//! Convert a non-negative half float to 16-bit logarithmic HDR value
+static unsigned int
+astc_half_to_lns(uint16_t value) {
+	if (value & 0x8000)
+		return 0;
+	if (value >= 0x7C00)
+		value = 0x7BFF;
+	unsigned int exponent = value >> 10;
+	unsigned int transformed = ((value & 0x3FF) << 3) + 4;
+	unsigned int mantissa;
+	if (transformed < 1536)
+		mantissa = transformed / 3;
+	else if (transformed < 5632)
+		mantissa = (transformed + 512) / 4;
+	else
+		mantissa = (transformed + 2048) / 5;
+	if (mantissa > 0x7FF)
+		mantissa = 0x7FF;
+	return (exponent << 11) | mantissa;
+}
+
+static void
+astc_block_decode(const uint8_t* data, unsigned int block_width, unsigned int block_height, bool srgb,
+                  astc_block_t* block) {
+	unsigned int texel_count = block_width * block_height;
+	block->error = false;
+	block->void_extent = false;
+	block->void_extent_hdr = false;
+
+	unsigned int mode = astc_bits_read(data, 0, 11);
+	if ((mode & 0x1FF) == 0x1FC) {
+		uint16_t color[4];
+		for (unsigned int ic = 0; ic < 4; ++ic)
+			color[ic] = (uint16_t)astc_bits_read(data, 64 + ic * 16, 16);
+		block->void_extent = true;
+		block->void_extent_hdr = ((mode >> 9) & 1) != 0;
+		for (unsigned int texel = 0; texel < texel_count; ++texel)
+			memcpy(block->color[texel], color, sizeof(color));
+		return;
+	}
+
+	const astc_block_mode_t* block_mode = astc_block_mode + mode;
+	unsigned int partition_count = astc_bits_read(data, 11, 2) + 1;
+	if (!block_mode->valid || (block_mode->x_weights > block_width) || (block_mode->y_weights > block_height) ||
+	    (block_mode->dual_plane && (partition_count == 4))) {
+		block->error = true;
+		return;
+	}
+
+	unsigned int cem[4];
+	unsigned int config_end;
+	unsigned int below_weights = 128 - block_mode->weight_bits;
+	unsigned int partition_seed = 0;
+	if (partition_count == 1) {
+		cem[0] = astc_bits_read(data, 13, 4);
+		config_end = 17;
+	} else {
+		partition_seed = astc_bits_read(data, 13, 10);
+		unsigned int encoded = astc_bits_read(data, 23, 6);
+		config_end = 29;
+		if (!(encoded & 3)) {
+			for (unsigned int ipart = 0; ipart < partition_count; ++ipart)
+				cem[ipart] = encoded >> 2;
+		} else {
+			unsigned int extra_bits = 3 * partition_count - 4;
+			below_weights -= extra_bits;
+			encoded |= astc_bits_read(data, below_weights, extra_bits) << 6;
+			unsigned int base_class = (encoded & 3) - 1;
+			unsigned int bitpos = 2;
+			for (unsigned int ipart = 0; ipart < partition_count; ++ipart, ++bitpos)
+				cem[ipart] = (base_class + ((encoded >> bitpos) & 1)) << 2;
+			for (unsigned int ipart = 0; ipart < partition_count; ++ipart, bitpos += 2)
+				cem[ipart] |= (encoded >> bitpos) & 3;
+		}
+	}
+
+	unsigned int plane2_component = 0;
+	if (block_mode->dual_plane) {
+		below_weights -= 2;
+		plane2_component = astc_bits_read(data, below_weights, 2);
+	}
+
+	unsigned int color_value_count = 0;
+	for (unsigned int ipart = 0; ipart < partition_count; ++ipart)
+		color_value_count += ((cem[ipart] >> 2) + 1) * 2;
+	if ((color_value_count > ASTC_MAX_COLOR_VALUES) || (below_weights < config_end)) {
+		block->error = true;
+		return;
+	}
+
+	unsigned int color_bits = below_weights - config_end;
+	int color_quant = -1;
+	for (int quant = ASTC_COLOR_QUANT_MAX; quant >= 0; --quant) {
+		if (astc_ise_size(color_value_count, (unsigned int)quant) <= color_bits) {
+			color_quant = quant;
+			break;
+		}
+	}
+	if (color_quant < ASTC_COLOR_QUANT_MIN) {
+		block->error = true;
+		return;
+	}
+
+	uint8_t color_values[ASTC_MAX_COLOR_VALUES];
+	astc_ise_decode(data, config_end, color_value_count, (unsigned int)color_quant, color_values);
+	for (unsigned int ival = 0; ival < color_value_count; ++ival)
+		color_values[ival] = astc_color_unquant[color_quant][color_values[ival]];
+
+	uint16_t endpoint[4][2][4];
+	unsigned int value_offset = 0;
+	for (unsigned int ipart = 0; ipart < partition_count; ++ipart) {
+		block->hdr_mask[ipart] = (uint8_t)astc_endpoints_unpack(cem[ipart], color_values + value_offset, srgb,
+		                                                        endpoint[ipart][0], endpoint[ipart][1]);
+		value_offset += ((cem[ipart] >> 2) + 1) * 2;
+	}
+
+	uint8_t reversed[ASTC_BLOCK_BYTES];
+	uint8_t weights[ASTC_MAX_WEIGHTS];
+	unsigned int plane_count = block_mode->dual_plane ? 2 : 1;
+	unsigned int weight_count = block_mode->x_weights * block_mode->y_weights * plane_count;
+	astc_bits_reverse(data, reversed);
+	astc_ise_decode(reversed, 0, weight_count, block_mode->weight_quant, weights);
+	for (unsigned int iweight = 0; iweight < weight_count; ++iweight)
+		weights[iweight] = astc_weight_unquant[block_mode->weight_quant][weights[iweight]];
+
+	astc_infill_t infill;
+	astc_infill_build(block_width, block_height, block_mode->x_weights, block_mode->y_weights, &infill);
+
+	bool small_block = (texel_count < 31);
+	unsigned int texel = 0;
+	for (unsigned int t = 0; t < block_height; ++t) {
+		for (unsigned int s = 0; s < block_width; ++s, ++texel) {
+			unsigned int partition = 0;
+			if (partition_count > 1)
+				partition = astc_partition_select(partition_seed, s, t, 0, partition_count, small_block);
+			block->partition[texel] = (uint8_t)partition;
+
+			unsigned int plane_weight[2];
+			for (unsigned int iplane = 0; iplane < plane_count; ++iplane) {
+				unsigned int sum = 8;
+				for (unsigned int itap = 0; itap < 4; ++itap)
+					sum += weights[infill.index[texel][itap] * plane_count + iplane] * infill.factor[texel][itap];
+				plane_weight[iplane] = sum >> 4;
+			}
+			for (unsigned int ic = 0; ic < 4; ++ic) {
+				unsigned int weight = plane_weight[0];
+				if (block_mode->dual_plane && (ic == plane2_component))
+					weight = plane_weight[1];
+				unsigned int c0 = endpoint[partition][0][ic];
+				unsigned int c1 = endpoint[partition][1][ic];
+				block->color[texel][ic] = (uint16_t)((c0 * (64 - weight) + c1 * weight + 32) >> 6);
+			}
+		}
+	}
+}
+
+static void
+astc_block_store_ldr(const astc_block_t* block, unsigned int texel, uint8_t* rgba) {
+	if (block->error || (block->void_extent && block->void_extent_hdr) ||
+	    (!block->void_extent && block->hdr_mask[block->partition[texel]])) {
+		rgba[0] = 0xFF;
+		rgba[1] = 0;
+		rgba[2] = 0xFF;
+		rgba[3] = 0xFF;
+		return;
+	}
+	for (unsigned int ic = 0; ic < 4; ++ic)
+		rgba[ic] = (uint8_t)(block->color[texel][ic] >> 8);
+}
+
+static void
+astc_block_store_hdr(const astc_block_t* block, unsigned int texel, float32_t* rgba) {
+	if (block->error) {
+		rgba[0] = 1.0f;
+		rgba[1] = 0;
+		rgba[2] = 1.0f;
+		rgba[3] = 1.0f;
+		return;
+	}
+	if (block->void_extent) {
+		for (unsigned int ic = 0; ic < 4; ++ic) {
+			if (block->void_extent_hdr)
+				rgba[ic] = image_half_to_float(block->color[texel][ic]);
+			else
+				rgba[ic] = (float32_t)block->color[texel][ic] / 65535.0f;
+		}
+		return;
+	}
+	unsigned int hdr_mask = block->hdr_mask[block->partition[texel]];
+	for (unsigned int ic = 0; ic < 4; ++ic) {
+		if (hdr_mask & (1U << ic))
+			rgba[ic] = image_half_to_float(astc_lns_to_half(block->color[texel][ic]));
+		else
+			rgba[ic] = (float32_t)block->color[texel][ic] / 65535.0f;
+	}
+}
+
+static void
+astc_void_extent_encode(uint8_t* data, bool hdr, const uint16_t* color) {
+	memset(data, 0, ASTC_BLOCK_BYTES);
+	// Void extent marker, reserved bits set and all extent coordinates set to all ones
+	astc_bits_write(data, 0, 9, 0x1FC);
+	astc_bits_write(data, 9, 1, hdr ? 1 : 0);
+	astc_bits_write(data, 10, 2, 3);
+	for (unsigned int icoord = 0; icoord < 4; ++icoord)
+		astc_bits_write(data, 12 + icoord * 13, 13, 0x1FFF);
+	for (unsigned int ic = 0; ic < 4; ++ic)
+		astc_bits_write(data, 64 + ic * 16, 16, color[ic]);
+}
+
+//! Quantize float endpoints in 16-bit domain to raw color values for the given mode
+static void
+astc_endpoints_quantize(unsigned int cem, unsigned int quant, const float32_t* e0, const float32_t* e1,
+                        uint8_t* raw) {
+	int value[8];
+	switch (cem) {
+		case 0:
+		case 4:
+			value[0] = (int)((e0[0] + e0[1] + e0[2]) / (3.0f * 257.0f) + 0.5f);
+			value[1] = (int)((e1[0] + e1[1] + e1[2]) / (3.0f * 257.0f) + 0.5f);
+			value[2] = (int)(e0[3] / 257.0f + 0.5f);
+			value[3] = (int)(e1[3] / 257.0f + 0.5f);
+			break;
+		case 8:
+		case 12:
+			for (unsigned int ic = 0; ic < 4; ++ic) {
+				value[ic * 2] = (int)(e0[ic] / 257.0f + 0.5f);
+				value[ic * 2 + 1] = (int)(e1[ic] / 257.0f + 0.5f);
+			}
+			break;
+		default:
+			// HDR direct mode with major component 3, red and green stored with 8 bits,
+			// blue with 7 bits and the mode flags in the top bits of the blue values
+			value[0] = (int)(e0[0] / 256.0f + 0.5f);
+			value[1] = (int)(e1[0] / 256.0f + 0.5f);
+			value[2] = (int)(e0[1] / 256.0f + 0.5f);
+			value[3] = (int)(e1[1] / 256.0f + 0.5f);
+			value[4] = (int)(e0[2] / 512.0f + 0.5f);
+			value[5] = (int)(e1[2] / 512.0f + 0.5f);
+			value[4] = (value[4] > 0x7F) ? 0xFF : (value[4] | 0x80);
+			value[5] = (value[5] > 0x7F) ? 0xFF : (value[5] | 0x80);
+			value[6] = (int)(e0[3] / 257.0f + 0.5f);
+			value[7] = (int)(e1[3] / 257.0f + 0.5f);
+			break;
+	}
+	unsigned int value_count = ((cem >> 2) + 1) * 2;
+	for (unsigned int ival = 0; ival < value_count; ++ival)
+		raw[ival] = astc_color_quant[quant][astc_clamp_unorm8(value[ival])];
+
+	if ((cem == 8) || (cem == 12)) {
+		// Avoid the blue contraction by keeping the endpoint with the larger sum last
+		const uint8_t* unquant = astc_color_unquant[quant];
+		if (unquant[raw[1]] + unquant[raw[3]] + unquant[raw[5]] < unquant[raw[0]] + unquant[raw[2]] + unquant[raw[4]]) {
+			for (unsigned int ival = 0; ival < value_count; ival += 2) {
+				uint8_t temp = raw[ival];
+				raw[ival] = raw[ival + 1];
+				raw[ival + 1] = temp;
+			}
+		}
+	}
+}
+
+static void
+astc_endpoints_fit(const float32_t (*texel)[4], unsigned int texel_count, unsigned int components,
+                   float32_t max_value, float32_t* e0, float32_t* e1) {
+	float32_t mean[4] = {0, 0, 0, 0};
+	float32_t low[4] = {max_value, max_value, max_value, max_value};
+	float32_t high[4] = {0, 0, 0, 0};
+	for (unsigned int it = 0; it < texel_count; ++it) {
+		for (unsigned int ic = 0; ic < components; ++ic) {
+			mean[ic] += texel[it][ic];
+			low[ic] = (texel[it][ic] < low[ic]) ? texel[it][ic] : low[ic];
+			high[ic] = (texel[it][ic] > high[ic]) ? texel[it][ic] : high[ic];
+		}
+	}
+	for (unsigned int ic = 0; ic < components; ++ic)
+		mean[ic] /= (float32_t)texel_count;
+
+	// Principal axis by power iteration on the covariance matrix
+	float32_t cov[4][4];
+	memset(cov, 0, sizeof(cov));
+	for (unsigned int it = 0; it < texel_count; ++it) {
+		for (unsigned int ic = 0; ic < components; ++ic) {
+			float32_t di = texel[it][ic] - mean[ic];
+			for (unsigned int jc = 0; jc < components; ++jc)
+				cov[ic][jc] += di * (texel[it][jc] - mean[jc]);
+		}
+	}
+	float32_t axis[4] = {0, 0, 0, 0};
+	for (unsigned int ic = 0; ic < components; ++ic)
+		axis[ic] = high[ic] - low[ic];
+	for (unsigned int iter = 0; iter < 8; ++iter) {
+		float32_t next[4] = {0, 0, 0, 0};
+		float32_t length = 0;
+		for (unsigned int ic = 0; ic < components; ++ic) {
+			for (unsigned int jc = 0; jc < components; ++jc)
+				next[ic] += cov[ic][jc] * axis[jc];
+			length += next[ic] * next[ic];
+		}
+		if (length <= 0)
+			break;
+		length = 1.0f / sqrtf(length);
+		for (unsigned int ic = 0; ic < components; ++ic)
+			axis[ic] = next[ic] * length;
+	}
+	float32_t axis_length = 0;
+	for (unsigned int ic = 0; ic < components; ++ic)
+		axis_length += axis[ic] * axis[ic];
+	if (axis_length <= 0) {
+		for (unsigned int ic = 0; ic < 4; ++ic) {
+			e0[ic] = (ic < components) ? mean[ic] : max_value;
+			e1[ic] = e0[ic];
+		}
+		return;
+	}
+	axis_length = 1.0f / sqrtf(axis_length);
+	for (unsigned int ic = 0; ic < components; ++ic)
+		axis[ic] *= axis_length;
+
+	float32_t tmin = 0, tmax = 0;
+	float32_t projection[ASTC_MAX_TEXELS];
+	for (unsigned int it = 0; it < texel_count; ++it) {
+		float32_t t = 0;
+		for (unsigned int ic = 0; ic < components; ++ic)
+			t += (texel[it][ic] - mean[ic]) * axis[ic];
+		projection[it] = t;
+		tmin = (t < tmin) ? t : tmin;
+		tmax = (t > tmax) ? t : tmax;
+	}
+	for (unsigned int ic = 0; ic < 4; ++ic) {
+		e0[ic] = (ic < components) ? mean[ic] + axis[ic] * tmin : max_value;
+		e1[ic] = (ic < components) ? mean[ic] + axis[ic] * tmax : max_value;
+	}
+
+	// Refine endpoints with a least squares fit given the projected weights
+	float32_t range = tmax - tmin;
+	if (range > 0) {
+		float32_t aa = 0, ab = 0, bb = 0;
+		float32_t rhs0[4] = {0, 0, 0, 0};
+		float32_t rhs1[4] = {0, 0, 0, 0};
+		for (unsigned int it = 0; it < texel_count; ++it) {
+			float32_t w = (projection[it] - tmin) / range;
+			float32_t iw = 1.0f - w;
+			aa += iw * iw;
+			ab += iw * w;
+			bb += w * w;
+			for (unsigned int ic = 0; ic < components; ++ic) {
+				rhs0[ic] += iw * texel[it][ic];
+				rhs1[ic] += w * texel[it][ic];
+			}
+		}
+		float32_t det = aa * bb - ab * ab;
+		if (det > 1e-6f) {
+			det = 1.0f / det;
+			for (unsigned int ic = 0; ic < components; ++ic) {
+				e0[ic] = (bb * rhs0[ic] - ab * rhs1[ic]) * det;
+				e1[ic] = (aa * rhs1[ic] - ab * rhs0[ic]) * det;
+			}
+		}
+	}
+	for (unsigned int ic = 0; ic < components; ++ic) {
+		e0[ic] = (e0[ic] < 0) ? 0 : ((e0[ic] > max_value) ? max_value : e0[ic]);
+		e1[ic] = (e1[ic] < 0) ? 0 : ((e1[ic] > max_value) ? max_value : e1[ic]);
+	}
+}
+
+static float32_t
+astc_candidate_evaluate(const astc_candidate_t* candidate, const float32_t (*texel)[4], unsigned int texel_count,
+                        unsigned int components, const uint16_t* endpoint0, const uint16_t* endpoint1,
+                        uint8_t* raw_weights) {
+	float32_t direction[4];
+	float32_t length = 0;
+	for (unsigned int ic = 0; ic < components; ++ic) {
+		direction[ic] = (float32_t)endpoint1[ic] - (float32_t)endpoint0[ic];
+		length += direction[ic] * direction[ic];
+	}
+
+	float32_t ideal[ASTC_MAX_TEXELS];
+	for (unsigned int it = 0; it < texel_count; ++it) {
+		float32_t w = 0;
+		if (length > 0) {
+			for (unsigned int ic = 0; ic < components; ++ic)
+				w += (texel[it][ic] - (float32_t)endpoint0[ic]) * direction[ic];
+			w = (w / length) * 64.0f;
+			w = (w < 0) ? 0 : ((w > 64.0f) ? 64.0f : w);
+		}
+		ideal[it] = w;
+	}
+
+	// Fit the weight grid to the ideal texel weights using the transposed infill
+	float32_t grid_sum[ASTC_MAX_WEIGHTS];
+	float32_t grid_factor[ASTC_MAX_WEIGHTS];
+	memset(grid_sum, 0, sizeof(float32_t) * candidate->weight_count);
+	memset(grid_factor, 0, sizeof(float32_t) * candidate->weight_count);
+	for (unsigned int it = 0; it < texel_count; ++it) {
+		for (unsigned int itap = 0; itap < 4; ++itap) {
+			float32_t factor = candidate->infill.factor[it][itap];
+			grid_sum[candidate->infill.index[it][itap]] += factor * ideal[it];
+			grid_factor[candidate->infill.index[it][itap]] += factor;
+		}
+	}
+	uint8_t grid[ASTC_MAX_WEIGHTS];
+	for (unsigned int iweight = 0; iweight < candidate->weight_count; ++iweight) {
+		float32_t w = (grid_factor[iweight] > 0) ? grid_sum[iweight] / grid_factor[iweight] : 0;
+		unsigned int raw = astc_weight_quant[candidate->weight_quant][(int)(w + 0.5f)];
+		raw_weights[iweight] = (uint8_t)raw;
+		grid[iweight] = astc_weight_unquant[candidate->weight_quant][raw];
+	}
+
+	float32_t error = 0;
+	for (unsigned int it = 0; it < texel_count; ++it) {
+		unsigned int sum = 8;
+		for (unsigned int itap = 0; itap < 4; ++itap)
+			sum += grid[candidate->infill.index[it][itap]] * candidate->infill.factor[it][itap];
+		unsigned int weight = sum >> 4;
+		for (unsigned int ic = 0; ic < components; ++ic) {
+			unsigned int value = (endpoint0[ic] * (64 - weight) + endpoint1[ic] * weight + 32) >> 6;
+			float32_t diff = (float32_t)value - texel[it][ic];
+			error += diff * diff;
+		}
+	}
+	return error;
+}
+
+static void
+astc_block_encode(const astc_encoder_t* encoder, const float32_t (*rgba)[4], uint8_t* data) {
+	unsigned int texel_count = encoder->block_width * encoder->block_height;
+	float32_t texel[ASTC_MAX_TEXELS][4];
+	bool constant = true;
+	bool opaque = true;
+	bool gray = true;
+
+	for (unsigned int it = 0; it < texel_count; ++it) {
+		for (unsigned int ic = 0; ic < 4; ++ic) {
+			float32_t value = rgba[it][ic];
+			if (encoder->hdr && (ic < 3)) {
+				texel[it][ic] = (float32_t)astc_half_to_lns(image_float_to_half(value));
+			} else {
+				value = (value < 0) ? 0 : ((value > 1.0f) ? 1.0f : value);
+				texel[it][ic] = (float32_t)(int)(value * 65535.0f + 0.5f);
+			}
+			if (texel[it][ic] != texel[0][ic])
+				constant = false;
+		}
+		if (texel[it][3] < 65535.0f - 128.0f)
+			opaque = false;
+		if ((fabsf(texel[it][0] - texel[it][1]) > 128.0f) || (fabsf(texel[it][0] - texel[it][2]) > 128.0f))
+			gray = false;
+	}
+
+	if (constant) {
+		uint16_t color[4];
+		for (unsigned int ic = 0; ic < 4; ++ic) {
+			if (encoder->hdr)
+				color[ic] = image_float_to_half(rgba[0][ic] < 0 ? 0 : rgba[0][ic]);
+			else
+				color[ic] = (uint16_t)texel[0][ic];
+		}
+		astc_void_extent_encode(data, encoder->hdr, color);
+		return;
+	}
+
+	unsigned int cem;
+	if (encoder->hdr)
+		cem = opaque ? 11 : 14;
+	else if (gray)
+		cem = opaque ? 0 : 4;
+	else
+		cem = opaque ? 8 : 12;
+	unsigned int value_count = ((cem >> 2) + 1) * 2;
+	unsigned int order_index = value_count / 2 - 1;
+	unsigned int components = opaque ? 3 : 4;
+
+	float32_t e0[4], e1[4];
+	astc_endpoints_fit((const float32_t(*)[4])texel, texel_count, components, 65535.0f, e0, e1);
+	if (opaque) {
+		e0[3] = 65535.0f;
+		e1[3] = 65535.0f;
+	}
+
+	float32_t best_error = 0;
+	const astc_candidate_t* best = 0;
+	uint8_t best_colors[8];
+	uint8_t best_weights[ASTC_MAX_WEIGHTS];
+
+	const unsigned int* order = encoder->order[order_index];
+	for (unsigned int icand = 0; icand < encoder->evaluate_count[order_index]; ++icand) {
+		const astc_candidate_t* candidate = encoder->candidate + order[icand];
+		unsigned int color_quant = candidate->color_quant[order_index];
+
+		uint8_t colors[8];
+		uint8_t unquant[8];
+		uint16_t endpoint0[4], endpoint1[4];
+		astc_endpoints_quantize(cem, color_quant, e0, e1, colors);
+		for (unsigned int ival = 0; ival < value_count; ++ival)
+			unquant[ival] = astc_color_unquant[color_quant][colors[ival]];
+		astc_endpoints_unpack(cem, unquant, encoder->srgb, endpoint0, endpoint1);
+
+		uint8_t weights[ASTC_MAX_WEIGHTS];
+		float32_t error = astc_candidate_evaluate(candidate, (const float32_t(*)[4])texel, texel_count, components,
+		                                          endpoint0, endpoint1, weights);
+		if (!best || (error < best_error)) {
+			best = candidate;
+			best_error = error;
+			memcpy(best_colors, colors, value_count);
+			memcpy(best_weights, weights, candidate->weight_count);
+			if (error <= 0)
+				break;
+		}
+	}
+
+	memset(data, 0, ASTC_BLOCK_BYTES);
+	if (!best)
+		return;
+	astc_bits_write(data, 0, 11, best->mode);
+	astc_bits_write(data, 11, 2, 0);
+	astc_bits_write(data, 13, 4, cem);
+	astc_ise_encode(data, 17, value_count, best->color_quant[order_index], best_colors);
+
+	uint8_t weight_data[ASTC_BLOCK_BYTES];
+	uint8_t reversed[ASTC_BLOCK_BYTES];
+	memset(weight_data, 0, sizeof(weight_data));
+	astc_ise_encode(weight_data, 0, best->weight_count, best->weight_quant, best_weights);
+	astc_bits_reverse(weight_data, reversed);
+	for (unsigned int ibyte = 0; ibyte < ASTC_BLOCK_BYTES; ++ibyte)
+		data[ibyte] |= reversed[ibyte];
+}
+
+static bool
+astc_footprint_is_valid(unsigned int block_width, unsigned int block_height) {
+	static const uint8_t footprint[14][2] = {{4, 4},  {5, 4},  {5, 5},  {6, 5},  {6, 6},   {8, 5},   {8, 6},
+	                                         {8, 8},  {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}};
+	for (unsigned int ifoot = 0; ifoot < 14; ++ifoot) {
+		if ((footprint[ifoot][0] == block_width) && (footprint[ifoot][1] == block_height))
+			return true;
+	}
+	return false;
+}
+
+bool
+image_astc_pixelformat(image_pixelformat_t* pixelformat, image_compression_t compression,
+                       image_colorspace_t colorspace, unsigned int block_width, unsigned int block_height) {
+	if (((compression != IMAGE_COMPRESSION_ASTC_LDR) && (compression != IMAGE_COMPRESSION_ASTC_HDR)) ||
+	    !astc_footprint_is_valid(block_width, block_height))
+		return false;
+	if ((compression == IMAGE_COMPRESSION_ASTC_HDR) && (colorspace == IMAGE_COLORSPACE_sRGB))
+		return false;
+
+	memset(pixelformat, 0, sizeof(image_pixelformat_t));
+	pixelformat->compression = compression;
+	pixelformat->colorspace = colorspace;
+	pixelformat->channels_count = 4;
+	pixelformat->block_width = block_width;
+	pixelformat->block_height = block_height;
+	pixelformat->block_depth = 1;
+	pixelformat->bits_per_block = ASTC_BLOCK_BYTES * 8;
+	image_datatype_t data_type =
+	    (compression == IMAGE_COMPRESSION_ASTC_HDR) ? IMAGE_DATATYPE_FLOAT : IMAGE_DATATYPE_UNSIGNED_INT;
+	for (unsigned int ich = 0; ich < 4; ++ich)
+		pixelformat->channel[ich].data_type = data_type;
+	return true;
+}
+
+static int
+astc_candidate_compare(const astc_candidate_t* candidate, unsigned int order_index, unsigned int texel_count) {
+	// Heuristic cost estimate balancing weight grid resolution against weight
+	// and color precision, lower is better
+	float32_t coverage = (float32_t)candidate->weight_count / (float32_t)texel_count;
+	float32_t cost = 1.0f / (float32_t)astc_quant_levels[candidate->weight_quant] +
+	                 1.0f / (float32_t)astc_quant_levels[candidate->color_quant[order_index]] +
+	                 0.5f * (1.0f - coverage);
+	return (int)(cost * 100000.0f);
+}
+
+static bool
+astc_encoder_initialize(astc_encoder_t* encoder, unsigned int block_width, unsigned int block_height, bool hdr,
+                        bool srgb, unsigned int quality) {
+	memset(encoder, 0, sizeof(astc_encoder_t));
+	encoder->block_width = block_width;
+	encoder->block_height = block_height;
+	encoder->hdr = hdr;
+	encoder->srgb = srgb;
+
+	unsigned int capacity = 0;
+	for (unsigned int mode = 0; mode < ASTC_BLOCK_MODES; ++mode) {
+		const astc_block_mode_t* block_mode = astc_block_mode + mode;
+		if (block_mode->valid && !block_mode->dual_plane && (block_mode->x_weights <= block_width) &&
+		    (block_mode->y_weights <= block_height))
+			++capacity;
+	}
+	if (!capacity)
+		return false;
+
+	encoder->candidate = memory_allocate(HASH_IMAGE, sizeof(astc_candidate_t) * capacity, 0, MEMORY_PERSISTENT);
+	for (unsigned int iorder = 0; iorder < 4; ++iorder)
+		encoder->order[iorder] = memory_allocate(HASH_IMAGE, sizeof(unsigned int) * capacity, 0, MEMORY_PERSISTENT);
+
+	for (unsigned int mode = 0; mode < ASTC_BLOCK_MODES; ++mode) {
+		const astc_block_mode_t* block_mode = astc_block_mode + mode;
+		if (!block_mode->valid || block_mode->dual_plane || (block_mode->x_weights > block_width) ||
+		    (block_mode->y_weights > block_height))
+			continue;
+
+		bool duplicate = false;
+		for (unsigned int icand = 0; !duplicate && (icand < encoder->candidate_count); ++icand) {
+			const astc_candidate_t* other = encoder->candidate + icand;
+			duplicate = (other->x_weights == block_mode->x_weights) && (other->y_weights == block_mode->y_weights) &&
+			            (other->weight_quant == block_mode->weight_quant);
+		}
+		if (duplicate)
+			continue;
+
+		astc_candidate_t* candidate = encoder->candidate + encoder->candidate_count++;
+		candidate->mode = mode;
+		candidate->x_weights = block_mode->x_weights;
+		candidate->y_weights = block_mode->y_weights;
+		candidate->weight_quant = block_mode->weight_quant;
+		candidate->weight_count = block_mode->x_weights * block_mode->y_weights;
+		candidate->weight_bits = block_mode->weight_bits;
+		astc_infill_build(block_width, block_height, candidate->x_weights, candidate->y_weights, &candidate->infill);
+
+		unsigned int color_bits = 128 - 17 - candidate->weight_bits;
+		for (unsigned int iorder = 0; iorder < 4; ++iorder) {
+			unsigned int value_count = (iorder + 1) * 2;
+			candidate->color_quant[iorder] = 0;
+			for (int quant = ASTC_COLOR_QUANT_MAX; quant >= ASTC_COLOR_QUANT_MIN; --quant) {
+				if (astc_ise_size(value_count, (unsigned int)quant) <= color_bits) {
+					candidate->color_quant[iorder] = (unsigned int)quant;
+					break;
+				}
+			}
+			// HDR direct endpoint mode stores flag bits in the color values and
+			// requires the full 8-bit color range
+			bool usable = encoder->hdr ? (candidate->color_quant[iorder] == ASTC_COLOR_QUANT_MAX) :
+			                             (candidate->color_quant[iorder] >= ASTC_COLOR_QUANT_MIN);
+			if (usable)
+				encoder->order[iorder][encoder->order_count[iorder]++] = encoder->candidate_count - 1;
+		}
+	}
+
+	unsigned int texel_count = block_width * block_height;
+	for (unsigned int iorder = 0; iorder < 4; ++iorder) {
+		unsigned int* order = encoder->order[iorder];
+		unsigned int count = encoder->order_count[iorder];
+		// Insertion sort, lists are short and only sorted once per encode
+		for (unsigned int icand = 1; icand < count; ++icand) {
+			unsigned int current = order[icand];
+			int cost = astc_candidate_compare(encoder->candidate + current, iorder, texel_count);
+			unsigned int islot = icand;
+			while (islot &&
+			       (astc_candidate_compare(encoder->candidate + order[islot - 1], iorder, texel_count) > cost)) {
+				order[islot] = order[islot - 1];
+				--islot;
+			}
+			order[islot] = current;
+		}
+		if (quality > 100)
+			quality = 100;
+		encoder->evaluate_count[iorder] = count ? 1 + ((count - 1) * quality + 99) / 100 : 0;
+	}
+	return true;
+}
+
+static void
+astc_encoder_finalize(astc_encoder_t* encoder) {
+	for (unsigned int iorder = 0; iorder < 4; ++iorder)
+		memory_deallocate(encoder->order[iorder]);
+	memory_deallocate(encoder->candidate);
+}
+
+typedef struct astc_level_job_t astc_level_job_t;
+
+struct astc_level_job_t {
+	const astc_encoder_t* encoder;
+	const image_pixelformat_t* source_format;
+	const uint8_t* source;
+	uint8_t* blocks;
+	unsigned int width;
+	unsigned int height;
+	unsigned int blocks_x;
+	unsigned int blocks_y;
+	bool srgb;
+	bool hdr;
+};
+
+static void
+astc_encode_rows(void* arg, size_t begin, size_t end) {
+	const astc_level_job_t* job = arg;
+	const astc_encoder_t* encoder = job->encoder;
+	unsigned int block_width = encoder->block_width;
+	unsigned int block_height = encoder->block_height;
+	size_t row_size = (size_t)job->width * (job->source_format->bits_per_pixel / 8);
+	float32_t* rows =
+	    memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * job->width * block_height, 0, MEMORY_TEMPORARY);
+	float32_t texel[ASTC_MAX_TEXELS][4];
+
+	image_trace_begin(IMAGE_TRACE_COMPRESS);
+	for (size_t irow = begin; irow < end; ++irow) {
+		size_t slice = irow / job->blocks_y;
+		unsigned int block_y = (unsigned int)(irow % job->blocks_y);
+		const uint8_t* slice_source = job->source + slice * row_size * job->height;
+		for (unsigned int t = 0; t < block_height; ++t) {
+			unsigned int y = block_y * block_height + t;
+			if (y >= job->height)
+				y = job->height - 1;
+			image_pixel_read(job->source_format, slice_source + row_size * y, job->width,
+			                 rows + (size_t)t * 4 * job->width);
+		}
+
+		uint8_t* block = job->blocks + irow * job->blocks_x * ASTC_BLOCK_BYTES;
+		for (unsigned int block_x = 0; block_x < job->blocks_x; ++block_x, block += ASTC_BLOCK_BYTES) {
+			unsigned int it = 0;
+			for (unsigned int t = 0; t < block_height; ++t) {
+				for (unsigned int s = 0; s < block_width; ++s, ++it) {
+					// Clamp partial blocks at the image edge by replicating edge texels
+					unsigned int x = block_x * block_width + s;
+					if (x >= job->width)
+						x = job->width - 1;
+					memcpy(texel[it], rows + ((size_t)t * job->width + x) * 4, sizeof(float32_t) * 4);
+				}
+			}
+			astc_block_encode(encoder, (const float32_t(*)[4])texel, block);
+		}
+	}
+	image_trace_end(IMAGE_TRACE_COMPRESS);
+
+	memory_deallocate(rows);
+}
+
+static void
+astc_decode_rows(void* arg, size_t begin, size_t end) {
+	const astc_level_job_t* job = arg;
+	unsigned int block_width = job->encoder->block_width;
+	unsigned int block_height = job->encoder->block_height;
+	size_t pixel_size = job->hdr ? sizeof(float32_t) * 4 : 4;
+	size_t row_size = pixel_size * job->width;
+	astc_block_t block;
+
+	image_trace_begin(IMAGE_TRACE_DECODE);
+	for (size_t irow = begin; irow < end; ++irow) {
+		size_t slice = irow / job->blocks_y;
+		unsigned int block_y = (unsigned int)(irow % job->blocks_y);
+		uint8_t* slice_dest = job->blocks + slice * row_size * job->height;
+		const uint8_t* data = job->source + irow * job->blocks_x * ASTC_BLOCK_BYTES;
+		for (unsigned int block_x = 0; block_x < job->blocks_x; ++block_x, data += ASTC_BLOCK_BYTES) {
+			astc_block_decode(data, block_width, block_height, job->srgb, &block);
+			for (unsigned int t = 0; t < block_height; ++t) {
+				unsigned int y = block_y * block_height + t;
+				if (y >= job->height)
+					break;
+				for (unsigned int s = 0; s < block_width; ++s) {
+					unsigned int x = block_x * block_width + s;
+					if (x >= job->width)
+						break;
+					void* dest = slice_dest + row_size * y + pixel_size * x;
+					if (job->hdr)
+						astc_block_store_hdr(&block, t * block_width + s, dest);
+					else
+						astc_block_store_ldr(&block, t * block_width + s, dest);
+				}
+			}
+		}
+	}
+	image_trace_end(IMAGE_TRACE_DECODE);
+}
+
+bool
+image_astc_encode(image_t* image, const image_t* source, const image_pixelformat_t* pixelformat,
+                  unsigned int quality) {
+	if (!source->data || (source->format.compression != IMAGE_COMPRESSION_NONE) ||
+	    (source->format.bits_per_pixel % 8) ||
+	    ((pixelformat->compression != IMAGE_COMPRESSION_ASTC_LDR) &&
+	     (pixelformat->compression != IMAGE_COMPRESSION_ASTC_HDR)) ||
+	    !astc_footprint_is_valid(pixelformat->block_width, pixelformat->block_height))
+		return false;
+
+	bool hdr = (pixelformat->compression == IMAGE_COMPRESSION_ASTC_HDR);
+	bool srgb = (pixelformat->colorspace == IMAGE_COLORSPACE_sRGB);
+	astc_encoder_t encoder;
+	if (!astc_encoder_initialize(&encoder, pixelformat->block_width, pixelformat->block_height, hdr, srgb, quality))
+		return false;
+
+	unsigned int layers = image_layers(source);
+	if (layers > 1) {
+		image_allocate_array_storage(image, pixelformat, source->width, source->height, layers, source->levels);
+		image->cubemap = source->cubemap;
+	} else {
+		image_allocate_storage(image, pixelformat, source->width, source->height, source->depth, source->levels);
+	}
+
+	for (unsigned int level = 0; level < source->levels; ++level) {
+		for (unsigned int layer = 0; layer < layers; ++layer) {
+			astc_level_job_t job;
+			job.encoder = &encoder;
+			job.source_format = &source->format;
+			job.source = image_layer_buffer((image_t*)source, level, layer);
+			job.blocks = image_layer_buffer(image, level, layer);
+			job.width = image_width(source, level);
+			job.height = image_height(source, level);
+			job.blocks_x = (job.width + encoder.block_width - 1) / encoder.block_width;
+			job.blocks_y = (job.height + encoder.block_height - 1) / encoder.block_height;
+			job.srgb = srgb;
+			job.hdr = hdr;
+			image_parallel_for((size_t)image_depth(source, level) * job.blocks_y, 1, astc_encode_rows, &job);
+		}
+	}
+
+	astc_encoder_finalize(&encoder);
+	return true;
+}
+
+bool
+image_astc_decode(image_t* image, const image_t* source) {
+	if (!source->data ||
+	    ((source->format.compression != IMAGE_COMPRESSION_ASTC_LDR) &&
+	     (source->format.compression != IMAGE_COMPRESSION_ASTC_HDR)) ||
+	    !astc_footprint_is_valid(source->format.block_width, source->format.block_height))
+		return false;
+
+	bool hdr = (source->format.compression == IMAGE_COMPRESSION_ASTC_HDR);
+	image_pixelformat_t pixelformat;
+	if (hdr)
+		image_pixelformat_initialize(&pixelformat, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+	else
+		image_pixelformat_initialize(&pixelformat, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, source->format.colorspace);
+	unsigned int layers = image_layers(source);
+	if (layers > 1) {
+		image_allocate_array_storage(image, &pixelformat, source->width, source->height, layers, source->levels);
+		image->cubemap = source->cubemap;
+	} else {
+		image_allocate_storage(image, &pixelformat, source->width, source->height, source->depth, source->levels);
+	}
+
+	// Decoder only needs block dimensions from the encoder setup
+	astc_encoder_t encoder;
+	memset(&encoder, 0, sizeof(encoder));
+	encoder.block_width = source->format.block_width;
+	encoder.block_height = source->format.block_height;
+	encoder.hdr = hdr;
+
+	for (unsigned int level = 0; level < source->levels; ++level) {
+		for (unsigned int layer = 0; layer < layers; ++layer) {
+			astc_level_job_t job;
+			job.encoder = &encoder;
+			job.source_format = &source->format;
+			job.source = image_layer_buffer((image_t*)source, level, layer);
+			job.blocks = image_layer_buffer(image, level, layer);
+			job.width = image_width(source, level);
+			job.height = image_height(source, level);
+			job.blocks_x = (job.width + encoder.block_width - 1) / encoder.block_width;
+			job.blocks_y = (job.height + encoder.block_height - 1) / encoder.block_height;
+			job.srgb = (source->format.colorspace == IMAGE_COLORSPACE_sRGB);
+			job.hdr = hdr;
+			image_parallel_for((size_t)image_depth(source, level) * job.blocks_y, 1, astc_decode_rows, &job);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,59 @@
+/* astc.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file astc.h
+    ASTC block compression */
+
+#include <image/types.h>
+
+/*! Initialize a pixel format for ASTC compressed data. Only 2D block footprints
+are supported, from 4x4 up to 12x12 texels.
+\param pixelformat  Pixel format to initialize
+\param compression  Compression, IMAGE_COMPRESSION_ASTC_LDR or IMAGE_COMPRESSION_ASTC_HDR
+\param colorspace   Color space, sRGB is only valid for LDR data
+\param block_width  Block footprint width in texels
+\param block_height Block footprint height in texels
+\return             true if footprint and compression is valid, false if not */
+IMAGE_API bool
+image_astc_pixelformat(image_pixelformat_t* pixelformat, image_compression_t compression,
+                       image_colorspace_t colorspace, unsigned int block_width, unsigned int block_height);
+
+/*! Compress an uncompressed image to ASTC, all mip levels, layers and depth slices.
+The blocks are encoded in parallel over the available hardware threads. The
+encoder only emits single partition, single plane blocks, so blocks holding several
+distinct color clusters are approximated by one endpoint pair and compress at
+lower quality than with a multi-partition encoder. The decoder handles all
+partition counts and dual plane blocks.
+\param image       Image receiving compressed data
+\param source      Source uncompressed image
+\param pixelformat ASTC pixel format as initialized by #image_astc_pixelformat
+\param quality     Quality level 0-100, controls how many block modes are evaluated
+\return            true if successful, false if not */
+IMAGE_API bool
+image_astc_encode(image_t* image, const image_t* source, const image_pixelformat_t* pixelformat,
+                  unsigned int quality);
+
+/*! Decompress an ASTC image, all mip levels, layers and depth slices. LDR data decodes
+to 8-bit unsigned RGBA, HDR data to 32-bit float RGBA.
+\param image  Image receiving uncompressed data
+\param source Source ASTC compressed image
+\return       true if successful, false if not */
+IMAGE_API bool
+image_astc_decode(image_t* image, const image_t* source);
@@ -0,0 +1,297 @@
+/* async.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "async.h"
+#include "internal.h"
+
+#define IMAGE_ASYNC_MAX_THREADS 64
+
+struct image_async_t {
+	image_t* image;
+	string_t path;
+	stream_t* stream;
+	unsigned int flags;
+	image_load_callback_fn callback;
+	void* userdata;
+	atomic32_t status;
+	//! Posted once the load has finished or been cancelled
+	semaphore_t done;
+	image_async_t* next;
+};
+
+static mutex_t* image_async_lock;
+static semaphore_t image_async_signal;
+static image_async_t* image_async_head;
+static image_async_t* image_async_tail;
+static thread_t* image_async_thread;
+static size_t image_async_thread_count;
+static bool image_async_terminate;
+
+void
+image_async_initialize(void);
+
+void
+image_async_finalize(void);
+
+static void
+image_async_complete(image_async_t* async, image_async_status_t status) {
+	if (async->stream && (async->flags & IMAGE_LOAD_ADOPT_STREAM))
+		stream_deallocate(async->stream);
+	async->stream = 0;
+	if (async->callback)
+		async->callback(async->image, status, async->userdata);
+	atomic_store32(&async->status, (int32_t)status, memory_order_release);
+	// Handle may be released as soon as it is posted
+	semaphore_post(&async->done);
+}
+
+static void
+image_async_execute(image_async_t* async) {
+	bool success = false;
+	if (async->stream) {
+		success = image_load(async->image, async->stream);
+	} else {
+		if (async->flags & IMAGE_LOAD_MAPPED)
+			success = image_load_mapped(async->image, STRING_ARGS(async->path));
+		if (!success) {
+			stream_t* stream = stream_open(STRING_ARGS(async->path), STREAM_IN | STREAM_BINARY);
+			if (stream) {
+				success = image_load(async->image, stream);
+				stream_deallocate(stream);
+			} else {
+				log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Unable to open image file: %.*s"),
+				          STRING_FORMAT(async->path));
+			}
+		}
+	}
+	if (success)
+		success = image_load_convert(async->image, async->flags);
+	image_async_complete(async, success ? IMAGE_ASYNC_COMPLETE : IMAGE_ASYNC_FAILED);
+}
+
+static void*
+image_async_worker(void* arg) {
+	// A single load thread leaves the remaining hardware threads to parallel loops
+	image_parallel_set_worker((uintptr_t)arg > 1);
+	while (true) {
+		semaphore_wait(&image_async_signal);
+
+		mutex_lock(image_async_lock);
+		if (image_async_terminate) {
+			mutex_unlock(image_async_lock);
+			break;
+		}
+		// Queue may be empty if the load was cancelled after being signalled
+		image_async_t* async = image_async_head;
+		if (async) {
+			image_async_head = async->next;
+			if (!image_async_head)
+				image_async_tail = 0;
+			async->next = 0;
+			atomic_store32(&async->status, IMAGE_ASYNC_RUNNING, memory_order_release);
+		}
+		mutex_unlock(image_async_lock);
+
+		if (async)
+			image_async_execute(async);
+	}
+	image_trace_thread_finalize();
+	return 0;
+}
+
+static void
+image_async_start(void) {
+	image_config_t config = image_module_config();
+	size_t thread_count = config.load_thread_count ? config.load_thread_count : system_hardware_threads();
+	if (thread_count > IMAGE_ASYNC_MAX_THREADS)
+		thread_count = IMAGE_ASYNC_MAX_THREADS;
+	if (!thread_count)
+		thread_count = 1;
+
+	image_async_thread = memory_allocate(HASH_IMAGE, sizeof(thread_t) * thread_count, 0, MEMORY_PERSISTENT);
+	for (size_t ithread = 0; ithread < thread_count; ++ithread) {
+		thread_initialize(&image_async_thread[ithread], image_async_worker, (void*)(uintptr_t)thread_count,
+		                  STRING_CONST("image_load"), THREAD_PRIORITY_NORMAL, 0);
+		thread_start(&image_async_thread[ithread]);
+	}
+	image_async_thread_count = thread_count;
+}
+
+static image_async_t*
+image_async_queue(image_t* image, string_t path, stream_t* stream, unsigned int flags, image_load_callback_fn callback,
+                  void* userdata) {
+	if (!image_async_lock) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Image module not initialized"));
+		// Ownership of the path and an adopted stream was passed in, release them as a
+		// completed load would
+		if (path.str)
+			string_deallocate(path.str);
+		if (stream && (flags & IMAGE_LOAD_ADOPT_STREAM))
+			stream_deallocate(stream);
+		return 0;
+	}
+
+	image_async_t* async = memory_allocate(HASH_IMAGE, sizeof(image_async_t), 0, MEMORY_PERSISTENT);
+	async->image = image;
+	async->path = path;
+	async->stream = stream;
+	async->flags = flags;
+	async->callback = callback;
+	async->userdata = userdata;
+	async->next = 0;
+	atomic_store32(&async->status, IMAGE_ASYNC_PENDING, memory_order_release);
+	semaphore_initialize(&async->done, 0);
+
+	mutex_lock(image_async_lock);
+	if (!image_async_thread_count)
+		image_async_start();
+	if (image_async_tail)
+		image_async_tail->next = async;
+	else
+		image_async_head = async;
+	image_async_tail = async;
+	mutex_unlock(image_async_lock);
+
+	semaphore_post(&image_async_signal);
+
+	return async;
+}
+
+image_async_t*
+image_load_async(image_t* image, const char* path, size_t length, unsigned int flags, image_load_callback_fn callback,
+                 void* userdata) {
+	return image_async_queue(image, string_clone(path, length), 0, flags, callback, userdata);
+}
+
+image_async_t*
+image_load_async_stream(image_t* image, stream_t* stream, unsigned int flags, image_load_callback_fn callback,
+                        void* userdata) {
+	string_t path = {0, 0};
+	return image_async_queue(image, path, stream, flags, callback, userdata);
+}
+
+image_async_status_t
+image_async_status(image_async_t* async) {
+	return (image_async_status_t)atomic_load32(&async->status, memory_order_acquire);
+}
+
+bool
+image_async_wait(image_async_t* async, unsigned int milliseconds) {
+	if (milliseconds) {
+		if (!semaphore_try_wait(&async->done, milliseconds))
+			return false;
+	} else {
+		semaphore_wait(&async->done);
+	}
+	// Keep the semaphore signalled for subsequent waits
+	semaphore_post(&async->done);
+	return true;
+}
+
+bool
+image_async_cancel(image_async_t* async) {
+	bool cancelled = false;
+	if (!image_async_lock)
+		return false;
+	mutex_lock(image_async_lock);
+	if (atomic_load32(&async->status, memory_order_acquire) == IMAGE_ASYNC_PENDING) {
+		image_async_t* prev = 0;
+		image_async_t* current = image_async_head;
+		while (current && (current != async)) {
+			prev = current;
+			current = current->next;
+		}
+		if (current) {
+			if (prev)
+				prev->next = async->next;
+			else
+				image_async_head = async->next;
+			if (image_async_tail == async)
+				image_async_tail = prev;
+			async->next = 0;
+			cancelled = true;
+		}
+	}
+	mutex_unlock(image_async_lock);
+
+	if (cancelled)
+		image_async_complete(async, IMAGE_ASYNC_CANCELLED);
+	return cancelled;
+}
+
+void
+image_async_release(image_async_t* async) {
+	if (!async)
+		return;
+	image_async_cancel(async);
+	semaphore_wait(&async->done);
+	semaphore_finalize(&async->done);
+	if (async->path.str)
+		string_deallocate(async->path.str);
+	memory_deallocate(async);
+}
+
+void
+image_async_initialize(void) {
+	image_async_lock = mutex_allocate(STRING_CONST("image_async"));
+	semaphore_initialize(&image_async_signal, 0);
+	image_async_head = 0;
+	image_async_tail = 0;
+	image_async_thread = 0;
+	image_async_thread_count = 0;
+	image_async_terminate = false;
+}
+
+void
+image_async_finalize(void) {
+	if (!image_async_lock)
+		return;
+
+	mutex_lock(image_async_lock);
+	image_async_terminate = true;
+	image_async_t* pending = image_async_head;
+	image_async_head = 0;
+	image_async_tail = 0;
+	mutex_unlock(image_async_lock);
+
+	for (size_t ithread = 0; ithread < image_async_thread_count; ++ithread)
+		semaphore_post(&image_async_signal);
+	for (size_t ithread = 0; ithread < image_async_thread_count; ++ithread) {
+		thread_join(&image_async_thread[ithread]);
+		thread_finalize(&image_async_thread[ithread]);
+	}
+	if (image_async_thread)
+		memory_deallocate(image_async_thread);
+	image_async_thread = 0;
+	image_async_thread_count = 0;
+
+	// Loads that never started are cancelled
+	while (pending) {
+		image_async_t* next = pending->next;
+		pending->next = 0;
+		image_async_complete(pending, IMAGE_ASYNC_CANCELLED);
+		pending = next;
+	}
+
+	semaphore_finalize(&image_async_signal);
+	mutex_deallocate(image_async_lock);
+	image_async_lock = 0;
+}
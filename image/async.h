@@ -0,0 +1,78 @@
+/* async.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file async.h
+    Asynchronous image loading on a worker thread pool owned by the image module */
+
+#include <image/types.h>
+
+/*! Queue an image file to be loaded asynchronously. The image must remain valid until the
+load has finished and the handle has been released.
+\param image    Image to load into
+\param path     File path
+\param length   Length of file path
+\param flags    Load flags, see #image_load_flag_t
+\param callback Function called on the worker thread when the load finishes or is cancelled, can be null
+\param userdata Argument passed to callback
+\return         Handle to poll, wait on or cancel the load, must be released with #image_async_release.
+                Null if the module is not initialized */
+IMAGE_API image_async_t*
+image_load_async(image_t* image, const char* path, size_t length, unsigned int flags, image_load_callback_fn callback,
+                 void* userdata);
+
+/*! Queue an image to be loaded asynchronously from a stream. The stream must not be used
+by the caller until the load has finished. Use #IMAGE_LOAD_ADOPT_STREAM to have the stream
+deallocated once the load has finished, or immediately if the load could not be queued.
+\param image    Image to load into
+\param stream   Source stream
+\param flags    Load flags, see #image_load_flag_t
+\param callback Function called on the worker thread when the load finishes or is cancelled, can be null
+\param userdata Argument passed to callback
+\return         Handle to poll, wait on or cancel the load, must be released with #image_async_release.
+                Null if the module is not initialized */
+IMAGE_API image_async_t*
+image_load_async_stream(image_t* image, stream_t* stream, unsigned int flags, image_load_callback_fn callback,
+                        void* userdata);
+
+/*! Poll the status of an asynchronous load
+\param async Handle
+\return      Current status */
+IMAGE_API image_async_status_t
+image_async_status(image_async_t* async);
+
+/*! Wait for an asynchronous load to finish
+\param async        Handle
+\param milliseconds Maximum time to wait, zero to wait indefinitely
+\return             true if the load has finished, false if timeout elapsed */
+IMAGE_API bool
+image_async_wait(image_async_t* async, unsigned int milliseconds);
+
+/*! Cancel an asynchronous load that has not yet started. The callback is called with
+#IMAGE_ASYNC_CANCELLED status on the calling thread.
+\param async Handle
+\return      true if the load was cancelled, false if it has already started or finished */
+IMAGE_API bool
+image_async_cancel(image_async_t* async);
+
+/*! Release a handle, cancelling the load if it has not yet started and otherwise waiting
+for it to finish
+\param async Handle */
+IMAGE_API void
+image_async_release(image_async_t* async);
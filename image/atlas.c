@@ -0,0 +1,294 @@
+/* atlas.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "atlas.h"
+
+typedef struct image_atlas_node_t image_atlas_node_t;
+typedef struct image_atlas_skyline_t image_atlas_skyline_t;
+typedef struct image_atlas_order_t image_atlas_order_t;
+typedef struct image_atlas_job_t image_atlas_job_t;
+
+//! Horizontal segment of the skyline at height y
+struct image_atlas_node_t {
+	unsigned int x;
+	unsigned int y;
+	unsigned int width;
+};
+
+//! Skyline of a page, segments ordered by x covering the full page width
+struct image_atlas_skyline_t {
+	image_atlas_node_t* node;
+	size_t count;
+};
+
+//! Packing order entry, images are packed tallest first
+struct image_atlas_order_t {
+	unsigned int height;
+	unsigned int width;
+	size_t index;
+};
+
+struct image_atlas_job_t {
+	const image_t* images;
+	image_t* pages;
+	const image_atlas_rect_t* rects;
+	unsigned int padding;
+};
+
+static unsigned int
+image_atlas_align(unsigned int value, unsigned int alignment) {
+	return ((value + alignment - 1) / alignment) * alignment;
+}
+
+//! Find the lowest position where a slot fits with its left edge at the given segment
+static bool
+image_atlas_skyline_fit(const image_atlas_skyline_t* skyline, size_t index, unsigned int width, unsigned int height,
+                        unsigned int page_width, unsigned int page_height, unsigned int* y) {
+	const image_atlas_node_t* node = skyline->node;
+	if (node[index].x + width > page_width)
+		return false;
+	unsigned int top = 0;
+	unsigned int remain = width;
+	for (size_t inode = index; remain && (inode < skyline->count); ++inode) {
+		if (node[inode].y > top)
+			top = node[inode].y;
+		if (top + height > page_height)
+			return false;
+		remain = (node[inode].width < remain) ? (remain - node[inode].width) : 0;
+	}
+	*y = top;
+	return true;
+}
+
+//! Bottom-left placement, lowest slot top edge first and leftmost on ties
+static bool
+image_atlas_skyline_find(const image_atlas_skyline_t* skyline, unsigned int width, unsigned int height,
+                         unsigned int page_width, unsigned int page_height, size_t* index, unsigned int* x,
+                         unsigned int* y) {
+	bool found = false;
+	unsigned int best_top = 0;
+	for (size_t inode = 0; inode < skyline->count; ++inode) {
+		unsigned int top;
+		if (!image_atlas_skyline_fit(skyline, inode, width, height, page_width, page_height, &top))
+			continue;
+		if (!found || (top + height < best_top)) {
+			found = true;
+			best_top = top + height;
+			*index = inode;
+			*x = skyline->node[inode].x;
+			*y = top;
+		}
+	}
+	return found;
+}
+
+static void
+image_atlas_skyline_insert(image_atlas_skyline_t* skyline, size_t index, unsigned int x, unsigned int top,
+                           unsigned int width) {
+	image_atlas_node_t* node = skyline->node;
+	memmove(node + index + 1, node + index, sizeof(image_atlas_node_t) * (skyline->count - index));
+	node[index].x = x;
+	node[index].y = top;
+	node[index].width = width;
+	++skyline->count;
+
+	// Trim segments covered by the new segment
+	size_t inode = index + 1;
+	while (inode < skyline->count) {
+		unsigned int end = node[inode - 1].x + node[inode - 1].width;
+		if (node[inode].x >= end)
+			break;
+		unsigned int shrink = end - node[inode].x;
+		if (node[inode].width > shrink) {
+			node[inode].x += shrink;
+			node[inode].width -= shrink;
+			break;
+		}
+		memmove(node + inode, node + inode + 1, sizeof(image_atlas_node_t) * (skyline->count - inode - 1));
+		--skyline->count;
+	}
+
+	// Merge neighbouring segments at the same height
+	for (inode = 0; inode + 1 < skyline->count;) {
+		if (node[inode].y == node[inode + 1].y) {
+			node[inode].width += node[inode + 1].width;
+			memmove(node + inode + 1, node + inode + 2, sizeof(image_atlas_node_t) * (skyline->count - inode - 2));
+			--skyline->count;
+		} else {
+			++inode;
+		}
+	}
+}
+
+static int
+image_atlas_order_compare(const void* lhs, const void* rhs) {
+	const image_atlas_order_t* first = lhs;
+	const image_atlas_order_t* second = rhs;
+	if (first->height != second->height)
+		return (first->height > second->height) ? -1 : 1;
+	if (first->width != second->width)
+		return (first->width > second->width) ? -1 : 1;
+	return (first->index < second->index) ? -1 : 1;
+}
+
+static void
+image_atlas_copy(void* arg, size_t begin, size_t end) {
+	image_atlas_job_t* job = arg;
+	unsigned int padding = job->padding;
+	for (size_t iimage = begin; iimage < end; ++iimage) {
+		const image_atlas_rect_t* placement = job->rects + iimage;
+		image_t* page = job->pages + placement->page;
+		image_rect_t rect = placement->rect;
+		image_blit(page, 0, rect.x, rect.y, job->images + iimage, 0, 0);
+		if (!padding)
+			continue;
+
+		// Extrude left and right columns, then top and bottom rows including the corners
+		image_rect_t edge = {rect.x, rect.y, 1, rect.height};
+		for (unsigned int ipad = 1; ipad <= padding; ++ipad)
+			image_blit(page, 0, rect.x - ipad, rect.y, page, 0, &edge);
+		edge.x = rect.x + rect.width - 1;
+		for (unsigned int ipad = 1; ipad <= padding; ++ipad)
+			image_blit(page, 0, edge.x + ipad, rect.y, page, 0, &edge);
+		edge.x = rect.x - padding;
+		edge.y = rect.y;
+		edge.width = rect.width + 2 * padding;
+		edge.height = 1;
+		for (unsigned int ipad = 1; ipad <= padding; ++ipad)
+			image_blit(page, 0, edge.x, rect.y - ipad, page, 0, &edge);
+		edge.y = rect.y + rect.height - 1;
+		for (unsigned int ipad = 1; ipad <= padding; ++ipad)
+			image_blit(page, 0, edge.x, edge.y + ipad, page, 0, &edge);
+	}
+}
+
+size_t
+image_atlas_build(const image_t* images, size_t count, const image_atlas_options_t* options, image_t* pages,
+                  size_t max_pages, image_atlas_rect_t* rects) {
+	const image_pixelformat_t* format = &options->format;
+	if ((format->compression != IMAGE_COMPRESSION_NONE) || !format->bits_per_pixel || (format->bits_per_pixel % 8)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Atlas pages require an uncompressed pixel format"));
+		return 0;
+	}
+	for (size_t iimage = 0; iimage < count; ++iimage) {
+		const image_pixelformat_t* image_format = &images[iimage].format;
+		if (!images[iimage].data || (image_format->compression != IMAGE_COMPRESSION_NONE) ||
+		    (image_format->bits_per_pixel % 8)) {
+			log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported atlas source image %" PRIsize),
+			          iimage);
+			return 0;
+		}
+	}
+
+	// Slots of block compressed targets must not share a block at the smallest mip level
+	unsigned int align_x = options->alignment ? options->alignment : 1;
+	unsigned int align_y = align_x;
+	if (options->block_width) {
+		unsigned int mip_scale = 1U << (options->mip_levels ? (options->mip_levels - 1) : 0);
+		unsigned int block_height = options->block_height ? options->block_height : 1;
+		align_x = image_atlas_align(options->block_width * mip_scale, align_x);
+		align_y = image_atlas_align(block_height * mip_scale, align_y);
+	}
+
+	unsigned int page_width = options->page_width;
+	unsigned int page_height = options->page_height;
+	unsigned int padding = options->padding;
+	image_atlas_order_t* order =
+	    memory_allocate(HASH_IMAGE, sizeof(image_atlas_order_t) * (count ? count : 1), 0, MEMORY_PERSISTENT);
+	for (size_t iimage = 0; iimage < count; ++iimage) {
+		order[iimage].height = images[iimage].height;
+		order[iimage].width = images[iimage].width;
+		order[iimage].index = iimage;
+	}
+	qsort(order, count, sizeof(image_atlas_order_t), image_atlas_order_compare);
+
+	size_t node_capacity = page_width / align_x + 2;
+	image_atlas_skyline_t* skyline =
+	    memory_allocate(HASH_IMAGE, sizeof(image_atlas_skyline_t) * (max_pages ? max_pages : 1), 0,
+	                    MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+	size_t page_count = 0;
+	bool success = true;
+	for (size_t iorder = 0; success && (iorder < count); ++iorder) {
+		size_t iimage = order[iorder].index;
+		unsigned int slot_width = image_atlas_align(images[iimage].width + 2 * padding, align_x);
+		unsigned int slot_height = image_atlas_align(images[iimage].height + 2 * padding, align_y);
+		size_t index = 0;
+		unsigned int x = 0;
+		unsigned int y = 0;
+		size_t page = 0;
+		while ((page < page_count) &&
+		       !image_atlas_skyline_find(skyline + page, slot_width, slot_height, page_width, page_height, &index,
+		                                 &x, &y))
+			++page;
+		if (page == page_count) {
+			if ((page_count == max_pages) || (slot_width > page_width) || (slot_height > page_height)) {
+				log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE,
+				          STRING_CONST("Atlas image %" PRIsize " (%ux%u) does not fit in %" PRIsize " pages"), iimage,
+				          images[iimage].width, images[iimage].height, max_pages);
+				success = false;
+				break;
+			}
+			skyline[page].node =
+			    memory_allocate(HASH_IMAGE, sizeof(image_atlas_node_t) * node_capacity, 0, MEMORY_PERSISTENT);
+			skyline[page].node[0].x = 0;
+			skyline[page].node[0].y = 0;
+			skyline[page].node[0].width = page_width;
+			skyline[page].count = 1;
+			++page_count;
+			index = 0;
+			x = 0;
+			y = 0;
+		}
+		image_atlas_skyline_insert(skyline + page, index, x, y + slot_height, slot_width);
+
+		image_atlas_rect_t* placement = rects + iimage;
+		placement->page = (unsigned int)page;
+		placement->rect.x = x + padding;
+		placement->rect.y = y + padding;
+		placement->rect.width = images[iimage].width;
+		placement->rect.height = images[iimage].height;
+		placement->u0 = (float32_t)placement->rect.x / (float32_t)page_width;
+		placement->v0 = (float32_t)placement->rect.y / (float32_t)page_height;
+		placement->u1 = (float32_t)(placement->rect.x + placement->rect.width) / (float32_t)page_width;
+		placement->v1 = (float32_t)(placement->rect.y + placement->rect.height) / (float32_t)page_height;
+	}
+
+	for (size_t ipage = 0; ipage < page_count; ++ipage)
+		memory_deallocate(skyline[ipage].node);
+	memory_deallocate(skyline);
+	memory_deallocate(order);
+	if (!success)
+		return 0;
+
+	for (size_t ipage = 0; ipage < page_count; ++ipage) {
+		image_allocate_storage(pages + ipage, format, page_width, page_height, 1, 1);
+		memset(pages[ipage].data, 0, image_buffer_size(format, page_width, page_height, 1, 1));
+	}
+
+	image_atlas_job_t job;
+	job.images = images;
+	job.pages = pages;
+	job.rects = rects;
+	job.padding = padding;
+	image_parallel_for(count, 0, image_atlas_copy, &job);
+
+	return page_count;
+}
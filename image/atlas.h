@@ -0,0 +1,44 @@
+/* atlas.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file atlas.h
+    Texture atlas building. Images are packed into one or more fixed size pages with a
+    skyline bottom-left packer, tallest images first, and copied into the pages in
+    parallel. */
+
+#include <image/types.h>
+
+/*! Pack images into atlas pages. Each image occupies a slot of its first mip level
+dimensions plus padding on all sides, where the padding is filled by extruding the
+image edges to avoid bleeding when sampling with filtering. Slot positions and sizes
+are rounded up to the alignment, and for block compressed targets to the block
+footprint scaled by the number of mip levels.
+\param images    Array of source images
+\param count     Number of source images
+\param options   Atlas options
+\param pages     Array of initialized images receiving atlas pages
+\param max_pages Maximum number of pages
+\param rects     Array receiving the placement of each source image
+\return          Number of pages used, zero if an image does not fit in a page, the
+                 images need more than the maximum number of pages or a format is
+                 not supported */
+IMAGE_API size_t
+image_atlas_build(const image_t* images, size_t count, const image_atlas_options_t* options, image_t* pages,
+                  size_t max_pages, image_atlas_rect_t* rects);
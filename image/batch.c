@@ -0,0 +1,351 @@
+/* batch.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "batch.h"
+#include "internal.h"
+
+#define IMAGE_BATCH_MAX_THREADS 64
+
+typedef enum image_batch_stage_t {
+	IMAGE_BATCH_STAGE_OPEN = 0,
+	IMAGE_BATCH_STAGE_READ,
+	IMAGE_BATCH_STAGE_DECODE,
+	IMAGE_BATCH_STAGE_CONVERT
+} image_batch_stage_t;
+
+typedef struct image_batch_item_t image_batch_item_t;
+typedef struct image_batch_queue_t image_batch_queue_t;
+typedef struct image_batch_t image_batch_t;
+typedef struct image_batch_worker_t image_batch_worker_t;
+
+struct image_batch_item_t {
+	image_batch_stage_t stage;
+	stream_t* stream;
+	void* buffer;
+	size_t size;
+	tick_t time;
+	bool success;
+};
+
+//! Task queue owned by one worker. The owner pushes and pops at the tail, other
+//! workers steal the oldest tasks from the head.
+struct image_batch_queue_t {
+	atomic32_t lock;
+	size_t head;
+	size_t tail;
+	size_t* task;
+};
+
+struct image_batch_t {
+	const string_const_t* paths;
+	image_t* images;
+	size_t count;
+	unsigned int flags;
+	image_batch_item_t* item;
+	image_batch_queue_t* queue;
+	size_t queue_count;
+	atomic64_t finished;
+	atomic64_t steals;
+	//! Number of workers parked waiting for tasks
+	atomic32_t idle;
+	//! Signalled when a task is queued while workers are parked, and for all workers when the batch is done
+	semaphore_t signal;
+};
+
+struct image_batch_worker_t {
+	image_batch_t* batch;
+	size_t index;
+};
+
+static void
+image_batch_queue_lock(image_batch_queue_t* queue) {
+	while (!atomic_cas32(&queue->lock, 1, 0, memory_order_acquire, memory_order_relaxed))
+		thread_yield();
+}
+
+static void
+image_batch_queue_unlock(image_batch_queue_t* queue) {
+	atomic_store32(&queue->lock, 0, memory_order_release);
+}
+
+static void
+image_batch_queue_push(image_batch_t* batch, image_batch_queue_t* queue, size_t item) {
+	// Each item has at most one queued task, so a queue never holds more than count tasks
+	image_batch_queue_lock(queue);
+	queue->task[queue->tail % batch->count] = item;
+	++queue->tail;
+	image_batch_queue_unlock(queue);
+	// Pairs with the fence in image_batch_park, either a parked worker is woken or it
+	// finds this task when scanning the queues again
+	atomic_thread_fence_sequentially_consistent();
+	if (atomic_load32(&batch->idle, memory_order_relaxed) > 0)
+		semaphore_post(&batch->signal);
+}
+
+static bool
+image_batch_queue_pop(image_batch_t* batch, image_batch_queue_t* queue, size_t* item) {
+	bool found = false;
+	image_batch_queue_lock(queue);
+	if (queue->tail != queue->head) {
+		--queue->tail;
+		*item = queue->task[queue->tail % batch->count];
+		found = true;
+	}
+	image_batch_queue_unlock(queue);
+	return found;
+}
+
+static bool
+image_batch_queue_steal(image_batch_t* batch, image_batch_queue_t* queue, size_t* item) {
+	bool found = false;
+	image_batch_queue_lock(queue);
+	if (queue->tail != queue->head) {
+		*item = queue->task[queue->head % batch->count];
+		++queue->head;
+		found = true;
+	}
+	image_batch_queue_unlock(queue);
+	return found;
+}
+
+//! Run the current stage of an item, returns true if the item has more stages to run
+static bool
+image_batch_process(image_batch_t* batch, size_t iitem) {
+	image_batch_item_t* item = batch->item + iitem;
+	image_t* image = batch->images + iitem;
+	string_const_t path = batch->paths[iitem];
+	tick_t start = time_current();
+	bool more = false;
+
+	switch (item->stage) {
+		case IMAGE_BATCH_STAGE_OPEN:
+			if ((batch->flags & IMAGE_LOAD_MAPPED) && image_load_mapped(image, STRING_ARGS(path))) {
+				item->size = image->mapping_size;
+				item->success = true;
+				if (batch->flags & (IMAGE_LOAD_CONVERT_UINT8 | IMAGE_LOAD_CONVERT_FLOAT32)) {
+					item->stage = IMAGE_BATCH_STAGE_CONVERT;
+					more = true;
+				}
+				break;
+			}
+			item->stream = stream_open(STRING_ARGS(path), STREAM_IN | STREAM_BINARY);
+			if (!item->stream) {
+				log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Unable to open image file: %.*s"),
+				          STRING_FORMAT(path));
+				break;
+			}
+			item->size = stream_size(item->stream);
+			if (!item->size) {
+				stream_deallocate(item->stream);
+				item->stream = 0;
+				break;
+			}
+			item->stage = IMAGE_BATCH_STAGE_READ;
+			more = true;
+			break;
+
+		case IMAGE_BATCH_STAGE_READ:
+			item->buffer = memory_allocate(HASH_IMAGE, item->size, 0, MEMORY_PERSISTENT);
+			if (stream_read(item->stream, item->buffer, item->size) == item->size) {
+				item->stage = IMAGE_BATCH_STAGE_DECODE;
+				more = true;
+			} else {
+				log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Unable to read image file: %.*s"),
+				          STRING_FORMAT(path));
+				memory_deallocate(item->buffer);
+				item->buffer = 0;
+			}
+			stream_deallocate(item->stream);
+			item->stream = 0;
+			break;
+
+		case IMAGE_BATCH_STAGE_DECODE: {
+			stream_t* stream =
+			    buffer_stream_allocate(item->buffer, STREAM_IN | STREAM_BINARY, item->size, item->size, true, false);
+			item->buffer = 0;
+			item->success = image_load(image, stream);
+			stream_deallocate(stream);
+			if (item->success && (batch->flags & (IMAGE_LOAD_CONVERT_UINT8 | IMAGE_LOAD_CONVERT_FLOAT32))) {
+				item->stage = IMAGE_BATCH_STAGE_CONVERT;
+				more = true;
+			}
+			break;
+		}
+
+		case IMAGE_BATCH_STAGE_CONVERT:
+			item->success = image_load_convert(image, batch->flags);
+			break;
+	}
+
+	item->time += time_diff(start, time_current());
+	return more;
+}
+
+static bool
+image_batch_find(image_batch_t* batch, size_t index, size_t* iitem) {
+	if (image_batch_queue_pop(batch, batch->queue + index, iitem))
+		return true;
+	for (size_t ivictim = 1; ivictim < batch->queue_count; ++ivictim) {
+		if (image_batch_queue_steal(batch, batch->queue + ((index + ivictim) % batch->queue_count), iitem)) {
+			atomic_incr64(&batch->steals, memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+//! Park an idle worker until a task is queued or the batch is done. Returns true with
+//! a task if one was found when scanning the queues after announcing the worker as idle
+static bool
+image_batch_park(image_batch_t* batch, size_t index, size_t* iitem) {
+	atomic_incr32(&batch->idle, memory_order_relaxed);
+	atomic_thread_fence_sequentially_consistent();
+	bool found = image_batch_find(batch, index, iitem);
+	if (!found && ((size_t)atomic_load64(&batch->finished, memory_order_acquire) < batch->count))
+		semaphore_wait(&batch->signal);
+	atomic_decr32(&batch->idle, memory_order_relaxed);
+	return found;
+}
+
+static void
+image_batch_execute(image_batch_t* batch, size_t index) {
+	image_batch_queue_t* queue = batch->queue + index;
+	while ((size_t)atomic_load64(&batch->finished, memory_order_acquire) < batch->count) {
+		size_t iitem = 0;
+		if (!image_batch_find(batch, index, &iitem) && !image_batch_park(batch, index, &iitem))
+			continue;
+		// Next stage is queued locally to keep the data in this thread's cache
+		if (image_batch_process(batch, iitem)) {
+			image_batch_queue_push(batch, queue, iitem);
+		} else if ((size_t)atomic_incr64(&batch->finished, memory_order_release) == batch->count) {
+			// Wake all parked workers so they see the batch is done
+			for (size_t iworker = 1; iworker < batch->queue_count; ++iworker)
+				semaphore_post(&batch->signal);
+		}
+	}
+}
+
+static void*
+image_batch_thread(void* arg) {
+	image_batch_worker_t* worker = arg;
+	image_parallel_set_worker(true);
+	image_batch_execute(worker->batch, worker->index);
+	image_trace_thread_finalize();
+	return 0;
+}
+
+size_t
+image_load_batch(const string_const_t* paths, image_t* images, size_t count, unsigned int flags,
+                 image_batch_result_t* results, image_batch_statistics_t* statistics) {
+	tick_t start = time_current();
+
+	image_config_t config = image_module_config();
+	size_t thread_count = config.load_thread_count ? config.load_thread_count : system_hardware_threads();
+	if (thread_count > IMAGE_BATCH_MAX_THREADS)
+		thread_count = IMAGE_BATCH_MAX_THREADS;
+	if (thread_count > count)
+		thread_count = count;
+	if (!thread_count)
+		thread_count = 1;
+
+	image_batch_t batch;
+	batch.paths = paths;
+	batch.images = images;
+	batch.count = count;
+	batch.flags = flags;
+	batch.queue_count = thread_count;
+	atomic_store64(&batch.finished, 0, memory_order_release);
+	atomic_store64(&batch.steals, 0, memory_order_release);
+	atomic_store32(&batch.idle, 0, memory_order_release);
+
+	if (count) {
+		semaphore_initialize(&batch.signal, 0);
+		batch.item = memory_allocate(HASH_IMAGE, sizeof(image_batch_item_t) * count, 0,
+		                             MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+		batch.queue = memory_allocate(HASH_IMAGE, sizeof(image_batch_queue_t) * thread_count, 0, MEMORY_PERSISTENT);
+		for (size_t iqueue = 0; iqueue < thread_count; ++iqueue) {
+			image_batch_queue_t* queue = batch.queue + iqueue;
+			atomic_store32(&queue->lock, 0, memory_order_release);
+			queue->head = 0;
+			queue->tail = 0;
+			queue->task = memory_allocate(HASH_IMAGE, sizeof(size_t) * count, 0, MEMORY_PERSISTENT);
+		}
+		// Items are dealt out round robin, pushed in reverse so each owner starts with its first item
+		for (size_t iitem = count; iitem > 0; --iitem)
+			image_batch_queue_push(&batch, batch.queue + ((iitem - 1) % thread_count), iitem - 1);
+
+		image_batch_worker_t worker[IMAGE_BATCH_MAX_THREADS];
+		thread_t thread[IMAGE_BATCH_MAX_THREADS];
+		for (size_t ithread = 1; ithread < thread_count; ++ithread) {
+			worker[ithread].batch = &batch;
+			worker[ithread].index = ithread;
+			thread_initialize(&thread[ithread], image_batch_thread, &worker[ithread], STRING_CONST("image_batch"),
+			                  THREAD_PRIORITY_NORMAL, 0);
+			thread_start(&thread[ithread]);
+		}
+
+		bool was_worker = image_parallel_set_worker(true);
+		image_batch_execute(&batch, 0);
+		image_parallel_set_worker(was_worker);
+
+		for (size_t ithread = 1; ithread < thread_count; ++ithread) {
+			thread_join(&thread[ithread]);
+			thread_finalize(&thread[ithread]);
+		}
+	}
+
+	size_t loaded = 0;
+	size_t total_size = 0;
+	for (size_t iitem = 0; iitem < count; ++iitem) {
+		const image_batch_item_t* item = batch.item + iitem;
+		if (item->success)
+			++loaded;
+		total_size += item->size;
+		if (results) {
+			results[iitem].success = item->success;
+			results[iitem].size = item->size;
+			results[iitem].time = item->time;
+		}
+	}
+
+	if (statistics) {
+		tick_t elapsed = time_diff(start, time_current());
+		double seconds = elapsed ? (double)elapsed / (double)time_ticks_per_second() : 0;
+		statistics->loaded = loaded;
+		statistics->failed = count - loaded;
+		statistics->size = total_size;
+		statistics->threads = thread_count;
+		statistics->steals = (size_t)atomic_load64(&batch.steals, memory_order_acquire);
+		statistics->time = elapsed;
+		statistics->images_per_second = (seconds > 0) ? (double)loaded / seconds : 0;
+		statistics->bytes_per_second = (seconds > 0) ? (double)total_size / seconds : 0;
+	}
+
+	if (count) {
+		for (size_t iqueue = 0; iqueue < thread_count; ++iqueue)
+			memory_deallocate(batch.queue[iqueue].task);
+		memory_deallocate(batch.queue);
+		memory_deallocate(batch.item);
+		semaphore_finalize(&batch.signal);
+	}
+
+	return loaded;
+}
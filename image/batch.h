@@ -0,0 +1,41 @@
+/* batch.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file batch.h
+    Batch image loading balanced over worker threads with work stealing */
+
+#include <image/types.h>
+
+/*! Load a batch of image files. Each file is processed in open, read and decode stages,
+followed by a convert stage if #IMAGE_LOAD_CONVERT_UINT8 or #IMAGE_LOAD_CONVERT_FLOAT32
+is given. Stages are scheduled as separate tasks on per-thread queues, with idle threads
+stealing tasks from other queues to balance a few large images against many small ones.
+Threads finding no task to steal sleep until one is queued. The calling thread
+participates in the work and the function returns once all images have been processed.
+\param paths      Array of file paths
+\param images     Array of images to load into, must be initialized
+\param count      Number of images
+\param flags      Load flags, see #image_load_flag_t
+\param results    Array of per image results, can be null
+\param statistics Aggregate statistics for the batch, can be null
+\return           Number of images loaded successfully */
+IMAGE_API size_t
+image_load_batch(const string_const_t* paths, image_t* images, size_t count, unsigned int flags,
+                 image_batch_result_t* results, image_batch_statistics_t* statistics);
@@ -0,0 +1,216 @@
+/* blit.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "blit.h"
+#include "trace.h"
+
+typedef enum image_blit_mode_t {
+	//! Identical layouts, rows are copied as is
+	IMAGE_BLIT_COPY = 0,
+	//! 8-bit unsigned channels remapped between channel counts
+	IMAGE_BLIT_BYTES,
+	//! Conversion through normalized floating point RGBA
+	IMAGE_BLIT_CONVERT
+} image_blit_mode_t;
+
+static bool
+image_blit_layout_equal(const image_pixelformat_t* first, const image_pixelformat_t* second) {
+	if ((first->compression != second->compression) || (first->bits_per_pixel != second->bits_per_pixel) ||
+	    (first->block_width != second->block_width) || (first->block_height != second->block_height) ||
+	    (first->bits_per_block != second->bits_per_block))
+		return false;
+	for (unsigned int ich = 0; ich < IMAGE_CHANNEL_COUNT; ++ich) {
+		const image_channel_format_t* first_channel = first->channel + ich;
+		const image_channel_format_t* second_channel = second->channel + ich;
+		if ((first_channel->data_type != second_channel->data_type) ||
+		    (first_channel->bits_per_pixel != second_channel->bits_per_pixel) ||
+		    (first_channel->offset != second_channel->offset))
+			return false;
+	}
+	return true;
+}
+
+static unsigned int
+image_blit_byte_channels(const image_pixelformat_t* pixelformat) {
+	image_datatype_t data_type;
+	unsigned int bits_per_channel;
+	if (image_pixelformat_is_uniform(pixelformat, &data_type, &bits_per_channel) &&
+	    (data_type == IMAGE_DATATYPE_UNSIGNED_INT) && (bits_per_channel == 8))
+		return pixelformat->channels_count;
+	return 0;
+}
+
+//! Remap 8-bit channels, missing color channels are set to zero and missing alpha to 255
+static void
+image_blit_bytes(uint8_t* dest, unsigned int dest_channels, const uint8_t* source, unsigned int source_channels,
+                 size_t count) {
+	if ((source_channels == 3) && (dest_channels == 4)) {
+		for (size_t ipixel = 0; ipixel < count; ++ipixel, dest += 4, source += 3) {
+			dest[0] = source[0];
+			dest[1] = source[1];
+			dest[2] = source[2];
+			dest[3] = 0xFF;
+		}
+	} else if ((source_channels == 4) && (dest_channels == 3)) {
+		for (size_t ipixel = 0; ipixel < count; ++ipixel, dest += 3, source += 4) {
+			dest[0] = source[0];
+			dest[1] = source[1];
+			dest[2] = source[2];
+		}
+	} else {
+		for (size_t ipixel = 0; ipixel < count; ++ipixel, dest += dest_channels, source += source_channels) {
+			for (unsigned int ich = 0; ich < dest_channels; ++ich)
+				dest[ich] = (ich < source_channels) ? source[ich] : ((ich == IMAGE_CHANNEL_ALPHA) ? 0xFF : 0);
+		}
+	}
+}
+
+static bool
+image_blit_blocks(image_t* dst, unsigned int dst_level, unsigned int dx, unsigned int dy, const image_t* src,
+                  unsigned int src_level, const image_rect_t* rect) {
+	const image_pixelformat_t* format = &src->format;
+	unsigned int src_width = image_width(src, src_level);
+	unsigned int src_height = image_height(src, src_level);
+	unsigned int dst_width = image_width(dst, dst_level);
+	unsigned int dst_height = image_height(dst, dst_level);
+	unsigned int block_width = format->block_width;
+	unsigned int block_height = format->block_height ? format->block_height : 1;
+	bool partial_x = (rect->x + rect->width == src_width) && (dx + rect->width == dst_width);
+	bool partial_y = (rect->y + rect->height == src_height) && (dy + rect->height == dst_height);
+	if ((rect->x % block_width) || (rect->y % block_height) || (dx % block_width) || (dy % block_height) ||
+	    ((rect->width % block_width) && !partial_x) || ((rect->height % block_height) && !partial_y)) {
+		log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE,
+		          STRING_CONST("Blit of block compressed image is not aligned to %ux%u blocks"), block_width,
+		          block_height);
+		return false;
+	}
+
+	size_t block_size = format->bits_per_block / 8;
+	size_t src_stride = ((src_width + block_width - 1) / block_width) * block_size;
+	size_t dst_stride = ((dst_width + block_width - 1) / block_width) * block_size;
+	size_t row_size = ((rect->width + block_width - 1) / block_width) * block_size;
+	size_t row_count = (rect->height + block_height - 1) / block_height;
+	const uint8_t* source = image_buffer((image_t*)src, src_level);
+	uint8_t* dest = image_buffer(dst, dst_level);
+	source += (rect->y / block_height) * src_stride + (rect->x / block_width) * block_size;
+	dest += (dy / block_height) * dst_stride + (dx / block_width) * block_size;
+	bool reverse = (src == dst) && (src_level == dst_level) && (source < dest);
+	for (size_t irow = 0; irow < row_count; ++irow) {
+		size_t row = reverse ? (row_count - irow - 1) : irow;
+		memmove(dest + row * dst_stride, source + row * src_stride, row_size);
+	}
+	return true;
+}
+
+bool
+image_blit(image_t* dst, unsigned int dst_level, unsigned int dx, unsigned int dy, const image_t* src,
+           unsigned int src_level, const image_rect_t* rect) {
+	if (!dst->data || !src->data || (dst_level >= dst->levels) || (src_level >= src->levels))
+		return false;
+	if ((image_layers(dst) > 1) || (image_layers(src) > 1)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Image blit does not support array layers"));
+		return false;
+	}
+
+	unsigned int src_width = image_width(src, src_level);
+	unsigned int src_height = image_height(src, src_level);
+	unsigned int dst_width = image_width(dst, dst_level);
+	unsigned int dst_height = image_height(dst, dst_level);
+	image_rect_t clipped = {0, 0, src_width, src_height};
+	if (rect)
+		clipped = *rect;
+	if ((clipped.x >= src_width) || (clipped.y >= src_height) || (dx >= dst_width) || (dy >= dst_height))
+		return true;
+	if (clipped.width > src_width - clipped.x)
+		clipped.width = src_width - clipped.x;
+	if (clipped.height > src_height - clipped.y)
+		clipped.height = src_height - clipped.y;
+	if (clipped.width > dst_width - dx)
+		clipped.width = dst_width - dx;
+	if (clipped.height > dst_height - dy)
+		clipped.height = dst_height - dy;
+	if (!clipped.width || !clipped.height)
+		return true;
+
+	const image_pixelformat_t* src_format = &src->format;
+	const image_pixelformat_t* dst_format = &dst->format;
+	bool layout_equal = image_blit_layout_equal(src_format, dst_format);
+	if ((src_format->compression != IMAGE_COMPRESSION_NONE) || (dst_format->compression != IMAGE_COMPRESSION_NONE)) {
+		bool twiddled = (src_format->compression >= IMAGE_COMPRESSION_PVRTC_2BPP) &&
+		                (src_format->compression <= IMAGE_COMPRESSION_PVRTC2_4BPP);
+		if (!layout_equal || twiddled || !src_format->block_width || (src_format->bits_per_block % 8)) {
+			log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+			         STRING_CONST("Blit of block compressed images requires identical block linear formats"));
+			return false;
+		}
+		return image_blit_blocks(dst, dst_level, dx, dy, src, src_level, &clipped);
+	}
+	if (!src_format->bits_per_pixel || !dst_format->bits_per_pixel || (src_format->bits_per_pixel % 8) ||
+	    (dst_format->bits_per_pixel % 8)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Blit requires byte aligned pixel formats"));
+		return false;
+	}
+
+	image_blit_mode_t mode = IMAGE_BLIT_CONVERT;
+	unsigned int src_channels = image_blit_byte_channels(src_format);
+	unsigned int dst_channels = image_blit_byte_channels(dst_format);
+	if (layout_equal)
+		mode = IMAGE_BLIT_COPY;
+	else if (src_channels && dst_channels)
+		mode = IMAGE_BLIT_BYTES;
+
+	size_t src_pixel_size = src_format->bits_per_pixel / 8;
+	size_t dst_pixel_size = dst_format->bits_per_pixel / 8;
+	size_t src_stride = src_pixel_size * src_width;
+	size_t dst_stride = dst_pixel_size * dst_width;
+	const uint8_t* source = image_buffer((image_t*)src, src_level);
+	uint8_t* dest = image_buffer(dst, dst_level);
+	source += clipped.y * src_stride + clipped.x * src_pixel_size;
+	dest += dy * dst_stride + dx * dst_pixel_size;
+
+	if (mode != IMAGE_BLIT_COPY)
+		image_trace_begin(IMAGE_TRACE_CONVERT);
+	float32_t* rgba = 0;
+	if (mode == IMAGE_BLIT_CONVERT)
+		rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * clipped.width, 0, MEMORY_PERSISTENT);
+
+	// Overlapping regions within the same image level are copied bottom up when moving down
+	bool reverse = (src == dst) && (src_level == dst_level) && (source < dest);
+	for (unsigned int irow = 0; irow < clipped.height; ++irow) {
+		size_t row = reverse ? (clipped.height - irow - 1) : irow;
+		const uint8_t* source_row = source + row * src_stride;
+		uint8_t* dest_row = dest + row * dst_stride;
+		if (mode == IMAGE_BLIT_COPY) {
+			memmove(dest_row, source_row, src_pixel_size * clipped.width);
+		} else if (mode == IMAGE_BLIT_BYTES) {
+			image_blit_bytes(dest_row, dst_channels, source_row, src_channels, clipped.width);
+		} else {
+			image_pixel_read(src_format, source_row, clipped.width, rgba);
+			image_pixel_write(dst_format, dest_row, clipped.width, rgba);
+		}
+	}
+
+	if (rgba)
+		memory_deallocate(rgba);
+	if (mode != IMAGE_BLIT_COPY)
+		image_trace_end(IMAGE_TRACE_CONVERT);
+	return true;
+}
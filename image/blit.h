@@ -0,0 +1,45 @@
+/* blit.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file blit.h
+    Copying of rectangular regions between images */
+
+#include <image/types.h>
+
+/*! Copy a rectangle of a source image mip level into a destination image mip level,
+converting pixel format on the fly. The rectangle is clipped to the source and
+destination bounds. Identical formats are copied row by row, 8-bit unsigned formats
+with different channel counts are remapped directly, and other format pairs are
+converted through normalized floating point as by #image_pixel_read and
+#image_pixel_write. Block compressed images can only be copied to images of identical
+format at block aligned positions, where partial blocks are only allowed at the edges
+of both images. Volume images are copied from and into the first depth slice, array
+and cubemap images are not supported. Source and destination can be the same image.
+\param dst       Destination image
+\param dst_level Destination mip level
+\param dx        Destination x coordinate
+\param dy        Destination y coordinate
+\param src       Source image
+\param src_level Source mip level
+\param rect      Source rectangle, null for the whole source level
+\return          true if successful, false if the formats or block alignment are not supported */
+IMAGE_API bool
+image_blit(image_t* dst, unsigned int dst_level, unsigned int dx, unsigned int dy, const image_t* src,
+           unsigned int src_level, const image_rect_t* rect);
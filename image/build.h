@@ -22,3 +22,8 @@
     Build setup */
 
 #include <foundation/platform.h>
+
+/*! Set to 0 to compile out recording of structured load events, see loadevent.h */
+#ifndef IMAGE_ENABLE_LOAD_EVENTS
+#define IMAGE_ENABLE_LOAD_EVENTS 1
+#endif
@@ -0,0 +1,401 @@
+/* cache.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "cache.h"
+
+//! Number of independently locked shards, must be a power of two
+#define IMAGE_CACHE_SHARDS 16
+#define IMAGE_CACHE_SHARD_BITS 4
+#define IMAGE_CACHE_INITIAL_BUCKETS 64
+
+typedef struct image_cache_entry_t image_cache_entry_t;
+typedef struct image_cache_shard_t image_cache_shard_t;
+
+struct image_cache_entry_t {
+	//! Image must be first to map shared image pointers back to entries
+	image_t image;
+	hash_t key;
+	size_t size;
+	//! Access stamp, increasing with each access across all shards
+	uint64_t access;
+	//! References held by users, plus one while the entry is in the cache
+	atomic32_t ref;
+	image_cache_entry_t* hash_next;
+	//! Least recently used list, head is most recently used
+	image_cache_entry_t* lru_prev;
+	image_cache_entry_t* lru_next;
+};
+
+struct image_cache_shard_t {
+	mutex_t* lock;
+	image_cache_entry_t** bucket;
+	size_t bucket_count;
+	size_t count;
+	image_cache_entry_t* lru_head;
+	image_cache_entry_t* lru_tail;
+};
+
+static image_cache_shard_t image_cache_shard[IMAGE_CACHE_SHARDS];
+static size_t image_cache_budget;
+static atomic64_t image_cache_size;
+static atomic64_t image_cache_access;
+static atomic64_t image_cache_hits;
+static atomic64_t image_cache_misses;
+static atomic64_t image_cache_evictions;
+
+void
+image_cache_initialize(void);
+
+void
+image_cache_finalize(void);
+
+static image_cache_shard_t*
+image_cache_shard_for_key(hash_t key) {
+	return image_cache_shard + (key >> (64 - IMAGE_CACHE_SHARD_BITS));
+}
+
+static void
+image_cache_entry_release(image_cache_entry_t* entry) {
+	if (atomic_decr32(&entry->ref, memory_order_acq_rel) == 0) {
+		image_finalize(&entry->image);
+		memory_deallocate(entry);
+	}
+}
+
+static void
+image_cache_lru_unlink(image_cache_shard_t* shard, image_cache_entry_t* entry) {
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		shard->lru_head = entry->lru_next;
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		shard->lru_tail = entry->lru_prev;
+	entry->lru_prev = 0;
+	entry->lru_next = 0;
+}
+
+static void
+image_cache_lru_push(image_cache_shard_t* shard, image_cache_entry_t* entry) {
+	entry->access = (uint64_t)atomic_incr64(&image_cache_access, memory_order_relaxed);
+	entry->lru_prev = 0;
+	entry->lru_next = shard->lru_head;
+	if (shard->lru_head)
+		shard->lru_head->lru_prev = entry;
+	else
+		shard->lru_tail = entry;
+	shard->lru_head = entry;
+}
+
+static image_cache_entry_t*
+image_cache_find(image_cache_shard_t* shard, hash_t key) {
+	image_cache_entry_t* entry = shard->bucket[key & (shard->bucket_count - 1)];
+	while (entry && (entry->key != key))
+		entry = entry->hash_next;
+	return entry;
+}
+
+static void
+image_cache_unlink(image_cache_shard_t* shard, image_cache_entry_t* entry) {
+	image_cache_entry_t** link = &shard->bucket[entry->key & (shard->bucket_count - 1)];
+	while (*link != entry)
+		link = &(*link)->hash_next;
+	*link = entry->hash_next;
+	entry->hash_next = 0;
+	image_cache_lru_unlink(shard, entry);
+	--shard->count;
+	atomic_add64(&image_cache_size, -(int64_t)entry->size, memory_order_release);
+}
+
+static void
+image_cache_grow(image_cache_shard_t* shard) {
+	size_t bucket_count = shard->bucket_count * 2;
+	image_cache_entry_t** bucket = memory_allocate(HASH_IMAGE, sizeof(image_cache_entry_t*) * bucket_count, 0,
+	                                               MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+	for (size_t ibucket = 0; ibucket < shard->bucket_count; ++ibucket) {
+		image_cache_entry_t* entry = shard->bucket[ibucket];
+		while (entry) {
+			image_cache_entry_t* next = entry->hash_next;
+			size_t index = entry->key & (bucket_count - 1);
+			entry->hash_next = bucket[index];
+			bucket[index] = entry;
+			entry = next;
+		}
+	}
+	memory_deallocate(shard->bucket);
+	shard->bucket = bucket;
+	shard->bucket_count = bucket_count;
+}
+
+static image_t*
+image_cache_lookup(hash_t key) {
+	image_cache_shard_t* shard = image_cache_shard_for_key(key);
+	image_cache_entry_t* entry = 0;
+	if (!shard->lock)
+		return 0;
+	mutex_lock(shard->lock);
+	entry = image_cache_find(shard, key);
+	if (entry) {
+		atomic_incr32(&entry->ref, memory_order_relaxed);
+		image_cache_lru_unlink(shard, entry);
+		image_cache_lru_push(shard, entry);
+	}
+	mutex_unlock(shard->lock);
+	if (entry)
+		atomic_incr64(&image_cache_hits, memory_order_relaxed);
+	return entry ? &entry->image : 0;
+}
+
+//! Evict least recently used entries until the cache is within budget, never evicting
+//! the entry just inserted. Each shard tail is the oldest entry in that shard, so the
+//! globally oldest entry is the tail with the lowest access stamp. Only one shard lock is
+//! held at a time.
+static void
+image_cache_evict(image_cache_entry_t* keep) {
+	while ((size_t)atomic_load64(&image_cache_size, memory_order_acquire) > image_cache_budget) {
+		image_cache_shard_t* oldest = 0;
+		uint64_t oldest_access = 0;
+		for (size_t ishard = 0; ishard < IMAGE_CACHE_SHARDS; ++ishard) {
+			image_cache_shard_t* shard = image_cache_shard + ishard;
+			mutex_lock(shard->lock);
+			image_cache_entry_t* tail = shard->lru_tail;
+			if (tail && (tail != keep) && (!oldest || (tail->access < oldest_access))) {
+				oldest = shard;
+				oldest_access = tail->access;
+			}
+			mutex_unlock(shard->lock);
+		}
+		if (!oldest)
+			break;
+
+		// Tail may have been accessed or evicted since it was inspected, if so try again
+		image_cache_entry_t* evicted = 0;
+		mutex_lock(oldest->lock);
+		if (oldest->lru_tail && (oldest->lru_tail->access == oldest_access)) {
+			evicted = oldest->lru_tail;
+			image_cache_unlink(oldest, evicted);
+		}
+		mutex_unlock(oldest->lock);
+
+		if (evicted) {
+			atomic_incr64(&image_cache_evictions, memory_order_relaxed);
+			image_cache_entry_release(evicted);
+		}
+	}
+}
+
+//! Insert a decoded image, returns the shared image which is an existing entry if another
+//! thread inserted the same key first
+static image_t*
+image_cache_insert(hash_t key, image_t* image) {
+	image_cache_entry_t* entry = memory_allocate(HASH_IMAGE, sizeof(image_cache_entry_t), 0, MEMORY_PERSISTENT);
+	entry->image = *image;
+	entry->key = key;
+	entry->size = sizeof(image_cache_entry_t) +
+	              (image->mapping ? image->mapping_size : image_data_size(image));
+	entry->hash_next = 0;
+	entry->lru_prev = 0;
+	entry->lru_next = 0;
+	atomic_store32(&entry->ref, 1, memory_order_release);
+
+	image_cache_shard_t* shard = image_cache_shard_for_key(key);
+	if (!shard->lock || (entry->size > image_cache_budget))
+		return &entry->image;
+
+	mutex_lock(shard->lock);
+	image_cache_entry_t* existing = image_cache_find(shard, key);
+	if (existing) {
+		atomic_incr32(&existing->ref, memory_order_relaxed);
+		image_cache_lru_unlink(shard, existing);
+		image_cache_lru_push(shard, existing);
+	} else {
+		if (shard->count >= shard->bucket_count * 2)
+			image_cache_grow(shard);
+		size_t index = key & (shard->bucket_count - 1);
+		entry->hash_next = shard->bucket[index];
+		shard->bucket[index] = entry;
+		image_cache_lru_push(shard, entry);
+		++shard->count;
+		// Reference held by the cache
+		atomic_incr32(&entry->ref, memory_order_relaxed);
+		atomic_add64(&image_cache_size, (int64_t)entry->size, memory_order_release);
+	}
+	mutex_unlock(shard->lock);
+
+	if (existing) {
+		image_cache_entry_release(entry);
+		return &existing->image;
+	}
+
+	image_cache_evict(entry);
+	return &entry->image;
+}
+
+image_t*
+image_cache_load(const char* path, size_t length) {
+	struct {
+		hash_t path;
+		tick_t modified;
+	} identity;
+	identity.path = hash(path, length);
+	identity.modified = fs_last_modified(path, length);
+	hash_t key = hash(&identity, sizeof(identity));
+
+	image_t* shared = image_cache_lookup(key);
+	if (shared)
+		return shared;
+
+	atomic_incr64(&image_cache_misses, memory_order_relaxed);
+	stream_t* stream = stream_open(path, length, STREAM_IN | STREAM_BINARY);
+	if (!stream)
+		return 0;
+	image_t image;
+	image_initialize(&image);
+	bool loaded = image_load(&image, stream);
+	stream_deallocate(stream);
+	if (!loaded) {
+		image_finalize(&image);
+		return 0;
+	}
+	return image_cache_insert(key, &image);
+}
+
+image_t*
+image_cache_load_stream(stream_t* stream) {
+	size_t begin = stream_tell(stream);
+	size_t size = stream_size(stream);
+	size = (size > begin) ? size - begin : 0;
+	if (!size)
+		return 0;
+
+	void* buffer = memory_allocate(HASH_IMAGE, size, 0, MEMORY_PERSISTENT);
+	size = stream_read(stream, buffer, size);
+	hash_t key = hash(buffer, size);
+
+	image_t* shared = image_cache_lookup(key);
+	if (shared) {
+		memory_deallocate(buffer);
+		return shared;
+	}
+
+	atomic_incr64(&image_cache_misses, memory_order_relaxed);
+	stream_t* source = buffer_stream_allocate(buffer, STREAM_IN | STREAM_BINARY, size, size, true, false);
+	image_t image;
+	image_initialize(&image);
+	bool loaded = image_load(&image, source);
+	stream_deallocate(source);
+	if (!loaded) {
+		image_finalize(&image);
+		return 0;
+	}
+	return image_cache_insert(key, &image);
+}
+
+image_t*
+image_cache_retain(image_t* image) {
+	image_cache_entry_t* entry = (image_cache_entry_t*)image;
+	atomic_incr32(&entry->ref, memory_order_relaxed);
+	return image;
+}
+
+void
+image_cache_release(image_t* image) {
+	if (image)
+		image_cache_entry_release((image_cache_entry_t*)image);
+}
+
+void
+image_cache_clear(void) {
+	for (size_t ishard = 0; ishard < IMAGE_CACHE_SHARDS; ++ishard) {
+		image_cache_shard_t* shard = image_cache_shard + ishard;
+		if (!shard->lock)
+			continue;
+		image_cache_entry_t* evicted = 0;
+		mutex_lock(shard->lock);
+		while (shard->lru_tail) {
+			image_cache_entry_t* entry = shard->lru_tail;
+			image_cache_unlink(shard, entry);
+			entry->hash_next = evicted;
+			evicted = entry;
+		}
+		mutex_unlock(shard->lock);
+
+		while (evicted) {
+			image_cache_entry_t* next = evicted->hash_next;
+			image_cache_entry_release(evicted);
+			evicted = next;
+		}
+	}
+}
+
+void
+image_cache_statistics(image_cache_statistics_t* statistics) {
+	size_t count = 0;
+	for (size_t ishard = 0; ishard < IMAGE_CACHE_SHARDS; ++ishard) {
+		image_cache_shard_t* shard = image_cache_shard + ishard;
+		if (!shard->lock)
+			continue;
+		mutex_lock(shard->lock);
+		count += shard->count;
+		mutex_unlock(shard->lock);
+	}
+	statistics->hits = (size_t)atomic_load64(&image_cache_hits, memory_order_acquire);
+	statistics->misses = (size_t)atomic_load64(&image_cache_misses, memory_order_acquire);
+	statistics->evictions = (size_t)atomic_load64(&image_cache_evictions, memory_order_acquire);
+	statistics->count = count;
+	statistics->size = (size_t)atomic_load64(&image_cache_size, memory_order_acquire);
+	statistics->budget = image_cache_budget;
+}
+
+void
+image_cache_initialize(void) {
+	image_cache_budget = image_module_config().cache_budget;
+	atomic_store64(&image_cache_size, 0, memory_order_release);
+	atomic_store64(&image_cache_access, 0, memory_order_release);
+	atomic_store64(&image_cache_hits, 0, memory_order_release);
+	atomic_store64(&image_cache_misses, 0, memory_order_release);
+	atomic_store64(&image_cache_evictions, 0, memory_order_release);
+	for (size_t ishard = 0; ishard < IMAGE_CACHE_SHARDS; ++ishard) {
+		image_cache_shard_t* shard = image_cache_shard + ishard;
+		shard->lock = mutex_allocate(STRING_CONST("image_cache"));
+		shard->bucket_count = IMAGE_CACHE_INITIAL_BUCKETS;
+		shard->bucket = memory_allocate(HASH_IMAGE, sizeof(image_cache_entry_t*) * shard->bucket_count, 0,
+		                                MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+		shard->count = 0;
+		shard->lru_head = 0;
+		shard->lru_tail = 0;
+	}
+}
+
+void
+image_cache_finalize(void) {
+	image_cache_clear();
+	for (size_t ishard = 0; ishard < IMAGE_CACHE_SHARDS; ++ishard) {
+		image_cache_shard_t* shard = image_cache_shard + ishard;
+		if (shard->bucket)
+			memory_deallocate(shard->bucket);
+		if (shard->lock)
+			mutex_deallocate(shard->lock);
+		shard->bucket = 0;
+		shard->lock = 0;
+	}
+}
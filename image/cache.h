@@ -0,0 +1,62 @@
+/* cache.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file cache.h
+    Decoded image cache with a memory budget and least recently used eviction. Images
+    returned from the cache are reference counted and shared between all users, and must
+    be treated as read only. An image evicted from the cache stays valid until the last
+    reference is released. */
+
+#include <image/types.h>
+
+/*! Load an image file through the cache, keyed by path and file modification time
+\param path   File path
+\param length Length of file path
+\return       Shared image, null if image could not be loaded. Release with #image_cache_release */
+IMAGE_API image_t*
+image_cache_load(const char* path, size_t length);
+
+/*! Load an image from a stream through the cache, keyed by a hash of the stream content
+from the current position to the end of the stream
+\param stream Source stream
+\return       Shared image, null if image could not be loaded. Release with #image_cache_release */
+IMAGE_API image_t*
+image_cache_load_stream(stream_t* stream);
+
+/*! Add a reference to a shared image
+\param image Image returned from the cache
+\return      Same image */
+IMAGE_API image_t*
+image_cache_retain(image_t* image);
+
+/*! Release a reference to a shared image, the image is deallocated when the last
+reference is released and the image is no longer in the cache
+\param image Image returned from the cache */
+IMAGE_API void
+image_cache_release(image_t* image);
+
+/*! Evict all images from the cache. Images still referenced stay valid until released. */
+IMAGE_API void
+image_cache_clear(void);
+
+/*! Query cache statistics
+\param statistics Statistics structure to fill */
+IMAGE_API void
+image_cache_statistics(image_cache_statistics_t* statistics);
@@ -0,0 +1,291 @@
+/* compare.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "compare.h"
+
+#define IMAGE_COMPARE_BLOCK 4
+#define IMAGE_COMPARE_MAX_CHUNKS 64
+
+//! SSIM stabilizing constants for a dynamic range of one
+#define IMAGE_COMPARE_SSIM_C1 (0.01 * 0.01)
+#define IMAGE_COMPARE_SSIM_C2 (0.03 * 0.03)
+
+typedef struct image_compare_sums_t image_compare_sums_t;
+typedef struct image_compare_partial_t image_compare_partial_t;
+typedef struct image_compare_job_t image_compare_job_t;
+
+//! Per channel sums over a set of pixels, from which SSIM is computed
+struct image_compare_sums_t {
+	float64_t sum_a[4];
+	float64_t sum_b[4];
+	//! Sum of squares of both images
+	float64_t sum_squares[4];
+	float64_t sum_ab[4];
+};
+
+//! Results of one chunk of block rows, merged in order after the parallel pass
+struct image_compare_partial_t {
+	float64_t squared_error[4];
+	float64_t max_error[4];
+	float64_t ssim[4];
+	image_compare_sums_t total;
+};
+
+struct image_compare_job_t {
+	const image_pixelformat_t* format_a;
+	const image_pixelformat_t* format_b;
+	const uint8_t* data_a;
+	const uint8_t* data_b;
+	size_t row_size_a;
+	size_t row_size_b;
+	size_t width;
+	size_t rows;
+	//! Number of complete 4x4 blocks in each dimension
+	size_t block_columns;
+	size_t block_rows;
+	size_t grain;
+	image_compare_partial_t* partial;
+};
+
+static void
+image_compare_sums_add(image_compare_sums_t* sums, const float32_t* a, const float32_t* b, size_t count) {
+	for (size_t ipixel = 0; ipixel < count; ++ipixel, a += 4, b += 4) {
+		for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+			float64_t value_a = a[ichannel];
+			float64_t value_b = b[ichannel];
+			sums->sum_a[ichannel] += value_a;
+			sums->sum_b[ichannel] += value_b;
+			sums->sum_squares[ichannel] += value_a * value_a + value_b * value_b;
+			sums->sum_ab[ichannel] += value_a * value_b;
+		}
+	}
+}
+
+static float64_t
+image_compare_ssim(const image_compare_sums_t* sums, unsigned int channel, float64_t count) {
+	float64_t mean_a = sums->sum_a[channel] / count;
+	float64_t mean_b = sums->sum_b[channel] / count;
+	float64_t variance = sums->sum_squares[channel] / count - mean_a * mean_a - mean_b * mean_b;
+	float64_t covariance = sums->sum_ab[channel] / count - mean_a * mean_b;
+	return ((2 * mean_a * mean_b + IMAGE_COMPARE_SSIM_C1) * (2 * covariance + IMAGE_COMPARE_SSIM_C2)) /
+	       ((mean_a * mean_a + mean_b * mean_b + IMAGE_COMPARE_SSIM_C1) * (variance + IMAGE_COMPARE_SSIM_C2));
+}
+
+//! Accumulate squared and maximum absolute error over rows of RGBA values
+static void
+image_compare_error(image_compare_partial_t* partial, const float32_t* a, const float32_t* b, size_t count) {
+	float64_t squared_error[4] = {0, 0, 0, 0};
+	float32_t max_error[4] = {0, 0, 0, 0};
+	for (size_t ipixel = 0; ipixel < count; ++ipixel, a += 4, b += 4) {
+		for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+			float32_t error = a[ichannel] - b[ichannel];
+			float32_t absolute = (error < 0) ? -error : error;
+			squared_error[ichannel] += (float64_t)error * error;
+			max_error[ichannel] = (absolute > max_error[ichannel]) ? absolute : max_error[ichannel];
+		}
+	}
+	for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+		partial->squared_error[ichannel] += squared_error[ichannel];
+		if (max_error[ichannel] > partial->max_error[ichannel])
+			partial->max_error[ichannel] = max_error[ichannel];
+	}
+}
+
+//! Process groups of four rows [begin, end). The group following the range is read as well
+//! when present, since 8x8 windows starting in the last group extend into it
+static void
+image_compare_rows(void* arg, size_t begin, size_t end) {
+	image_compare_job_t* job = arg;
+	image_compare_partial_t* partial = job->partial + (begin / job->grain);
+	size_t width = job->width;
+	size_t group_size = width * 4 * IMAGE_COMPARE_BLOCK;
+	size_t block_count = job->block_columns ? job->block_columns : 1;
+	float32_t* rgba_a = memory_allocate(HASH_IMAGE, sizeof(float32_t) * group_size * 2, 0, MEMORY_PERSISTENT);
+	float32_t* rgba_b = rgba_a + group_size;
+	image_compare_sums_t* blocks = memory_allocate(HASH_IMAGE, sizeof(image_compare_sums_t) * block_count * 2, 0,
+	                                               MEMORY_PERSISTENT);
+	image_compare_sums_t* previous = blocks;
+	image_compare_sums_t* current = blocks + block_count;
+
+	size_t group_count = (job->rows + IMAGE_COMPARE_BLOCK - 1) / IMAGE_COMPARE_BLOCK;
+	size_t last = (end < job->block_rows) ? end : (end - 1);
+	for (size_t igroup = begin; (igroup <= last) && (igroup < group_count); ++igroup) {
+		size_t first_row = igroup * IMAGE_COMPARE_BLOCK;
+		size_t row_count = job->rows - first_row;
+		if (row_count > IMAGE_COMPARE_BLOCK)
+			row_count = IMAGE_COMPARE_BLOCK;
+		for (size_t irow = 0; irow < row_count; ++irow) {
+			image_pixel_read(job->format_a, job->data_a + job->row_size_a * (first_row + irow), width,
+			                 rgba_a + irow * width * 4);
+			image_pixel_read(job->format_b, job->data_b + job->row_size_b * (first_row + irow), width,
+			                 rgba_b + irow * width * 4);
+		}
+
+		if (igroup < end) {
+			image_compare_error(partial, rgba_a, rgba_b, width * row_count);
+			image_compare_sums_add(&partial->total, rgba_a, rgba_b, width * row_count);
+		}
+		if ((igroup >= job->block_rows) || !job->block_columns)
+			continue;
+
+		memset(current, 0, sizeof(image_compare_sums_t) * job->block_columns);
+		for (size_t irow = 0; irow < IMAGE_COMPARE_BLOCK; ++irow) {
+			const float32_t* row_a = rgba_a + irow * width * 4;
+			const float32_t* row_b = rgba_b + irow * width * 4;
+			for (size_t iblock = 0; iblock < job->block_columns; ++iblock)
+				image_compare_sums_add(current + iblock, row_a + iblock * IMAGE_COMPARE_BLOCK * 4,
+				                       row_b + iblock * IMAGE_COMPARE_BLOCK * 4, IMAGE_COMPARE_BLOCK);
+		}
+
+		// Each window covers 2x2 blocks, its top row of blocks being the previous group
+		if (igroup > begin) {
+			for (size_t iwindow = 0; iwindow + 1 < job->block_columns; ++iwindow) {
+				image_compare_sums_t window;
+				for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+					window.sum_a[ichannel] = previous[iwindow].sum_a[ichannel] +
+					                         previous[iwindow + 1].sum_a[ichannel] +
+					                         current[iwindow].sum_a[ichannel] + current[iwindow + 1].sum_a[ichannel];
+					window.sum_b[ichannel] = previous[iwindow].sum_b[ichannel] +
+					                         previous[iwindow + 1].sum_b[ichannel] +
+					                         current[iwindow].sum_b[ichannel] + current[iwindow + 1].sum_b[ichannel];
+					window.sum_squares[ichannel] =
+					    previous[iwindow].sum_squares[ichannel] + previous[iwindow + 1].sum_squares[ichannel] +
+					    current[iwindow].sum_squares[ichannel] + current[iwindow + 1].sum_squares[ichannel];
+					window.sum_ab[ichannel] = previous[iwindow].sum_ab[ichannel] +
+					                          previous[iwindow + 1].sum_ab[ichannel] +
+					                          current[iwindow].sum_ab[ichannel] + current[iwindow + 1].sum_ab[ichannel];
+				}
+				for (unsigned int ichannel = 0; ichannel < 4; ++ichannel)
+					partial->ssim[ichannel] += image_compare_ssim(&window, ichannel, 64.0);
+			}
+		}
+		image_compare_sums_t* swap = previous;
+		previous = current;
+		current = swap;
+	}
+
+	memory_deallocate(blocks);
+	memory_deallocate(rgba_a);
+}
+
+static bool
+image_compare_level(const image_t* a, const image_t* b, unsigned int level, image_compare_metrics_t* metrics) {
+	image_compare_job_t job;
+	job.format_a = &a->format;
+	job.format_b = &b->format;
+	job.data_a = image_buffer((image_t*)a, level);
+	job.data_b = image_buffer((image_t*)b, level);
+	job.width = image_width(a, level);
+	job.rows = (size_t)image_height(a, level) * image_depth(a, level) * image_layers(a);
+	job.row_size_a = ((size_t)a->format.bits_per_pixel * job.width) / 8;
+	job.row_size_b = ((size_t)b->format.bits_per_pixel * job.width) / 8;
+	job.block_columns = job.width / IMAGE_COMPARE_BLOCK;
+	job.block_rows = job.rows / IMAGE_COMPARE_BLOCK;
+	if (job.block_columns < 2)
+		job.block_columns = 0;
+
+	size_t group_count = (job.rows + IMAGE_COMPARE_BLOCK - 1) / IMAGE_COMPARE_BLOCK;
+	size_t chunk_count = (group_count < IMAGE_COMPARE_MAX_CHUNKS) ? group_count : IMAGE_COMPARE_MAX_CHUNKS;
+	job.grain = (group_count + chunk_count - 1) / chunk_count;
+	chunk_count = (group_count + job.grain - 1) / job.grain;
+	job.partial = memory_allocate(HASH_IMAGE, sizeof(image_compare_partial_t) * chunk_count, 0,
+	                              MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+
+	image_parallel_for(group_count, job.grain, image_compare_rows, &job);
+
+	image_compare_partial_t total;
+	memset(&total, 0, sizeof(total));
+	for (size_t ichunk = 0; ichunk < chunk_count; ++ichunk) {
+		const image_compare_partial_t* partial = job.partial + ichunk;
+		for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+			total.squared_error[ichannel] += partial->squared_error[ichannel];
+			if (partial->max_error[ichannel] > total.max_error[ichannel])
+				total.max_error[ichannel] = partial->max_error[ichannel];
+			total.ssim[ichannel] += partial->ssim[ichannel];
+			total.total.sum_a[ichannel] += partial->total.sum_a[ichannel];
+			total.total.sum_b[ichannel] += partial->total.sum_b[ichannel];
+			total.total.sum_squares[ichannel] += partial->total.sum_squares[ichannel];
+			total.total.sum_ab[ichannel] += partial->total.sum_ab[ichannel];
+		}
+	}
+	memory_deallocate(job.partial);
+
+	// Images too small for a single 8x8 window are treated as one window
+	size_t windows = job.block_columns ? (job.block_columns - 1) * (job.block_rows ? job.block_rows - 1 : 0) : 0;
+	metrics->pixels = (uint64_t)job.width * job.rows;
+	for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+		float64_t mse = total.squared_error[ichannel] / (float64_t)metrics->pixels;
+		metrics->mse[ichannel] = mse;
+		metrics->psnr[ichannel] = (mse > 0) ? 10.0 * log10(1.0 / mse) : DBL_MAX;
+		metrics->max_error[ichannel] = total.max_error[ichannel];
+		metrics->ssim[ichannel] = windows ? (total.ssim[ichannel] / (float64_t)windows) :
+		                                    image_compare_ssim(&total.total, ichannel, (float64_t)metrics->pixels);
+	}
+	return true;
+}
+
+static bool
+image_compare_is_supported(const image_t* image) {
+	const image_pixelformat_t* format = &image->format;
+	return (format->compression == IMAGE_COMPRESSION_NONE) && format->bits_per_pixel && !(format->bits_per_pixel % 8);
+}
+
+static bool
+image_compare_is_astc(const image_t* image) {
+	return (image->format.compression == IMAGE_COMPRESSION_ASTC_LDR) ||
+	       (image->format.compression == IMAGE_COMPRESSION_ASTC_HDR);
+}
+
+bool
+image_compare(const image_t* a, const image_t* b, unsigned int level, image_compare_metrics_t* metrics) {
+	memset(metrics, 0, sizeof(image_compare_metrics_t));
+	if (!a->data || !b->data || (level >= a->levels) || (level >= b->levels) ||
+	    (image_width(a, level) != image_width(b, level)) || (image_height(a, level) != image_height(b, level)) ||
+	    (image_depth(a, level) != image_depth(b, level)) || (image_layers(a) != image_layers(b))) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE,
+		         STRING_CONST("Compared images must have matching dimensions and layer counts"));
+		return false;
+	}
+
+	image_t decoded_a;
+	image_t decoded_b;
+	image_initialize(&decoded_a);
+	image_initialize(&decoded_b);
+	bool valid = true;
+	if (image_compare_is_astc(a)) {
+		valid = image_astc_decode(&decoded_a, a);
+		a = &decoded_a;
+	}
+	if (valid && image_compare_is_astc(b)) {
+		valid = image_astc_decode(&decoded_b, b);
+		b = &decoded_b;
+	}
+
+	bool success = false;
+	if (valid && image_compare_is_supported(a) && image_compare_is_supported(b))
+		success = image_compare_level(a, b, level, metrics);
+	else
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported image format for comparison"));
+
+	image_finalize(&decoded_a);
+	image_finalize(&decoded_b);
+	return success;
+}
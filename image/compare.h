@@ -0,0 +1,38 @@
+/* compare.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file compare.h
+    Image quality metrics for comparing a processed image against its source. */
+
+#include <image/types.h>
+
+/*! Compare a mip level of two images with matching dimensions, computing per channel
+mean squared error, PSNR, maximum absolute error and SSIM in a single multithreaded pass.
+Images in different uncompressed formats are converted on the fly to normalized values
+as by #image_pixel_read, ASTC compressed images are decoded first. Depth slices of
+volume images and layers of array and cubemap images are compared as consecutive rows,
+both images must have the same number of layers.
+\param a       First image
+\param b       Second image
+\param level   Mip level
+\param metrics Metrics structure to fill
+\return        true if successful, false if dimensions do not match or a format is not supported */
+IMAGE_API bool
+image_compare(const image_t* a, const image_t* b, unsigned int level, image_compare_metrics_t* metrics);
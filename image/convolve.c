@@ -0,0 +1,437 @@
+/* convolve.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include <math.h>
+
+#include "image.h"
+#include "convolve.h"
+#include "internal.h"
+
+//! Number of columns filtered together in column passes, as a contiguous vector of floats
+#define IMAGE_CONVOLVE_BAND 32
+//! Minimum number of bytes processed per parallel chunk
+#define IMAGE_CONVOLVE_CHUNK_SIZE (64 * 1024)
+//! Standard deviation from which Gaussian blurs use the recursive filter
+#define IMAGE_CONVOLVE_RECURSIVE_SIGMA 3.0f
+
+typedef enum image_convolve_filter_t {
+	//! Weighted sum of kernel taps
+	IMAGE_CONVOLVE_FIR = 0,
+	//! Running sum of a sliding window
+	IMAGE_CONVOLVE_BOX,
+	//! Causal and anti causal third order recursive Gaussian
+	IMAGE_CONVOLVE_RECURSIVE
+} image_convolve_filter_t;
+
+typedef struct image_convolve_pass_t image_convolve_pass_t;
+typedef struct image_convolve_job_t image_convolve_job_t;
+
+//! One dimensional filter applied along rows or columns
+struct image_convolve_pass_t {
+	image_convolve_filter_t filter;
+	//! Number of elements read beyond each end of a line
+	unsigned int radius;
+	//! Kernel weights for FIR filters, 2 * radius + 1 values
+	const float32_t* kernel;
+	//! Input scale and feedback coefficients for recursive filters
+	float32_t coefficient[4];
+};
+
+struct image_convolve_job_t {
+	const image_pixelformat_t* format;
+	//! Pixel data of the filtered slice
+	uint8_t* data;
+	size_t pitch;
+	size_t pixel_size;
+	unsigned int width;
+	unsigned int height;
+	image_edge_t edge;
+	//! Intermediate floating point RGBA plane
+	float32_t* plane;
+	//! Width in pixels of a plane row
+	size_t plane_width;
+	image_convolve_pass_t pass_x;
+	image_convolve_pass_t pass_y;
+	//! Weights and edge length of non-separable kernels
+	const float32_t* kernel;
+	unsigned int size;
+};
+
+unsigned int
+image_convolve_edge(int64_t index, unsigned int count, image_edge_t edge) {
+	if ((index >= 0) && (index < (int64_t)count))
+		return (unsigned int)index;
+	if (edge == IMAGE_EDGE_WRAP) {
+		index %= (int64_t)count;
+		return (unsigned int)((index < 0) ? (index + count) : index);
+	}
+	if ((edge == IMAGE_EDGE_MIRROR) && (count > 1)) {
+		int64_t period = 2 * ((int64_t)count - 1);
+		index %= period;
+		if (index < 0)
+			index = -index;
+		return (unsigned int)((index >= (int64_t)count) ? (period - index) : index);
+	}
+	return (index < 0) ? 0 : (count - 1);
+}
+
+//! Fill the elements outside a padded line from the elements inside it
+static void
+image_convolve_pad(float32_t* line, unsigned int count, unsigned int radius, size_t stride, image_edge_t edge) {
+	float32_t* inner = line + radius * stride;
+	for (unsigned int ipad = 0; ipad < radius; ++ipad) {
+		int64_t before = -(int64_t)radius + ipad;
+		int64_t after = (int64_t)count + ipad;
+		memcpy(line + ipad * stride, inner + image_convolve_edge(before, count, edge) * stride,
+		       sizeof(float32_t) * stride);
+		memcpy(inner + (size_t)after * stride, inner + image_convolve_edge(after, count, edge) * stride,
+		       sizeof(float32_t) * stride);
+	}
+}
+
+//! Filter a padded line of count elements of stride floats each. The inner loops run over
+//! contiguous floats with loop invariant weights, which compilers vectorize for any stride.
+static void
+image_convolve_line(const image_convolve_pass_t* pass, float32_t* line, float32_t* out, unsigned int count,
+                    size_t stride) {
+	size_t total = count * stride;
+	if (pass->filter == IMAGE_CONVOLVE_FIR) {
+		unsigned int size = 2 * pass->radius + 1;
+		float32_t weight = pass->kernel[0];
+		for (size_t ivalue = 0; ivalue < total; ++ivalue)
+			out[ivalue] = weight * line[ivalue];
+		for (unsigned int itap = 1; itap < size; ++itap) {
+			const float32_t* tap = line + itap * stride;
+			weight = pass->kernel[itap];
+			for (size_t ivalue = 0; ivalue < total; ++ivalue)
+				out[ivalue] += weight * tap[ivalue];
+		}
+	} else if (pass->filter == IMAGE_CONVOLVE_BOX) {
+		// Window sums are kept in the first output element and slid one element per step,
+		// accumulating in double precision to avoid drift over long lines
+		unsigned int size = 2 * pass->radius + 1;
+		double sum[IMAGE_CONVOLVE_BAND * 4];
+		float32_t scale = 1.0f / (float32_t)size;
+		for (size_t ivalue = 0; ivalue < stride; ++ivalue)
+			sum[ivalue] = 0;
+		for (unsigned int itap = 0; itap < size; ++itap) {
+			const float32_t* tap = line + itap * stride;
+			for (size_t ivalue = 0; ivalue < stride; ++ivalue)
+				sum[ivalue] += tap[ivalue];
+		}
+		for (unsigned int ielement = 0; ielement < count; ++ielement) {
+			float32_t* dest = out + ielement * stride;
+			const float32_t* enter = line + (ielement + size) * stride;
+			const float32_t* leave = line + ielement * stride;
+			for (size_t ivalue = 0; ivalue < stride; ++ivalue)
+				dest[ivalue] = (float32_t)sum[ivalue] * scale;
+			if (ielement + 1 < count) {
+				for (size_t ivalue = 0; ivalue < stride; ++ivalue)
+					sum[ivalue] += (double)enter[ivalue] - (double)leave[ivalue];
+			}
+		}
+	} else {
+		// Young and van Vliet recursive Gaussian, run forward then backward in place over the
+		// padded line with the state initialized to the steady state of the line ends
+		size_t padded = count + 2 * pass->radius;
+		float32_t scale = pass->coefficient[0];
+		float32_t b1 = pass->coefficient[1];
+		float32_t b2 = pass->coefficient[2];
+		float32_t b3 = pass->coefficient[3];
+		float32_t w1[IMAGE_CONVOLVE_BAND * 4];
+		float32_t w2[IMAGE_CONVOLVE_BAND * 4];
+		float32_t w3[IMAGE_CONVOLVE_BAND * 4];
+		for (unsigned int idirection = 0; idirection < 2; ++idirection) {
+			const float32_t* end = line + (idirection ? (padded - 1) : 0) * stride;
+			for (size_t ivalue = 0; ivalue < stride; ++ivalue) {
+				w1[ivalue] = end[ivalue];
+				w2[ivalue] = end[ivalue];
+				w3[ivalue] = end[ivalue];
+			}
+			for (size_t ielement = 0; ielement < padded; ++ielement) {
+				float32_t* value = line + (idirection ? (padded - 1 - ielement) : ielement) * stride;
+				for (size_t ivalue = 0; ivalue < stride; ++ivalue) {
+					float32_t w0 = scale * value[ivalue] + b1 * w1[ivalue] + b2 * w2[ivalue] + b3 * w3[ivalue];
+					value[ivalue] = w0;
+					w3[ivalue] = w2[ivalue];
+					w2[ivalue] = w1[ivalue];
+					w1[ivalue] = w0;
+				}
+			}
+		}
+		memcpy(out, line + pass->radius * stride, sizeof(float32_t) * total);
+	}
+}
+
+//! Filter rows of the image into the plane
+static void
+image_convolve_rows(void* arg, size_t begin, size_t end) {
+	const image_convolve_job_t* job = arg;
+	unsigned int radius = job->pass_x.radius;
+	float32_t* line =
+	    memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * (job->width + 2 * radius), 0, MEMORY_PERSISTENT);
+	for (size_t irow = begin; irow < end; ++irow) {
+		image_pixel_read(job->format, job->data + irow * job->pitch, job->width, line + radius * 4);
+		image_convolve_pad(line, job->width, radius, 4, job->edge);
+		image_convolve_line(&job->pass_x, line, job->plane + irow * job->plane_width * 4, job->width, 4);
+	}
+	memory_deallocate(line);
+}
+
+//! Filter bands of plane columns back into the image
+static void
+image_convolve_columns(void* arg, size_t begin, size_t end) {
+	const image_convolve_job_t* job = arg;
+	unsigned int radius = job->pass_y.radius;
+	size_t band_size = (size_t)IMAGE_CONVOLVE_BAND * 4;
+	float32_t* line = memory_allocate(HASH_IMAGE, sizeof(float32_t) * band_size * (2 * job->height + 2 * radius),
+	                                  0, MEMORY_PERSISTENT);
+	float32_t* out = line + band_size * (job->height + 2 * radius);
+	for (size_t iband = begin; iband < end; ++iband) {
+		unsigned int x0 = (unsigned int)iband * IMAGE_CONVOLVE_BAND;
+		unsigned int columns = ((x0 + IMAGE_CONVOLVE_BAND) < job->width) ? IMAGE_CONVOLVE_BAND : (job->width - x0);
+		size_t stride = (size_t)columns * 4;
+		for (unsigned int irow = 0; irow < job->height; ++irow)
+			memcpy(line + (radius + irow) * stride, job->plane + (irow * job->plane_width + x0) * 4,
+			       sizeof(float32_t) * stride);
+		image_convolve_pad(line, job->height, radius, stride, job->edge);
+		image_convolve_line(&job->pass_y, line, out, job->height, stride);
+		for (unsigned int irow = 0; irow < job->height; ++irow)
+			image_pixel_write(job->format, job->data + irow * job->pitch + x0 * job->pixel_size, columns,
+			                  out + irow * stride);
+	}
+	memory_deallocate(line);
+}
+
+//! Read rows of the image into a plane padded on all sides
+static void
+image_convolve_gather(void* arg, size_t begin, size_t end) {
+	const image_convolve_job_t* job = arg;
+	unsigned int radius = job->size / 2;
+	for (size_t irow = begin; irow < end; ++irow) {
+		unsigned int source = image_convolve_edge((int64_t)irow - radius, job->height, job->edge);
+		float32_t* line = job->plane + irow * job->plane_width * 4;
+		image_pixel_read(job->format, job->data + source * job->pitch, job->width, line + radius * 4);
+		image_convolve_pad(line, job->width, radius, 4, job->edge);
+	}
+}
+
+//! Filter rows of the padded plane with a non-separable kernel back into the image
+static void
+image_convolve_kernel(void* arg, size_t begin, size_t end) {
+	const image_convolve_job_t* job = arg;
+	size_t total = (size_t)job->width * 4;
+	float32_t* out = memory_allocate(HASH_IMAGE, sizeof(float32_t) * total, 0, MEMORY_PERSISTENT);
+	for (size_t irow = begin; irow < end; ++irow) {
+		memset(out, 0, sizeof(float32_t) * total);
+		for (unsigned int ky = 0; ky < job->size; ++ky) {
+			const float32_t* line = job->plane + (irow + ky) * job->plane_width * 4;
+			for (unsigned int kx = 0; kx < job->size; ++kx) {
+				float32_t weight = job->kernel[ky * job->size + kx];
+				const float32_t* tap = line + kx * 4;
+				if (weight == 0)
+					continue;
+				for (size_t ivalue = 0; ivalue < total; ++ivalue)
+					out[ivalue] += weight * tap[ivalue];
+			}
+		}
+		image_pixel_write(job->format, job->data + irow * job->pitch, job->width, out);
+	}
+	memory_deallocate(out);
+}
+
+static size_t
+image_convolve_grain(size_t unit_size) {
+	size_t grain = IMAGE_CONVOLVE_CHUNK_SIZE / (unit_size ? unit_size : 1);
+	return grain ? grain : 1;
+}
+
+static bool
+image_convolve_validate(const image_t* image, unsigned int level) {
+	const image_pixelformat_t* format = &image->format;
+	if (!image->data || (level >= image->levels)) {
+		log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Invalid image level for convolution: %u"), level);
+		return false;
+	}
+	if ((format->compression != IMAGE_COMPRESSION_NONE) || format->block_width || !format->bits_per_pixel ||
+	    (format->bits_per_pixel % 8)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Convolution requires uncompressed byte aligned pixel formats"));
+		return false;
+	}
+	return true;
+}
+
+static void
+image_convolve_job_initialize(image_convolve_job_t* job, image_t* image, unsigned int level, image_edge_t edge) {
+	memset(job, 0, sizeof(image_convolve_job_t));
+	job->format = &image->format;
+	job->width = image_width(image, level);
+	job->height = image_height(image, level);
+	job->pixel_size = image->format.bits_per_pixel / 8;
+	job->pitch = job->pixel_size * job->width;
+	job->edge = edge;
+}
+
+static bool
+image_convolve_passes(image_t* image, unsigned int level, const image_convolve_pass_t* pass_x,
+                      const image_convolve_pass_t* pass_y, image_edge_t edge) {
+	image_convolve_job_t job;
+	image_convolve_job_initialize(&job, image, level, edge);
+	job.pass_x = *pass_x;
+	job.pass_y = *pass_y;
+	job.plane_width = job.width;
+	job.plane = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * job.plane_width * job.height, 0,
+	                            MEMORY_PERSISTENT);
+
+	uint8_t* data = image_buffer(image, level);
+	// Layers of each level follow each other like depth slices of volume images
+	unsigned int slice_count = image_depth(image, level) * image_layers(image);
+	size_t slice_size = job.pitch * job.height;
+	size_t band_count = (job.width + IMAGE_CONVOLVE_BAND - 1) / IMAGE_CONVOLVE_BAND;
+	size_t row_grain = image_convolve_grain(job.plane_width * 4 * sizeof(float32_t));
+	size_t band_grain = image_convolve_grain((size_t)job.height * IMAGE_CONVOLVE_BAND * 4 * sizeof(float32_t));
+	for (unsigned int slice = 0; slice < slice_count; ++slice) {
+		job.data = data + slice_size * slice;
+		image_parallel_for(job.height, row_grain, image_convolve_rows, &job);
+		image_parallel_for(band_count, band_grain, image_convolve_columns, &job);
+	}
+
+	memory_deallocate(job.plane);
+	return true;
+}
+
+static bool
+image_convolve_validate_kernel(unsigned int size) {
+	if (!(size & 1)) {
+		log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Convolution kernel size must be odd: %u"), size);
+		return false;
+	}
+	return true;
+}
+
+bool
+image_convolve_separable(image_t* image, unsigned int level, const float32_t* kernel_x, unsigned int size_x,
+                         const float32_t* kernel_y, unsigned int size_y, image_edge_t edge) {
+	if (!image_convolve_validate(image, level) || !image_convolve_validate_kernel(size_x) ||
+	    !image_convolve_validate_kernel(size_y))
+		return false;
+
+	image_convolve_pass_t pass_x;
+	image_convolve_pass_t pass_y;
+	memset(&pass_x, 0, sizeof(pass_x));
+	memset(&pass_y, 0, sizeof(pass_y));
+	pass_x.filter = IMAGE_CONVOLVE_FIR;
+	pass_x.radius = size_x / 2;
+	pass_x.kernel = kernel_x;
+	pass_y.filter = IMAGE_CONVOLVE_FIR;
+	pass_y.radius = size_y / 2;
+	pass_y.kernel = kernel_y;
+	return image_convolve_passes(image, level, &pass_x, &pass_y, edge);
+}
+
+bool
+image_convolve(image_t* image, unsigned int level, const float32_t* kernel, unsigned int size, image_edge_t edge) {
+	if (!image_convolve_validate(image, level) || !image_convolve_validate_kernel(size))
+		return false;
+	if (size > IMAGE_CONVOLVE_MAX_SIZE) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Convolution kernel too large: %u (max %u)"), size,
+		          IMAGE_CONVOLVE_MAX_SIZE);
+		return false;
+	}
+
+	image_convolve_job_t job;
+	image_convolve_job_initialize(&job, image, level, edge);
+	job.kernel = kernel;
+	job.size = size;
+	job.plane_width = job.width + size - 1;
+	size_t plane_height = job.height + size - 1;
+	job.plane =
+	    memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * job.plane_width * plane_height, 0, MEMORY_PERSISTENT);
+
+	uint8_t* data = image_buffer(image, level);
+	unsigned int slice_count = image_depth(image, level) * image_layers(image);
+	size_t slice_size = job.pitch * job.height;
+	size_t grain = image_convolve_grain(job.plane_width * 4 * sizeof(float32_t));
+	for (unsigned int slice = 0; slice < slice_count; ++slice) {
+		job.data = data + slice_size * slice;
+		image_parallel_for(plane_height, grain, image_convolve_gather, &job);
+		image_parallel_for(job.height, grain, image_convolve_kernel, &job);
+	}
+
+	memory_deallocate(job.plane);
+	return true;
+}
+
+bool
+image_box_blur(image_t* image, unsigned int level, unsigned int radius, image_edge_t edge) {
+	if (!image_convolve_validate(image, level))
+		return false;
+	if (!radius)
+		return true;
+
+	image_convolve_pass_t pass;
+	memset(&pass, 0, sizeof(pass));
+	pass.filter = IMAGE_CONVOLVE_BOX;
+	pass.radius = radius;
+	return image_convolve_passes(image, level, &pass, &pass, edge);
+}
+
+bool
+image_gaussian_blur(image_t* image, unsigned int level, float32_t sigma, image_edge_t edge) {
+	if (!image_convolve_validate(image, level))
+		return false;
+	if (!(sigma > 0))
+		return true;
+
+	image_convolve_pass_t pass;
+	memset(&pass, 0, sizeof(pass));
+	pass.radius = (unsigned int)ceilf(3.0f * sigma);
+	if (sigma < IMAGE_CONVOLVE_RECURSIVE_SIGMA) {
+		unsigned int size = 2 * pass.radius + 1;
+		float32_t kernel[2 * 9 + 1];
+		float32_t sum = 0;
+		for (unsigned int itap = 0; itap < size; ++itap) {
+			float32_t offset = (float32_t)itap - (float32_t)pass.radius;
+			kernel[itap] = expf(-(offset * offset) / (2.0f * sigma * sigma));
+			sum += kernel[itap];
+		}
+		for (unsigned int itap = 0; itap < size; ++itap)
+			kernel[itap] /= sum;
+		pass.filter = IMAGE_CONVOLVE_FIR;
+		pass.kernel = kernel;
+		return image_convolve_passes(image, level, &pass, &pass, edge);
+	}
+
+	// Coefficients from Young and van Vliet, "Recursive implementation of the Gaussian filter"
+	float32_t q = 0.98711f * sigma - 0.96330f;
+	float32_t q2 = q * q;
+	float32_t q3 = q2 * q;
+	float32_t b0 = 1.57825f + 2.44413f * q + 1.4281f * q2 + 0.422205f * q3;
+	float32_t b1 = 2.44413f * q + 2.85619f * q2 + 1.26661f * q3;
+	float32_t b2 = -(1.4281f * q2 + 1.26661f * q3);
+	float32_t b3 = 0.422205f * q3;
+	pass.filter = IMAGE_CONVOLVE_RECURSIVE;
+	pass.coefficient[0] = 1.0f - (b1 + b2 + b3) / b0;
+	pass.coefficient[1] = b1 / b0;
+	pass.coefficient[2] = b2 / b0;
+	pass.coefficient[3] = b3 / b0;
+	return image_convolve_passes(image, level, &pass, &pass, edge);
+}
@@ -0,0 +1,77 @@
+/* convolve.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file convolve.h
+    Convolution filters and blurs */
+
+#include <image/types.h>
+
+//! Largest edge length of non-separable kernels
+#define IMAGE_CONVOLVE_MAX_SIZE 9
+
+/*! Filter a mip level with a separable kernel, first along rows then along columns.
+Pixels are converted to normalized floating point RGBA as by #image_pixel_read, filtered
+and converted back into the image. Depth slices of volume images and layers of array and
+cubemap images are filtered individually. Kernels have an odd number of weights centered
+on the filtered pixel.
+\param image    Image to filter
+\param level    Mip level
+\param kernel_x Horizontal kernel weights
+\param size_x   Number of horizontal weights, must be odd
+\param kernel_y Vertical kernel weights
+\param size_y   Number of vertical weights, must be odd
+\param edge     Addressing of pixels outside the image
+\return         true if successful, false if the format or kernel is not supported */
+IMAGE_API bool
+image_convolve_separable(image_t* image, unsigned int level, const float32_t* kernel_x, unsigned int size_x,
+                         const float32_t* kernel_y, unsigned int size_y, image_edge_t edge);
+
+/*! Filter a mip level with a square non-separable kernel, as for sharpening or edge
+detection. Kernel sizes are limited to #IMAGE_CONVOLVE_MAX_SIZE, use separable
+kernels for larger filters.
+\param image  Image to filter
+\param level  Mip level
+\param kernel Kernel weights in row major order, size * size values
+\param size   Kernel edge length, must be odd
+\param edge   Addressing of pixels outside the image
+\return       true if successful, false if the format or kernel is not supported */
+IMAGE_API bool
+image_convolve(image_t* image, unsigned int level, const float32_t* kernel, unsigned int size, image_edge_t edge);
+
+/*! Average each pixel of a mip level with all pixels within a square of the given
+radius. Cost is independent of the radius, as running sums slide along rows and columns.
+\param image  Image to filter
+\param level  Mip level
+\param radius Radius in pixels, zero leaves the image unchanged
+\param edge   Addressing of pixels outside the image
+\return       true if successful, false if the format is not supported */
+IMAGE_API bool
+image_box_blur(image_t* image, unsigned int level, unsigned int radius, image_edge_t edge);
+
+/*! Blur a mip level with a Gaussian of the given standard deviation. Small deviations
+use a sampled kernel, larger deviations switch to a recursive filter with cost
+independent of the deviation.
+\param image Image to filter
+\param level Mip level
+\param sigma Standard deviation in pixels, zero or less leaves the image unchanged
+\param edge  Addressing of pixels outside the image
+\return      true if successful, false if the format is not supported */
+IMAGE_API bool
+image_gaussian_blur(image_t* image, unsigned int level, float32_t sigma, image_edge_t edge);
@@ -0,0 +1,814 @@
+/* cubemap.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include <math.h>
+
+#include "image.h"
+#include "cubemap.h"
+
+//! Minimum number of bytes processed per parallel chunk
+#define IMAGE_CUBEMAP_CHUNK_SIZE (64 * 1024)
+//! Upper bound of partial results merged after a parallel reduction
+#define IMAGE_CUBEMAP_MAX_CHUNKS 64
+#define IMAGE_CUBEMAP_FACES 6
+#define IMAGE_CUBEMAP_DEFAULT_SAMPLES 128
+#define IMAGE_CUBEMAP_DEFAULT_IRRADIANCE_SIZE 32
+//! Spherical harmonics coefficients per channel, and the stride of a partial sum including the solid angle
+#define IMAGE_CUBEMAP_SH_COUNT 9
+#define IMAGE_CUBEMAP_SH_STRIDE (IMAGE_CUBEMAP_SH_COUNT * 3 + 1)
+
+typedef struct image_cubemap_plane_t image_cubemap_plane_t;
+typedef struct image_cubemap_output_t image_cubemap_output_t;
+typedef struct image_cubemap_read_job_t image_cubemap_read_job_t;
+typedef struct image_cubemap_resample_job_t image_cubemap_resample_job_t;
+typedef struct image_cubemap_prefilter_job_t image_cubemap_prefilter_job_t;
+typedef struct image_cubemap_sh_job_t image_cubemap_sh_job_t;
+
+//! Linear RGBA texels of one level, rows of all layers stored consecutively
+struct image_cubemap_plane_t {
+	float32_t* data;
+	unsigned int width;
+	unsigned int height;
+	unsigned int layers;
+};
+
+//! Destination level, rows are indexed across layers like a plane
+struct image_cubemap_output_t {
+	const image_pixelformat_t* format;
+	uint8_t* layer[IMAGE_CUBEMAP_FACES];
+	size_t pitch;
+	unsigned int width;
+	unsigned int height;
+	bool srgb;
+};
+
+struct image_cubemap_read_job_t {
+	const image_pixelformat_t* format;
+	const uint8_t* layer[IMAGE_CUBEMAP_FACES];
+	size_t pitch;
+	bool srgb;
+	image_cubemap_plane_t* plane;
+};
+
+struct image_cubemap_resample_job_t {
+	image_cubemap_output_t output;
+	const image_cubemap_plane_t* source;
+	//! Irradiance coefficients premultiplied by the cosine lobe convolution
+	float32_t sh[IMAGE_CUBEMAP_SH_COUNT * 3];
+};
+
+struct image_cubemap_prefilter_job_t {
+	image_cubemap_output_t output;
+	const image_cubemap_plane_t* pyramid;
+	unsigned int pyramid_levels;
+	//! Sample directions in tangent space around +Z with cosine weights and source mip levels,
+	//! stored as separate arrays so the per texel rotation runs as straight vector arithmetic
+	const float32_t* sample_x;
+	const float32_t* sample_y;
+	const float32_t* sample_z;
+	const float32_t* sample_weight;
+	const float32_t* sample_lod;
+	unsigned int sample_count;
+};
+
+struct image_cubemap_sh_job_t {
+	const image_cubemap_plane_t* plane;
+	size_t grain;
+	float64_t* partial;
+};
+
+static float32_t
+image_cubemap_srgb_to_linear(float32_t value) {
+	if (value <= 0.04045f)
+		return value / 12.92f;
+	return powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float32_t
+image_cubemap_linear_to_srgb(float32_t value) {
+	if (value <= 0.0031308f)
+		return value * 12.92f;
+	return 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static size_t
+image_cubemap_grain(size_t unit_size) {
+	size_t grain = IMAGE_CUBEMAP_CHUNK_SIZE / (unit_size ? unit_size : 1);
+	return grain ? grain : 1;
+}
+
+static bool
+image_cubemap_format_supported(const image_pixelformat_t* format) {
+	return (format->compression == IMAGE_COMPRESSION_NONE) && !format->block_width && format->bits_per_pixel &&
+	       !(format->bits_per_pixel % 8);
+}
+
+static bool
+image_cubemap_validate(const image_t* cubemap) {
+	if (!cubemap->data || !cubemap->cubemap || (image_layers(cubemap) != IMAGE_CUBEMAP_FACES) ||
+	    !image_cubemap_format_supported(&cubemap->format)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Cubemap operations require an uncompressed byte aligned cubemap"));
+		return false;
+	}
+	return true;
+}
+
+//! Direction through a face coordinate in [-1,1], with t pointing down the face
+static void
+image_cubemap_direction(unsigned int face, float32_t s, float32_t t, float32_t* dir) {
+	switch (face) {
+		case 0:
+			dir[0] = 1;
+			dir[1] = -t;
+			dir[2] = -s;
+			break;
+		case 1:
+			dir[0] = -1;
+			dir[1] = -t;
+			dir[2] = s;
+			break;
+		case 2:
+			dir[0] = s;
+			dir[1] = 1;
+			dir[2] = t;
+			break;
+		case 3:
+			dir[0] = s;
+			dir[1] = -1;
+			dir[2] = -t;
+			break;
+		case 4:
+			dir[0] = s;
+			dir[1] = -t;
+			dir[2] = 1;
+			break;
+		default:
+			dir[0] = -s;
+			dir[1] = -t;
+			dir[2] = -1;
+			break;
+	}
+}
+
+//! Face hit by a direction, with the face coordinate mapped to [0,1]
+static unsigned int
+image_cubemap_face(float32_t x, float32_t y, float32_t z, float32_t* s, float32_t* t) {
+	float32_t ax = fabsf(x);
+	float32_t ay = fabsf(y);
+	float32_t az = fabsf(z);
+	unsigned int face;
+	float32_t major, sc, tc;
+	if ((ax >= ay) && (ax >= az)) {
+		major = ax;
+		face = (x > 0) ? 0 : 1;
+		sc = (x > 0) ? -z : z;
+		tc = -y;
+	} else if (ay >= az) {
+		major = ay;
+		face = (y > 0) ? 2 : 3;
+		sc = x;
+		tc = (y > 0) ? z : -z;
+	} else {
+		major = az;
+		face = (z > 0) ? 4 : 5;
+		sc = (z > 0) ? x : -x;
+		tc = -y;
+	}
+	float32_t scale = 0.5f / major;
+	*s = sc * scale + 0.5f;
+	*t = tc * scale + 0.5f;
+	return face;
+}
+
+//! Add a bilinearly filtered texel of a plane layer, clamped at the layer edges
+static void
+image_cubemap_accumulate(const image_cubemap_plane_t* plane, unsigned int layer, float32_t s, float32_t t,
+                         float32_t weight, float32_t* sum) {
+	float32_t fx = s * (float32_t)plane->width - 0.5f;
+	float32_t fy = t * (float32_t)plane->height - 0.5f;
+	float32_t max_x = (float32_t)(plane->width - 1);
+	float32_t max_y = (float32_t)(plane->height - 1);
+	fx = (fx > 0) ? ((fx < max_x) ? fx : max_x) : 0;
+	fy = (fy > 0) ? ((fy < max_y) ? fy : max_y) : 0;
+	unsigned int x0 = (unsigned int)fx;
+	unsigned int y0 = (unsigned int)fy;
+	unsigned int x1 = (x0 + 1 < plane->width) ? x0 + 1 : x0;
+	unsigned int y1 = (y0 + 1 < plane->height) ? y0 + 1 : y0;
+	float32_t wx = fx - (float32_t)x0;
+	float32_t wy = fy - (float32_t)y0;
+	size_t row_size = (size_t)plane->width * 4;
+	const float32_t* top = plane->data + ((size_t)layer * plane->height + y0) * row_size;
+	const float32_t* bottom = plane->data + ((size_t)layer * plane->height + y1) * row_size;
+	float32_t w00 = weight * (1 - wx) * (1 - wy);
+	float32_t w10 = weight * wx * (1 - wy);
+	float32_t w01 = weight * (1 - wx) * wy;
+	float32_t w11 = weight * wx * wy;
+	for (unsigned int ich = 0; ich < 4; ++ich)
+		sum[ich] += w00 * top[x0 * 4 + ich] + w10 * top[x1 * 4 + ich] + w01 * bottom[x0 * 4 + ich] +
+		            w11 * bottom[x1 * 4 + ich];
+}
+
+//! Read rows of all source layers into the plane, converting sRGB to linear
+static void
+image_cubemap_read_rows(void* arg, size_t begin, size_t end) {
+	const image_cubemap_read_job_t* job = arg;
+	const image_cubemap_plane_t* plane = job->plane;
+	size_t row_size = (size_t)plane->width * 4;
+	for (size_t irow = begin; irow < end; ++irow) {
+		float32_t* rgba = plane->data + irow * row_size;
+		const uint8_t* source = job->layer[irow / plane->height] + (irow % plane->height) * job->pitch;
+		image_pixel_read(job->format, source, plane->width, rgba);
+		if (job->srgb) {
+			for (unsigned int x = 0; x < plane->width; ++x, rgba += 4) {
+				rgba[0] = image_cubemap_srgb_to_linear(rgba[0]);
+				rgba[1] = image_cubemap_srgb_to_linear(rgba[1]);
+				rgba[2] = image_cubemap_srgb_to_linear(rgba[2]);
+			}
+		}
+	}
+}
+
+static void
+image_cubemap_read(image_cubemap_plane_t* plane, const image_t* image, unsigned int width, unsigned int height,
+                   unsigned int layers) {
+	image_cubemap_read_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.format = &image->format;
+	job.pitch = (size_t)width * (image->format.bits_per_pixel / 8);
+	job.srgb = (image->format.colorspace == IMAGE_COLORSPACE_sRGB);
+	for (unsigned int layer = 0; layer < layers; ++layer)
+		job.layer[layer] = image_layer_buffer((image_t*)image, 0, layer);
+	plane->width = width;
+	plane->height = height;
+	plane->layers = layers;
+	plane->data =
+	    memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * width * height * layers, 0, MEMORY_PERSISTENT);
+	job.plane = plane;
+	image_parallel_for((size_t)height * layers, image_cubemap_grain(sizeof(float32_t) * 4 * width),
+	                   image_cubemap_read_rows, &job);
+}
+
+static void
+image_cubemap_output_initialize(image_cubemap_output_t* output, image_t* image, unsigned int level) {
+	output->format = &image->format;
+	output->width = image_width(image, level);
+	output->height = image_height(image, level);
+	output->pitch = (size_t)output->width * (image->format.bits_per_pixel / 8);
+	output->srgb = (image->format.colorspace == IMAGE_COLORSPACE_sRGB);
+	unsigned int layers = image_layers(image);
+	for (unsigned int layer = 0; layer < IMAGE_CUBEMAP_FACES; ++layer)
+		output->layer[layer] = (layer < layers) ? image_layer_buffer(image, level, layer) : 0;
+}
+
+//! Encode and store a row of linear texels, the row buffer is overwritten
+static void
+image_cubemap_output_row(const image_cubemap_output_t* output, size_t row, float32_t* rgba) {
+	if (output->srgb) {
+		float32_t* texel = rgba;
+		for (unsigned int x = 0; x < output->width; ++x, texel += 4) {
+			texel[0] = image_cubemap_linear_to_srgb(texel[0]);
+			texel[1] = image_cubemap_linear_to_srgb(texel[1]);
+			texel[2] = image_cubemap_linear_to_srgb(texel[2]);
+		}
+	}
+	uint8_t* destination = output->layer[row / output->height] + (row % output->height) * output->pitch;
+	image_pixel_write(output->format, destination, output->width, rgba);
+}
+
+//! Face coordinate in [-1,1] of a texel center
+static float32_t
+image_cubemap_coordinate(unsigned int index, unsigned int size) {
+	return (2.0f * ((float32_t)index + 0.5f) / (float32_t)size) - 1.0f;
+}
+
+static void
+image_cubemap_from_equirect_rows(void* arg, size_t begin, size_t end) {
+	const image_cubemap_resample_job_t* job = arg;
+	const image_cubemap_output_t* output = &job->output;
+	const image_cubemap_plane_t* source = job->source;
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * output->width, 0, MEMORY_PERSISTENT);
+	size_t row_size = (size_t)source->width * 4;
+	for (size_t irow = begin; irow < end; ++irow) {
+		unsigned int face = (unsigned int)(irow / output->height);
+		float32_t t = image_cubemap_coordinate((unsigned int)(irow % output->height), output->height);
+		for (unsigned int x = 0; x < output->width; ++x) {
+			float32_t dir[3];
+			image_cubemap_direction(face, image_cubemap_coordinate(x, output->width), t, dir);
+			float32_t inv_length = 1.0f / sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+			float32_t y = dir[1] * inv_length;
+			y = (y < 1.0f) ? ((y > -1.0f) ? y : -1.0f) : 1.0f;
+			float32_t u = 0.5f + atan2f(dir[0], -dir[2]) / (2.0f * (float32_t)REAL_PI);
+			float32_t v = acosf(y) / (float32_t)REAL_PI;
+
+			// Wrap around the horizontal seam, clamp at the poles
+			float32_t fx = u * (float32_t)source->width - 0.5f;
+			float32_t fy = v * (float32_t)source->height - 0.5f;
+			float32_t max_y = (float32_t)(source->height - 1);
+			fy = (fy > 0) ? ((fy < max_y) ? fy : max_y) : 0;
+			float32_t floor_x = floorf(fx);
+			float32_t wx = fx - floor_x;
+			int64_t ix = (int64_t)floor_x % (int64_t)source->width;
+			if (ix < 0)
+				ix += source->width;
+			unsigned int x0 = (unsigned int)ix;
+			unsigned int x1 = (x0 + 1 < source->width) ? x0 + 1 : 0;
+			unsigned int y0 = (unsigned int)fy;
+			unsigned int y1 = (y0 + 1 < source->height) ? y0 + 1 : y0;
+			float32_t wy = fy - (float32_t)y0;
+			const float32_t* top = source->data + y0 * row_size;
+			const float32_t* bottom = source->data + y1 * row_size;
+			for (unsigned int ich = 0; ich < 4; ++ich)
+				rgba[x * 4 + ich] = (1 - wy) * ((1 - wx) * top[x0 * 4 + ich] + wx * top[x1 * 4 + ich]) +
+				                    wy * ((1 - wx) * bottom[x0 * 4 + ich] + wx * bottom[x1 * 4 + ich]);
+		}
+		image_cubemap_output_row(output, irow, rgba);
+	}
+	memory_deallocate(rgba);
+}
+
+bool
+image_cubemap_from_equirect(image_t* cubemap, const image_t* equirect, unsigned int size) {
+	if (cubemap == equirect) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Cubemap must not be the source panorama"));
+		return false;
+	}
+	if (!equirect->data || !image_cubemap_format_supported(&equirect->format)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Cubemap conversion requires an uncompressed byte aligned panorama"));
+		return false;
+	}
+	if (!size)
+		size = (equirect->width >= 4) ? equirect->width / 4 : 1;
+
+	image_cubemap_plane_t source;
+	image_cubemap_read(&source, equirect, equirect->width, equirect->height, 1);
+
+	image_pixelformat_t format = equirect->format;
+	image_allocate_cubemap_storage(cubemap, &format, size, 1);
+
+	image_cubemap_resample_job_t job;
+	memset(&job, 0, sizeof(job));
+	image_cubemap_output_initialize(&job.output, cubemap, 0);
+	job.source = &source;
+	image_parallel_for((size_t)size * IMAGE_CUBEMAP_FACES, image_cubemap_grain(sizeof(float32_t) * 4 * size),
+	                   image_cubemap_from_equirect_rows, &job);
+	memory_deallocate(source.data);
+
+	return true;
+}
+
+static void
+image_cubemap_to_equirect_rows(void* arg, size_t begin, size_t end) {
+	const image_cubemap_resample_job_t* job = arg;
+	const image_cubemap_output_t* output = &job->output;
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * output->width, 0, MEMORY_PERSISTENT);
+	for (size_t irow = begin; irow < end; ++irow) {
+		float32_t theta = (float32_t)REAL_PI * ((float32_t)irow + 0.5f) / (float32_t)output->height;
+		float32_t sin_theta = sinf(theta);
+		float32_t y = cosf(theta);
+		memset(rgba, 0, sizeof(float32_t) * 4 * output->width);
+		for (unsigned int x = 0; x < output->width; ++x) {
+			float32_t phi = 2.0f * (float32_t)REAL_PI * (((float32_t)x + 0.5f) / (float32_t)output->width - 0.5f);
+			float32_t s, t;
+			unsigned int face = image_cubemap_face(sin_theta * sinf(phi), y, -sin_theta * cosf(phi), &s, &t);
+			image_cubemap_accumulate(job->source, face, s, t, 1.0f, rgba + x * 4);
+		}
+		image_cubemap_output_row(output, irow, rgba);
+	}
+	memory_deallocate(rgba);
+}
+
+bool
+image_cubemap_to_equirect(image_t* equirect, const image_t* cubemap, unsigned int width, unsigned int height) {
+	if (equirect == cubemap) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Panorama must not be the source cubemap"));
+		return false;
+	}
+	if (!image_cubemap_validate(cubemap))
+		return false;
+	if (!width)
+		width = cubemap->width * 4;
+	if (!height)
+		height = (width >= 2) ? width / 2 : 1;
+
+	image_cubemap_plane_t source;
+	image_cubemap_read(&source, cubemap, cubemap->width, cubemap->height, IMAGE_CUBEMAP_FACES);
+
+	image_pixelformat_t format = cubemap->format;
+	image_allocate_storage(equirect, &format, width, height, 1, 1);
+
+	image_cubemap_resample_job_t job;
+	memset(&job, 0, sizeof(job));
+	image_cubemap_output_initialize(&job.output, equirect, 0);
+	job.source = &source;
+	image_parallel_for(height, image_cubemap_grain(sizeof(float32_t) * 4 * width), image_cubemap_to_equirect_rows,
+	                   &job);
+	memory_deallocate(source.data);
+
+	return true;
+}
+
+//! Average 2x2 texel blocks of the level above into rows of a pyramid level
+static void
+image_cubemap_downsample_rows(void* arg, size_t begin, size_t end) {
+	const image_cubemap_plane_t* pyramid = arg;
+	const image_cubemap_plane_t* source = pyramid;
+	const image_cubemap_plane_t* target = pyramid + 1;
+	size_t source_row = (size_t)source->width * 4;
+	size_t target_row = (size_t)target->width * 4;
+	for (size_t irow = begin; irow < end; ++irow) {
+		size_t layer = irow / target->height;
+		unsigned int y0 = (unsigned int)(irow % target->height) * 2;
+		unsigned int y1 = (y0 + 1 < source->height) ? y0 + 1 : y0;
+		const float32_t* top = source->data + (layer * source->height + y0) * source_row;
+		const float32_t* bottom = source->data + (layer * source->height + y1) * source_row;
+		float32_t* texel = target->data + irow * target_row;
+		for (unsigned int x = 0; x < target->width; ++x, texel += 4) {
+			unsigned int x0 = x * 2;
+			unsigned int x1 = (x0 + 1 < source->width) ? x0 + 1 : x0;
+			for (unsigned int ich = 0; ich < 4; ++ich)
+				texel[ich] = 0.25f * (top[x0 * 4 + ich] + top[x1 * 4 + ich] + bottom[x0 * 4 + ich] +
+				                      bottom[x1 * 4 + ich]);
+		}
+	}
+}
+
+static void
+image_cubemap_prefilter_rows(void* arg, size_t begin, size_t end) {
+	const image_cubemap_prefilter_job_t* job = arg;
+	const image_cubemap_output_t* output = &job->output;
+	unsigned int count = job->sample_count;
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * output->width, 0, MEMORY_PERSISTENT);
+	float32_t* world =
+	    count ? memory_allocate(HASH_IMAGE, sizeof(float32_t) * 3 * count, 0, MEMORY_PERSISTENT) : 0;
+	float32_t* world_x = world;
+	float32_t* world_y = world + count;
+	float32_t* world_z = world + count * 2;
+	float32_t max_lod = (float32_t)(job->pyramid_levels - 1);
+	for (size_t irow = begin; irow < end; ++irow) {
+		unsigned int face = (unsigned int)(irow / output->height);
+		float32_t t = image_cubemap_coordinate((unsigned int)(irow % output->height), output->height);
+		memset(rgba, 0, sizeof(float32_t) * 4 * output->width);
+		for (unsigned int x = 0; x < output->width; ++x) {
+			float32_t* sum = rgba + x * 4;
+			float32_t n[3];
+			image_cubemap_direction(face, image_cubemap_coordinate(x, output->width), t, n);
+			if (!count) {
+				// Zero roughness reflects along the normal only
+				float32_t s, u;
+				unsigned int source_face = image_cubemap_face(n[0], n[1], n[2], &s, &u);
+				image_cubemap_accumulate(job->pyramid, source_face, s, u, 1.0f, sum);
+				continue;
+			}
+
+			float32_t inv_length = 1.0f / sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			n[0] *= inv_length;
+			n[1] *= inv_length;
+			n[2] *= inv_length;
+			// Tangent frame around the normal, with view and normal directions assumed equal
+			float32_t up[3] = {0, 0, 1};
+			if (fabsf(n[2]) >= 0.999f) {
+				up[0] = 1;
+				up[2] = 0;
+			}
+			float32_t tangent[3] = {up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2],
+			                        up[0] * n[1] - up[1] * n[0]};
+			float32_t inv_tangent = 1.0f / sqrtf(tangent[0] * tangent[0] + tangent[1] * tangent[1] +
+			                                     tangent[2] * tangent[2]);
+			tangent[0] *= inv_tangent;
+			tangent[1] *= inv_tangent;
+			tangent[2] *= inv_tangent;
+			float32_t bitangent[3] = {n[1] * tangent[2] - n[2] * tangent[1], n[2] * tangent[0] - n[0] * tangent[2],
+			                          n[0] * tangent[1] - n[1] * tangent[0]};
+
+			// Rotate all samples into the frame in straight line arithmetic the compiler vectorizes
+			const float32_t* sample_x = job->sample_x;
+			const float32_t* sample_y = job->sample_y;
+			const float32_t* sample_z = job->sample_z;
+			for (unsigned int isample = 0; isample < count; ++isample) {
+				world_x[isample] =
+				    tangent[0] * sample_x[isample] + bitangent[0] * sample_y[isample] + n[0] * sample_z[isample];
+				world_y[isample] =
+				    tangent[1] * sample_x[isample] + bitangent[1] * sample_y[isample] + n[1] * sample_z[isample];
+				world_z[isample] =
+				    tangent[2] * sample_x[isample] + bitangent[2] * sample_y[isample] + n[2] * sample_z[isample];
+			}
+
+			float32_t total = 0;
+			for (unsigned int isample = 0; isample < count; ++isample) {
+				float32_t weight = job->sample_weight[isample];
+				float32_t lod = job->sample_lod[isample];
+				lod = (lod < max_lod) ? lod : max_lod;
+				unsigned int level = (unsigned int)lod;
+				float32_t blend = lod - (float32_t)level;
+				float32_t s, u;
+				unsigned int source_face =
+				    image_cubemap_face(world_x[isample], world_y[isample], world_z[isample], &s, &u);
+				image_cubemap_accumulate(job->pyramid + level, source_face, s, u, weight * (1 - blend), sum);
+				if (blend > 0)
+					image_cubemap_accumulate(job->pyramid + level + 1, source_face, s, u, weight * blend, sum);
+				total += weight;
+			}
+			float32_t inv_total = 1.0f / total;
+			for (unsigned int ich = 0; ich < 4; ++ich)
+				sum[ich] *= inv_total;
+		}
+		image_cubemap_output_row(output, irow, rgba);
+	}
+	memory_deallocate(world);
+	memory_deallocate(rgba);
+}
+
+//! Van der Corput radical inverse in base two, the second Hammersley coordinate
+static float32_t
+image_cubemap_radical_inverse(uint32_t bits) {
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555U) << 1) | ((bits & 0xAAAAAAAAU) >> 1);
+	bits = ((bits & 0x33333333U) << 2) | ((bits & 0xCCCCCCCCU) >> 2);
+	bits = ((bits & 0x0F0F0F0FU) << 4) | ((bits & 0xF0F0F0F0U) >> 4);
+	bits = ((bits & 0x00FF00FFU) << 8) | ((bits & 0xFF00FF00U) >> 8);
+	return (float32_t)bits * 2.3283064365386963e-10f;
+}
+
+//! Importance sample the GGX distribution around +Z, returning the number of samples above
+//! the horizon. The source mip level of each sample matches its solid angle to the texel
+//! solid angle of the first pyramid level.
+static unsigned int
+image_cubemap_ggx_samples(float32_t* samples, unsigned int count, float32_t roughness, unsigned int source_size) {
+	float32_t* sample_x = samples;
+	float32_t* sample_y = samples + count;
+	float32_t* sample_z = samples + count * 2;
+	float32_t* sample_weight = samples + count * 3;
+	float32_t* sample_lod = samples + count * 4;
+	float32_t alpha = roughness * roughness;
+	float32_t alpha2 = alpha * alpha;
+	float32_t texel_solid_angle =
+	    4.0f * (float32_t)REAL_PI / ((float32_t)IMAGE_CUBEMAP_FACES * (float32_t)source_size * (float32_t)source_size);
+	unsigned int accepted = 0;
+	for (unsigned int isample = 0; isample < count; ++isample) {
+		float32_t xi_x = (float32_t)isample / (float32_t)count;
+		float32_t xi_y = image_cubemap_radical_inverse(isample);
+		float32_t phi = 2.0f * (float32_t)REAL_PI * xi_x;
+		float32_t cos_theta = sqrtf((1.0f - xi_y) / (1.0f + (alpha2 - 1.0f) * xi_y));
+		float32_t sin_theta = sqrtf(1.0f - cos_theta * cos_theta);
+		// Reflect the view direction, which equals the normal, about the half vector
+		float32_t n_dot_l = 2.0f * cos_theta * cos_theta - 1.0f;
+		if (n_dot_l <= 0)
+			continue;
+		float32_t denominator = cos_theta * cos_theta * (alpha2 - 1.0f) + 1.0f;
+		float32_t distribution = alpha2 / ((float32_t)REAL_PI * denominator * denominator);
+		// With view along the normal the reflected direction pdf reduces to D/4
+		float32_t pdf = distribution * 0.25f;
+		float32_t sample_solid_angle = 1.0f / ((float32_t)count * pdf);
+		float32_t lod = 0.5f * log2f(sample_solid_angle / texel_solid_angle) + 1.0f;
+		sample_x[accepted] = 2.0f * cos_theta * sin_theta * cosf(phi);
+		sample_y[accepted] = 2.0f * cos_theta * sin_theta * sinf(phi);
+		sample_z[accepted] = n_dot_l;
+		sample_weight[accepted] = n_dot_l;
+		sample_lod[accepted] = (lod > 0) ? lod : 0;
+		++accepted;
+	}
+	return accepted;
+}
+
+bool
+image_cubemap_prefilter(image_t* prefiltered, const image_t* cubemap, unsigned int size, unsigned int levels,
+                        unsigned int samples) {
+	if (prefiltered == cubemap) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Prefiltered cubemap must not be the source"));
+		return false;
+	}
+	if (!image_cubemap_validate(cubemap))
+		return false;
+	if (!size)
+		size = cubemap->width;
+	unsigned int max_levels = 1;
+	for (unsigned int extent = size; extent > 1; extent >>= 1)
+		++max_levels;
+	if (!levels)
+		levels = max_levels;
+	if (levels > max_levels) {
+		log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE,
+		          STRING_CONST("Prefiltered cubemap level count %u exceeds maximum %u for face size %u"), levels,
+		          max_levels, size);
+		return false;
+	}
+	if (!samples)
+		samples = IMAGE_CUBEMAP_DEFAULT_SAMPLES;
+
+	// Source pyramid down to one texel per face for filtered importance sampling
+	unsigned int pyramid_levels = 1;
+	for (unsigned int extent = cubemap->width; extent > 1; extent >>= 1)
+		++pyramid_levels;
+	image_cubemap_plane_t* pyramid =
+	    memory_allocate(HASH_IMAGE, sizeof(image_cubemap_plane_t) * pyramid_levels, 0, MEMORY_PERSISTENT);
+	image_cubemap_read(pyramid, cubemap, cubemap->width, cubemap->width, IMAGE_CUBEMAP_FACES);
+	for (unsigned int ilevel = 1; ilevel < pyramid_levels; ++ilevel) {
+		image_cubemap_plane_t* target = pyramid + ilevel;
+		target->width = pyramid[ilevel - 1].width > 1 ? pyramid[ilevel - 1].width / 2 : 1;
+		target->height = target->width;
+		target->layers = IMAGE_CUBEMAP_FACES;
+		target->data = memory_allocate(HASH_IMAGE,
+		                               sizeof(float32_t) * 4 * target->width * target->height * IMAGE_CUBEMAP_FACES,
+		                               0, MEMORY_PERSISTENT);
+		image_parallel_for((size_t)target->height * IMAGE_CUBEMAP_FACES,
+		                   image_cubemap_grain(sizeof(float32_t) * 16 * target->width),
+		                   image_cubemap_downsample_rows, pyramid + ilevel - 1);
+	}
+
+	image_pixelformat_t format = cubemap->format;
+	image_allocate_cubemap_storage(prefiltered, &format, size, levels);
+
+	float32_t* sample_data = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 5 * samples, 0, MEMORY_PERSISTENT);
+	image_cubemap_prefilter_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.pyramid = pyramid;
+	job.pyramid_levels = pyramid_levels;
+	for (unsigned int level = 0; level < levels; ++level) {
+		image_trace_begin(IMAGE_TRACE_MIP);
+		float32_t roughness = (levels > 1) ? (float32_t)level / (float32_t)(levels - 1) : 0;
+		job.sample_count = (roughness > 0) ? image_cubemap_ggx_samples(sample_data, samples, roughness,
+		                                                               cubemap->width) : 0;
+		job.sample_x = sample_data;
+		job.sample_y = sample_data + samples;
+		job.sample_z = sample_data + samples * 2;
+		job.sample_weight = sample_data + samples * 3;
+		job.sample_lod = sample_data + samples * 4;
+		image_cubemap_output_initialize(&job.output, prefiltered, level);
+		size_t texel_cost = sizeof(float32_t) * 4 * (job.sample_count ? job.sample_count * 4 : 1);
+		image_parallel_for((size_t)job.output.height * IMAGE_CUBEMAP_FACES,
+		                   image_cubemap_grain(texel_cost * job.output.width), image_cubemap_prefilter_rows, &job);
+		image_trace_end(IMAGE_TRACE_MIP);
+	}
+
+	memory_deallocate(sample_data);
+	for (unsigned int ilevel = 0; ilevel < pyramid_levels; ++ilevel)
+		memory_deallocate(pyramid[ilevel].data);
+	memory_deallocate(pyramid);
+
+	return true;
+}
+
+//! Real spherical harmonics basis of the first three bands for a unit direction
+static void
+image_cubemap_sh_basis(float32_t x, float32_t y, float32_t z, float32_t* basis) {
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * y;
+	basis[2] = 0.488603f * z;
+	basis[3] = 0.488603f * x;
+	basis[4] = 1.092548f * x * y;
+	basis[5] = 1.092548f * y * z;
+	basis[6] = 0.315392f * (3.0f * z * z - 1.0f);
+	basis[7] = 1.092548f * x * z;
+	basis[8] = 0.546274f * (x * x - y * y);
+}
+
+static void
+image_cubemap_sh_rows(void* arg, size_t begin, size_t end) {
+	const image_cubemap_sh_job_t* job = arg;
+	const image_cubemap_plane_t* plane = job->plane;
+	float64_t* partial = job->partial + (begin / job->grain) * IMAGE_CUBEMAP_SH_STRIDE;
+	unsigned int size = plane->width;
+	float32_t texel_area = 4.0f / ((float32_t)size * (float32_t)size);
+	for (size_t irow = begin; irow < end; ++irow) {
+		unsigned int face = (unsigned int)(irow / size);
+		float32_t t = image_cubemap_coordinate((unsigned int)(irow % size), size);
+		const float32_t* texel = plane->data + irow * size * 4;
+		// Rows are summed in single precision and added to the chunk in double precision
+		float32_t sum[IMAGE_CUBEMAP_SH_STRIDE];
+		memset(sum, 0, sizeof(sum));
+		for (unsigned int x = 0; x < size; ++x, texel += 4) {
+			float32_t dir[3];
+			image_cubemap_direction(face, image_cubemap_coordinate(x, size), t, dir);
+			float32_t length2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+			float32_t inv_length = 1.0f / sqrtf(length2);
+			// Solid angle of the texel, its area projected onto the unit sphere
+			float32_t solid_angle = texel_area * inv_length / length2;
+			float32_t basis[IMAGE_CUBEMAP_SH_COUNT];
+			image_cubemap_sh_basis(dir[0] * inv_length, dir[1] * inv_length, dir[2] * inv_length, basis);
+			for (unsigned int icoeff = 0; icoeff < IMAGE_CUBEMAP_SH_COUNT; ++icoeff) {
+				float32_t weight = basis[icoeff] * solid_angle;
+				sum[icoeff * 3 + 0] += weight * texel[0];
+				sum[icoeff * 3 + 1] += weight * texel[1];
+				sum[icoeff * 3 + 2] += weight * texel[2];
+			}
+			sum[IMAGE_CUBEMAP_SH_STRIDE - 1] += solid_angle;
+		}
+		for (unsigned int icoeff = 0; icoeff < IMAGE_CUBEMAP_SH_STRIDE; ++icoeff)
+			partial[icoeff] += sum[icoeff];
+	}
+}
+
+bool
+image_cubemap_irradiance_sh(const image_t* cubemap, float32_t* sh) {
+	if (!image_cubemap_validate(cubemap))
+		return false;
+
+	image_cubemap_plane_t plane;
+	image_cubemap_read(&plane, cubemap, cubemap->width, cubemap->width, IMAGE_CUBEMAP_FACES);
+
+	image_cubemap_sh_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.plane = &plane;
+	size_t rows = (size_t)plane.height * IMAGE_CUBEMAP_FACES;
+	size_t chunk_count = (rows < IMAGE_CUBEMAP_MAX_CHUNKS) ? rows : IMAGE_CUBEMAP_MAX_CHUNKS;
+	job.grain = (rows + chunk_count - 1) / chunk_count;
+	chunk_count = (rows + job.grain - 1) / job.grain;
+	job.partial = memory_allocate(HASH_IMAGE, sizeof(float64_t) * IMAGE_CUBEMAP_SH_STRIDE * chunk_count, 0,
+	                              MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+	image_parallel_for(rows, job.grain, image_cubemap_sh_rows, &job);
+
+	// Chunks are merged in order so the result does not depend on thread scheduling
+	float64_t total[IMAGE_CUBEMAP_SH_STRIDE];
+	memset(total, 0, sizeof(total));
+	for (size_t ichunk = 0; ichunk < chunk_count; ++ichunk) {
+		const float64_t* partial = job.partial + ichunk * IMAGE_CUBEMAP_SH_STRIDE;
+		for (unsigned int icoeff = 0; icoeff < IMAGE_CUBEMAP_SH_STRIDE; ++icoeff)
+			total[icoeff] += partial[icoeff];
+	}
+	// Normalize the discrete solid angles to integrate to exactly the full sphere
+	float64_t scale = (4.0 * REAL_PI) / total[IMAGE_CUBEMAP_SH_STRIDE - 1];
+	for (unsigned int icoeff = 0; icoeff < IMAGE_CUBEMAP_SH_COUNT * 3; ++icoeff)
+		sh[icoeff] = (float32_t)(total[icoeff] * scale);
+
+	memory_deallocate(job.partial);
+	memory_deallocate(plane.data);
+
+	return true;
+}
+
+static void
+image_cubemap_irradiance_rows(void* arg, size_t begin, size_t end) {
+	const image_cubemap_resample_job_t* job = arg;
+	const image_cubemap_output_t* output = &job->output;
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * output->width, 0, MEMORY_PERSISTENT);
+	for (size_t irow = begin; irow < end; ++irow) {
+		unsigned int face = (unsigned int)(irow / output->height);
+		float32_t t = image_cubemap_coordinate((unsigned int)(irow % output->height), output->height);
+		for (unsigned int x = 0; x < output->width; ++x) {
+			float32_t dir[3];
+			image_cubemap_direction(face, image_cubemap_coordinate(x, output->width), t, dir);
+			float32_t inv_length = 1.0f / sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+			float32_t basis[IMAGE_CUBEMAP_SH_COUNT];
+			image_cubemap_sh_basis(dir[0] * inv_length, dir[1] * inv_length, dir[2] * inv_length, basis);
+			float32_t* texel = rgba + x * 4;
+			for (unsigned int ich = 0; ich < 3; ++ich) {
+				float32_t value = 0;
+				for (unsigned int icoeff = 0; icoeff < IMAGE_CUBEMAP_SH_COUNT; ++icoeff)
+					value += basis[icoeff] * job->sh[icoeff * 3 + ich];
+				// Truncated harmonics ring slightly negative next to strong lights
+				texel[ich] = (value > 0) ? value : 0;
+			}
+			texel[3] = 1.0f;
+		}
+		image_cubemap_output_row(output, irow, rgba);
+	}
+	memory_deallocate(rgba);
+}
+
+bool
+image_cubemap_irradiance(image_t* irradiance, const image_t* cubemap, unsigned int size) {
+	if (irradiance == cubemap) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Irradiance cubemap must not be the source"));
+		return false;
+	}
+	image_cubemap_resample_job_t job;
+	memset(&job, 0, sizeof(job));
+	if (!image_cubemap_irradiance_sh(cubemap, job.sh))
+		return false;
+	if (!size)
+		size = IMAGE_CUBEMAP_DEFAULT_IRRADIANCE_SIZE;
+
+	// Convolution with the clamped cosine lobe scales each band, A0 = pi, A1 = 2pi/3 and
+	// A2 = pi/4, and the division by pi turns irradiance into reflected radiance
+	static const float32_t band_scale[IMAGE_CUBEMAP_SH_COUNT] = {
+	    1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+	for (unsigned int icoeff = 0; icoeff < IMAGE_CUBEMAP_SH_COUNT * 3; ++icoeff)
+		job.sh[icoeff] *= band_scale[icoeff / 3];
+
+	image_pixelformat_t format = cubemap->format;
+	image_allocate_cubemap_storage(irradiance, &format, size, 1);
+	image_cubemap_output_initialize(&job.output, irradiance, 0);
+	image_parallel_for((size_t)size * IMAGE_CUBEMAP_FACES, image_cubemap_grain(sizeof(float32_t) * 64 * size),
+	                   image_cubemap_irradiance_rows, &job);
+
+	return true;
+}
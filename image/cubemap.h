@@ -0,0 +1,79 @@
+/* cubemap.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file cubemap.h
+    Cubemap conversion and image based lighting prefiltering */
+
+#include <image/types.h>
+
+/*! Resample an equirectangular (latitude-longitude) panorama into a cubemap. The center
+of the panorama looks down -Z with +Y up, texels are bilinearly filtered in linear space.
+Volume and array sources use the first slice and layer of the first level.
+\param cubemap  Cubemap receiving a single level in the panorama format, previous storage is released
+\param equirect Panorama, must be uncompressed with byte aligned pixels
+\param size     Face size, zero for a quarter of the panorama width
+\return         true if successful, false if the format is not supported */
+IMAGE_API bool
+image_cubemap_from_equirect(image_t* cubemap, const image_t* equirect, unsigned int size);
+
+/*! Resample the first level of a cubemap into an equirectangular panorama, the inverse
+of #image_cubemap_from_equirect.
+\param equirect Panorama receiving a single level in the cubemap format, previous storage is released
+\param cubemap  Cubemap, must be uncompressed with byte aligned pixels
+\param width    Panorama width, zero for four times the face size
+\param height   Panorama height, zero for half the width
+\return         true if successful, false if the format is not supported */
+IMAGE_API bool
+image_cubemap_to_equirect(image_t* equirect, const image_t* cubemap, unsigned int width, unsigned int height);
+
+/*! Prefilter the first level of a cubemap into a specular radiance mip chain for the GGX
+microfacet distribution. Level n is filtered with perceptual roughness n/(levels-1), the
+first level being a plain resample. Each texel integrates importance sampled directions
+weighted by the cosine term, reading from a mip pyramid of the source to suppress
+undersampling noise (filtered importance sampling).
+\param prefiltered Cubemap receiving the chain in the source format, previous storage is released
+\param cubemap     Source cubemap, must be uncompressed with byte aligned pixels
+\param size        Face size of the first level, zero for the source size
+\param levels      Number of levels, zero for a full chain down to one texel
+\param samples     Number of samples per texel, zero for a default of 128
+\return            true if successful, false if the format or level count is not supported */
+IMAGE_API bool
+image_cubemap_prefilter(image_t* prefiltered, const image_t* cubemap, unsigned int size, unsigned int levels,
+                        unsigned int samples);
+
+/*! Project the radiance of the first level of a cubemap onto the nine real spherical
+harmonics basis functions of the first three bands, integrating over the solid angle of
+each texel. Coefficients are stored as RGB triplets in band order L00, L1-1, L10, L11,
+L2-2, L2-1, L20, L21, L22.
+\param cubemap Cubemap, must be uncompressed with byte aligned pixels
+\param sh      Array receiving 27 coefficients
+\return        true if successful, false if the format is not supported */
+IMAGE_API bool
+image_cubemap_irradiance_sh(const image_t* cubemap, float32_t* sh);
+
+/*! Generate a diffuse irradiance cubemap from the spherical harmonics projection of a
+cubemap. Stored values are irradiance divided by pi, which is the radiance reflected by a
+white Lambertian surface, so a constant environment maps to itself. Alpha is set to one.
+\param irradiance Cubemap receiving a single level in the source format, previous storage is released
+\param cubemap    Source cubemap, must be uncompressed with byte aligned pixels
+\param size       Face size, zero for a default of 32
+\return           true if successful, false if the format is not supported */
+IMAGE_API bool
+image_cubemap_irradiance(image_t* irradiance, const image_t* cubemap, unsigned int size);
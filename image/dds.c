@@ -0,0 +1,214 @@
+/* dds.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "dds.h"
+#include "pixel.h"
+
+#define DDS_HEADER_SIZE 124
+#define DDS_PIXELFORMAT_SIZE 32
+#define DDS_HEADER_DX10_SIZE 20
+
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PITCH 0x8
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDSD_DEPTH 0x800000
+
+#define DDPF_ALPHAPIXELS 0x1
+#define DDPF_FOURCC 0x4
+#define DDPF_RGB 0x40
+
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+#define DDSCAPS2_CUBEMAP 0x200
+#define DDSCAPS2_CUBEMAP_ALLFACES 0xFC00
+#define DDSCAPS2_VOLUME 0x200000
+
+#define DDS_DIMENSION_TEXTURE2D 3
+#define DDS_DIMENSION_TEXTURE3D 4
+
+#define DDS_RESOURCE_MISC_TEXTURECUBE 0x4
+
+typedef struct dds_format_t dds_format_t;
+
+struct dds_format_t {
+	image_datatype_t data_type;
+	unsigned int bits_per_channel;
+	unsigned int channels_count;
+	uint32_t dxgi_format;
+	uint32_t dxgi_format_srgb;
+};
+
+static const dds_format_t dds_format[] = {
+    {IMAGE_DATATYPE_UNSIGNED_INT, 8, 1, 61, 61},  {IMAGE_DATATYPE_UNSIGNED_INT, 8, 2, 49, 49},
+    {IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, 28, 29},  {IMAGE_DATATYPE_UNSIGNED_INT, 16, 1, 56, 56},
+    {IMAGE_DATATYPE_UNSIGNED_INT, 16, 2, 35, 35}, {IMAGE_DATATYPE_UNSIGNED_INT, 16, 4, 11, 11},
+    {IMAGE_DATATYPE_INT, 8, 1, 63, 63},           {IMAGE_DATATYPE_INT, 8, 2, 51, 51},
+    {IMAGE_DATATYPE_INT, 8, 4, 31, 31},           {IMAGE_DATATYPE_INT, 16, 1, 58, 58},
+    {IMAGE_DATATYPE_INT, 16, 2, 37, 37},          {IMAGE_DATATYPE_INT, 16, 4, 13, 13},
+    {IMAGE_DATATYPE_FLOAT, 16, 1, 54, 54},        {IMAGE_DATATYPE_FLOAT, 16, 2, 34, 34},
+    {IMAGE_DATATYPE_FLOAT, 16, 4, 10, 10},        {IMAGE_DATATYPE_FLOAT, 32, 1, 41, 41},
+    {IMAGE_DATATYPE_FLOAT, 32, 2, 16, 16},        {IMAGE_DATATYPE_FLOAT, 32, 3, 6, 6},
+    {IMAGE_DATATYPE_FLOAT, 32, 4, 2, 2}};
+
+static void
+dds_uint32_store(uint8_t* dest, uint32_t value) {
+	dest[0] = (uint8_t)value;
+	dest[1] = (uint8_t)(value >> 8);
+	dest[2] = (uint8_t)(value >> 16);
+	dest[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t
+dds_dxgi_format(const image_pixelformat_t* pixelformat) {
+	bool srgb = (pixelformat->colorspace == IMAGE_COLORSPACE_sRGB);
+	switch (pixelformat->compression) {
+		case IMAGE_COMPRESSION_BC1:
+			return srgb ? 72 : 71;
+		case IMAGE_COMPRESSION_BC2:
+			return srgb ? 75 : 74;
+		case IMAGE_COMPRESSION_BC3:
+			return srgb ? 78 : 77;
+		case IMAGE_COMPRESSION_NONE:
+			break;
+		default:
+			return 0;
+	}
+
+	image_datatype_t data_type;
+	unsigned int bits_per_channel;
+	if (!image_pixelformat_is_uniform(pixelformat, &data_type, &bits_per_channel))
+		return 0;
+	for (size_t iformat = 0; iformat < sizeof(dds_format) / sizeof(dds_format[0]); ++iformat) {
+		const dds_format_t* format = dds_format + iformat;
+		if ((format->data_type == data_type) && (format->bits_per_channel == bits_per_channel) &&
+		    (format->channels_count == pixelformat->channels_count))
+			return srgb ? format->dxgi_format_srgb : format->dxgi_format;
+	}
+	return 0;
+}
+
+bool
+image_dds_save(const image_t* image, stream_t* stream, const image_save_options_t* options) {
+	FOUNDATION_UNUSED(options);
+
+	const image_pixelformat_t* pixelformat = &image->format;
+	image_datatype_t data_type = IMAGE_DATATYPE_UNSIGNED_INT;
+	unsigned int bits_per_channel = 0;
+	bool uniform = image_pixelformat_is_uniform(pixelformat, &data_type, &bits_per_channel);
+	// 24-bit RGB has no DXGI format and is stored with a legacy header
+	bool legacy_rgb = uniform && (data_type == IMAGE_DATATYPE_UNSIGNED_INT) && (bits_per_channel == 8) &&
+	                  (pixelformat->channels_count == 3);
+	uint32_t dxgi_format = legacy_rgb ? 0 : dds_dxgi_format(pixelformat);
+	if (!legacy_rgb && !dxgi_format) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported DDS pixel format (compression %u)"),
+		          (unsigned int)pixelformat->compression);
+		return false;
+	}
+	unsigned int layers = image_layers(image);
+	if (legacy_rgb && (layers > 1) && !image->cubemap) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported DDS array of 24-bit RGB layers"));
+		return false;
+	}
+
+	bool compressed = (pixelformat->compression != IMAGE_COMPRESSION_NONE);
+	bool volume = (image->depth > 1);
+	size_t level_size = image_buffer_size(pixelformat, image->width, image->height, image->depth, 1);
+
+	uint8_t header[4 + DDS_HEADER_SIZE + DDS_HEADER_DX10_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header, "DDS ", 4);
+	uint8_t* desc = header + 4;
+	uint32_t flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT;
+	flags |= compressed ? DDSD_LINEARSIZE : DDSD_PITCH;
+	if (image->levels > 1)
+		flags |= DDSD_MIPMAPCOUNT;
+	if (volume)
+		flags |= DDSD_DEPTH;
+	dds_uint32_store(desc, DDS_HEADER_SIZE);
+	dds_uint32_store(desc + 4, flags);
+	dds_uint32_store(desc + 8, image->height);
+	dds_uint32_store(desc + 12, image->width);
+	dds_uint32_store(desc + 16,
+	                 compressed ? (uint32_t)(level_size / image->depth) :
+	                              (uint32_t)(((size_t)pixelformat->bits_per_pixel * image->width + 7) / 8));
+	dds_uint32_store(desc + 20, volume ? image->depth : 0);
+	dds_uint32_store(desc + 24, image->levels);
+
+	uint8_t* ddspf = desc + 72;
+	dds_uint32_store(ddspf, DDS_PIXELFORMAT_SIZE);
+	if (legacy_rgb) {
+		dds_uint32_store(ddspf + 4, DDPF_RGB);
+		dds_uint32_store(ddspf + 12, 24);
+		dds_uint32_store(ddspf + 16, 0x000000FF);
+		dds_uint32_store(ddspf + 20, 0x0000FF00);
+		dds_uint32_store(ddspf + 24, 0x00FF0000);
+	} else {
+		dds_uint32_store(ddspf + 4, DDPF_FOURCC);
+		memcpy(ddspf + 8, "DX10", 4);
+	}
+
+	uint32_t caps = DDSCAPS_TEXTURE;
+	if (image->levels > 1)
+		caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	if (volume || (layers > 1))
+		caps |= DDSCAPS_COMPLEX;
+	dds_uint32_store(desc + 104, caps);
+	dds_uint32_store(desc + 108, volume ? DDSCAPS2_VOLUME :
+	                                      (image->cubemap ? (DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES) : 0));
+
+	size_t header_size = 4 + DDS_HEADER_SIZE;
+	if (!legacy_rgb) {
+		uint8_t* dx10 = header + header_size;
+		dds_uint32_store(dx10, dxgi_format);
+		dds_uint32_store(dx10 + 4, volume ? DDS_DIMENSION_TEXTURE3D : DDS_DIMENSION_TEXTURE2D);
+		// Array size of a cubemap counts whole cubes
+		dds_uint32_store(dx10 + 8, image->cubemap ? DDS_RESOURCE_MISC_TEXTURECUBE : 0);
+		dds_uint32_store(dx10 + 12, image->cubemap ? layers / 6 : layers);
+		dds_uint32_store(dx10 + 16, 0);
+		header_size += DDS_HEADER_DX10_SIZE;
+	}
+	stream_write(stream, header, header_size);
+
+	// Mip levels are stored consecutively, each level with all depth slices,
+	// matching the in-memory layout of a single layer
+	if (layers == 1) {
+		size_t data_size = image_buffer_size(pixelformat, image->width, image->height, image->depth, image->levels);
+		stream_write(stream, image->data, data_size);
+		return true;
+	}
+
+	// Layers are stored with their full mip chain one after the other, while memory
+	// holds all layers of a level together
+	for (unsigned int layer = 0; layer < layers; ++layer) {
+		for (unsigned int level = 0; level < image->levels; ++level) {
+			size_t layer_size = image_buffer_size(pixelformat, image_width(image, level), image_height(image, level),
+			                                      image_depth(image, level), 1);
+			stream_write(stream, image_layer_buffer((image_t*)image, level, layer), layer_size);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,324 @@
+/* dedup.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "dedup.h"
+
+#define IMAGE_PHASH_SIZE 32
+#define IMAGE_PHASH_FREQUENCIES 8
+//! Source rows averaged into each row of the downscale
+#define IMAGE_PHASH_ROW_SAMPLES 4
+
+typedef struct image_dedup_entry_t image_dedup_entry_t;
+typedef struct image_dedup_job_t image_dedup_job_t;
+
+struct image_dedup_entry_t {
+	hash_t hash;
+	size_t index;
+};
+
+struct image_dedup_job_t {
+	image_t* images;
+	image_dedup_result_t* results;
+	bool* perceptual;
+	unsigned int flags;
+};
+
+static bool
+image_dedup_is_astc(const image_t* image) {
+	return (image->format.compression == IMAGE_COMPRESSION_ASTC_LDR) ||
+	       (image->format.compression == IMAGE_COMPRESSION_ASTC_HDR);
+}
+
+hash_t
+image_content_hash(const image_t* image) {
+	if (!image->data)
+		return 0;
+	// Format and dimensions are serialized field by field so padding never affects the hash
+	uint32_t key[16 + IMAGE_CHANNEL_COUNT * 3];
+	const image_pixelformat_t* format = &image->format;
+	hash_t data_hash = hash(image->data, image_data_size(image));
+	size_t ikey = 0;
+	key[ikey++] = (uint32_t)data_hash;
+	key[ikey++] = (uint32_t)(data_hash >> 32);
+	key[ikey++] = image->width;
+	key[ikey++] = image->height;
+	key[ikey++] = image->depth;
+	key[ikey++] = image->levels;
+	key[ikey++] = image_layers(image);
+	key[ikey++] = image->cubemap ? 1 : 0;
+	key[ikey++] = (uint32_t)format->compression;
+	key[ikey++] = (uint32_t)format->colorspace;
+	key[ikey++] = format->premultiplied_alpha ? 1 : 0;
+	key[ikey++] = format->bits_per_pixel;
+	key[ikey++] = format->channels_count;
+	key[ikey++] = format->block_width;
+	key[ikey++] = format->block_height;
+	key[ikey++] = format->bits_per_block;
+	for (unsigned int ich = 0; ich < IMAGE_CHANNEL_COUNT; ++ich) {
+		key[ikey++] = (uint32_t)format->channel[ich].data_type;
+		key[ikey++] = format->channel[ich].bits_per_pixel;
+		key[ikey++] = format->channel[ich].offset;
+	}
+	hash_t content_hash = hash(key, sizeof(key));
+	return content_hash ? content_hash : 1;
+}
+
+//! Average luminance into a 32x32 grid, reading at most four source rows per grid row
+static void
+image_phash_downscale(const image_t* image, float64_t* grid) {
+	size_t width = image->width;
+	size_t height = image->height;
+	size_t row_size = ((size_t)image->format.bits_per_pixel * width) / 8;
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * width, 0, MEMORY_PERSISTENT);
+	float64_t* luminance = memory_allocate(HASH_IMAGE, sizeof(float64_t) * width, 0, MEMORY_PERSISTENT);
+	for (size_t iy = 0; iy < IMAGE_PHASH_SIZE; ++iy) {
+		size_t row_begin = (iy * height) / IMAGE_PHASH_SIZE;
+		size_t row_end = ((iy + 1) * height) / IMAGE_PHASH_SIZE;
+		if (row_end <= row_begin)
+			row_end = row_begin + 1;
+		size_t row_count = row_end - row_begin;
+		size_t samples = (row_count < IMAGE_PHASH_ROW_SAMPLES) ? row_count : IMAGE_PHASH_ROW_SAMPLES;
+
+		float64_t* grid_row = grid + iy * IMAGE_PHASH_SIZE;
+		memset(grid_row, 0, sizeof(float64_t) * IMAGE_PHASH_SIZE);
+		for (size_t isample = 0; isample < samples; ++isample) {
+			size_t row = row_begin + (isample * row_count) / samples;
+			image_pixel_read(&image->format, image->data + row_size * row, width, rgba);
+			for (size_t ipixel = 0; ipixel < width; ++ipixel) {
+				const float32_t* pixel = rgba + ipixel * 4;
+				luminance[ipixel] = 0.299 * pixel[0] + 0.587 * pixel[1] + 0.114 * pixel[2];
+			}
+			for (size_t ix = 0; ix < IMAGE_PHASH_SIZE; ++ix) {
+				size_t column_begin = (ix * width) / IMAGE_PHASH_SIZE;
+				size_t column_end = ((ix + 1) * width) / IMAGE_PHASH_SIZE;
+				if (column_end <= column_begin)
+					column_end = column_begin + 1;
+				float64_t sum = 0;
+				for (size_t ipixel = column_begin; ipixel < column_end; ++ipixel)
+					sum += luminance[ipixel];
+				grid_row[ix] += sum / (float64_t)(column_end - column_begin);
+			}
+		}
+		for (size_t ix = 0; ix < IMAGE_PHASH_SIZE; ++ix)
+			grid_row[ix] /= (float64_t)samples;
+	}
+	memory_deallocate(luminance);
+	memory_deallocate(rgba);
+}
+
+static uint64_t
+image_phash_grid(const float64_t* grid) {
+	// Only the lowest frequencies of the two dimensional DCT-II are needed
+	float64_t basis[IMAGE_PHASH_FREQUENCIES][IMAGE_PHASH_SIZE];
+	for (unsigned int ifreq = 0; ifreq < IMAGE_PHASH_FREQUENCIES; ++ifreq) {
+		for (unsigned int ix = 0; ix < IMAGE_PHASH_SIZE; ++ix)
+			basis[ifreq][ix] = cos(((2.0 * ix + 1.0) * ifreq * REAL_PI) / (2.0 * IMAGE_PHASH_SIZE));
+	}
+
+	float64_t rows[IMAGE_PHASH_SIZE][IMAGE_PHASH_FREQUENCIES];
+	for (unsigned int iy = 0; iy < IMAGE_PHASH_SIZE; ++iy) {
+		for (unsigned int ifreq = 0; ifreq < IMAGE_PHASH_FREQUENCIES; ++ifreq) {
+			float64_t sum = 0;
+			for (unsigned int ix = 0; ix < IMAGE_PHASH_SIZE; ++ix)
+				sum += grid[iy * IMAGE_PHASH_SIZE + ix] * basis[ifreq][ix];
+			rows[iy][ifreq] = sum;
+		}
+	}
+
+	float64_t coefficient[IMAGE_PHASH_FREQUENCIES * IMAGE_PHASH_FREQUENCIES];
+	float64_t sorted[IMAGE_PHASH_FREQUENCIES * IMAGE_PHASH_FREQUENCIES];
+	for (unsigned int ifreq_y = 0; ifreq_y < IMAGE_PHASH_FREQUENCIES; ++ifreq_y) {
+		for (unsigned int ifreq_x = 0; ifreq_x < IMAGE_PHASH_FREQUENCIES; ++ifreq_x) {
+			float64_t sum = 0;
+			for (unsigned int iy = 0; iy < IMAGE_PHASH_SIZE; ++iy)
+				sum += rows[iy][ifreq_x] * basis[ifreq_y][iy];
+			coefficient[ifreq_y * IMAGE_PHASH_FREQUENCIES + ifreq_x] = sum;
+		}
+	}
+
+	// Each bit tells if a coefficient is above the median
+	size_t count = IMAGE_PHASH_FREQUENCIES * IMAGE_PHASH_FREQUENCIES;
+	for (size_t icoeff = 0; icoeff < count; ++icoeff) {
+		size_t insert = icoeff;
+		while (insert && (sorted[insert - 1] > coefficient[icoeff])) {
+			sorted[insert] = sorted[insert - 1];
+			--insert;
+		}
+		sorted[insert] = coefficient[icoeff];
+	}
+	float64_t median = (sorted[count / 2 - 1] + sorted[count / 2]) * 0.5;
+	uint64_t bits = 0;
+	for (size_t icoeff = 0; icoeff < count; ++icoeff) {
+		if (coefficient[icoeff] > median)
+			bits |= ((uint64_t)1 << icoeff);
+	}
+	return bits;
+}
+
+bool
+image_perceptual_hash(const image_t* image, uint64_t* hash) {
+	*hash = 0;
+	if (!image->data || !image->width || !image->height)
+		return false;
+
+	image_t decoded;
+	image_initialize(&decoded);
+	if (image_dedup_is_astc(image)) {
+		if (!image_astc_decode(&decoded, image)) {
+			image_finalize(&decoded);
+			return false;
+		}
+		image = &decoded;
+	}
+	const image_pixelformat_t* format = &image->format;
+	if ((format->compression != IMAGE_COMPRESSION_NONE) || !format->bits_per_pixel || (format->bits_per_pixel % 8)) {
+		image_finalize(&decoded);
+		return false;
+	}
+
+	float64_t grid[IMAGE_PHASH_SIZE * IMAGE_PHASH_SIZE];
+	image_phash_downscale(image, grid);
+	*hash = image_phash_grid(grid);
+
+	image_finalize(&decoded);
+	return true;
+}
+
+unsigned int
+image_perceptual_distance(uint64_t first, uint64_t second) {
+	uint64_t bits = first ^ second;
+	bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+	bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+	bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (unsigned int)((bits * 0x0101010101010101ULL) >> 56);
+}
+
+static void
+image_dedup_hash(void* arg, size_t begin, size_t end) {
+	image_dedup_job_t* job = arg;
+	for (size_t iimage = begin; iimage < end; ++iimage) {
+		image_dedup_result_t* result = job->results + iimage;
+		result->content_hash = image_content_hash(job->images + iimage);
+		result->perceptual_hash = 0;
+		result->duplicate_of = iimage;
+		result->exact = false;
+		job->perceptual[iimage] = false;
+		if ((job->flags & IMAGE_DEDUP_PERCEPTUAL) && result->content_hash)
+			job->perceptual[iimage] = image_perceptual_hash(job->images + iimage, &result->perceptual_hash);
+	}
+}
+
+static int
+image_dedup_entry_compare(const void* lhs, const void* rhs) {
+	const image_dedup_entry_t* first = lhs;
+	const image_dedup_entry_t* second = rhs;
+	if (first->hash != second->hash)
+		return (first->hash < second->hash) ? -1 : 1;
+	if (first->index != second->index)
+		return (first->index < second->index) ? -1 : 1;
+	return 0;
+}
+
+static bool
+image_dedup_is_equal(const image_t* first, const image_t* second) {
+	if ((first->width != second->width) || (first->height != second->height) || (first->depth != second->depth) ||
+	    (first->levels != second->levels) || (image_layers(first) != image_layers(second)) ||
+	    (first->cubemap != second->cubemap) || (first->format.compression != second->format.compression) ||
+	    (first->format.colorspace != second->format.colorspace) ||
+	    (first->format.channels_count != second->format.channels_count) ||
+	    (first->format.bits_per_pixel != second->format.bits_per_pixel) ||
+	    (first->format.bits_per_block != second->format.bits_per_block))
+		return false;
+	return !memcmp(first->data, second->data, image_data_size(first));
+}
+
+size_t
+image_dedup(image_t* images, size_t count, unsigned int flags, unsigned int max_distance,
+            image_dedup_result_t* results) {
+	if (!count)
+		return 0;
+
+	image_dedup_job_t job;
+	job.images = images;
+	job.results = results;
+	job.flags = flags;
+	job.perceptual = memory_allocate(HASH_IMAGE, sizeof(bool) * count, 0, MEMORY_PERSISTENT);
+	image_parallel_for(count, 1, image_dedup_hash, &job);
+
+	// Sorting by hash groups exact duplicate candidates, ordered by index within each group
+	image_dedup_entry_t* entry = memory_allocate(HASH_IMAGE, sizeof(image_dedup_entry_t) * count, 0,
+	                                             MEMORY_PERSISTENT);
+	size_t entry_count = 0;
+	for (size_t iimage = 0; iimage < count; ++iimage) {
+		if (results[iimage].content_hash) {
+			entry[entry_count].hash = results[iimage].content_hash;
+			entry[entry_count].index = iimage;
+			++entry_count;
+		}
+	}
+	qsort(entry, entry_count, sizeof(image_dedup_entry_t), image_dedup_entry_compare);
+
+	size_t duplicates = 0;
+	for (size_t ientry = 0, group = 0; ientry < entry_count; ++ientry) {
+		if (entry[ientry].hash != entry[group].hash)
+			group = ientry;
+		size_t index = entry[ientry].index;
+		// Compare against each earlier unique image in the group, hash collisions form separate groups
+		for (size_t iprev = group; iprev < ientry; ++iprev) {
+			size_t original = entry[iprev].index;
+			if ((results[original].duplicate_of == original) &&
+			    image_dedup_is_equal(images + original, images + index)) {
+				results[index].duplicate_of = original;
+				results[index].exact = true;
+				++duplicates;
+				break;
+			}
+		}
+	}
+	memory_deallocate(entry);
+
+	if (flags & IMAGE_DEDUP_PERCEPTUAL) {
+		for (size_t iimage = 0; iimage < count; ++iimage) {
+			if ((results[iimage].duplicate_of != iimage) || !job.perceptual[iimage])
+				continue;
+			for (size_t iprev = 0; iprev < iimage; ++iprev) {
+				if ((results[iprev].duplicate_of != iprev) || !job.perceptual[iprev])
+					continue;
+				if (image_perceptual_distance(results[iprev].perceptual_hash, results[iimage].perceptual_hash) <=
+				    max_distance) {
+					results[iimage].duplicate_of = iprev;
+					++duplicates;
+					break;
+				}
+			}
+		}
+	}
+
+	if (flags & IMAGE_DEDUP_RELEASE) {
+		for (size_t iimage = 0; iimage < count; ++iimage) {
+			if (results[iimage].exact)
+				image_finalize(images + iimage);
+		}
+	}
+
+	memory_deallocate(job.perceptual);
+	return duplicates;
+}
@@ -0,0 +1,64 @@
+/* dedup.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file dedup.h
+    Content and perceptual hashing of decoded images, and duplicate detection across
+    sets of images. The content hash only depends on pixel format, dimensions and pixel
+    data, so images decoded from byte different files with identical pixels hash equal.
+    The perceptual hash is a 64-bit DCT based hash of a 32x32 luminance downscale, where
+    visually similar images differ in few bits. */
+
+#include <image/types.h>
+
+/*! Compute a hash of the pixel format, dimensions and pixel data of all mip levels
+\param image Image
+\return      Content hash, zero if the image has no data */
+IMAGE_API hash_t
+image_content_hash(const image_t* image);
+
+/*! Compute the perceptual hash of the first mip level of an uncompressed or ASTC
+compressed image. Volume images are hashed from the first depth slice.
+\param image Image
+\param hash  Receives perceptual hash
+\return      true if successful, false if the image format is not supported */
+IMAGE_API bool
+image_perceptual_hash(const image_t* image, uint64_t* hash);
+
+/*! Get the number of differing bits between two perceptual hashes
+\param first  First hash
+\param second Second hash
+\return       Hamming distance, 0 to 64 */
+IMAGE_API unsigned int
+image_perceptual_distance(uint64_t first, uint64_t second);
+
+/*! Find duplicates in a set of images. Hashes are computed in one parallel pass, then
+each image is matched against earlier images in the set. Exact duplicates have equal
+content hashes and pixel data, perceptual duplicates have perceptual hashes within the
+given distance. With #IMAGE_DEDUP_RELEASE the storage of exact duplicates is released
+so the pixel data is only held by the image given in the result.
+\param images       Array of images
+\param count        Number of images
+\param flags        Dedup flags, see #image_dedup_flag_t
+\param max_distance Maximum perceptual hash distance for perceptual duplicates
+\param results      Array receiving per image results
+\return             Number of images that duplicate an earlier image */
+IMAGE_API size_t
+image_dedup(image_t* images, size_t count, unsigned int flags, unsigned int max_distance,
+            image_dedup_result_t* results);
@@ -0,0 +1,689 @@
+/* deflate.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "deflate.h"
+
+void
+image_deflate_initialize(void);
+
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_WINDOW_MASK (DEFLATE_WINDOW_SIZE - 1)
+#define DEFLATE_HASH_SIZE 32768
+#define DEFLATE_HASH_MASK (DEFLATE_HASH_SIZE - 1)
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_BLOCK_SYMBOLS 16384
+#define DEFLATE_STORED_MAX 65535
+#define DEFLATE_LITLEN_CODES 286
+#define DEFLATE_DIST_CODES 30
+#define DEFLATE_CODELEN_CODES 19
+#define DEFLATE_NIL ((size_t)-1)
+
+typedef struct deflate_output_t deflate_output_t;
+typedef struct deflate_symbol_t deflate_symbol_t;
+typedef struct deflate_context_t deflate_context_t;
+
+struct deflate_output_t {
+	uint8_t* data;
+	size_t offset;
+	uint64_t bits;
+	unsigned int bit_count;
+};
+
+//! LZ77 symbol, a literal if length is zero (distance then holds the literal byte)
+struct deflate_symbol_t {
+	uint16_t length;
+	uint16_t distance;
+};
+
+struct deflate_context_t {
+	const uint8_t* source;
+	size_t size;
+	size_t head[DEFLATE_HASH_SIZE];
+	size_t prev[DEFLATE_WINDOW_SIZE];
+	deflate_symbol_t symbol[DEFLATE_BLOCK_SYMBOLS];
+	unsigned int symbol_count;
+	size_t block_start;
+	size_t block_end;
+	unsigned int max_chain;
+	unsigned int nice_length;
+	bool lazy;
+	bool final;
+	deflate_output_t output;
+};
+
+static const uint16_t deflate_length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                                 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t deflate_length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t deflate_dist_base[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                               33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                               1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t deflate_dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                               6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t deflate_codelen_order[DEFLATE_CODELEN_CODES] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                                                     11, 4,  12, 3, 13, 2, 14, 1, 15};
+static const uint16_t deflate_level_chain[10] = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+static const uint16_t deflate_level_nice[10] = {0, 8, 16, 32, 64, 128, 128, 258, 258, 258};
+
+static uint8_t deflate_length_code[DEFLATE_MAX_MATCH + 1];
+static uint8_t deflate_dist_code[DEFLATE_WINDOW_SIZE + 1];
+static uint8_t deflate_fixed_litlen_length[288];
+static uint8_t deflate_fixed_dist_length[DEFLATE_DIST_CODES];
+static uint16_t deflate_fixed_litlen_code[288];
+static uint16_t deflate_fixed_dist_code[DEFLATE_DIST_CODES];
+static uint32_t crc32_table[256];
+
+static void
+deflate_codes_assign(const uint8_t* lengths, unsigned int count, uint16_t* codes) {
+	unsigned int bl_count[16] = {0};
+	unsigned int next_code[16];
+	for (unsigned int isym = 0; isym < count; ++isym)
+		++bl_count[lengths[isym]];
+	bl_count[0] = 0;
+	unsigned int code = 0;
+	for (unsigned int bits = 1; bits < 16; ++bits) {
+		code = (code + bl_count[bits - 1]) << 1;
+		next_code[bits] = code;
+	}
+	for (unsigned int isym = 0; isym < count; ++isym) {
+		unsigned int length = lengths[isym];
+		if (!length) {
+			codes[isym] = 0;
+			continue;
+		}
+		// Huffman codes are stored most significant bit first, reverse for the bit writer
+		unsigned int value = next_code[length]++;
+		unsigned int reversed = 0;
+		for (unsigned int ibit = 0; ibit < length; ++ibit, value >>= 1)
+			reversed = (reversed << 1) | (value & 1);
+		codes[isym] = (uint16_t)reversed;
+	}
+}
+
+void
+image_deflate_initialize(void) {
+	for (unsigned int icode = 0; icode < 29; ++icode) {
+		unsigned int end = (icode < 28) ? deflate_length_base[icode + 1] : DEFLATE_MAX_MATCH + 1;
+		for (unsigned int length = deflate_length_base[icode]; length < end; ++length)
+			deflate_length_code[length] = (uint8_t)icode;
+	}
+	for (unsigned int icode = 0; icode < DEFLATE_DIST_CODES; ++icode) {
+		unsigned int end = deflate_dist_base[icode] + (1U << deflate_dist_extra[icode]);
+		for (unsigned int distance = deflate_dist_base[icode]; distance < end; ++distance)
+			deflate_dist_code[distance] = (uint8_t)icode;
+	}
+
+	for (unsigned int isym = 0; isym < 288; ++isym)
+		deflate_fixed_litlen_length[isym] = (isym < 144) ? 8 : ((isym < 256) ? 9 : ((isym < 280) ? 7 : 8));
+	for (unsigned int isym = 0; isym < DEFLATE_DIST_CODES; ++isym)
+		deflate_fixed_dist_length[isym] = 5;
+	deflate_codes_assign(deflate_fixed_litlen_length, 288, deflate_fixed_litlen_code);
+	deflate_codes_assign(deflate_fixed_dist_length, DEFLATE_DIST_CODES, deflate_fixed_dist_code);
+
+	for (uint32_t ientry = 0; ientry < 256; ++ientry) {
+		uint32_t crc = ientry;
+		for (unsigned int ibit = 0; ibit < 8; ++ibit)
+			crc = (crc & 1) ? (0xEDB88320U ^ (crc >> 1)) : (crc >> 1);
+		crc32_table[ientry] = crc;
+	}
+}
+
+uint32_t
+image_crc32(uint32_t crc, const void* source, size_t size) {
+	const uint8_t* data = source;
+	crc = ~crc;
+	for (size_t ibyte = 0; ibyte < size; ++ibyte)
+		crc = crc32_table[(crc ^ data[ibyte]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+#define ADLER32_BASE 65521U
+// Largest number of bytes which can be summed before the 32-bit sums must be reduced
+#define ADLER32_RUN 5552
+
+uint32_t
+image_adler32(uint32_t adler, const void* source, size_t size) {
+	const uint8_t* data = source;
+	uint32_t sum1 = adler & 0xFFFF;
+	uint32_t sum2 = adler >> 16;
+	while (size) {
+		size_t run = (size < ADLER32_RUN) ? size : ADLER32_RUN;
+		size -= run;
+		while (run--) {
+			sum1 += *data++;
+			sum2 += sum1;
+		}
+		sum1 %= ADLER32_BASE;
+		sum2 %= ADLER32_BASE;
+	}
+	return (sum2 << 16) | sum1;
+}
+
+uint32_t
+image_adler32_combine(uint32_t first, uint32_t second, size_t second_size) {
+	uint32_t remainder = (uint32_t)(second_size % ADLER32_BASE);
+	uint32_t sum1 = first & 0xFFFF;
+	uint32_t sum2 = (uint32_t)(((uint64_t)remainder * sum1) % ADLER32_BASE);
+	sum1 += (second & 0xFFFF) + ADLER32_BASE - 1;
+	sum2 += (first >> 16) + (second >> 16) + ADLER32_BASE - remainder;
+	if (sum1 >= ADLER32_BASE)
+		sum1 -= ADLER32_BASE;
+	if (sum1 >= ADLER32_BASE)
+		sum1 -= ADLER32_BASE;
+	if (sum2 >= (ADLER32_BASE << 1))
+		sum2 -= (ADLER32_BASE << 1);
+	if (sum2 >= ADLER32_BASE)
+		sum2 -= ADLER32_BASE;
+	return (sum2 << 16) | sum1;
+}
+
+size_t
+image_deflate_bound(size_t size) {
+	// Blocks fall back to stored when compression does not pay off, overhead is then
+	// bounded by stored block headers and alignment padding for each symbol block
+	return size + (size / 2048) * 8 + 128;
+}
+
+static void
+deflate_bits_write(deflate_output_t* output, uint32_t value, unsigned int count) {
+	output->bits |= (uint64_t)value << output->bit_count;
+	output->bit_count += count;
+	while (output->bit_count >= 8) {
+		output->data[output->offset++] = (uint8_t)output->bits;
+		output->bits >>= 8;
+		output->bit_count -= 8;
+	}
+}
+
+static void
+deflate_bits_align(deflate_output_t* output) {
+	if (output->bit_count)
+		deflate_bits_write(output, 0, 8 - output->bit_count);
+}
+
+static void
+deflate_huffman_lengths(const uint32_t* freq, unsigned int count, unsigned int limit, uint8_t* lengths) {
+	uint16_t leaf[DEFLATE_LITLEN_CODES];
+	uint32_t node_freq[DEFLATE_LITLEN_CODES * 2];
+	uint16_t parent[DEFLATE_LITLEN_CODES * 2];
+	uint8_t depth[DEFLATE_LITLEN_CODES * 2];
+	unsigned int leaf_count = 0;
+
+	memset(lengths, 0, count);
+	for (unsigned int isym = 0; isym < count; ++isym) {
+		if (!freq[isym])
+			continue;
+		// Insertion sort by ascending frequency
+		unsigned int islot = leaf_count++;
+		while (islot && (freq[leaf[islot - 1]] > freq[isym])) {
+			leaf[islot] = leaf[islot - 1];
+			--islot;
+		}
+		leaf[islot] = (uint16_t)isym;
+	}
+	if (!leaf_count)
+		return;
+	if (leaf_count == 1) {
+		// Pad a single code with an unused symbol to form a complete code
+		lengths[leaf[0]] = 1;
+		lengths[leaf[0] ? 0 : 1] = 1;
+		return;
+	}
+
+	// Two queue Huffman construction, internal nodes are created in order of
+	// nondecreasing frequency so they form a second sorted queue
+	for (unsigned int ileaf = 0; ileaf < leaf_count; ++ileaf)
+		node_freq[ileaf] = freq[leaf[ileaf]];
+	unsigned int next_leaf = 0;
+	unsigned int next_node = leaf_count;
+	unsigned int node_count = leaf_count;
+	for (unsigned int imerge = 0; imerge < leaf_count - 1; ++imerge) {
+		unsigned int child[2];
+		for (unsigned int ichild = 0; ichild < 2; ++ichild) {
+			if ((next_leaf < leaf_count) &&
+			    ((next_node >= node_count) || (node_freq[next_leaf] <= node_freq[next_node])))
+				child[ichild] = next_leaf++;
+			else
+				child[ichild] = next_node++;
+		}
+		node_freq[node_count] = node_freq[child[0]] + node_freq[child[1]];
+		parent[child[0]] = (uint16_t)node_count;
+		parent[child[1]] = (uint16_t)node_count;
+		++node_count;
+	}
+	unsigned int bl_count[DEFLATE_LITLEN_CODES * 2];
+	memset(bl_count, 0, sizeof(bl_count));
+	depth[node_count - 1] = 0;
+	unsigned int max_length = 0;
+	for (unsigned int inode = node_count - 1; inode-- > 0;) {
+		depth[inode] = (uint8_t)(depth[parent[inode]] + 1);
+		if (inode < leaf_count) {
+			++bl_count[depth[inode]];
+			max_length = (depth[inode] > max_length) ? depth[inode] : max_length;
+		}
+	}
+
+	// Limit code lengths by moving pairs of the longest codes up the tree
+	for (unsigned int length = max_length; length > limit; --length) {
+		while (bl_count[length]) {
+			unsigned int shorter = length - 2;
+			while (!bl_count[shorter])
+				--shorter;
+			bl_count[length] -= 2;
+			bl_count[length - 1] += 1;
+			bl_count[shorter + 1] += 2;
+			bl_count[shorter] -= 1;
+		}
+	}
+
+	// Assign the longest codes to the least frequent symbols
+	unsigned int ileaf = 0;
+	for (unsigned int length = (max_length < limit) ? max_length : limit; length > 0; --length) {
+		for (unsigned int icount = 0; icount < bl_count[length]; ++icount)
+			lengths[leaf[ileaf++]] = (uint8_t)length;
+	}
+}
+
+typedef struct deflate_tree_t deflate_tree_t;
+
+struct deflate_tree_t {
+	uint8_t litlen_length[DEFLATE_LITLEN_CODES];
+	uint8_t dist_length[DEFLATE_DIST_CODES];
+	uint16_t litlen_code[DEFLATE_LITLEN_CODES];
+	uint16_t dist_code[DEFLATE_DIST_CODES];
+	uint8_t codelen_length[DEFLATE_CODELEN_CODES];
+	uint16_t codelen_code[DEFLATE_CODELEN_CODES];
+	uint8_t rle[DEFLATE_LITLEN_CODES + DEFLATE_DIST_CODES];
+	uint8_t rle_extra[DEFLATE_LITLEN_CODES + DEFLATE_DIST_CODES];
+	unsigned int rle_count;
+	unsigned int litlen_count;
+	unsigned int dist_count;
+	unsigned int codelen_count;
+};
+
+static size_t
+deflate_tree_build(deflate_tree_t* tree, const uint32_t* litlen_freq, const uint32_t* dist_freq) {
+	deflate_huffman_lengths(litlen_freq, DEFLATE_LITLEN_CODES, 15, tree->litlen_length);
+	deflate_huffman_lengths(dist_freq, DEFLATE_DIST_CODES, 15, tree->dist_length);
+
+	// Blocks without matches still need a complete distance code
+	if (!tree->dist_length[0] && !tree->dist_length[1]) {
+		bool dist_used = false;
+		for (unsigned int icode = 2; icode < DEFLATE_DIST_CODES; ++icode)
+			dist_used = dist_used || tree->dist_length[icode];
+		if (!dist_used) {
+			tree->dist_length[0] = 1;
+			tree->dist_length[1] = 1;
+		}
+	}
+
+	deflate_codes_assign(tree->litlen_length, DEFLATE_LITLEN_CODES, tree->litlen_code);
+	deflate_codes_assign(tree->dist_length, DEFLATE_DIST_CODES, tree->dist_code);
+
+	tree->litlen_count = DEFLATE_LITLEN_CODES;
+	while ((tree->litlen_count > 257) && !tree->litlen_length[tree->litlen_count - 1])
+		--tree->litlen_count;
+	tree->dist_count = DEFLATE_DIST_CODES;
+	while ((tree->dist_count > 1) && !tree->dist_length[tree->dist_count - 1])
+		--tree->dist_count;
+
+	uint8_t lengths[DEFLATE_LITLEN_CODES + DEFLATE_DIST_CODES];
+	unsigned int total = tree->litlen_count + tree->dist_count;
+	memcpy(lengths, tree->litlen_length, tree->litlen_count);
+	memcpy(lengths + tree->litlen_count, tree->dist_length, tree->dist_count);
+
+	uint32_t codelen_freq[DEFLATE_CODELEN_CODES];
+	memset(codelen_freq, 0, sizeof(codelen_freq));
+	tree->rle_count = 0;
+	for (unsigned int ilen = 0; ilen < total;) {
+		unsigned int length = lengths[ilen];
+		unsigned int run = 1;
+		while ((ilen + run < total) && (lengths[ilen + run] == length))
+			++run;
+		ilen += run;
+		if (!length) {
+			while (run >= 11) {
+				unsigned int chunk = (run > 138) ? 138 : run;
+				tree->rle[tree->rle_count] = 18;
+				tree->rle_extra[tree->rle_count++] = (uint8_t)(chunk - 11);
+				run -= chunk;
+			}
+			if (run >= 3) {
+				tree->rle[tree->rle_count] = 17;
+				tree->rle_extra[tree->rle_count++] = (uint8_t)(run - 3);
+				run = 0;
+			}
+		} else {
+			tree->rle[tree->rle_count] = (uint8_t)length;
+			tree->rle_extra[tree->rle_count++] = 0;
+			--run;
+			while (run >= 3) {
+				unsigned int chunk = (run > 6) ? 6 : run;
+				tree->rle[tree->rle_count] = 16;
+				tree->rle_extra[tree->rle_count++] = (uint8_t)(chunk - 3);
+				run -= chunk;
+			}
+		}
+		while (run--) {
+			tree->rle[tree->rle_count] = (uint8_t)length;
+			tree->rle_extra[tree->rle_count++] = 0;
+		}
+	}
+	for (unsigned int irle = 0; irle < tree->rle_count; ++irle)
+		++codelen_freq[tree->rle[irle]];
+
+	deflate_huffman_lengths(codelen_freq, DEFLATE_CODELEN_CODES, 7, tree->codelen_length);
+	deflate_codes_assign(tree->codelen_length, DEFLATE_CODELEN_CODES, tree->codelen_code);
+	tree->codelen_count = DEFLATE_CODELEN_CODES;
+	while ((tree->codelen_count > 4) && !tree->codelen_length[deflate_codelen_order[tree->codelen_count - 1]])
+		--tree->codelen_count;
+
+	size_t header_bits = 5 + 5 + 4 + 3 * tree->codelen_count;
+	for (unsigned int irle = 0; irle < tree->rle_count; ++irle) {
+		unsigned int symbol = tree->rle[irle];
+		header_bits += tree->codelen_length[symbol];
+		header_bits += (symbol == 16) ? 2 : ((symbol == 17) ? 3 : ((symbol == 18) ? 7 : 0));
+	}
+	return header_bits;
+}
+
+static void
+deflate_tree_write(deflate_output_t* output, const deflate_tree_t* tree) {
+	deflate_bits_write(output, tree->litlen_count - 257, 5);
+	deflate_bits_write(output, tree->dist_count - 1, 5);
+	deflate_bits_write(output, tree->codelen_count - 4, 4);
+	for (unsigned int icode = 0; icode < tree->codelen_count; ++icode)
+		deflate_bits_write(output, tree->codelen_length[deflate_codelen_order[icode]], 3);
+	for (unsigned int irle = 0; irle < tree->rle_count; ++irle) {
+		unsigned int symbol = tree->rle[irle];
+		deflate_bits_write(output, tree->codelen_code[symbol], tree->codelen_length[symbol]);
+		if (symbol == 16)
+			deflate_bits_write(output, tree->rle_extra[irle], 2);
+		else if (symbol == 17)
+			deflate_bits_write(output, tree->rle_extra[irle], 3);
+		else if (symbol == 18)
+			deflate_bits_write(output, tree->rle_extra[irle], 7);
+	}
+}
+
+static void
+deflate_symbols_write(deflate_output_t* output, const deflate_symbol_t* symbol, unsigned int count,
+                      const uint16_t* litlen_code, const uint8_t* litlen_length, const uint16_t* dist_code,
+                      const uint8_t* dist_length) {
+	for (unsigned int isym = 0; isym < count; ++isym) {
+		if (!symbol[isym].length) {
+			unsigned int literal = symbol[isym].distance;
+			deflate_bits_write(output, litlen_code[literal], litlen_length[literal]);
+			continue;
+		}
+		unsigned int length = symbol[isym].length;
+		unsigned int distance = symbol[isym].distance;
+		unsigned int lcode = deflate_length_code[length];
+		unsigned int dcode = deflate_dist_code[distance];
+		deflate_bits_write(output, litlen_code[257 + lcode], litlen_length[257 + lcode]);
+		if (deflate_length_extra[lcode])
+			deflate_bits_write(output, length - deflate_length_base[lcode], deflate_length_extra[lcode]);
+		deflate_bits_write(output, dist_code[dcode], dist_length[dcode]);
+		if (deflate_dist_extra[dcode])
+			deflate_bits_write(output, distance - deflate_dist_base[dcode], deflate_dist_extra[dcode]);
+	}
+	deflate_bits_write(output, litlen_code[256], litlen_length[256]);
+}
+
+static void
+deflate_stored_write(deflate_output_t* output, const uint8_t* data, size_t size, bool final) {
+	do {
+		size_t chunk = (size > DEFLATE_STORED_MAX) ? DEFLATE_STORED_MAX : size;
+		size -= chunk;
+		deflate_bits_write(output, (final && !size) ? 1 : 0, 1);
+		deflate_bits_write(output, 0, 2);
+		deflate_bits_align(output);
+		deflate_bits_write(output, (uint32_t)chunk, 16);
+		deflate_bits_write(output, (uint32_t)(~chunk & 0xFFFF), 16);
+		memcpy(output->data + output->offset, data, chunk);
+		output->offset += chunk;
+		data += chunk;
+	} while (size);
+}
+
+static void
+deflate_block_flush(deflate_context_t* context, bool last) {
+	bool final = last && context->final;
+	uint32_t litlen_freq[DEFLATE_LITLEN_CODES];
+	uint32_t dist_freq[DEFLATE_DIST_CODES];
+	memset(litlen_freq, 0, sizeof(litlen_freq));
+	memset(dist_freq, 0, sizeof(dist_freq));
+
+	size_t extra_bits = 0;
+	for (unsigned int isym = 0; isym < context->symbol_count; ++isym) {
+		const deflate_symbol_t* symbol = context->symbol + isym;
+		if (!symbol->length) {
+			++litlen_freq[symbol->distance];
+			continue;
+		}
+		unsigned int lcode = deflate_length_code[symbol->length];
+		unsigned int dcode = deflate_dist_code[symbol->distance];
+		++litlen_freq[257 + lcode];
+		++dist_freq[dcode];
+		extra_bits += deflate_length_extra[lcode] + deflate_dist_extra[dcode];
+	}
+	litlen_freq[256] = 1;
+
+	deflate_tree_t tree;
+	size_t dynamic_bits = 3 + deflate_tree_build(&tree, litlen_freq, dist_freq) + extra_bits;
+	size_t fixed_bits = 3 + extra_bits;
+	for (unsigned int icode = 0; icode < DEFLATE_LITLEN_CODES; ++icode) {
+		dynamic_bits += (size_t)litlen_freq[icode] * tree.litlen_length[icode];
+		fixed_bits += (size_t)litlen_freq[icode] * deflate_fixed_litlen_length[icode];
+	}
+	for (unsigned int icode = 0; icode < DEFLATE_DIST_CODES; ++icode) {
+		dynamic_bits += (size_t)dist_freq[icode] * tree.dist_length[icode];
+		fixed_bits += (size_t)dist_freq[icode] * deflate_fixed_dist_length[icode];
+	}
+	size_t raw_size = context->block_end - context->block_start;
+	size_t stored_bits = (raw_size + (raw_size / DEFLATE_STORED_MAX + 1) * 5 + 1) * 8;
+
+	deflate_output_t* output = &context->output;
+	if ((stored_bits <= dynamic_bits) && (stored_bits <= fixed_bits)) {
+		deflate_stored_write(output, context->source + context->block_start, raw_size, final);
+	} else if (fixed_bits <= dynamic_bits) {
+		deflate_bits_write(output, final ? 1 : 0, 1);
+		deflate_bits_write(output, 1, 2);
+		deflate_symbols_write(output, context->symbol, context->symbol_count, deflate_fixed_litlen_code,
+		                      deflate_fixed_litlen_length, deflate_fixed_dist_code, deflate_fixed_dist_length);
+	} else {
+		deflate_bits_write(output, final ? 1 : 0, 1);
+		deflate_bits_write(output, 2, 2);
+		deflate_tree_write(output, &tree);
+		deflate_symbols_write(output, context->symbol, context->symbol_count, tree.litlen_code, tree.litlen_length,
+		                      tree.dist_code, tree.dist_length);
+	}
+
+	context->symbol_count = 0;
+	context->block_start = context->block_end;
+}
+
+static void
+deflate_symbol_emit(deflate_context_t* context, unsigned int length, unsigned int distance) {
+	deflate_symbol_t* symbol = context->symbol + context->symbol_count++;
+	if (length) {
+		symbol->length = (uint16_t)length;
+		symbol->distance = (uint16_t)distance;
+		context->block_end += length;
+	} else {
+		symbol->length = 0;
+		symbol->distance = context->source[context->block_end];
+		context->block_end += 1;
+	}
+	if (context->symbol_count == DEFLATE_BLOCK_SYMBOLS)
+		deflate_block_flush(context, false);
+}
+
+static unsigned int
+deflate_hash(const uint8_t* data) {
+	return (((unsigned int)data[0] << 10) ^ ((unsigned int)data[1] << 5) ^ data[2]) & DEFLATE_HASH_MASK;
+}
+
+static void
+deflate_hash_insert(deflate_context_t* context, size_t pos) {
+	if (pos + DEFLATE_MIN_MATCH > context->size)
+		return;
+	unsigned int hash = deflate_hash(context->source + pos);
+	context->prev[pos & DEFLATE_WINDOW_MASK] = context->head[hash];
+	context->head[hash] = pos;
+}
+
+static unsigned int
+deflate_match_find(deflate_context_t* context, size_t pos, unsigned int min_length, unsigned int* distance) {
+	const uint8_t* source = context->source;
+	size_t available = context->size - pos;
+	if (available < DEFLATE_MIN_MATCH)
+		return 0;
+	unsigned int max_length = (available < DEFLATE_MAX_MATCH) ? (unsigned int)available : DEFLATE_MAX_MATCH;
+	size_t limit = (pos > DEFLATE_WINDOW_SIZE) ? pos - DEFLATE_WINDOW_SIZE : 0;
+	unsigned int best_length = (min_length < DEFLATE_MIN_MATCH - 1) ? DEFLATE_MIN_MATCH - 1 : min_length;
+	unsigned int best_distance = 0;
+	unsigned int chain = context->max_chain;
+
+	size_t candidate = context->head[deflate_hash(source + pos)];
+	while ((candidate != DEFLATE_NIL) && (candidate >= limit) && (candidate < pos) && chain--) {
+		const uint8_t* match = source + candidate;
+		const uint8_t* current = source + pos;
+		if ((best_length < max_length) && (match[best_length] == current[best_length]) && (match[0] == current[0]) &&
+		    (match[1] == current[1])) {
+			unsigned int length = 2;
+			while ((length < max_length) && (match[length] == current[length]))
+				++length;
+			if (length > best_length) {
+				best_length = length;
+				best_distance = (unsigned int)(pos - candidate);
+				if (length >= context->nice_length)
+					break;
+			}
+		}
+		size_t next = context->prev[candidate & DEFLATE_WINDOW_MASK];
+		if ((next == DEFLATE_NIL) || (next >= candidate))
+			break;
+		candidate = next;
+	}
+
+	if (!best_distance)
+		return 0;
+	*distance = best_distance;
+	return best_length;
+}
+
+static void
+deflate_compress(deflate_context_t* context) {
+	size_t size = context->size;
+	size_t pos = 0;
+	unsigned int prev_length = 0;
+	unsigned int prev_distance = 0;
+
+	while (pos < size) {
+		unsigned int distance = 0;
+		unsigned int length = deflate_match_find(context, pos, prev_length, &distance);
+		deflate_hash_insert(context, pos);
+
+		if (prev_length) {
+			if (length > prev_length) {
+				// Better match at next position, emit previous byte as literal
+				deflate_symbol_emit(context, 0, 0);
+				prev_length = length;
+				prev_distance = distance;
+				++pos;
+				continue;
+			}
+			deflate_symbol_emit(context, prev_length, prev_distance);
+			size_t end = pos - 1 + prev_length;
+			for (++pos; pos < end; ++pos)
+				deflate_hash_insert(context, pos);
+			prev_length = 0;
+			continue;
+		}
+
+		if (length >= DEFLATE_MIN_MATCH) {
+			if (context->lazy && (length < context->nice_length)) {
+				prev_length = length;
+				prev_distance = distance;
+				++pos;
+				continue;
+			}
+			deflate_symbol_emit(context, length, distance);
+			size_t end = pos + length;
+			for (++pos; pos < end; ++pos)
+				deflate_hash_insert(context, pos);
+			continue;
+		}
+
+		deflate_symbol_emit(context, 0, 0);
+		++pos;
+	}
+	if (prev_length)
+		deflate_symbol_emit(context, prev_length, prev_distance);
+}
+
+size_t
+image_deflate(const void* source, size_t size, unsigned int level, bool final, void* destination) {
+	deflate_output_t output;
+	memset(&output, 0, sizeof(output));
+	output.data = destination;
+
+	if (!level || !size) {
+		if (size || final)
+			deflate_stored_write(&output, source, size, final);
+	} else {
+		if (level > 9)
+			level = 9;
+		deflate_context_t* context =
+		    memory_allocate(HASH_IMAGE, sizeof(deflate_context_t), 0, MEMORY_PERSISTENT);
+		context->source = source;
+		context->size = size;
+		memset(context->head, 0xFF, sizeof(context->head));
+		memset(context->prev, 0xFF, sizeof(context->prev));
+		context->symbol_count = 0;
+		context->block_start = 0;
+		context->block_end = 0;
+		context->max_chain = deflate_level_chain[level];
+		context->nice_length = deflate_level_nice[level];
+		context->lazy = (level >= 4);
+		context->final = final;
+		context->output = output;
+
+		deflate_compress(context);
+		if (context->symbol_count || final)
+			deflate_block_flush(context, true);
+
+		output = context->output;
+		memory_deallocate(context);
+	}
+
+	if (!final) {
+		// Empty stored block to end the segment on a byte boundary
+		deflate_bits_write(&output, 0, 3);
+		deflate_bits_align(&output);
+		deflate_bits_write(&output, 0x0000, 16);
+		deflate_bits_write(&output, 0xFFFF, 16);
+	}
+	deflate_bits_align(&output);
+	return output.offset;
+}
@@ -0,0 +1,66 @@
+/* deflate.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file deflate.h
+    Deflate compression and checksums used by the image writers */
+
+#include <image/types.h>
+
+/*! Get an upper bound of the compressed size of a deflate segment
+\param size Size of uncompressed data
+\return     Maximum size of compressed data */
+IMAGE_API size_t
+image_deflate_bound(size_t size);
+
+/*! Compress data to a raw deflate segment. A segment which is not final is terminated
+with an empty stored block, ending it on a byte boundary so segments compressed
+independently can be concatenated into a single deflate stream.
+\param source      Source data
+\param size        Size of source data
+\param level       Compression level, 0 (stored) to 9 (best compression)
+\param final       Flag indicating if this is the final segment of the stream
+\param destination Destination buffer, must hold at least #image_deflate_bound bytes
+\return            Size of compressed data */
+IMAGE_API size_t
+image_deflate(const void* source, size_t size, unsigned int level, bool final, void* destination);
+
+/*! Update a CRC-32 checksum
+\param crc    Previous checksum, zero for initial value
+\param source Data
+\param size   Size of data
+\return       Updated checksum */
+IMAGE_API uint32_t
+image_crc32(uint32_t crc, const void* source, size_t size);
+
+/*! Update an Adler-32 checksum
+\param adler  Previous checksum, one for initial value
+\param source Data
+\param size   Size of data
+\return       Updated checksum */
+IMAGE_API uint32_t
+image_adler32(uint32_t adler, const void* source, size_t size);
+
+/*! Combine Adler-32 checksums of two consecutive blocks of data
+\param first       Checksum of first block
+\param second      Checksum of second block
+\param second_size Size of second block
+\return            Checksum of the two blocks concatenated */
+IMAGE_API uint32_t
+image_adler32_combine(uint32_t first, uint32_t second, size_t second_size);
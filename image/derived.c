@@ -0,0 +1,268 @@
+/* derived.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "derived.h"
+
+#include <stdlib.h>
+
+#define DERIVED_EXTENSION ".img"
+#define DERIVED_KEY_SIZE (6 + 9 + IMAGE_CHANNEL_COUNT * 3 + 3)
+
+typedef struct image_derived_entry_t image_derived_entry_t;
+
+struct image_derived_entry_t {
+	tick_t last_modified;
+	uint64_t size;
+	string_t name;
+};
+
+static string_t
+image_derived_path(char* buffer, size_t capacity, string_const_t directory, hash_t key, const char* suffix,
+                   size_t suffix_length) {
+	char name[64];
+	string_t key_string = string_from_uint(name, sizeof(name), key, true, 16, '0');
+	string_t path = path_concat(buffer, capacity, STRING_ARGS(directory), STRING_ARGS(key_string));
+	return string_append(STRING_ARGS(path), capacity, suffix, suffix_length);
+}
+
+static int
+image_derived_entry_compare(const void* lhs, const void* rhs) {
+	const image_derived_entry_t* first = lhs;
+	const image_derived_entry_t* second = rhs;
+	if (first->last_modified < second->last_modified)
+		return -1;
+	return (first->last_modified > second->last_modified) ? 1 : 0;
+}
+
+//! Running total of entry sizes in the cache directory, seeded when the module is initialized
+//! and updated on store and eviction, so the directory is only scanned when over budget
+static atomic64_t image_derived_total;
+//! Set while a thread is trimming the cache directory
+static atomic32_t image_derived_trimming;
+
+//! Collect the cache entries in a directory, returns the total size of the entries
+static uint64_t
+image_derived_entries(string_const_t directory, string_t** files, image_derived_entry_t** entries,
+                      size_t* entry_count) {
+	string_t* file = fs_files(STRING_ARGS(directory));
+	size_t file_count = array_size(file);
+	image_derived_entry_t* entry = 0;
+	uint64_t total_size = 0;
+	size_t count = 0;
+	char buffer[BUILD_MAX_PATHLEN];
+
+	if (file_count && entries)
+		entry = memory_allocate(HASH_IMAGE, sizeof(image_derived_entry_t) * file_count, 0, MEMORY_PERSISTENT);
+	for (size_t ifile = 0; ifile < file_count; ++ifile) {
+		if (!string_ends_with(STRING_ARGS(file[ifile]), STRING_CONST(DERIVED_EXTENSION)))
+			continue;
+		string_t path = path_concat(buffer, sizeof(buffer), STRING_ARGS(directory), STRING_ARGS(file[ifile]));
+		uint64_t size = fs_size(STRING_ARGS(path));
+		if (entry) {
+			entry[count].last_modified = fs_last_modified(STRING_ARGS(path));
+			entry[count].size = size;
+			entry[count].name = file[ifile];
+		}
+		total_size += size;
+		++count;
+	}
+
+	if (files)
+		*files = file;
+	else
+		string_array_deallocate(file);
+	if (entries)
+		*entries = entry;
+	if (entry_count)
+		*entry_count = count;
+	return total_size;
+}
+
+//! Remove least recently used entries until the cache directory is within budget. The
+//! running total is resynchronized with the directory contents, which also picks up
+//! entries written or removed by other processes
+static void
+image_derived_trim(string_const_t directory, size_t budget) {
+	// A concurrent trim already brings the directory within budget
+	if (!atomic_cas32(&image_derived_trimming, 1, 0, memory_order_acquire, memory_order_relaxed))
+		return;
+
+	string_t* files = 0;
+	image_derived_entry_t* entry = 0;
+	size_t entry_count = 0;
+	uint64_t total_size = image_derived_entries(directory, &files, &entry, &entry_count);
+	char buffer[BUILD_MAX_PATHLEN];
+
+	if (total_size > budget) {
+		qsort(entry, entry_count, sizeof(image_derived_entry_t), image_derived_entry_compare);
+		for (size_t ientry = 0; (ientry < entry_count) && (total_size > budget); ++ientry) {
+			string_t path =
+			    path_concat(buffer, sizeof(buffer), STRING_ARGS(directory), STRING_ARGS(entry[ientry].name));
+			if (fs_remove_file(STRING_ARGS(path)))
+				total_size -= entry[ientry].size;
+		}
+	}
+	atomic_store64(&image_derived_total, (int64_t)total_size, memory_order_release);
+
+	if (entry)
+		memory_deallocate(entry);
+	string_array_deallocate(files);
+	atomic_store32(&image_derived_trimming, 0, memory_order_release);
+}
+
+void
+image_derived_initialize(void) {
+	image_config_t config = image_module_config();
+	uint64_t total_size = 0;
+	if (config.derived_cache_path.length && config.derived_cache_budget)
+		total_size = image_derived_entries(config.derived_cache_path, 0, 0, 0);
+	atomic_store64(&image_derived_total, (int64_t)total_size, memory_order_release);
+	atomic_store32(&image_derived_trimming, 0, memory_order_release);
+}
+
+hash_t
+image_derived_key(const void* source, size_t size, const image_derived_params_t* params) {
+	// Parameters are serialized field by field so padding never affects the key
+	uint32_t key[DERIVED_KEY_SIZE];
+	hash_t source_hash = hash(source, size);
+	const image_pixelformat_t* format = &params->format;
+	size_t ikey = 0;
+	key[ikey++] = (uint32_t)source_hash;
+	key[ikey++] = (uint32_t)(source_hash >> 32);
+	key[ikey++] = (uint32_t)size;
+	key[ikey++] = (uint32_t)((uint64_t)size >> 32);
+	key[ikey++] = (uint32_t)params->operation;
+	key[ikey++] = (uint32_t)(params->operation >> 32);
+	key[ikey++] = (uint32_t)format->compression;
+	key[ikey++] = (uint32_t)format->colorspace;
+	key[ikey++] = format->premultiplied_alpha ? 1 : 0;
+	key[ikey++] = format->bits_per_pixel;
+	key[ikey++] = format->channels_count;
+	key[ikey++] = format->block_width;
+	key[ikey++] = format->block_height;
+	key[ikey++] = format->block_depth;
+	key[ikey++] = format->bits_per_block;
+	for (unsigned int ich = 0; ich < IMAGE_CHANNEL_COUNT; ++ich) {
+		key[ikey++] = (uint32_t)format->channel[ich].data_type;
+		key[ikey++] = format->channel[ich].bits_per_pixel;
+		key[ikey++] = format->channel[ich].offset;
+	}
+	key[ikey++] = params->mip_filter;
+	key[ikey++] = params->mip_levels;
+	key[ikey++] = params->quality;
+	return hash(key, sizeof(key));
+}
+
+bool
+image_derived_lookup(image_t* image, hash_t key) {
+	string_const_t directory = image_module_config().derived_cache_path;
+	if (!directory.length)
+		return false;
+
+	char buffer[BUILD_MAX_PATHLEN];
+	string_t path = image_derived_path(buffer, sizeof(buffer), directory, key, STRING_CONST(DERIVED_EXTENSION));
+	if (!fs_is_file(STRING_ARGS(path)) || !image_load_mapped(image, STRING_ARGS(path)))
+		return false;
+
+	// Modification time tracks recency of use for eviction
+	fs_touch(STRING_ARGS(path));
+	return true;
+}
+
+bool
+image_derived_store(const image_t* image, hash_t key) {
+	image_config_t config = image_module_config();
+	string_const_t directory = config.derived_cache_path;
+	if (!directory.length)
+		return false;
+
+	fs_make_directory(STRING_ARGS(directory));
+
+	// Write to a uniquely named temporary file and rename into place so concurrent
+	// lookups, from this or other processes, never observe a partial entry
+	char suffix_buffer[64];
+	char temporary_buffer[BUILD_MAX_PATHLEN];
+	char buffer[BUILD_MAX_PATHLEN];
+	uint64_t identity[2] = {thread_id(), (uint64_t)time_current()};
+	hash_t unique = hash(identity, sizeof(identity));
+	string_t suffix = string_from_uint(suffix_buffer, sizeof(suffix_buffer), unique, true, 16, '0');
+	suffix = string_append(STRING_ARGS(suffix), sizeof(suffix_buffer), STRING_CONST(".tmp"));
+	string_t temporary_path = image_derived_path(temporary_buffer, sizeof(temporary_buffer), directory, key,
+	                                             STRING_ARGS(suffix));
+	string_t path = image_derived_path(buffer, sizeof(buffer), directory, key, STRING_CONST(DERIVED_EXTENSION));
+
+	stream_t* stream =
+	    stream_open(STRING_ARGS(temporary_path), STREAM_OUT | STREAM_BINARY | STREAM_CREATE | STREAM_TRUNCATE);
+	if (!stream) {
+		log_warnf(HASH_IMAGE, WARNING_SYSTEM_CALL_FAIL, STRING_CONST("Unable to create derived image file: %.*s"),
+		          STRING_FORMAT(temporary_path));
+		return false;
+	}
+	bool stored = image_save(image, stream, IMAGE_FILE_FORMAT_NATIVE, 0);
+	int64_t stored_size = (int64_t)stream_tell(stream);
+	stream_deallocate(stream);
+
+	// An entry with the same key is replaced and no longer counts towards the total
+	int64_t replaced_size = stored ? (int64_t)fs_size(STRING_ARGS(path)) : 0;
+	if (stored)
+		stored = fs_move_file(STRING_ARGS(temporary_path), STRING_ARGS(path));
+	if (!stored) {
+		fs_remove_file(STRING_ARGS(temporary_path));
+		return false;
+	}
+
+	if (config.derived_cache_budget) {
+		int64_t total = atomic_add64(&image_derived_total, stored_size - replaced_size, memory_order_acq_rel);
+		if (total > (int64_t)config.derived_cache_budget)
+			image_derived_trim(directory, config.derived_cache_budget);
+	}
+	return true;
+}
+
+bool
+image_derived_process(image_t* result, stream_t* source, const image_derived_params_t* params, image_derive_fn fn,
+                      void* userdata) {
+	size_t begin = stream_tell(source);
+	size_t size = stream_size(source);
+	size = (size > begin) ? size - begin : 0;
+	if (!size)
+		return false;
+
+	void* buffer = memory_allocate(HASH_IMAGE, size, 0, MEMORY_PERSISTENT);
+	size = stream_read(source, buffer, size);
+	hash_t key = image_derived_key(buffer, size, params);
+
+	if (image_derived_lookup(result, key)) {
+		memory_deallocate(buffer);
+		return true;
+	}
+
+	stream_t* stream = buffer_stream_allocate(buffer, STREAM_IN | STREAM_BINARY, size, size, true, false);
+	image_t image;
+	image_initialize(&image);
+	bool processed = image_load(&image, stream) && fn(result, &image, params, userdata);
+	stream_deallocate(stream);
+	image_finalize(&image);
+
+	if (processed)
+		image_derived_store(result, key);
+	return processed;
+}
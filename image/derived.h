@@ -0,0 +1,67 @@
+/* derived.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file derived.h
+    On-disk cache of derived images such as converted, mipmapped or compressed results.
+    Entries are keyed by a hash of the source bytes and the processing parameters, stored
+    in the native image format in the directory given by the module config, and evicted
+    by least recent use when the directory exceeds the disk budget. The size of the
+    directory is scanned once at module initialization and then tracked as a running
+    total, the directory is only rescanned when a store exceeds the budget. Entries are
+    written to a temporary file and renamed into place, so a lookup never sees a partial
+    entry. */
+
+#include <image/types.h>
+
+/*! Calculate the cache key for a source and processing parameters
+\param source Source data
+\param size   Size of source data
+\param params Processing parameters
+\return       Cache key */
+IMAGE_API hash_t
+image_derived_key(const void* source, size_t size, const image_derived_params_t* params);
+
+/*! Load a derived image from the cache. The image is memory mapped from the cache file.
+\param image Image to load into
+\param key   Cache key
+\return      true if found, false if not in cache or cache is disabled */
+IMAGE_API bool
+image_derived_lookup(image_t* image, hash_t key);
+
+/*! Store a derived image in the cache, evicting the least recently used entries if the
+cache exceeds the disk budget
+\param image Image to store
+\param key   Cache key
+\return      true if stored, false if cache is disabled or the entry could not be written */
+IMAGE_API bool
+image_derived_store(const image_t* image, hash_t key);
+
+/*! Load a source image from a stream and process it, returning the cached result without
+loading or processing if the same source was previously processed with the same
+parameters
+\param result   Image to receive the processed result
+\param source   Source stream, read from the current position to the end of the stream
+\param params   Processing parameters
+\param fn       Processing function
+\param userdata Argument passed to processing function
+\return         true if successful, false if source could not be loaded or processing failed */
+IMAGE_API bool
+image_derived_process(image_t* result, stream_t* source, const image_derived_params_t* params, image_derive_fn fn,
+                      void* userdata);
@@ -19,6 +19,7 @@
 #include <foundation/foundation.h>
 
 #include "image.h"
+#include "internal.h"
 #include "freeimage.h"
 
 #include "ext/FreeImage.h"
@@ -29,8 +30,16 @@ image_freeimage_initialize(void);
 extern void
 image_freeimage_finalize(void);
 
+//! Edge length in pixels of the tiles copied when orientation swaps rows and columns
+#define IMAGE_FREEIMAGE_TILE 32
+
 static object_t library_freeimage;
 
+//! Set once all symbols are resolved and FreeImage is initialized
+static atomic32_t freeimage_ready;
+//! Number of loads in progress, finalization waits for these to complete
+static atomic32_t freeimage_active;
+
 typedef void(DLL_CALLCONV* FreeImage_Initialise_t)(BOOL);
 typedef void(DLL_CALLCONV* FreeImage_DeInitialise_t)(void);
 typedef FREE_IMAGE_FORMAT(DLL_CALLCONV* FreeImage_GetFileTypeFromHandle_t)(FreeImageIO*, fi_handle, int);
@@ -44,6 +53,18 @@ typedef unsigned(DLL_CALLCONV* FreeImage_GetBPP_t)(FIBITMAP*);
 typedef FREE_IMAGE_TYPE(DLL_CALLCONV* FreeImage_GetImageType_t)(FIBITMAP*);
 typedef FREE_IMAGE_COLOR_TYPE(DLL_CALLCONV* FreeImage_GetColorType_t)(FIBITMAP*);
 typedef BYTE*(DLL_CALLCONV* FreeImage_GetBits_t)(FIBITMAP*);
+typedef BOOL(DLL_CALLCONV* FreeImage_GetMetadata_t)(FREE_IMAGE_MDMODEL, FIBITMAP*, const char*, FITAG**);
+typedef FREE_IMAGE_MDTYPE(DLL_CALLCONV* FreeImage_GetTagType_t)(FITAG*);
+typedef DWORD(DLL_CALLCONV* FreeImage_GetTagCount_t)(FITAG*);
+typedef const void*(DLL_CALLCONV* FreeImage_GetTagValue_t)(FITAG*);
+
+//! IO handle passed to FreeImage, counting reads for the load record
+typedef struct image_freeimage_io_t image_freeimage_io_t;
+
+struct image_freeimage_io_t {
+	stream_t* stream;
+	image_load_record_t* record;
+};
 
 static FreeImage_Initialise_t FreeImage_Initialise_Fn;
 static FreeImage_DeInitialise_t FreeImage_DeInitialise_Fn;
@@ -58,6 +79,11 @@ static FreeImage_GetBPP_t FreeImage_GetBPP_Fn;
 static FreeImage_GetImageType_t FreeImage_GetImageType_Fn;
 static FreeImage_GetColorType_t FreeImage_GetColorType_Fn;
 static FreeImage_GetBits_t FreeImage_GetBits_Fn;
+//! Metadata accessors are optional, images are loaded without orientation if missing
+static FreeImage_GetMetadata_t FreeImage_GetMetadata_Fn;
+static FreeImage_GetTagType_t FreeImage_GetTagType_Fn;
+static FreeImage_GetTagCount_t FreeImage_GetTagCount_Fn;
+static FreeImage_GetTagValue_t FreeImage_GetTagValue_Fn;
 
 void
 image_freeimage_initialize(void) {
@@ -91,6 +117,14 @@ image_freeimage_initialize(void) {
 		    (FreeImage_GetColorType_t)library_symbol(library_freeimage, STRING_CONST("FreeImage_GetColorType"));
 		FreeImage_GetBits_Fn =
 		    (FreeImage_GetBits_t)library_symbol(library_freeimage, STRING_CONST("FreeImage_GetBits"));
+		FreeImage_GetMetadata_Fn =
+		    (FreeImage_GetMetadata_t)library_symbol(library_freeimage, STRING_CONST("FreeImage_GetMetadata"));
+		FreeImage_GetTagType_Fn =
+		    (FreeImage_GetTagType_t)library_symbol(library_freeimage, STRING_CONST("FreeImage_GetTagType"));
+		FreeImage_GetTagCount_Fn =
+		    (FreeImage_GetTagCount_t)library_symbol(library_freeimage, STRING_CONST("FreeImage_GetTagCount"));
+		FreeImage_GetTagValue_Fn =
+		    (FreeImage_GetTagValue_t)library_symbol(library_freeimage, STRING_CONST("FreeImage_GetTagValue"));
 	} else {
 		FreeImage_Initialise_Fn = 0;
 		FreeImage_DeInitialise_Fn = 0;
@@ -107,12 +141,18 @@ image_freeimage_initialize(void) {
 		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Failed to find symbold is loaded FreeImage library"));
 	}
 
-	if (FreeImage_Initialise_Fn)
+	if (FreeImage_Initialise_Fn) {
 		FreeImage_Initialise_Fn(0);
+		atomic_store32(&freeimage_ready, 1, memory_order_release);
+	}
 }
 
 void
 image_freeimage_finalize(void) {
+	atomic_store32(&freeimage_ready, 0, memory_order_seq_cst);
+	while (atomic_load32(&freeimage_active, memory_order_seq_cst))
+		thread_yield();
+
 	if (FreeImage_DeInitialise_Fn)
 		FreeImage_DeInitialise_Fn();
 	if (library_freeimage)
@@ -122,25 +162,29 @@ image_freeimage_finalize(void) {
 
 static unsigned DLL_CALLCONV
 image_freeimage_read(void* buffer, unsigned size, unsigned count, fi_handle handle) {
-	stream_t* stream = (stream_t*)handle;
-	if (!stream)
+	image_freeimage_io_t* io = (image_freeimage_io_t*)handle;
+	if (!io || !size)
 		return 0;
-	return (unsigned)(stream_read(stream, buffer, size * count) / size);
+	size_t read = stream_read(io->stream, buffer, size * count);
+	image_load_record_read(io->record, read);
+	return (unsigned)(read / size);
 }
 
 static unsigned DLL_CALLCONV
 image_freeimage_write(void* buffer, unsigned size, unsigned count, fi_handle handle) {
-	stream_t* stream = (stream_t*)handle;
-	if (!stream)
+	image_freeimage_io_t* io = (image_freeimage_io_t*)handle;
+	if (!io || !size)
 		return 0;
+	stream_t* stream = io->stream;
 	return (unsigned)(stream_write(stream, buffer, size * count) / size);
 }
 
 static int DLL_CALLCONV
 image_freeimage_seek(fi_handle handle, long offset, int origin) {
-	stream_t* stream = (stream_t*)handle;
-	if (!stream)
+	image_freeimage_io_t* io = (image_freeimage_io_t*)handle;
+	if (!io)
 		return 0;
+	stream_t* stream = io->stream;
 
 	stream_seek_mode_t mode = STREAM_SEEK_CURRENT;
 	if (origin == SEEK_END)
@@ -154,31 +198,134 @@ image_freeimage_seek(fi_handle handle, long offset, int origin) {
 
 static long DLL_CALLCONV
 image_freeimage_tell(fi_handle handle) {
-	stream_t* stream = (stream_t*)handle;
-	if (!stream)
+	image_freeimage_io_t* io = (image_freeimage_io_t*)handle;
+	if (!io)
 		return -1;
 
-	return (long)stream_tell(stream);
+	return (long)stream_tell(io->stream);
 }
 
-bool
-image_freeimage_load(image_t* image, stream_t* stream) {
-	if (!FreeImage_Initialise_Fn)
-		return false;
+static image_load_format_t
+image_freeimage_format(FREE_IMAGE_FORMAT fif) {
+	switch (fif) {
+		case FIF_PNG:
+			return IMAGE_LOAD_FORMAT_PNG;
+		case FIF_JPEG:
+			return IMAGE_LOAD_FORMAT_JPEG;
+		case FIF_BMP:
+			return IMAGE_LOAD_FORMAT_BMP;
+		case FIF_TARGA:
+			return IMAGE_LOAD_FORMAT_TGA;
+		case FIF_TIFF:
+			return IMAGE_LOAD_FORMAT_TIFF;
+		case FIF_DDS:
+			return IMAGE_LOAD_FORMAT_DDS;
+		case FIF_GIF:
+			return IMAGE_LOAD_FORMAT_GIF;
+		case FIF_PSD:
+			return IMAGE_LOAD_FORMAT_PSD;
+		case FIF_HDR:
+			return IMAGE_LOAD_FORMAT_HDR;
+		case FIF_EXR:
+			return IMAGE_LOAD_FORMAT_EXR;
+		default:
+			return IMAGE_LOAD_FORMAT_OTHER;
+	}
+}
+
+static image_transform_t
+image_freeimage_orientation(FIBITMAP* bitmap) {
+	if (!FreeImage_GetMetadata_Fn || !FreeImage_GetTagType_Fn || !FreeImage_GetTagCount_Fn ||
+	    !FreeImage_GetTagValue_Fn)
+		return IMAGE_TRANSFORM_NONE;
+	FITAG* tag = 0;
+	if (!FreeImage_GetMetadata_Fn(FIMD_EXIF_MAIN, bitmap, "Orientation", &tag) || !tag ||
+	    (FreeImage_GetTagType_Fn(tag) != FIDT_SHORT) || !FreeImage_GetTagCount_Fn(tag))
+		return IMAGE_TRANSFORM_NONE;
+	const WORD* value = FreeImage_GetTagValue_Fn(tag);
+	return value ? image_transform_orientation(*value) : IMAGE_TRANSFORM_NONE;
+}
 
+//! Convert a run of consecutive source pixels, writing destination pixels step bytes apart
+static void
+image_freeimage_copy_span(uint8_t* dest, ptrdiff_t step, const void* source, unsigned int count,
+                          FREE_IMAGE_TYPE image_type, FREE_IMAGE_COLOR_TYPE color_type,
+                          unsigned int source_bytes_per_pixel) {
+	if (image_type == FIT_BITMAP) {
+		if (color_type == FIC_RGB) {
+			const RGBTRIPLE* pixel = source;
+			for (unsigned int x = 0; x < count; ++x, dest += step) {
+				dest[0] = pixel->rgbtRed;
+				dest[1] = pixel->rgbtGreen;
+				dest[2] = pixel->rgbtBlue;
+				pixel = pointer_offset_const(pixel, source_bytes_per_pixel);
+			}
+		} else {
+			const RGBQUAD* pixel = source;
+			for (unsigned int x = 0; x < count; ++x, dest += step) {
+				dest[0] = pixel->rgbRed;
+				dest[1] = pixel->rgbGreen;
+				dest[2] = pixel->rgbBlue;
+				dest[3] = pixel->rgbReserved;
+				pixel = pointer_offset_const(pixel, source_bytes_per_pixel);
+			}
+		}
+	} else if (image_type == FIT_RGB16) {
+		const FIRGB16* pixel = source;
+		for (unsigned int x = 0; x < count; ++x, ++pixel, dest += step) {
+			uint16_t* value = (void*)dest;
+			value[0] = pixel->red;
+			value[1] = pixel->green;
+			value[2] = pixel->blue;
+		}
+	} else if (image_type == FIT_RGBA16) {
+		const FIRGBA16* pixel = source;
+		for (unsigned int x = 0; x < count; ++x, ++pixel, dest += step) {
+			uint16_t* value = (void*)dest;
+			value[0] = pixel->red;
+			value[1] = pixel->green;
+			value[2] = pixel->blue;
+			value[3] = pixel->alpha;
+		}
+	} else if (image_type == FIT_RGBF) {
+		const FIRGBF* pixel = source;
+		for (unsigned int x = 0; x < count; ++x, ++pixel, dest += step) {
+			float32_t* value = (void*)dest;
+			value[0] = pixel->red;
+			value[1] = pixel->green;
+			value[2] = pixel->blue;
+		}
+	} else {
+		const FIRGBAF* pixel = source;
+		for (unsigned int x = 0; x < count; ++x, ++pixel, dest += step) {
+			float32_t* value = (void*)dest;
+			value[0] = pixel->red;
+			value[1] = pixel->green;
+			value[2] = pixel->blue;
+			value[3] = pixel->alpha;
+		}
+	}
+}
+
+static bool
+image_freeimage_decode(image_t* image, stream_t* stream, image_load_record_t* record) {
 	FreeImageIO io = {image_freeimage_read, image_freeimage_write, image_freeimage_seek, image_freeimage_tell};
+	image_freeimage_io_t handle = {stream, record};
 
+	image_load_record_begin(record, IMAGE_LOAD_STAGE_PROBE);
 	size_t begin_pos = stream_tell(stream);
-	FREE_IMAGE_FORMAT fif = FreeImage_GetFileTypeFromHandle_Fn(&io, (fi_handle)stream, 0);
-	if (fif == FIF_UNKNOWN) {
-		log_info(HASH_IMAGE, STRING_CONST("FreeImage failed to get file type from stream"));
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileTypeFromHandle_Fn(&io, (fi_handle)&handle, 0);
+	image_load_record_end(record, IMAGE_LOAD_STAGE_PROBE);
+	if (fif == FIF_UNKNOWN)
 		return false;
-	}
+	record->format = image_freeimage_format(fif);
 
 	stream_seek(stream, (ssize_t)begin_pos, STREAM_SEEK_BEGIN);
-	FIBITMAP* bitmap = FreeImage_LoadFromHandle_Fn(fif, &io, (fi_handle)stream, 0);
+	image_load_record_begin(record, IMAGE_LOAD_STAGE_DECODE);
+	FIBITMAP* bitmap = FreeImage_LoadFromHandle_Fn(fif, &io, (fi_handle)&handle, 0);
+	image_load_record_end(record, IMAGE_LOAD_STAGE_DECODE);
 	if (!bitmap) {
-		log_info(HASH_IMAGE, STRING_CONST("FreeImage failed to load image from stream"));
+		record->status = IMAGE_LOAD_STATUS_DECODE_FAILED;
 		return false;
 	}
 
@@ -192,8 +339,8 @@ image_freeimage_load(image_t* image, stream_t* stream) {
 	FREE_IMAGE_TYPE image_type = FreeImage_GetImageType_Fn(bitmap);
 	FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType_Fn(bitmap);
 
-	log_infof(HASH_IMAGE, STRING_CONST("Loaded image: %.*s (type %d, color %d)"), STRING_FORMAT(stream->path),
-	          (int)image_type, (int)color_type);
+	// Any failure past this point is a pixel format this library does not handle
+	record->status = IMAGE_LOAD_STATUS_UNSUPPORTED;
 
 	if ((color_type != FIC_RGB) && (color_type != FIC_RGBALPHA) && (color_type != FIC_CMYK)) {
 		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported FreeImage color type: %u"),
@@ -274,109 +421,72 @@ image_freeimage_load(image_t* image, stream_t* stream) {
 		pixelformat.channel[IMAGE_CHANNEL_ALPHA].offset = bits_per_channel * 3;
 	}
 
-	image_allocate_storage(image, &pixelformat, width, height, 1, 1);
+	image_transform_t orientation = image_freeimage_orientation(bitmap);
+	bool swap = image_transform_swaps_dimensions(orientation);
+
+	image_load_record_begin(record, IMAGE_LOAD_STAGE_ALLOCATE);
+	image_allocate_storage(image, &pixelformat, swap ? height : width, swap ? width : height, 1, 1);
+	image_load_record_end(record, IMAGE_LOAD_STAGE_ALLOCATE);
 
-	// FreeImage loads images with bottom-left corner at start of buffer,
-	// but we store images with top-left corner at start of buffer
+	image_load_record_begin(record, IMAGE_LOAD_STAGE_COPY);
+	// FreeImage loads images with bottom-left corner at start of buffer, but we store images
+	// with top-left corner at start of buffer. Source rows are read top-down and each pixel
+	// is written directly to its oriented position, so orientation costs no extra pass.
+	const uint8_t* bits = FreeImage_GetBits_Fn(bitmap);
 	unsigned int source_bytes_per_pixel = source_bpp / 8;
-	if (image_type == FIT_BITMAP) {
-		if (color_type == FIC_RGB) {
-			const RGBTRIPLE* line = (const RGBTRIPLE*)FreeImage_GetBits_Fn(bitmap);
-			const RGBTRIPLE* source = (const RGBTRIPLE*)pointer_offset_const(line, pitch * (height - 1));
-			uint8_t* dest = (void*)image->data;
-			for (unsigned int y = 0; y < height; ++y) {
-				line = source;
-				for (unsigned int x = 0; x < width; ++x) {
-					*dest++ = source->rgbtRed;
-					*dest++ = source->rgbtGreen;
-					*dest++ = source->rgbtBlue;
-					source = pointer_offset_const(source, source_bytes_per_pixel);
-				}
-				source = (const RGBTRIPLE*)pointer_offset_const(line, -(int)pitch);
-			}
-			err = 0;
-		} else if (color_type == FIC_RGBALPHA) {
-			const RGBQUAD* line = (const RGBQUAD*)FreeImage_GetBits_Fn(bitmap);
-			const RGBQUAD* source = (const RGBQUAD*)pointer_offset_const(line, pitch * (height - 1));
-			uint8_t* dest = (void*)image->data;
-			for (unsigned int y = 0; y < height; ++y) {
-				line = source;
-				for (unsigned int x = 0; x < width; ++x) {
-					*dest++ = source->rgbRed;
-					*dest++ = source->rgbGreen;
-					*dest++ = source->rgbBlue;
-					*dest++ = source->rgbReserved;
-					source = pointer_offset_const(source, source_bytes_per_pixel);
-				}
-				source = (const RGBQUAD*)pointer_offset_const(line, -(int)pitch);
-			}
-			err = 0;
+	size_t pixel_size = pixelformat.bits_per_pixel / 8;
+	int64_t origin, step_x, step_y;
+	image_transform_mapping(orientation, width, height, &origin, &step_x, &step_y);
+	ptrdiff_t dest_step = (ptrdiff_t)(step_x * (int64_t)pixel_size);
+	if (!swap) {
+		for (unsigned int y = 0; y < height; ++y) {
+			const void* source = bits + (size_t)pitch * (height - 1 - y);
+			uint8_t* dest = image->data + (origin + step_y * y) * (int64_t)pixel_size;
+			image_freeimage_copy_span(dest, dest_step, source, width, image_type, color_type, source_bytes_per_pixel);
 		}
 	} else {
-		if (image_type == FIT_RGB16) {
-			const FIRGB16* line = (const FIRGB16*)FreeImage_GetBits_Fn(bitmap);
-			const FIRGB16* source = (const FIRGB16*)pointer_offset_const(line, pitch * (height - 1));
-			uint16_t* dest = (void*)image->data;
-			for (unsigned int y = 0; y < height; ++y) {
-				line = source;
-				for (unsigned int x = 0; x < width; ++x, ++source) {
-					*dest++ = source->red;
-					*dest++ = source->green;
-					*dest++ = source->blue;
-				}
-				source = (const FIRGB16*)pointer_offset_const(line, -(int)pitch);
-			}
-			err = 0;
-		} else if (image_type == FIT_RGBA16) {
-			const FIRGBA16* line = (const FIRGBA16*)FreeImage_GetBits_Fn(bitmap);
-			const FIRGBA16* source = (const FIRGBA16*)pointer_offset_const(line, pitch * (height - 1));
-			uint16_t* dest = (void*)image->data;
-			for (unsigned int y = 0; y < height; ++y) {
-				line = source;
-				for (unsigned int x = 0; x < width; ++x, ++source) {
-					*dest++ = source->red;
-					*dest++ = source->green;
-					*dest++ = source->blue;
-					*dest++ = source->alpha;
-				}
-				source = (const FIRGBA16*)pointer_offset_const(line, -(int)pitch);
-			}
-			err = 0;
-		} else if (image_type == FIT_RGBF) {
-			const FIRGBF* line = (const FIRGBF*)FreeImage_GetBits_Fn(bitmap);
-			const FIRGBF* source = (const FIRGBF*)pointer_offset_const(line, pitch * (height - 1));
-			float32_t* dest = (void*)image->data;
-			for (unsigned int y = 0; y < height; ++y) {
-				line = source;
-				for (unsigned int x = 0; x < width; ++x, ++source) {
-					*dest++ = source->red;
-					*dest++ = source->green;
-					*dest++ = source->blue;
-				}
-				source = (const FIRGBF*)pointer_offset_const(line, -(int)pitch);
-				line = source;
-			}
-			err = 0;
-		} else if (image_type == FIT_RGBAF) {
-			const FIRGBAF* line = (const FIRGBAF*)FreeImage_GetBits_Fn(bitmap);
-			const FIRGBAF* source = (const FIRGBAF*)pointer_offset_const(line, pitch * (height - 1));
-			float32_t* dest = (void*)image->data;
-			for (unsigned int y = 0; y < height; ++y) {
-				line = source;
-				for (unsigned int x = 0; x < width; ++x, ++source) {
-					*dest++ = source->red;
-					*dest++ = source->green;
-					*dest++ = source->blue;
-					*dest++ = source->alpha;
+		// Source rows map to destination columns, copy in tiles to keep destination rows in cache
+		for (unsigned int y0 = 0; y0 < height; y0 += IMAGE_FREEIMAGE_TILE) {
+			unsigned int y1 = (y0 + IMAGE_FREEIMAGE_TILE < height) ? (y0 + IMAGE_FREEIMAGE_TILE) : height;
+			for (unsigned int x0 = 0; x0 < width; x0 += IMAGE_FREEIMAGE_TILE) {
+				unsigned int count = (x0 + IMAGE_FREEIMAGE_TILE < width) ? IMAGE_FREEIMAGE_TILE : (width - x0);
+				for (unsigned int y = y0; y < y1; ++y) {
+					const void* source =
+					    bits + (size_t)pitch * (height - 1 - y) + (size_t)x0 * source_bytes_per_pixel;
+					uint8_t* dest = image->data + (origin + step_x * x0 + step_y * y) * (int64_t)pixel_size;
+					image_freeimage_copy_span(dest, dest_step, source, count, image_type, color_type,
+					                          source_bytes_per_pixel);
 				}
-				source = (const FIRGBAF*)pointer_offset_const(line, -(int)pitch);
 			}
-			err = 0;
 		}
 	}
+	err = 0;
+	image_load_record_end(record, IMAGE_LOAD_STAGE_COPY);
 
 cleanup:
 	FreeImage_Unload_Fn(bitmap);
 
 	return !err;
 }
+
+bool
+image_freeimage_load_record(image_t* image, stream_t* stream, image_load_record_t* record) {
+	// FreeImage decoding is reentrant once initialized and each load uses its own bitmap
+	// and IO handle, so loads only need to hold off finalization instead of serializing
+	// on a global lock
+	atomic_incr32(&freeimage_active, memory_order_seq_cst);
+	bool loaded = false;
+	if (atomic_load32(&freeimage_ready, memory_order_seq_cst))
+		loaded = image_freeimage_decode(image, stream, record);
+	atomic_decr32(&freeimage_active, memory_order_release);
+	return loaded;
+}
+
+bool
+image_freeimage_load(image_t* image, stream_t* stream) {
+	image_load_record_t record;
+	image_load_record_initialize(&record);
+	bool loaded = image_freeimage_load_record(image, stream, &record);
+	image_load_record_commit(&record, image, loaded);
+	return loaded;
+}
@@ -20,5 +20,10 @@
 
 #include <image/types.h>
 
+/*! Load an image using the FreeImage library. Safe to call concurrently from any
+thread while the image module is initialized.
+\param image  Image to load into
+\param stream Source stream
+\return       true if successful, false if FreeImage is not available or failed to load image */
 IMAGE_API bool
 image_freeimage_load(image_t* image, stream_t* stream);
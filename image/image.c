@@ -20,9 +20,27 @@
 
 #include "image.h"
 #include "freeimage.h"
+#include "png.h"
+#include "tga.h"
+#include "dds.h"
+#include "ktx.h"
+#include "native.h"
+#include "metrics.h"
+#include "storage.h"
+#include "trace.h"
+#include "internal.h"
+
+#define IMAGE_MODULE_UNINITIALIZED 0
+#define IMAGE_MODULE_INITIALIZING 1
+#define IMAGE_MODULE_INITIALIZED 2
+#define IMAGE_MODULE_FINALIZING 3
+
+#define IMAGE_CONVERT_CHUNK_SIZE (64 * 1024)
+//! Pixels converted through one float buffer on the stack
+#define IMAGE_CONVERT_SPAN 256
 
 static image_config_t image_config;
-static bool image_initialized;
+static atomic32_t image_initialized;
 
 void
 image_freeimage_initialize(void);
@@ -30,6 +48,45 @@ image_freeimage_initialize(void);
 void
 image_freeimage_finalize(void);
 
+void
+image_astc_initialize(void);
+
+void
+image_deflate_initialize(void);
+
+void
+image_parallel_initialize(void);
+
+void
+image_parallel_finalize(void);
+
+void
+image_async_initialize(void);
+
+void
+image_async_finalize(void);
+
+void
+image_cache_initialize(void);
+
+void
+image_cache_finalize(void);
+
+void
+image_derived_initialize(void);
+
+void
+image_trace_initialize(void);
+
+void
+image_trace_finalize(void);
+
+void
+image_load_event_initialize(void);
+
+void
+image_load_event_finalize(void);
+
 static void
 image_initialize_config(const image_config_t config) {
 	image_config = config;
@@ -37,29 +94,56 @@ image_initialize_config(const image_config_t config) {
 
 int
 image_module_initialize(const image_config_t config) {
-	if (image_initialized)
-		return 0;
+	while (!atomic_cas32(&image_initialized, IMAGE_MODULE_INITIALIZING, IMAGE_MODULE_UNINITIALIZED,
+	                     memory_order_acquire, memory_order_relaxed)) {
+		// Another thread is initializing or finalizing the module, wait for it to settle
+		if (atomic_load32(&image_initialized, memory_order_acquire) == IMAGE_MODULE_INITIALIZED)
+			return 0;
+		thread_yield();
+	}
 
 	image_initialize_config(config);
 
+	image_trace_initialize();
+	image_load_event_initialize();
 	image_freeimage_initialize();
+	image_astc_initialize();
+	image_deflate_initialize();
+	image_parallel_initialize();
+	image_async_initialize();
+	image_cache_initialize();
+	image_derived_initialize();
 
-	image_initialized = true;
+	atomic_store32(&image_initialized, IMAGE_MODULE_INITIALIZED, memory_order_release);
 
 	return 0;
 }
 
 bool
 image_module_is_initialized(void) {
-	return image_initialized;
+	return atomic_load32(&image_initialized, memory_order_acquire) == IMAGE_MODULE_INITIALIZED;
 }
 
 void
 image_module_finalize(void) {
-	if (!image_initialized)
-		return;
+	while (!atomic_cas32(&image_initialized, IMAGE_MODULE_FINALIZING, IMAGE_MODULE_INITIALIZED, memory_order_acq_rel,
+	                     memory_order_relaxed)) {
+		// Wait for an initialization in progress to complete rather than leave it running,
+		// nothing to do if the module is not initialized or another thread is finalizing it
+		int32_t state = atomic_load32(&image_initialized, memory_order_acquire);
+		if ((state == IMAGE_MODULE_UNINITIALIZED) || (state == IMAGE_MODULE_FINALIZING))
+			return;
+		thread_yield();
+	}
 
+	image_async_finalize();
+	image_cache_finalize();
+	image_parallel_finalize();
 	image_freeimage_finalize();
+	image_load_event_finalize();
+	image_trace_finalize();
+
+	atomic_store32(&image_initialized, IMAGE_MODULE_UNINITIALIZED, memory_order_release);
 }
 
 image_config_t
@@ -72,10 +156,24 @@ image_initialize(image_t* image) {
 	memset(image, 0, sizeof(image_t));
 }
 
+static void
+image_release_storage(image_t* image) {
+	if (image->mapping) {
+		image_native_unmap(image->mapping, image->mapping_size);
+	} else if (image->data) {
+		image_storage_untrack(&image->format, image->storage_size);
+		memory_deallocate(image->data);
+	}
+	image->data = 0;
+	image->mapping = 0;
+	image->mapping_size = 0;
+	image->storage_size = 0;
+}
+
 void
 image_finalize(image_t* image) {
-	if (image && image->data)
-		memory_deallocate(image->data);
+	if (image)
+		image_release_storage(image);
 }
 
 image_t*
@@ -94,8 +192,7 @@ image_deallocate(image_t* image) {
 void
 image_allocate_storage(image_t* image, const image_pixelformat_t* pixelformat, unsigned int width, unsigned int height,
                        unsigned int depth, unsigned int levels) {
-	if (image->data)
-		memory_deallocate(image->data);
+	image_release_storage(image);
 
 	size_t data_size = image_buffer_size(pixelformat, width, height, depth, levels);
 
@@ -104,7 +201,11 @@ image_allocate_storage(image_t* image, const image_pixelformat_t* pixelformat, u
 	image->height = height;
 	image->depth = depth;
 	image->levels = levels;
+	image->layers = 1;
+	image->cubemap = false;
 	image->data = memory_allocate(HASH_IMAGE, data_size, 0, MEMORY_PERSISTENT);
+	image->storage_size = data_size;
+	image_storage_track(&image->format, data_size);
 
 	if ((image->format.compression >= IMAGE_COMPRESSION_PVRTC_2BPP) &&
 	    (image->format.compression <= IMAGE_COMPRESSION_PVRTC2_4BPP)) {
@@ -115,6 +216,71 @@ image_allocate_storage(image_t* image, const image_pixelformat_t* pixelformat, u
 	}
 }
 
+bool
+image_allocate_array_storage(image_t* image, const image_pixelformat_t* pixelformat, unsigned int width,
+                             unsigned int height, unsigned int layers, unsigned int levels) {
+	if (!layers) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Array images require at least one layer"));
+		return false;
+	}
+	image_release_storage(image);
+
+	// Layers are interleaved per mip level, each level stores all layers consecutively
+	size_t data_size = image_buffer_size(pixelformat, width, height, 1, levels) * layers;
+
+	memcpy(&image->format, pixelformat, sizeof(image_pixelformat_t));
+	image->width = width;
+	image->height = height;
+	image->depth = 1;
+	image->levels = levels;
+	image->layers = layers;
+	image->cubemap = false;
+	image->data = memory_allocate(HASH_IMAGE, data_size, 0, MEMORY_PERSISTENT);
+	image->storage_size = data_size;
+	image_storage_track(&image->format, data_size);
+	return true;
+}
+
+bool
+image_allocate_cubemap_storage(image_t* image, const image_pixelformat_t* pixelformat, unsigned int size,
+                               unsigned int levels) {
+	if (!image_allocate_array_storage(image, pixelformat, size, size, 6, levels))
+		return false;
+	image->cubemap = true;
+	return true;
+}
+
+void*
+image_buffer(image_t* image, unsigned int miplevel) {
+	if (!image->data || (miplevel >= image->levels))
+		return 0;
+	size_t offset = image_buffer_size(&image->format, image->width, image->height, image->depth, miplevel);
+	return pointer_offset(image->data, offset * image_layers(image));
+}
+
+void*
+image_layer_buffer(image_t* image, unsigned int miplevel, unsigned int layer) {
+	if (layer >= image_layers(image))
+		return 0;
+	void* buffer = image_buffer(image, miplevel);
+	if (!buffer || !layer)
+		return buffer;
+	size_t layer_size = image_buffer_size(&image->format, image_width(image, miplevel), image_height(image, miplevel),
+	                                      image_depth(image, miplevel), 1);
+	return pointer_offset(buffer, layer_size * layer);
+}
+
+size_t
+image_data_size(const image_t* image) {
+	return image_buffer_size(&image->format, image->width, image->height, image->depth, image->levels) *
+	       image_layers(image);
+}
+
+unsigned int
+image_layers(const image_t* image) {
+	return image->layers ? image->layers : 1;
+}
+
 unsigned int
 image_width(const image_t* image, unsigned int level) {
 	if (!level)
@@ -169,7 +335,18 @@ image_buffer_size(const image_pixelformat_t* pixelformat, unsigned int width, un
 				level_height = 8;
 		}
 
-		size_t level_size = pixelformat->bits_per_pixel * level_width * level_height * depth;
+		size_t level_size;
+		if (pixelformat->block_width) {
+			// Block compressed formats store partial blocks at edges as full blocks
+			unsigned int block_height = pixelformat->block_height ? pixelformat->block_height : 1;
+			unsigned int block_depth = pixelformat->block_depth ? pixelformat->block_depth : 1;
+			size_t blocks_x = (level_width + pixelformat->block_width - 1) / pixelformat->block_width;
+			size_t blocks_y = (level_height + block_height - 1) / block_height;
+			size_t blocks_z = (depth + block_depth - 1) / block_depth;
+			level_size = blocks_x * blocks_y * blocks_z * (pixelformat->bits_per_block / 8);
+		} else {
+			level_size = ((size_t)pixelformat->bits_per_pixel * level_width * level_height * depth + 7) / 8;
+		}
 
 		total_size += level_size;
 		if ((width == 1) && (height == 1) && (depth == 1))
@@ -186,17 +363,97 @@ image_buffer_size(const image_pixelformat_t* pixelformat, unsigned int width, un
 
 bool
 image_load(image_t* image, stream_t* stream) {
+	image_load_record_t record;
+	image_load_record_initialize(&record);
+	image_trace_begin(IMAGE_TRACE_LOAD);
+
+	bool loaded = false;
 	if (image_config.loader) {
-		if (image_config.loader(image, stream))
-			return true;
+		// Custom loaders are opaque, attribute the full load to the decode stage
+		size_t begin_pos = stream_tell(stream);
+		image_load_record_begin(&record, IMAGE_LOAD_STAGE_DECODE);
+		loaded = image_config.loader(image, stream);
+		image_load_record_end(&record, IMAGE_LOAD_STAGE_DECODE);
+		if (loaded) {
+			record.format = IMAGE_LOAD_FORMAT_CUSTOM;
+			record.bytes_read = stream_tell(stream) - begin_pos;
+		}
 	}
-	if (image_freeimage_load(image, stream))
-		return true;
+	if (!loaded)
+		loaded = image_native_load_record(image, stream, &record);
+	if (!loaded)
+		loaded = image_freeimage_load_record(image, stream, &record);
+
+	image_load_record_commit(&record, image, loaded);
+	image_trace_end(IMAGE_TRACE_LOAD);
+	return loaded;
+}
+
+bool
+image_load_mapped(image_t* image, const char* path, size_t length) {
+	return image_native_map(image, path, length);
+}
+
+bool
+image_save(const image_t* image, stream_t* stream, image_file_format_t format, const image_save_options_t* options) {
+	image_save_options_t default_options;
+	if (!options) {
+		memset(&default_options, 0, sizeof(default_options));
+		options = &default_options;
+	}
+	if (!image->data)
+		return false;
+
+	switch (format) {
+		case IMAGE_FILE_FORMAT_PNG:
+			return image_png_save(image, stream, options);
+		case IMAGE_FILE_FORMAT_TGA:
+			return image_tga_save(image, stream, options);
+		case IMAGE_FILE_FORMAT_DDS:
+			return image_dds_save(image, stream, options);
+		case IMAGE_FILE_FORMAT_KTX:
+			return image_ktx_save(image, stream, options);
+		case IMAGE_FILE_FORMAT_NATIVE:
+			return image_native_save(image, stream, options);
+		default:
+			break;
+	}
+
+	log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported image file format: %u"), (unsigned int)format);
 	return false;
 }
 
+typedef struct image_convert_job_t image_convert_job_t;
+
+struct image_convert_job_t {
+	const image_pixelformat_t* source_format;
+	const image_pixelformat_t* dest_format;
+	const uint8_t* source;
+	uint8_t* dest;
+};
+
+static void
+image_convert_pixels(void* arg, size_t begin, size_t end) {
+	const image_convert_job_t* job = arg;
+	size_t source_pixel_size = job->source_format->bits_per_pixel / 8;
+	size_t dest_pixel_size = job->dest_format->bits_per_pixel / 8;
+	float32_t rgba[IMAGE_CONVERT_SPAN * 4];
+	for (size_t ipixel = begin; ipixel < end; ipixel += IMAGE_CONVERT_SPAN) {
+		size_t count = ((end - ipixel) < IMAGE_CONVERT_SPAN) ? (end - ipixel) : IMAGE_CONVERT_SPAN;
+		image_pixel_read(job->source_format, job->source + ipixel * source_pixel_size, count, rgba);
+		image_pixel_write(job->dest_format, job->dest + ipixel * dest_pixel_size, count, rgba);
+	}
+}
+
 bool
 image_convert_channels(image_t* image, image_datatype_t data_type, unsigned int bitdepth) {
+	if (image->format.compression != IMAGE_COMPRESSION_NONE) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED,
+		          STRING_CONST("Channel conversion of block compressed image (compression %u)"),
+		          (unsigned int)image->format.compression);
+		return false;
+	}
+
 	bool need_convert = false;
 	for (unsigned int ich = 0; ich < IMAGE_CHANNEL_COUNT; ++ich) {
 		if (!image->format.channel[ich].bits_per_pixel)
@@ -210,7 +467,48 @@ image_convert_channels(image_t* image, image_datatype_t data_type, unsigned int
 	if (!need_convert)
 		return true;
 
-	// TODO: Implement
+	bool float_depth = (bitdepth == 16) || (bitdepth == 32) || (bitdepth == 64);
+	bool int_depth = (bitdepth == 8) || (bitdepth == 16) || (bitdepth == 32);
+	if (!image->data || !image->format.bits_per_pixel || (image->format.bits_per_pixel % 8) ||
+	    ((data_type == IMAGE_DATATYPE_FLOAT) ? !float_depth : !int_depth)) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED,
+		          STRING_CONST("Unsupported channel conversion (%u bits per pixel to %u bits per channel)"),
+		          image->format.bits_per_pixel, bitdepth);
+		return false;
+	}
 
-	return false;
+	// All levels, layers and slices are tightly packed pixels of the same format, so the
+	// whole storage converts as one run of pixels and the layout is kept as is
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, data_type, bitdepth, image->format.channels_count, image->format.colorspace);
+	format.premultiplied_alpha = image->format.premultiplied_alpha;
+	size_t pixel_count = image_data_size(image) / (image->format.bits_per_pixel / 8);
+	size_t data_size = pixel_count * (format.bits_per_pixel / 8);
+
+	image_trace_begin(IMAGE_TRACE_CONVERT);
+	image_convert_job_t job;
+	job.source_format = &image->format;
+	job.dest_format = &format;
+	job.source = image->data;
+	job.dest = memory_allocate(HASH_IMAGE, data_size, 0, MEMORY_PERSISTENT);
+	size_t grain = IMAGE_CONVERT_CHUNK_SIZE / (image->format.bits_per_pixel / 8);
+	image_parallel_for(pixel_count, grain ? grain : 1, image_convert_pixels, &job);
+
+	image_release_storage(image);
+	memcpy(&image->format, &format, sizeof(image_pixelformat_t));
+	image->data = job.dest;
+	image->storage_size = data_size;
+	image_storage_track(&image->format, data_size);
+	image_trace_end(IMAGE_TRACE_CONVERT);
+	return true;
+}
+
+bool
+image_load_convert(image_t* image, unsigned int flags) {
+	if (!(flags & (IMAGE_LOAD_CONVERT_UINT8 | IMAGE_LOAD_CONVERT_FLOAT32)) ||
+	    (image->format.compression != IMAGE_COMPRESSION_NONE))
+		return true;
+	if (flags & IMAGE_LOAD_CONVERT_FLOAT32)
+		return image_convert_channels(image, IMAGE_DATATYPE_FLOAT, 32);
+	return image_convert_channels(image, IMAGE_DATATYPE_UNSIGNED_INT, 8);
 }
@@ -23,6 +23,28 @@
 
 #include <image/types.h>
 #include <image/hashstrings.h>
+#include <image/pixel.h>
+#include <image/parallel.h>
+#include <image/astc.h>
+#include <image/async.h>
+#include <image/atlas.h>
+#include <image/batch.h>
+#include <image/blit.h>
+#include <image/cache.h>
+#include <image/compare.h>
+#include <image/convolve.h>
+#include <image/cubemap.h>
+#include <image/dedup.h>
+#include <image/derived.h>
+#include <image/loadevent.h>
+#include <image/metrics.h>
+#include <image/mipmap.h>
+#include <image/normalmap.h>
+#include <image/sdf.h>
+#include <image/statistics.h>
+#include <image/storage.h>
+#include <image/trace.h>
+#include <image/transform.h>
 
 /*! Initialize image functionality. Must be called prior to any other image
 module API calls.
@@ -68,9 +90,53 @@ void
 image_allocate_storage(image_t* image, const image_pixelformat_t* pixelformat, unsigned int width, unsigned int height,
                        unsigned int depth, unsigned int levels);
 
+/*! Allocate storage for an array of two dimensional layers sharing format, dimensions and
+mip level count. Each mip level stores all layers consecutively, previous storage is released.
+\param image       Image
+\param pixelformat Pixel format
+\param width       Width of first level
+\param height      Height of first level
+\param layers      Number of layers, must be non-zero
+\param levels      Number of mip levels
+\return            true if successful, false if layer count is invalid */
+IMAGE_API bool
+image_allocate_array_storage(image_t* image, const image_pixelformat_t* pixelformat, unsigned int width,
+                             unsigned int height, unsigned int layers, unsigned int levels);
+
+/*! Allocate storage for a cubemap, an array of six square layers in +X, -X, +Y, -Y, +Z, -Z
+face order, previous storage is released.
+\param image       Image
+\param pixelformat Pixel format
+\param size        Width and height of each face in the first level
+\param levels      Number of mip levels
+\return            true if successful, false if storage could not be allocated */
+IMAGE_API bool
+image_allocate_cubemap_storage(image_t* image, const image_pixelformat_t* pixelformat, unsigned int size,
+                               unsigned int levels);
+
 void*
 image_buffer(image_t* image, unsigned int miplevel);
 
+/*! Get the data of a single layer in a mip level. Layer zero is the same as #image_buffer.
+\param image    Image
+\param miplevel Mip level
+\param layer    Layer index
+\return         Layer data, null if level or layer is out of range or image has no data */
+IMAGE_API void*
+image_layer_buffer(image_t* image, unsigned int miplevel, unsigned int layer);
+
+/*! Get the total size of image data for all mip levels and layers
+\param image Image
+\return      Data size in bytes */
+IMAGE_API size_t
+image_data_size(const image_t* image);
+
+/*! Get the number of layers in an image, one for plain images
+\param image Image
+\return      Layer count */
+IMAGE_API unsigned int
+image_layers(const image_t* image);
+
 size_t
 image_buffer_size(const image_pixelformat_t* pixelformat, unsigned int width, unsigned int height, unsigned int depth,
                   unsigned int levels);
@@ -84,8 +150,44 @@ image_height(const image_t* image, unsigned int level);
 unsigned int
 image_depth(const image_t* image, unsigned int level);
 
+/*! Load an image from a stream. Safe to call concurrently from any thread as long as
+each call uses its own image and stream.
+\param image  Image to load into
+\param stream Source stream
+\return       true if successful, false if image could not be loaded */
 bool
 image_load(image_t* image, stream_t* stream);
 
-bool
+/*! Load an image stored in the native image format by memory mapping the file. The image
+data points directly into a private copy-on-write mapping of the file, no pixel data is
+read or copied until accessed. The mapping is released by #image_finalize.
+\param image  Image to load into, previous storage is released on success
+\param path   File path
+\param length Length of file path
+\return       true if successful, false if file could not be mapped or is not a valid native image */
+IMAGE_API bool
+image_load_mapped(image_t* image, const char* path, size_t length);
+
+/*! Save an image to a stream in the given file format. PNG and TGA store the first
+mip level, layer and depth slice, DDS, KTX and the native format store the full mip chain
+including block compressed data. DDS and KTX also store array layers and cubemaps, the
+native format only single layer images.
+\param image   Image to save
+\param stream  Destination stream
+\param format  File format
+\param options Save options, null for defaults
+\return        true if successful, false if image format is not supported by file format */
+IMAGE_API bool
+image_save(const image_t* image, stream_t* stream, image_file_format_t format, const image_save_options_t* options);
+
+/*! Convert all channels of an uncompressed image to the given data type and bit depth,
+keeping channel count, color space and the mip level, layer and slice layout. Values
+are converted through normalized floating point as by #image_pixel_read and
+#image_pixel_write, in parallel over the available hardware threads. A memory mapped
+image is copied to allocated storage.
+\param image     Image to convert
+\param data_type Channel data type
+\param bitdepth  Bits per channel, 8, 16 or 32 for integer and 16, 32 or 64 for float channels
+\return          true if successful or already in the requested format, false if not supported */
+IMAGE_API bool
 image_convert_channels(image_t* image, image_datatype_t data_type, unsigned int bitdepth);
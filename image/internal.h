@@ -0,0 +1,113 @@
+/* internal.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file internal.h
+    Internal functions shared between modules, not part of the public interface */
+
+#include <image/types.h>
+
+/*! Mark the calling thread as a library worker thread. Parallel loops started on
+a worker thread run serially on that thread, since the pool of workers it belongs
+to already occupies the hardware threads.
+\param worker Flag indicating the thread is a worker thread
+\return Previous value of the flag */
+bool
+image_parallel_set_worker(bool worker);
+
+/*! Convert the channels of a loaded image as requested by the load flags. Compressed
+images and images already in the requested format are left as is.
+\param image Loaded image
+\param flags Load flags, see #image_load_flag_t
+\return      true if successful, false if conversion failed */
+bool
+image_load_convert(image_t* image, unsigned int flags);
+
+typedef struct image_load_record_t image_load_record_t;
+
+//! Measurements of a single load in progress, committed to the aggregated statistics on completion
+struct image_load_record_t {
+	image_load_format_t format;
+	//! Failure status, set by the loader that identified the format
+	image_load_status_t status;
+	size_t bytes_read;
+	size_t read_calls;
+	tick_t start;
+	tick_t stage_start;
+	tick_t stage[IMAGE_LOAD_STAGE_COUNT];
+};
+
+/*! Initialize a load record and start timing the load
+\param record Record to initialize */
+void
+image_load_record_initialize(image_load_record_t* record);
+
+/*! Start timing a load stage
+\param record Load record
+\param stage  Stage */
+void
+image_load_record_begin(image_load_record_t* record, image_load_stage_t stage);
+
+/*! Stop timing a load stage and report it to the profiling system
+\param record Load record
+\param stage  Stage */
+void
+image_load_record_end(image_load_record_t* record, image_load_stage_t stage);
+
+/*! Account bytes read from the source stream
+\param record Load record
+\param size   Number of bytes read */
+void
+image_load_record_read(image_load_record_t* record, size_t size);
+
+/*! Commit a finished load to the aggregated statistics
+\param record  Load record
+\param image   Loaded image
+\param success Flag indicating if the load succeeded */
+void
+image_load_record_commit(image_load_record_t* record, const image_t* image, bool success);
+
+/*! Push a finished load to the load event ring, dropped if the ring is full
+\param event Load event */
+void
+image_load_event_record(const image_load_event_t* event);
+
+/*! Load a native format image, reporting progress in a load record
+\param image  Image to load into
+\param stream Source stream
+\param record Load record
+\return       true if successful, false if not a native image or an error occurred */
+bool
+image_native_load_record(image_t* image, stream_t* stream, image_load_record_t* record);
+
+/*! Load an image through FreeImage, reporting progress in a load record
+\param image  Image to load into
+\param stream Source stream
+\param record Load record
+\return       true if successful, false if error */
+bool
+image_freeimage_load_record(image_t* image, stream_t* stream, image_load_record_t* record);
+
+/*! Map a pixel index outside [0, count) to the source pixel given by the edge mode
+\param index Pixel index, can be negative
+\param count Number of pixels in the row or column
+\param edge  Edge addressing mode
+\return      Source pixel index in [0, count) */
+unsigned int
+image_convolve_edge(int64_t index, unsigned int count, image_edge_t edge);
@@ -0,0 +1,211 @@
+/* ktx.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "ktx.h"
+#include "pixel.h"
+
+#define KTX_HEADER_SIZE 64
+#define KTX_ENDIANNESS 0x04030201
+
+#define GL_BYTE 0x1400
+#define GL_UNSIGNED_BYTE 0x1401
+#define GL_SHORT 0x1402
+#define GL_UNSIGNED_SHORT 0x1403
+#define GL_FLOAT 0x1406
+#define GL_HALF_FLOAT 0x140B
+
+#define GL_RED 0x1903
+#define GL_RG 0x8227
+#define GL_RGB 0x1907
+#define GL_RGBA 0x1908
+
+typedef struct ktx_format_t ktx_format_t;
+
+struct ktx_format_t {
+	image_datatype_t data_type;
+	unsigned int bits_per_channel;
+	//! Internal format per channel count, zero if not supported
+	uint32_t internal_format[4];
+};
+
+static const ktx_format_t ktx_format[] = {
+    {IMAGE_DATATYPE_UNSIGNED_INT, 8, {0x8229, 0x822B, 0x8051, 0x8058}},
+    {IMAGE_DATATYPE_UNSIGNED_INT, 16, {0x822A, 0x822C, 0x8054, 0x805B}},
+    {IMAGE_DATATYPE_INT, 8, {0x8F94, 0x8F95, 0x8F96, 0x8F97}},
+    {IMAGE_DATATYPE_INT, 16, {0x8F98, 0x8F99, 0x8F9A, 0x8F9B}},
+    {IMAGE_DATATYPE_FLOAT, 16, {0x822D, 0x822F, 0x881B, 0x881A}},
+    {IMAGE_DATATYPE_FLOAT, 32, {0x822E, 0x8230, 0x8815, 0x8814}}};
+
+static const uint32_t ktx_base_format[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+//! ASTC block footprints in order of the GL internal format enumeration
+static const uint8_t ktx_astc_footprint[14][2] = {{4, 4},  {5, 4},  {5, 5},  {6, 5},  {6, 6},   {8, 5},   {8, 6},
+                                                  {8, 8},  {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}};
+
+static void
+ktx_uint32_store(uint8_t* dest, uint32_t value) {
+	dest[0] = (uint8_t)value;
+	dest[1] = (uint8_t)(value >> 8);
+	dest[2] = (uint8_t)(value >> 16);
+	dest[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t
+ktx_compressed_format(const image_pixelformat_t* pixelformat, uint32_t* base_format) {
+	bool srgb = (pixelformat->colorspace == IMAGE_COLORSPACE_sRGB);
+	*base_format = GL_RGBA;
+	switch (pixelformat->compression) {
+		case IMAGE_COMPRESSION_BC1:
+			return srgb ? 0x8C4D : 0x83F1;
+		case IMAGE_COMPRESSION_BC2:
+			return srgb ? 0x8C4E : 0x83F2;
+		case IMAGE_COMPRESSION_BC3:
+			return srgb ? 0x8C4F : 0x83F3;
+		case IMAGE_COMPRESSION_PVRTC_2BPP:
+			return srgb ? 0x8A56 : 0x8C03;
+		case IMAGE_COMPRESSION_PVRTC_4BPP:
+			return srgb ? 0x8A57 : 0x8C02;
+		case IMAGE_COMPRESSION_PVRTC2_2BPP:
+			return srgb ? 0x93F0 : 0x9137;
+		case IMAGE_COMPRESSION_PVRTC2_4BPP:
+			return srgb ? 0x93F1 : 0x9138;
+		case IMAGE_COMPRESSION_ETC1:
+			*base_format = GL_RGB;
+			return 0x8D64;
+		case IMAGE_COMPRESSION_ETC2:
+			if (pixelformat->channels_count < 4) {
+				*base_format = GL_RGB;
+				return srgb ? 0x9275 : 0x9274;
+			}
+			return srgb ? 0x9279 : 0x9278;
+		case IMAGE_COMPRESSION_ASTC_LDR:
+		case IMAGE_COMPRESSION_ASTC_HDR:
+			for (unsigned int ifoot = 0; ifoot < 14; ++ifoot) {
+				if ((ktx_astc_footprint[ifoot][0] == pixelformat->block_width) &&
+				    (ktx_astc_footprint[ifoot][1] == pixelformat->block_height))
+					return (srgb ? 0x93D0 : 0x93B0) + ifoot;
+			}
+			return 0;
+		default:
+			return 0;
+	}
+}
+
+bool
+image_ktx_save(const image_t* image, stream_t* stream, const image_save_options_t* options) {
+	FOUNDATION_UNUSED(options);
+
+	const image_pixelformat_t* pixelformat = &image->format;
+	bool compressed = (pixelformat->compression != IMAGE_COMPRESSION_NONE);
+	uint32_t gl_type = 0;
+	uint32_t gl_type_size = 1;
+	uint32_t gl_format = 0;
+	uint32_t internal_format = 0;
+	uint32_t base_format = 0;
+
+	if (compressed) {
+		internal_format = ktx_compressed_format(pixelformat, &base_format);
+	} else {
+		image_datatype_t data_type;
+		unsigned int bits_per_channel;
+		if (image_pixelformat_is_uniform(pixelformat, &data_type, &bits_per_channel)) {
+			for (size_t iformat = 0; iformat < sizeof(ktx_format) / sizeof(ktx_format[0]); ++iformat) {
+				const ktx_format_t* format = ktx_format + iformat;
+				if ((format->data_type == data_type) && (format->bits_per_channel == bits_per_channel))
+					internal_format = format->internal_format[pixelformat->channels_count - 1];
+			}
+			if ((pixelformat->colorspace == IMAGE_COLORSPACE_sRGB) && (data_type == IMAGE_DATATYPE_UNSIGNED_INT) &&
+			    (bits_per_channel == 8) && (pixelformat->channels_count >= 3))
+				internal_format = (pixelformat->channels_count == 4) ? 0x8C43 : 0x8C41;
+			gl_type_size = bits_per_channel / 8;
+			if (data_type == IMAGE_DATATYPE_FLOAT)
+				gl_type = (bits_per_channel == 16) ? GL_HALF_FLOAT : GL_FLOAT;
+			else if (data_type == IMAGE_DATATYPE_INT)
+				gl_type = (bits_per_channel == 16) ? GL_SHORT : GL_BYTE;
+			else
+				gl_type = (bits_per_channel == 16) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+			gl_format = ktx_base_format[pixelformat->channels_count - 1];
+			base_format = gl_format;
+		}
+	}
+	if (!internal_format) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported KTX pixel format (compression %u)"),
+		          (unsigned int)pixelformat->compression);
+		return false;
+	}
+
+	static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+	uint8_t header[KTX_HEADER_SIZE];
+	memcpy(header, identifier, sizeof(identifier));
+	ktx_uint32_store(header + 12, KTX_ENDIANNESS);
+	ktx_uint32_store(header + 16, gl_type);
+	ktx_uint32_store(header + 20, gl_type_size);
+	ktx_uint32_store(header + 24, gl_format);
+	ktx_uint32_store(header + 28, internal_format);
+	ktx_uint32_store(header + 32, base_format);
+	ktx_uint32_store(header + 36, image->width);
+	ktx_uint32_store(header + 40, image->height);
+	ktx_uint32_store(header + 44, (image->depth > 1) ? image->depth : 0);
+	unsigned int layers = image_layers(image);
+	unsigned int faces = image->cubemap ? 6 : 1;
+	unsigned int elements = layers / faces;
+	// A non-array cubemap pads and sizes each face individually
+	bool single_cube = (faces > 1) && (elements == 1);
+	ktx_uint32_store(header + 48, (elements > 1) ? elements : 0);
+	ktx_uint32_store(header + 52, faces);
+	ktx_uint32_store(header + 56, image->levels);
+	ktx_uint32_store(header + 60, 0);
+	stream_write(stream, header, sizeof(header));
+
+	static const uint8_t padding[4] = {0, 0, 0, 0};
+	for (unsigned int level = 0; level < image->levels; ++level) {
+		unsigned int width = image_width(image, level);
+		unsigned int height = image_height(image, level);
+		unsigned int depth = image_depth(image, level);
+		size_t level_size = image_buffer_size(pixelformat, width, height, depth, 1);
+
+		// Uncompressed rows are padded to four byte alignment
+		size_t row_size = compressed ? 0 : ((size_t)pixelformat->bits_per_pixel * width) / 8;
+		size_t row_padding = compressed ? 0 : ((4 - (row_size & 3)) & 3);
+		size_t image_size = row_padding ? (row_size + row_padding) * height * depth : level_size;
+
+		uint8_t size[4];
+		ktx_uint32_store(size, (uint32_t)(single_cube ? image_size : image_size * layers));
+		stream_write(stream, size, sizeof(size));
+		for (unsigned int layer = 0; layer < layers; ++layer) {
+			const uint8_t* data = image_layer_buffer((image_t*)image, level, layer);
+			if (!row_padding) {
+				stream_write(stream, data, level_size);
+			} else {
+				for (size_t irow = 0; irow < (size_t)height * depth; ++irow) {
+					stream_write(stream, data + irow * row_size, row_size);
+					stream_write(stream, padding, row_padding);
+				}
+			}
+			if (single_cube && (image_size & 3))
+				stream_write(stream, padding, 4 - (image_size & 3));
+		}
+		if (!single_cube && ((image_size * layers) & 3))
+			stream_write(stream, padding, 4 - ((image_size * layers) & 3));
+	}
+
+	return true;
+}
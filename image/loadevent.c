@@ -0,0 +1,203 @@
+/* loadevent.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "loadevent.h"
+#include "internal.h"
+
+static const string_const_t image_load_status_names[IMAGE_LOAD_STATUS_COUNT] = {
+    {STRING_CONST("ok")},
+    {STRING_CONST("unrecognized")},
+    {STRING_CONST("decode failed")},
+    {STRING_CONST("unsupported")},
+    {STRING_CONST("truncated")}};
+
+void
+image_load_event_initialize(void);
+
+void
+image_load_event_finalize(void);
+
+#if IMAGE_ENABLE_LOAD_EVENTS
+
+//! Events in the ring buffer, must be a power of two
+#define IMAGE_LOAD_EVENT_CAPACITY 4096
+
+typedef struct image_load_event_slot_t image_load_event_slot_t;
+
+//! Slot in the bounded multi producer, multi consumer ring. The sequence equals the slot
+//! position when free for writing, and the position plus one when holding an event
+struct image_load_event_slot_t {
+	atomic64_t sequence;
+	image_load_event_t event;
+};
+
+static image_load_event_slot_t* image_load_event_ring;
+static atomic64_t image_load_event_head;
+static atomic64_t image_load_event_tail;
+static atomic64_t image_load_event_dropped_count;
+static atomic32_t image_load_event_ready;
+//! Number of threads accessing the ring, finalization waits for this to reach zero
+static atomic32_t image_load_event_active;
+
+void
+image_load_event_initialize(void) {
+	image_load_event_ring = memory_allocate(HASH_IMAGE, sizeof(image_load_event_slot_t) * IMAGE_LOAD_EVENT_CAPACITY,
+	                                        0, MEMORY_PERSISTENT);
+	for (int64_t islot = 0; islot < IMAGE_LOAD_EVENT_CAPACITY; ++islot)
+		atomic_store64(&image_load_event_ring[islot].sequence, islot, memory_order_relaxed);
+	atomic_store64(&image_load_event_head, 0, memory_order_relaxed);
+	atomic_store64(&image_load_event_tail, 0, memory_order_relaxed);
+	atomic_store64(&image_load_event_dropped_count, 0, memory_order_release);
+	atomic_store32(&image_load_event_ready, 1, memory_order_release);
+}
+
+void
+image_load_event_finalize(void) {
+	// Wait for threads still recording or draining, later calls see the module as not
+	// ready and never touch the ring, so it can be released
+	atomic_store32(&image_load_event_ready, 0, memory_order_seq_cst);
+	while (atomic_load32(&image_load_event_active, memory_order_seq_cst))
+		thread_yield();
+	memory_deallocate(image_load_event_ring);
+	image_load_event_ring = 0;
+}
+
+static void
+image_load_event_push(const image_load_event_t* event) {
+	int64_t position = atomic_load64(&image_load_event_tail, memory_order_relaxed);
+	image_load_event_slot_t* slot;
+	while (true) {
+		slot = image_load_event_ring + (position & (IMAGE_LOAD_EVENT_CAPACITY - 1));
+		int64_t sequence = atomic_load64(&slot->sequence, memory_order_acquire);
+		if (sequence == position) {
+			if (atomic_cas64(&image_load_event_tail, position + 1, position, memory_order_relaxed,
+			                 memory_order_relaxed))
+				break;
+		} else if (sequence < position) {
+			// Slot still holds an event from the previous lap, ring is full
+			atomic_incr64(&image_load_event_dropped_count, memory_order_relaxed);
+			return;
+		}
+		position = atomic_load64(&image_load_event_tail, memory_order_relaxed);
+	}
+	slot->event = *event;
+	atomic_store64(&slot->sequence, position + 1, memory_order_release);
+}
+
+void
+image_load_event_record(const image_load_event_t* event) {
+	atomic_incr32(&image_load_event_active, memory_order_seq_cst);
+	if (atomic_load32(&image_load_event_ready, memory_order_seq_cst))
+		image_load_event_push(event);
+	atomic_decr32(&image_load_event_active, memory_order_release);
+}
+
+static size_t
+image_load_event_pop(image_load_event_t* events, size_t capacity) {
+	size_t count = 0;
+	while (count < capacity) {
+		int64_t position = atomic_load64(&image_load_event_head, memory_order_relaxed);
+		image_load_event_slot_t* slot = image_load_event_ring + (position & (IMAGE_LOAD_EVENT_CAPACITY - 1));
+		int64_t sequence = atomic_load64(&slot->sequence, memory_order_acquire);
+		if (sequence < position + 1)
+			break;
+		if ((sequence == position + 1) && atomic_cas64(&image_load_event_head, position + 1, position,
+		                                               memory_order_relaxed, memory_order_relaxed)) {
+			events[count++] = slot->event;
+			atomic_store64(&slot->sequence, position + IMAGE_LOAD_EVENT_CAPACITY, memory_order_release);
+		}
+	}
+	return count;
+}
+
+size_t
+image_load_event_drain(image_load_event_t* events, size_t capacity) {
+	size_t count = 0;
+	atomic_incr32(&image_load_event_active, memory_order_seq_cst);
+	if (atomic_load32(&image_load_event_ready, memory_order_seq_cst))
+		count = image_load_event_pop(events, capacity);
+	atomic_decr32(&image_load_event_active, memory_order_release);
+	return count;
+}
+
+size_t
+image_load_event_dropped(void) {
+	return (size_t)atomic_load64(&image_load_event_dropped_count, memory_order_relaxed);
+}
+
+#else
+
+void
+image_load_event_initialize(void) {
+}
+
+void
+image_load_event_finalize(void) {
+}
+
+void
+image_load_event_record(const image_load_event_t* event) {
+	FOUNDATION_UNUSED(event);
+}
+
+size_t
+image_load_event_drain(image_load_event_t* events, size_t capacity) {
+	FOUNDATION_UNUSED(events);
+	FOUNDATION_UNUSED(capacity);
+	return 0;
+}
+
+size_t
+image_load_event_dropped(void) {
+	return 0;
+}
+
+#endif
+
+size_t
+image_load_event_write(stream_t* stream) {
+	image_load_event_t events[64];
+	size_t total = 0;
+	size_t count;
+	double ns_per_ms = 1000000.0;
+	while ((count = image_load_event_drain(events, sizeof(events) / sizeof(events[0])))) {
+		for (size_t ievent = 0; ievent < count; ++ievent) {
+			const image_load_event_t* event = events + ievent;
+			string_const_t format = image_load_format_name(event->format);
+			string_const_t status = image_load_status_name(event->status);
+			stream_write_format(stream,
+			                    STRING_CONST("%.*s %.*s %ux%u levels %u read %" PRIu64
+			                                 " bytes in %.3f ms (thread %" PRIu64 ")\n"),
+			                    STRING_FORMAT(format), STRING_FORMAT(status), event->width, event->height,
+			                    event->levels, event->bytes_read, (double)event->duration_ns / ns_per_ms,
+			                    event->thread);
+		}
+		total += count;
+	}
+	return total;
+}
+
+string_const_t
+image_load_status_name(image_load_status_t status) {
+	if ((int)status >= IMAGE_LOAD_STATUS_COUNT)
+		return string_const(STRING_CONST("invalid"));
+	return image_load_status_names[status];
+}
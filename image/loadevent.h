@@ -0,0 +1,53 @@
+/* loadevent.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file loadevent.h
+    Structured load events. Every call to #image_load records an event with source format,
+    dimensions, status and duration into a lock free ring buffer. Events are only formatted
+    when a consumer drains them, keeping the load path free of string formatting and log
+    locks. Events are dropped if the ring buffer is full. Recording can be compiled out by
+    defining IMAGE_ENABLE_LOAD_EVENTS to 0, in which case no events are ever returned. */
+
+#include <image/types.h>
+
+/*! Remove recorded events from the ring buffer, oldest first. Safe to call concurrently
+with loads and other consumers.
+\param events   Array to receive events
+\param capacity Maximum number of events to remove
+\return         Number of events stored in the array */
+IMAGE_API size_t
+image_load_event_drain(image_load_event_t* events, size_t capacity);
+
+/*! Remove all recorded events from the ring buffer and write them as text, one line per event
+\param stream Destination stream
+\return       Number of events written */
+IMAGE_API size_t
+image_load_event_write(stream_t* stream);
+
+/*! Query number of events dropped because the ring buffer was full
+\return Number of dropped events */
+IMAGE_API size_t
+image_load_event_dropped(void);
+
+/*! Get the name of a load status
+\param status Load status
+\return       Status name */
+IMAGE_API string_const_t
+image_load_status_name(image_load_status_t status);
@@ -0,0 +1,178 @@
+/* metrics.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "metrics.h"
+#include "internal.h"
+#include "loadevent.h"
+
+typedef struct image_load_counters_t image_load_counters_t;
+
+struct image_load_counters_t {
+	atomic64_t loads;
+	atomic64_t failures;
+	atomic64_t bytes_read;
+	atomic64_t read_calls;
+	atomic64_t pixels;
+	atomic64_t stage_ns[IMAGE_LOAD_STAGE_COUNT];
+	atomic64_t total_ns;
+};
+
+static image_load_counters_t image_load_counters[IMAGE_LOAD_FORMAT_COUNT];
+
+static const string_const_t image_load_format_names[IMAGE_LOAD_FORMAT_COUNT] = {
+    {STRING_CONST("unknown")}, {STRING_CONST("custom")}, {STRING_CONST("native")}, {STRING_CONST("png")},
+    {STRING_CONST("jpeg")},    {STRING_CONST("bmp")},    {STRING_CONST("tga")},    {STRING_CONST("tiff")},
+    {STRING_CONST("dds")},     {STRING_CONST("gif")},    {STRING_CONST("psd")},    {STRING_CONST("hdr")},
+    {STRING_CONST("exr")},     {STRING_CONST("other")}};
+
+static const string_const_t image_load_stage_names[IMAGE_LOAD_STAGE_COUNT] = {
+    {STRING_CONST("image_load_probe")},
+    {STRING_CONST("image_load_decode")},
+    {STRING_CONST("image_load_allocate")},
+    {STRING_CONST("image_load_copy")}};
+
+//! Trace stage of each load stage
+static const image_trace_stage_t image_load_stage_trace[IMAGE_LOAD_STAGE_COUNT] = {
+    IMAGE_TRACE_PROBE, IMAGE_TRACE_DECODE, IMAGE_TRACE_ALLOCATE, IMAGE_TRACE_REPACK};
+
+static uint64_t
+image_load_ticks_to_ns(tick_t ticks) {
+	uint64_t frequency = (uint64_t)time_ticks_per_second();
+	uint64_t value = (ticks > 0) ? (uint64_t)ticks : 0;
+	// Split to avoid overflowing the multiplication for long durations
+	return (value / frequency) * 1000000000ULL + ((value % frequency) * 1000000000ULL) / frequency;
+}
+
+void
+image_load_record_initialize(image_load_record_t* record) {
+	memset(record, 0, sizeof(image_load_record_t));
+	record->start = time_current();
+}
+
+void
+image_load_record_begin(image_load_record_t* record, image_load_stage_t stage) {
+	profile_begin_block(STRING_ARGS(image_load_stage_names[stage]));
+	image_trace_begin(image_load_stage_trace[stage]);
+	record->stage_start = time_current();
+}
+
+void
+image_load_record_end(image_load_record_t* record, image_load_stage_t stage) {
+	record->stage[stage] += time_diff(record->stage_start, time_current());
+	image_trace_end(image_load_stage_trace[stage]);
+	profile_end_block();
+}
+
+void
+image_load_record_read(image_load_record_t* record, size_t size) {
+	record->bytes_read += size;
+	++record->read_calls;
+}
+
+void
+image_load_record_commit(image_load_record_t* record, const image_t* image, bool success) {
+	tick_t total = time_diff(record->start, time_current());
+	image_load_format_t format = record->format;
+	if ((int)format >= IMAGE_LOAD_FORMAT_COUNT)
+		format = IMAGE_LOAD_FORMAT_UNKNOWN;
+
+	uint64_t pixels = 0;
+	if (success) {
+		for (unsigned int ilevel = 0; ilevel < image->levels; ++ilevel)
+			pixels += (uint64_t)image_width(image, ilevel) * image_height(image, ilevel) * image_depth(image, ilevel);
+	}
+
+	image_load_counters_t* counters = image_load_counters + format;
+	atomic_incr64(success ? &counters->loads : &counters->failures, memory_order_relaxed);
+	atomic_add64(&counters->bytes_read, (int64_t)record->bytes_read, memory_order_relaxed);
+	atomic_add64(&counters->read_calls, (int64_t)record->read_calls, memory_order_relaxed);
+	atomic_add64(&counters->pixels, (int64_t)pixels, memory_order_relaxed);
+	for (int istage = 0; istage < IMAGE_LOAD_STAGE_COUNT; ++istage) {
+		if (record->stage[istage])
+			atomic_add64(&counters->stage_ns[istage], (int64_t)image_load_ticks_to_ns(record->stage[istage]),
+			             memory_order_relaxed);
+	}
+	atomic_add64(&counters->total_ns, (int64_t)image_load_ticks_to_ns(total), memory_order_relaxed);
+
+#if IMAGE_ENABLE_LOAD_EVENTS
+	image_load_event_t event;
+	event.format = format;
+	event.status = IMAGE_LOAD_STATUS_OK;
+	if (!success) {
+		event.status = record->status;
+		if (event.status == IMAGE_LOAD_STATUS_OK)
+			event.status = record->format ? IMAGE_LOAD_STATUS_DECODE_FAILED : IMAGE_LOAD_STATUS_UNRECOGNIZED;
+	}
+	event.width = success ? image->width : 0;
+	event.height = success ? image->height : 0;
+	event.levels = success ? image->levels : 0;
+	event.bytes_read = record->bytes_read;
+	event.duration_ns = image_load_ticks_to_ns(total);
+	event.thread = thread_id();
+	event.timestamp = time_current();
+	image_load_event_record(&event);
+#endif
+}
+
+static void
+image_load_statistics_accumulate(image_load_statistics_t* statistics, image_load_counters_t* counters) {
+	statistics->loads += (uint64_t)atomic_load64(&counters->loads, memory_order_relaxed);
+	statistics->failures += (uint64_t)atomic_load64(&counters->failures, memory_order_relaxed);
+	statistics->bytes_read += (uint64_t)atomic_load64(&counters->bytes_read, memory_order_relaxed);
+	statistics->read_calls += (uint64_t)atomic_load64(&counters->read_calls, memory_order_relaxed);
+	statistics->pixels += (uint64_t)atomic_load64(&counters->pixels, memory_order_relaxed);
+	for (int istage = 0; istage < IMAGE_LOAD_STAGE_COUNT; ++istage)
+		statistics->stage_ns[istage] += (uint64_t)atomic_load64(&counters->stage_ns[istage], memory_order_relaxed);
+	statistics->total_ns += (uint64_t)atomic_load64(&counters->total_ns, memory_order_relaxed);
+}
+
+void
+image_load_statistics(image_load_format_t format, image_load_statistics_t* statistics) {
+	memset(statistics, 0, sizeof(image_load_statistics_t));
+	if ((int)format < IMAGE_LOAD_FORMAT_COUNT) {
+		image_load_statistics_accumulate(statistics, image_load_counters + format);
+		return;
+	}
+	for (int iformat = 0; iformat < IMAGE_LOAD_FORMAT_COUNT; ++iformat)
+		image_load_statistics_accumulate(statistics, image_load_counters + iformat);
+}
+
+void
+image_load_statistics_reset(void) {
+	image_load_counters_t* counters = image_load_counters;
+	for (int iformat = 0; iformat < IMAGE_LOAD_FORMAT_COUNT; ++iformat, ++counters) {
+		atomic_store64(&counters->loads, 0, memory_order_relaxed);
+		atomic_store64(&counters->failures, 0, memory_order_relaxed);
+		atomic_store64(&counters->bytes_read, 0, memory_order_relaxed);
+		atomic_store64(&counters->read_calls, 0, memory_order_relaxed);
+		atomic_store64(&counters->pixels, 0, memory_order_relaxed);
+		for (int istage = 0; istage < IMAGE_LOAD_STAGE_COUNT; ++istage)
+			atomic_store64(&counters->stage_ns[istage], 0, memory_order_relaxed);
+		atomic_store64(&counters->total_ns, 0, memory_order_relaxed);
+	}
+}
+
+string_const_t
+image_load_format_name(image_load_format_t format) {
+	if ((int)format >= IMAGE_LOAD_FORMAT_COUNT)
+		return string_const(STRING_CONST("invalid"));
+	return image_load_format_names[format];
+}
@@ -0,0 +1,43 @@
+/* metrics.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file metrics.h
+    Load path instrumentation. Every call to #image_load records the time spent in each
+    load stage along with bytes read, read calls and pixels produced, aggregated per
+    source file format with lock free counters. Stages are also reported to the
+    foundation profiling system as named blocks. */
+
+#include <image/types.h>
+
+/*! Query aggregated load statistics for a source file format
+\param format     Source file format, or #IMAGE_LOAD_FORMAT_COUNT for totals across all formats
+\param statistics Statistics structure to fill */
+IMAGE_API void
+image_load_statistics(image_load_format_t format, image_load_statistics_t* statistics);
+
+/*! Reset all load statistics to zero */
+IMAGE_API void
+image_load_statistics_reset(void);
+
+/*! Get the name of a source file format
+\param format Source file format
+\return       Format name */
+IMAGE_API string_const_t
+image_load_format_name(image_load_format_t format);
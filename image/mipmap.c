@@ -0,0 +1,286 @@
+/* mipmap.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include <math.h>
+
+#include "image.h"
+#include "mipmap.h"
+
+//! Minimum number of bytes processed per parallel chunk
+#define IMAGE_MIPMAP_CHUNK_SIZE (64 * 1024)
+
+typedef struct image_mipmap_job_t image_mipmap_job_t;
+
+struct image_mipmap_job_t {
+	const image_pixelformat_t* format;
+	//! Floating point RGBA texels of the level above, in linear space or as unnormalized normals
+	const float32_t* source;
+	//! Floating point RGBA texels of the generated level
+	float32_t* dest;
+	unsigned int source_width;
+	unsigned int source_height;
+	unsigned int source_depth;
+	unsigned int width;
+	unsigned int height;
+	//! Pixel data of the generated level
+	uint8_t* data;
+	size_t pitch;
+	image_mipmap_mode_t mode;
+	//! Color channels are sRGB encoded
+	bool srgb;
+	//! Normal channels are biased to [0,1]
+	bool biased;
+	//! Normals are stored without the blue channel
+	bool reconstruct;
+	bool toksvig;
+};
+
+static float32_t
+image_mipmap_srgb_to_linear(float32_t value) {
+	if (value <= 0.04045f)
+		return value / 12.92f;
+	return powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float32_t
+image_mipmap_linear_to_srgb(float32_t value) {
+	if (value <= 0.0031308f)
+		return value * 12.92f;
+	return 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+//! Convert a row of stored texels to the filtering representation
+static void
+image_mipmap_decode(const image_mipmap_job_t* job, float32_t* rgba, unsigned int count) {
+	if (job->mode == IMAGE_MIPMAP_NORMALMAP) {
+		float32_t scale = job->biased ? 2.0f : 1.0f;
+		float32_t bias = job->biased ? -1.0f : 0.0f;
+		for (unsigned int ipixel = 0; ipixel < count; ++ipixel, rgba += 4) {
+			float32_t x = rgba[0] * scale + bias;
+			float32_t y = rgba[1] * scale + bias;
+			float32_t z = rgba[2] * scale + bias;
+			if (job->reconstruct) {
+				float32_t zz = 1.0f - x * x - y * y;
+				z = (zz > 0) ? sqrtf(zz) : 0;
+			}
+			float32_t length = sqrtf(x * x + y * y + z * z);
+			float32_t inv_length = (length > 0) ? (1.0f / length) : 0;
+			rgba[0] = x * inv_length;
+			rgba[1] = y * inv_length;
+			rgba[2] = (length > 0) ? (z * inv_length) : 1.0f;
+		}
+	} else if (job->srgb) {
+		for (unsigned int ipixel = 0; ipixel < count; ++ipixel, rgba += 4) {
+			rgba[0] = image_mipmap_srgb_to_linear(rgba[0]);
+			rgba[1] = image_mipmap_srgb_to_linear(rgba[1]);
+			rgba[2] = image_mipmap_srgb_to_linear(rgba[2]);
+		}
+	}
+}
+
+//! Convert a row of filtered texels to the stored representation
+static void
+image_mipmap_encode(const image_mipmap_job_t* job, const float32_t* source, float32_t* rgba, unsigned int count) {
+	if (job->mode == IMAGE_MIPMAP_NORMALMAP) {
+		float32_t scale = job->biased ? 0.5f : 1.0f;
+		float32_t bias = job->biased ? 0.5f : 0.0f;
+		for (unsigned int ipixel = 0; ipixel < count; ++ipixel, source += 4, rgba += 4) {
+			float32_t length = sqrtf(source[0] * source[0] + source[1] * source[1] + source[2] * source[2]);
+			float32_t inv_length = (length > 0) ? (1.0f / length) : 0;
+			rgba[0] = source[0] * inv_length * scale + bias;
+			rgba[1] = source[1] * inv_length * scale + bias;
+			rgba[2] = ((length > 0) ? (source[2] * inv_length) : 1.0f) * scale + bias;
+			if (job->toksvig) {
+				float32_t variance = (length > 0) ? ((1.0f - length) / length) : 1.0f;
+				rgba[3] = (variance < 0) ? 0 : ((variance > 1) ? 1 : variance);
+			} else {
+				rgba[3] = source[3];
+			}
+		}
+	} else if (job->srgb) {
+		for (unsigned int ipixel = 0; ipixel < count; ++ipixel, source += 4, rgba += 4) {
+			rgba[0] = image_mipmap_linear_to_srgb(source[0]);
+			rgba[1] = image_mipmap_linear_to_srgb(source[1]);
+			rgba[2] = image_mipmap_linear_to_srgb(source[2]);
+			rgba[3] = source[3];
+		}
+	} else {
+		memcpy(rgba, source, sizeof(float32_t) * 4 * count);
+	}
+}
+
+//! Read rows of the first level into the source plane
+static void
+image_mipmap_read(void* arg, size_t begin, size_t end) {
+	const image_mipmap_job_t* job = arg;
+	for (size_t irow = begin; irow < end; ++irow) {
+		float32_t* rgba = job->dest + irow * job->width * 4;
+		uint8_t* row = job->data + irow * job->pitch;
+		image_pixel_read(job->format, row, job->width, rgba);
+		if (job->toksvig) {
+			// First level normals have no spread within the texel
+			for (unsigned int ipixel = 0; ipixel < job->width; ++ipixel)
+				rgba[ipixel * 4 + 3] = 0;
+			image_pixel_write(job->format, row, job->width, rgba);
+		}
+		image_mipmap_decode(job, rgba, job->width);
+	}
+}
+
+//! Average texel blocks of the source plane into rows of the generated level
+static void
+image_mipmap_downsample(void* arg, size_t begin, size_t end) {
+	const image_mipmap_job_t* job = arg;
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * job->width, 0, MEMORY_PERSISTENT);
+	size_t source_slice = (size_t)job->source_width * job->source_height;
+	for (size_t irow = begin; irow < end; ++irow) {
+		unsigned int y = (unsigned int)(irow % job->height);
+		unsigned int z = (unsigned int)(irow / job->height);
+		// Odd source dimensions repeat the last texel, single texel dimensions are not halved
+		unsigned int y0 = 2 * y;
+		unsigned int y1 = (y0 + 1 < job->source_height) ? (y0 + 1) : (job->source_height - 1);
+		unsigned int z0 = (2 * z < job->source_depth) ? (2 * z) : (job->source_depth - 1);
+		unsigned int z1 = (z0 + 1 < job->source_depth) ? (z0 + 1) : (job->source_depth - 1);
+		const float32_t* row[4];
+		row[0] = job->source + (z0 * source_slice + (size_t)y0 * job->source_width) * 4;
+		row[1] = job->source + (z0 * source_slice + (size_t)y1 * job->source_width) * 4;
+		row[2] = job->source + (z1 * source_slice + (size_t)y0 * job->source_width) * 4;
+		row[3] = job->source + (z1 * source_slice + (size_t)y1 * job->source_width) * 4;
+		float32_t* dest = job->dest + irow * job->width * 4;
+		for (unsigned int x = 0; x < job->width; ++x) {
+			size_t x0 = (size_t)(2 * x) * 4;
+			size_t x1 = ((2 * x + 1 < job->source_width) ? (2 * x + 1) : (job->source_width - 1)) * (size_t)4;
+			for (unsigned int ich = 0; ich < 4; ++ich)
+				dest[x * 4 + ich] = 0.125f * (row[0][x0 + ich] + row[0][x1 + ich] + row[1][x0 + ich] +
+				                              row[1][x1 + ich] + row[2][x0 + ich] + row[2][x1 + ich] +
+				                              row[3][x0 + ich] + row[3][x1 + ich]);
+		}
+		image_mipmap_encode(job, dest, rgba, job->width);
+		image_pixel_write(job->format, job->data + irow * job->pitch, job->width, rgba);
+	}
+	memory_deallocate(rgba);
+}
+
+static size_t
+image_mipmap_grain(size_t unit_size) {
+	size_t grain = IMAGE_MIPMAP_CHUNK_SIZE / (unit_size ? unit_size : 1);
+	return grain ? grain : 1;
+}
+
+bool
+image_mipmap_generate(image_t* image, image_mipmap_mode_t mode, unsigned int flags) {
+	const image_pixelformat_t* format = &image->format;
+	if (!image->data || (format->compression != IMAGE_COMPRESSION_NONE) || format->block_width ||
+	    !format->bits_per_pixel || (format->bits_per_pixel % 8)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Mip generation requires uncompressed byte aligned pixel formats"));
+		return false;
+	}
+	bool toksvig = (flags & IMAGE_MIPMAP_TOKSVIG_ALPHA) != 0;
+	if ((mode == IMAGE_MIPMAP_NORMALMAP) && (!format->channel[IMAGE_CHANNEL_RED].bits_per_pixel ||
+	                                         !format->channel[IMAGE_CHANNEL_GREEN].bits_per_pixel)) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Normal map mips require red and green channels"));
+		return false;
+	}
+	if (toksvig && ((mode != IMAGE_MIPMAP_NORMALMAP) || !format->channel[IMAGE_CHANNEL_ALPHA].bits_per_pixel)) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE,
+		         STRING_CONST("Toksvig variance requires a normal map with an alpha channel"));
+		return false;
+	}
+
+	unsigned int levels = 1;
+	unsigned int extent = image->width;
+	if (image->height > extent)
+		extent = image->height;
+	if (image->depth > extent)
+		extent = image->depth;
+	while (extent > 1) {
+		extent >>= 1;
+		++levels;
+	}
+
+	image_mipmap_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.format = format;
+	job.mode = mode;
+	job.srgb = (format->colorspace == IMAGE_COLORSPACE_sRGB);
+	job.biased = (format->channel[IMAGE_CHANNEL_RED].data_type == IMAGE_DATATYPE_UNSIGNED_INT);
+	job.reconstruct = !format->channel[IMAGE_CHANNEL_BLUE].bits_per_pixel;
+	job.toksvig = toksvig;
+
+	unsigned int layers = image_layers(image);
+	image_t result;
+	image_initialize(&result);
+	if (layers > 1) {
+		image_allocate_array_storage(&result, format, image->width, image->height, layers, levels);
+		result.cubemap = image->cubemap;
+	} else {
+		image_allocate_storage(&result, format, image->width, image->height, image->depth, levels);
+	}
+	size_t first_size = image_buffer_size(format, image->width, image->height, image->depth, 1) * layers;
+	memcpy(result.data, image->data, first_size);
+
+	// Generated levels are filtered from the unquantized texels of the level above, which
+	// alternate between two planes sized for the first and second level
+	size_t texel_count = (size_t)image->width * image->height * image->depth;
+	size_t second_count = (size_t)image_width(&result, 1) * image_height(&result, 1) * image_depth(&result, 1);
+	float32_t* plane[2];
+	plane[0] = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * texel_count, 0, MEMORY_PERSISTENT);
+	plane[1] = (levels > 1) ?
+	               memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * second_count, 0, MEMORY_PERSISTENT) :
+	               0;
+
+	// Layers of array and cubemap images are filtered independently, cubemap faces are not
+	// filtered across edges
+	for (unsigned int ilayer = 0; ilayer < layers; ++ilayer) {
+		job.dest = plane[0];
+		job.width = image->width;
+		job.height = image->height;
+		job.data = image_layer_buffer(&result, 0, ilayer);
+		job.pitch = (size_t)image->width * (format->bits_per_pixel / 8);
+		image_parallel_for((size_t)job.height * image->depth, image_mipmap_grain(job.pitch), image_mipmap_read,
+		                   &job);
+
+		for (unsigned int level = 1; level < levels; ++level) {
+			image_trace_begin(IMAGE_TRACE_MIP);
+			job.source = job.dest;
+			job.source_width = job.width;
+			job.source_height = job.height;
+			job.source_depth = image_depth(&result, level - 1);
+			job.dest = plane[level & 1];
+			job.width = image_width(&result, level);
+			job.height = image_height(&result, level);
+			job.data = image_layer_buffer(&result, level, ilayer);
+			job.pitch = (size_t)job.width * (format->bits_per_pixel / 8);
+			size_t rows = (size_t)job.height * image_depth(&result, level);
+			image_parallel_for(rows, image_mipmap_grain(job.width * 4 * sizeof(float32_t) * 2),
+			                   image_mipmap_downsample, &job);
+			image_trace_end(IMAGE_TRACE_MIP);
+		}
+	}
+
+	memory_deallocate(plane[0]);
+	if (plane[1])
+		memory_deallocate(plane[1]);
+
+	image_finalize(image);
+	memcpy(image, &result, sizeof(image_t));
+	return true;
+}
@@ -0,0 +1,43 @@
+/* mipmap.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file mipmap.h
+    Mip chain generation */
+
+#include <image/types.h>
+
+/*! Generate the full mip chain of an image down to a single texel from the first
+level, replacing any existing mip levels. Texels are converted to normalized floating
+point as by #image_pixel_read, filtered and converted back. Each layer of an array or
+cubemap image gets its own mip chain, cubemap faces are not filtered across edges.
+
+In normal map mode the red, green and blue channels hold a tangent space normal,
+biased to [0,1] for unsigned formats. Two channel maps reconstruct the blue channel.
+Each level averages the unnormalized normals of the level above and stores them
+renormalized. The shortening of the average measures the spread of normals within
+the texel footprint. With #IMAGE_MIPMAP_TOKSVIG_ALPHA it is stored in the alpha channel
+as the variance (1 - |n|) / |n|, clamped to [0,1], for specular antialiasing with the
+Toksvig factor 1 / (1 + power * variance). The first level then stores zero variance.
+\param image Image, must be uncompressed with byte aligned pixels
+\param mode  Filter mode
+\param flags Mode flags, see #image_mipmap_flag_t
+\return      true if successful, false if the format is not supported */
+IMAGE_API bool
+image_mipmap_generate(image_t* image, image_mipmap_mode_t mode, unsigned int flags);
@@ -0,0 +1,414 @@
+/* native.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "internal.h"
+#include "native.h"
+
+#if FOUNDATION_PLATFORM_WINDOWS
+#include <foundation/windows.h>
+#elif FOUNDATION_PLATFORM_POSIX
+#include <foundation/posix.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+#define NATIVE_VERSION 2
+#define NATIVE_ENDIANNESS 0x04030201
+//! Level data starts at a page aligned offset so the mapped data is page aligned
+#define NATIVE_ALIGNMENT 4096
+#define NATIVE_MAX_LEVELS 32
+
+// Fixed header layout, all values in host byte order
+#define NATIVE_OFFSET_ENDIANNESS 4
+#define NATIVE_OFFSET_VERSION 8
+#define NATIVE_OFFSET_HEADER_SIZE 12
+#define NATIVE_OFFSET_WIDTH 16
+#define NATIVE_OFFSET_HEIGHT 20
+#define NATIVE_OFFSET_DEPTH 24
+#define NATIVE_OFFSET_LEVELS 28
+#define NATIVE_OFFSET_FORMAT 32
+#define NATIVE_FORMAT_SIZE (9 * 4 + IMAGE_CHANNEL_COUNT * 3 * 4)
+#define NATIVE_OFFSET_DATA_OFFSET (NATIVE_OFFSET_FORMAT + NATIVE_FORMAT_SIZE)
+#define NATIVE_OFFSET_DATA_SIZE (NATIVE_OFFSET_DATA_OFFSET + 8)
+#define NATIVE_OFFSET_LAYERS (NATIVE_OFFSET_DATA_SIZE + 8)
+#define NATIVE_OFFSET_FLAGS (NATIVE_OFFSET_LAYERS + 4)
+#define NATIVE_OFFSET_LEVEL_TABLE (NATIVE_OFFSET_FLAGS + 4)
+//! Version 1 has no layer count or flags, the level table follows the data size
+#define NATIVE_OFFSET_LEVEL_TABLE_V1 (NATIVE_OFFSET_DATA_SIZE + 8)
+#define NATIVE_HEADER_MAX_SIZE (NATIVE_OFFSET_LEVEL_TABLE + NATIVE_MAX_LEVELS * 8)
+
+#define NATIVE_FLAG_CUBEMAP 0x0001
+
+static const uint8_t native_identifier[4] = {'I', 'M', 'G', 'N'};
+
+static void
+native_uint32_store(uint8_t* dest, uint32_t value) {
+	memcpy(dest, &value, sizeof(value));
+}
+
+static void
+native_uint64_store(uint8_t* dest, uint64_t value) {
+	memcpy(dest, &value, sizeof(value));
+}
+
+static uint32_t
+native_uint32_load(const uint8_t* source) {
+	uint32_t value;
+	memcpy(&value, source, sizeof(value));
+	return value;
+}
+
+static uint64_t
+native_uint64_load(const uint8_t* source) {
+	uint64_t value;
+	memcpy(&value, source, sizeof(value));
+	return value;
+}
+
+static size_t
+native_level_table_offset(uint32_t version) {
+	return (version == 1) ? NATIVE_OFFSET_LEVEL_TABLE_V1 : NATIVE_OFFSET_LEVEL_TABLE;
+}
+
+static size_t
+native_header_size(uint32_t version, unsigned int levels) {
+	return native_level_table_offset(version) + (size_t)levels * 8;
+}
+
+static size_t
+native_data_offset(uint32_t version, unsigned int levels) {
+	return (native_header_size(version, levels) + (NATIVE_ALIGNMENT - 1)) & ~(size_t)(NATIVE_ALIGNMENT - 1);
+}
+
+static void
+native_format_store(uint8_t* dest, const image_pixelformat_t* format) {
+	native_uint32_store(dest, (uint32_t)format->compression);
+	native_uint32_store(dest + 4, (uint32_t)format->colorspace);
+	native_uint32_store(dest + 8, format->premultiplied_alpha ? 1 : 0);
+	native_uint32_store(dest + 12, format->bits_per_pixel);
+	native_uint32_store(dest + 16, format->channels_count);
+	native_uint32_store(dest + 20, format->block_width);
+	native_uint32_store(dest + 24, format->block_height);
+	native_uint32_store(dest + 28, format->block_depth);
+	native_uint32_store(dest + 32, format->bits_per_block);
+	dest += 36;
+	for (unsigned int ich = 0; ich < IMAGE_CHANNEL_COUNT; ++ich, dest += 12) {
+		native_uint32_store(dest, (uint32_t)format->channel[ich].data_type);
+		native_uint32_store(dest + 4, format->channel[ich].bits_per_pixel);
+		native_uint32_store(dest + 8, format->channel[ich].offset);
+	}
+}
+
+static bool
+native_format_load(image_pixelformat_t* format, const uint8_t* source) {
+	memset(format, 0, sizeof(image_pixelformat_t));
+	uint32_t compression = native_uint32_load(source);
+	uint32_t colorspace = native_uint32_load(source + 4);
+	if ((compression >= IMAGE_COMPRESSION_COUNT) || (colorspace >= IMAGE_COLORSPACE_COUNT))
+		return false;
+	format->compression = (image_compression_t)compression;
+	format->colorspace = (image_colorspace_t)colorspace;
+	format->premultiplied_alpha = (native_uint32_load(source + 8) != 0);
+	format->bits_per_pixel = native_uint32_load(source + 12);
+	format->channels_count = native_uint32_load(source + 16);
+	format->block_width = native_uint32_load(source + 20);
+	format->block_height = native_uint32_load(source + 24);
+	format->block_depth = native_uint32_load(source + 28);
+	format->bits_per_block = native_uint32_load(source + 32);
+	source += 36;
+	for (unsigned int ich = 0; ich < IMAGE_CHANNEL_COUNT; ++ich, source += 12) {
+		uint32_t data_type = native_uint32_load(source);
+		if (data_type >= IMAGE_DATATYPE_COUNT)
+			return false;
+		format->channel[ich].data_type = (image_datatype_t)data_type;
+		format->channel[ich].bits_per_pixel = native_uint32_load(source + 4);
+		format->channel[ich].offset = native_uint32_load(source + 8);
+	}
+	if (format->block_width && (format->bits_per_block < 8))
+		return false;
+	return (format->bits_per_pixel || format->block_width);
+}
+
+//! Parse and validate the header, filling in all image fields except data
+static bool
+native_header_parse(image_t* image, const uint8_t* header, size_t size, size_t* data_offset, size_t* data_size) {
+	if ((size < NATIVE_OFFSET_LEVEL_TABLE_V1) || memcmp(header, native_identifier, sizeof(native_identifier)))
+		return false;
+	if (native_uint32_load(header + NATIVE_OFFSET_ENDIANNESS) != NATIVE_ENDIANNESS) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Native image has mismatching byte order"));
+		return false;
+	}
+	uint32_t version = native_uint32_load(header + NATIVE_OFFSET_VERSION);
+	if (!version || (version > NATIVE_VERSION)) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported native image version: %u"), version);
+		return false;
+	}
+
+	image_t parsed;
+	image_initialize(&parsed);
+	parsed.width = native_uint32_load(header + NATIVE_OFFSET_WIDTH);
+	parsed.height = native_uint32_load(header + NATIVE_OFFSET_HEIGHT);
+	parsed.depth = native_uint32_load(header + NATIVE_OFFSET_DEPTH);
+	parsed.levels = native_uint32_load(header + NATIVE_OFFSET_LEVELS);
+	parsed.layers = 1;
+	uint32_t flags = 0;
+	if ((version > 1) && (size >= NATIVE_OFFSET_LEVEL_TABLE)) {
+		parsed.layers = native_uint32_load(header + NATIVE_OFFSET_LAYERS);
+		flags = native_uint32_load(header + NATIVE_OFFSET_FLAGS);
+	}
+	parsed.cubemap = (flags & NATIVE_FLAG_CUBEMAP) != 0;
+	// Layered images are two dimensional, cubemaps store six square faces per cube
+	bool layout_valid = parsed.layers && ((parsed.layers == 1) || (parsed.depth == 1)) &&
+	                    (!parsed.cubemap || (!(parsed.layers % 6) && (parsed.width == parsed.height)));
+	size_t header_size = native_header_size(version, parsed.levels);
+	if (!parsed.width || !parsed.height || !parsed.depth || !parsed.levels || (parsed.levels > NATIVE_MAX_LEVELS) ||
+	    !layout_valid || (native_uint32_load(header + NATIVE_OFFSET_HEADER_SIZE) != header_size) ||
+	    (size < header_size) || !native_format_load(&parsed.format, header + NATIVE_OFFSET_FORMAT)) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Invalid native image header"));
+		return false;
+	}
+
+	// Level data must match the in-memory layout for the image to use it in place, with
+	// the layers of each level stored consecutively
+	uint64_t stored_offset = native_uint64_load(header + NATIVE_OFFSET_DATA_OFFSET);
+	uint64_t stored_size = native_uint64_load(header + NATIVE_OFFSET_DATA_SIZE);
+	size_t level_table = native_level_table_offset(version);
+	size_t expected_size =
+	    image_buffer_size(&parsed.format, parsed.width, parsed.height, parsed.depth, parsed.levels) * parsed.layers;
+	bool valid = (stored_offset == native_data_offset(version, parsed.levels)) && (stored_size == expected_size);
+	for (unsigned int ilevel = 0; valid && (ilevel < parsed.levels); ++ilevel) {
+		uint64_t level_offset = native_uint64_load(header + level_table + ilevel * 8);
+		valid = (level_offset ==
+		         image_buffer_size(&parsed.format, parsed.width, parsed.height, parsed.depth, ilevel) * parsed.layers);
+	}
+	if (!valid) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Invalid native image level table"));
+		return false;
+	}
+
+	*image = parsed;
+	*data_offset = (size_t)stored_offset;
+	*data_size = (size_t)stored_size;
+	return true;
+}
+
+bool
+image_native_save(const image_t* image, stream_t* stream, const image_save_options_t* options) {
+	FOUNDATION_UNUSED(options);
+
+	if (!image->levels || (image->levels > NATIVE_MAX_LEVELS)) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported native image level count: %u"),
+		          image->levels);
+		return false;
+	}
+
+	unsigned int layers = image_layers(image);
+	size_t data_offset = native_data_offset(NATIVE_VERSION, image->levels);
+	size_t data_size = image_data_size(image);
+	uint8_t* header = memory_allocate(HASH_IMAGE, data_offset, 0, MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+
+	memcpy(header, native_identifier, sizeof(native_identifier));
+	native_uint32_store(header + NATIVE_OFFSET_ENDIANNESS, NATIVE_ENDIANNESS);
+	native_uint32_store(header + NATIVE_OFFSET_VERSION, NATIVE_VERSION);
+	native_uint32_store(header + NATIVE_OFFSET_HEADER_SIZE,
+	                    (uint32_t)native_header_size(NATIVE_VERSION, image->levels));
+	native_uint32_store(header + NATIVE_OFFSET_WIDTH, image->width);
+	native_uint32_store(header + NATIVE_OFFSET_HEIGHT, image->height);
+	native_uint32_store(header + NATIVE_OFFSET_DEPTH, image->depth);
+	native_uint32_store(header + NATIVE_OFFSET_LEVELS, image->levels);
+	native_format_store(header + NATIVE_OFFSET_FORMAT, &image->format);
+	native_uint64_store(header + NATIVE_OFFSET_DATA_OFFSET, data_offset);
+	native_uint64_store(header + NATIVE_OFFSET_DATA_SIZE, data_size);
+	native_uint32_store(header + NATIVE_OFFSET_LAYERS, layers);
+	native_uint32_store(header + NATIVE_OFFSET_FLAGS, image->cubemap ? NATIVE_FLAG_CUBEMAP : 0);
+	for (unsigned int ilevel = 0; ilevel < image->levels; ++ilevel)
+		native_uint64_store(
+		    header + NATIVE_OFFSET_LEVEL_TABLE + ilevel * 8,
+		    image_buffer_size(&image->format, image->width, image->height, image->depth, ilevel) * layers);
+
+	stream_write(stream, header, data_offset);
+	stream_write(stream, image->data, data_size);
+
+	memory_deallocate(header);
+
+	return true;
+}
+
+bool
+image_native_load_record(image_t* image, stream_t* stream, image_load_record_t* record) {
+	image_load_record_begin(record, IMAGE_LOAD_STAGE_PROBE);
+	size_t start = stream_tell(stream);
+	uint8_t header[NATIVE_HEADER_MAX_SIZE];
+	size_t read = stream_read(stream, header, NATIVE_OFFSET_LEVEL_TABLE_V1);
+	image_load_record_read(record, read);
+	if ((read != NATIVE_OFFSET_LEVEL_TABLE_V1) || memcmp(header, native_identifier, sizeof(native_identifier))) {
+		stream_seek(stream, (ssize_t)start, STREAM_SEEK_BEGIN);
+		image_load_record_end(record, IMAGE_LOAD_STAGE_PROBE);
+		return false;
+	}
+	record->format = IMAGE_LOAD_FORMAT_NATIVE;
+	uint32_t version = native_uint32_load(header + NATIVE_OFFSET_VERSION);
+	unsigned int levels = native_uint32_load(header + NATIVE_OFFSET_LEVELS);
+	if ((levels > NATIVE_MAX_LEVELS) || (levels < 1))
+		levels = 1;
+	size_t level_table_read = stream_read(stream, header + read, native_header_size(version, levels) - read);
+	image_load_record_read(record, level_table_read);
+	read += level_table_read;
+
+	image_t parsed;
+	size_t data_offset = 0;
+	size_t data_size = 0;
+	bool valid = native_header_parse(&parsed, header, read, &data_offset, &data_size);
+	image_load_record_end(record, IMAGE_LOAD_STAGE_PROBE);
+	if (!valid) {
+		stream_seek(stream, (ssize_t)start, STREAM_SEEK_BEGIN);
+		return false;
+	}
+
+	// Reject data extending past the end of the stream before allocating storage for it
+	size_t available = stream_size(stream) - start;
+	if ((data_offset > available) || (data_size > available - data_offset)) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Truncated native image data"));
+		record->status = IMAGE_LOAD_STATUS_TRUNCATED;
+		stream_seek(stream, (ssize_t)start, STREAM_SEEK_BEGIN);
+		return false;
+	}
+
+	stream_seek(stream, (ssize_t)(start + data_offset), STREAM_SEEK_BEGIN);
+	image_load_record_begin(record, IMAGE_LOAD_STAGE_ALLOCATE);
+	if (parsed.layers > 1) {
+		image_allocate_array_storage(image, &parsed.format, parsed.width, parsed.height, parsed.layers,
+		                             parsed.levels);
+		image->cubemap = parsed.cubemap;
+	} else {
+		image_allocate_storage(image, &parsed.format, parsed.width, parsed.height, parsed.depth, parsed.levels);
+	}
+	image_load_record_end(record, IMAGE_LOAD_STAGE_ALLOCATE);
+
+	image_load_record_begin(record, IMAGE_LOAD_STAGE_COPY);
+	size_t data_read = stream_read(stream, image->data, data_size);
+	image_load_record_read(record, data_read);
+	image_load_record_end(record, IMAGE_LOAD_STAGE_COPY);
+	if (data_read != data_size) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Truncated native image data"));
+		record->status = IMAGE_LOAD_STATUS_TRUNCATED;
+		return false;
+	}
+
+	return true;
+}
+
+bool
+image_native_load(image_t* image, stream_t* stream) {
+	image_load_record_t record;
+	image_load_record_initialize(&record);
+	bool loaded = image_native_load_record(image, stream, &record);
+	// Streams that are not native images are left for other loaders and not counted
+	if (loaded || record.format)
+		image_load_record_commit(&record, image, loaded);
+	return loaded;
+}
+
+bool
+image_native_map(image_t* image, const char* path, size_t length) {
+	char buffer[BUILD_MAX_PATHLEN];
+	string_t filename = string_copy(buffer, sizeof(buffer), path, length);
+	void* mapping = 0;
+	size_t size = 0;
+
+#if FOUNDATION_PLATFORM_WINDOWS
+	HANDLE file = CreateFileA(filename.str, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER file_size;
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart) {
+			// Copy on write mapping keeps the image data writable without touching the file
+			HANDLE file_mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+			if (file_mapping) {
+				mapping = MapViewOfFile(file_mapping, FILE_MAP_COPY, 0, 0, 0);
+				size = (size_t)file_size.QuadPart;
+				CloseHandle(file_mapping);
+			}
+		}
+		CloseHandle(file);
+	}
+#elif FOUNDATION_PLATFORM_POSIX
+	int fd = open(filename.str, O_RDONLY);
+	if (fd >= 0) {
+		struct stat st;
+		if (!fstat(fd, &st) && (st.st_size > 0)) {
+			// Private mapping keeps the image data writable without touching the file
+			mapping = mmap(0, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			size = (size_t)st.st_size;
+			if (mapping == MAP_FAILED)
+				mapping = 0;
+		}
+		close(fd);
+	}
+#else
+	FOUNDATION_UNUSED(filename);
+#endif
+
+	if (!mapping) {
+		log_warnf(HASH_IMAGE, WARNING_SYSTEM_CALL_FAIL, STRING_CONST("Unable to map image file: %.*s"),
+		          STRING_FORMAT(filename));
+		return false;
+	}
+
+	// Other file formats are rejected silently so callers can fall back to decoding
+	if ((size < sizeof(native_identifier)) || memcmp(mapping, native_identifier, sizeof(native_identifier))) {
+		image_native_unmap(mapping, size);
+		return false;
+	}
+
+	image_t parsed;
+	size_t data_offset = 0;
+	size_t data_size = 0;
+	if (!native_header_parse(&parsed, mapping, (size < NATIVE_HEADER_MAX_SIZE) ? size : NATIVE_HEADER_MAX_SIZE,
+	                         &data_offset, &data_size) ||
+	    (size < data_offset + data_size)) {
+		log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Invalid native image file: %.*s"),
+		          STRING_FORMAT(filename));
+		image_native_unmap(mapping, size);
+		return false;
+	}
+
+	image_finalize(image);
+	*image = parsed;
+	image->data = pointer_offset(mapping, data_offset);
+	image->mapping = mapping;
+	image->mapping_size = size;
+
+	return true;
+}
+
+void
+image_native_unmap(void* mapping, size_t size) {
+#if FOUNDATION_PLATFORM_WINDOWS
+	FOUNDATION_UNUSED(size);
+	UnmapViewOfFile(mapping);
+#elif FOUNDATION_PLATFORM_POSIX
+	munmap(mapping, size);
+#else
+	FOUNDATION_UNUSED(mapping);
+	FOUNDATION_UNUSED(size);
+#endif
+}
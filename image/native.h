@@ -0,0 +1,40 @@
+/* native.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file native.h
+    Native memory mappable image format. The file stores the image header fields, the
+    full pixel format, the layer count and cubemap flag, a mip level offset table and the
+    raw level data starting at a page aligned offset, so the data can be used directly
+    from a memory mapping. Array and cubemap layers are stored as in memory, with all
+    layers of a mip level stored consecutively. */
+
+#include <image/types.h>
+
+IMAGE_API bool
+image_native_save(const image_t* image, stream_t* stream, const image_save_options_t* options);
+
+IMAGE_API bool
+image_native_load(image_t* image, stream_t* stream);
+
+IMAGE_API bool
+image_native_map(image_t* image, const char* path, size_t length);
+
+IMAGE_API void
+image_native_unmap(void* mapping, size_t size);
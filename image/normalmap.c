@@ -0,0 +1,177 @@
+/* normalmap.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include <math.h>
+
+#include "image.h"
+#include "normalmap.h"
+#include "internal.h"
+
+//! Minimum number of bytes processed per parallel chunk
+#define IMAGE_NORMALMAP_CHUNK_SIZE (64 * 1024)
+
+typedef struct image_normalmap_job_t image_normalmap_job_t;
+
+struct image_normalmap_job_t {
+	const image_pixelformat_t* source_format;
+	const uint8_t* source;
+	size_t source_pitch;
+	const image_pixelformat_t* format;
+	uint8_t* data;
+	size_t pitch;
+	unsigned int width;
+	unsigned int height;
+	image_edge_t edge;
+	//! Heights with a border of one texel on all sides
+	float32_t* plane;
+	//! Weights of the outer and center gradient taps, including normalization
+	float32_t outer;
+	float32_t center;
+	float32_t strength;
+	//! Sign applied to the vertical gradient
+	float32_t sign_y;
+	//! Normal channels are biased to [0,1]
+	bool biased;
+};
+
+//! Read rows of the height map into the bordered plane
+static void
+image_normalmap_gather(void* arg, size_t begin, size_t end) {
+	const image_normalmap_job_t* job = arg;
+	size_t plane_width = (size_t)job->width + 2;
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * job->width, 0, MEMORY_PERSISTENT);
+	for (size_t irow = begin; irow < end; ++irow) {
+		unsigned int source = image_convolve_edge((int64_t)irow - 1, job->height, job->edge);
+		float32_t* line = job->plane + irow * plane_width;
+		image_pixel_read(job->source_format, job->source + source * job->source_pitch, job->width, rgba);
+		for (unsigned int x = 0; x < job->width; ++x)
+			line[x + 1] = rgba[x * 4];
+		line[0] = line[image_convolve_edge(-1, job->width, job->edge) + 1];
+		line[job->width + 1] = line[image_convolve_edge(job->width, job->width, job->edge) + 1];
+	}
+	memory_deallocate(rgba);
+}
+
+//! Compute normals for rows of the normal map
+static void
+image_normalmap_rows(void* arg, size_t begin, size_t end) {
+	const image_normalmap_job_t* job = arg;
+	size_t plane_width = (size_t)job->width + 2;
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * job->width, 0, MEMORY_PERSISTENT);
+	float32_t outer = job->outer;
+	float32_t center = job->center;
+	float32_t scale = job->biased ? 0.5f : 1.0f;
+	float32_t bias = job->biased ? 0.5f : 0.0f;
+	float32_t strength_x = -job->strength;
+	float32_t strength_y = job->strength * job->sign_y;
+	for (size_t irow = begin; irow < end; ++irow) {
+		const float32_t* above = job->plane + irow * plane_width;
+		const float32_t* middle = above + plane_width;
+		const float32_t* below = middle + plane_width;
+		// Straight line arithmetic over contiguous rows, which compilers vectorize
+		for (unsigned int x = 0; x < job->width; ++x) {
+			float32_t dx = outer * (above[x + 2] - above[x]) + center * (middle[x + 2] - middle[x]) +
+			               outer * (below[x + 2] - below[x]);
+			float32_t dy = outer * (below[x] - above[x]) + center * (below[x + 1] - above[x + 1]) +
+			               outer * (below[x + 2] - above[x + 2]);
+			float32_t nx = strength_x * dx;
+			float32_t ny = strength_y * dy;
+			float32_t inv_length = 1.0f / sqrtf(nx * nx + ny * ny + 1.0f);
+			rgba[x * 4 + 0] = nx * inv_length * scale + bias;
+			rgba[x * 4 + 1] = ny * inv_length * scale + bias;
+			rgba[x * 4 + 2] = inv_length * scale + bias;
+			rgba[x * 4 + 3] = 1.0f;
+		}
+		image_pixel_write(job->format, job->data + irow * job->pitch, job->width, rgba);
+	}
+	memory_deallocate(rgba);
+}
+
+static size_t
+image_normalmap_grain(size_t unit_size) {
+	size_t grain = IMAGE_NORMALMAP_CHUNK_SIZE / (unit_size ? unit_size : 1);
+	return grain ? grain : 1;
+}
+
+bool
+image_normalmap_from_height(image_t* normalmap, const image_t* height, unsigned int level,
+                            const image_normalmap_options_t* options) {
+	const image_pixelformat_t* source_format = &height->format;
+	if (normalmap == height) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Normal map must not be the height map"));
+		return false;
+	}
+	if (!height->data || (level >= height->levels) || (source_format->compression != IMAGE_COMPRESSION_NONE) ||
+	    source_format->block_width || !source_format->bits_per_pixel || (source_format->bits_per_pixel % 8)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Normal map generation requires an uncompressed byte aligned height map level"));
+		return false;
+	}
+
+	image_normalmap_options_t defaults;
+	memset(&defaults, 0, sizeof(defaults));
+	if (!options)
+		options = &defaults;
+	image_pixelformat_t format = options->format;
+	if (!format.bits_per_pixel)
+		image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+	if ((format.compression != IMAGE_COMPRESSION_NONE) || format.block_width || (format.bits_per_pixel % 8) ||
+	    (format.channels_count < 3)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Normal maps require uncompressed byte aligned formats with three or four channels"));
+		return false;
+	}
+
+	image_normalmap_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.source_format = source_format;
+	job.source = image_buffer((image_t*)height, level);
+	job.width = image_width(height, level);
+	job.height = image_height(height, level);
+	job.source_pitch = (size_t)job.width * (source_format->bits_per_pixel / 8);
+	job.edge = options->edge;
+	// Gradient weights normalized to height difference per pixel
+	if (options->filter == IMAGE_NORMALMAP_SCHARR) {
+		job.outer = 3.0f / 32.0f;
+		job.center = 10.0f / 32.0f;
+	} else {
+		job.outer = 1.0f / 8.0f;
+		job.center = 2.0f / 8.0f;
+	}
+	job.strength = (options->strength != 0) ? options->strength : 1.0f;
+	// Rows run down the image, so with green pointing up the row gradient enters the normal unnegated
+	job.sign_y = options->flip_y ? -1.0f : 1.0f;
+	job.biased = (format.channel[IMAGE_CHANNEL_RED].data_type == IMAGE_DATATYPE_UNSIGNED_INT);
+
+	image_allocate_storage(normalmap, &format, job.width, job.height, 1, 1);
+	job.format = &normalmap->format;
+	job.data = normalmap->data;
+	job.pitch = (size_t)job.width * (format.bits_per_pixel / 8);
+
+	size_t plane_width = (size_t)job.width + 2;
+	job.plane =
+	    memory_allocate(HASH_IMAGE, sizeof(float32_t) * plane_width * (job.height + 2), 0, MEMORY_PERSISTENT);
+	size_t grain = image_normalmap_grain(job.width * 4 * sizeof(float32_t));
+	image_parallel_for(job.height + 2, grain, image_normalmap_gather, &job);
+	image_parallel_for(job.height, grain, image_normalmap_rows, &job);
+	memory_deallocate(job.plane);
+
+	return true;
+}
@@ -0,0 +1,39 @@
+/* normalmap.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file normalmap.h
+    Normal map generation */
+
+#include <image/types.h>
+
+/*! Generate a tangent space normal map from the red channel of a height map level.
+Height gradients are estimated with a 3x3 Sobel or Scharr filter, scaled by the
+strength and turned into unit normals, which are biased to [0,1] when stored in
+unsigned formats. A zero strength in the options selects unit strength, use a small
+value for nearly flat normals. The alpha channel is set to one. Volume images use the first depth
+slice. Any previous storage of the normal map is released.
+\param normalmap Normal map receiving a single level with the height map level dimensions
+\param height    Height map, must be uncompressed with byte aligned pixels
+\param level     Height map mip level
+\param options   Generation options, null for Sobel filtering with unit strength and clamped edges
+\return          true if successful, false if the format is not supported */
+IMAGE_API bool
+image_normalmap_from_height(image_t* normalmap, const image_t* height, unsigned int level,
+                            const image_normalmap_options_t* options);
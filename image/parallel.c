@@ -0,0 +1,191 @@
+/* parallel.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "parallel.h"
+#include "internal.h"
+
+#define IMAGE_PARALLEL_MAX_THREADS 64
+
+typedef struct image_parallel_loop_t image_parallel_loop_t;
+
+struct image_parallel_loop_t {
+	image_parallel_fn fn;
+	void* arg;
+	size_t count;
+	size_t grain;
+	atomic64_t next;
+};
+
+//! Module owned worker threads, started with the module and shared by all loops
+static thread_t image_parallel_thread_pool[IMAGE_PARALLEL_MAX_THREADS];
+//! Number of started worker threads
+static size_t image_parallel_thread_count;
+//! Posted once for each worker woken to take part in the current loop
+static semaphore_t image_parallel_wake;
+//! Posted by each woken worker once it leaves the current loop
+static semaphore_t image_parallel_done;
+//! Loop the woken workers take part in
+static atomicptr_t image_parallel_loop;
+//! Set while a thread owns the pool, other loops then run on their calling thread
+static atomic32_t image_parallel_busy;
+static atomic32_t image_parallel_running;
+
+//! Set on threads already running as part of a pool of workers
+FOUNDATION_DECLARE_THREAD_LOCAL(int, image_parallel_worker, 0)
+
+void
+image_parallel_initialize(void);
+
+void
+image_parallel_finalize(void);
+
+bool
+image_parallel_set_worker(bool worker) {
+	bool previous = (get_thread_image_parallel_worker() != 0);
+	set_thread_image_parallel_worker(worker ? 1 : 0);
+	return previous;
+}
+
+static void
+image_parallel_execute(image_parallel_loop_t* loop) {
+	while (true) {
+		size_t begin = (size_t)atomic_exchange_and_add64(&loop->next, (int64_t)loop->grain, memory_order_relaxed);
+		if (begin >= loop->count)
+			break;
+		size_t end = begin + loop->grain;
+		if (end > loop->count)
+			end = loop->count;
+		loop->fn(loop->arg, begin, end);
+	}
+}
+
+static void*
+image_parallel_thread(void* arg) {
+	FOUNDATION_UNUSED(arg);
+	set_thread_image_parallel_worker(1);
+	while (true) {
+		semaphore_wait(&image_parallel_wake);
+		if (!atomic_load32(&image_parallel_running, memory_order_acquire))
+			break;
+		image_parallel_execute(atomic_loadptr(&image_parallel_loop, memory_order_acquire));
+		semaphore_post(&image_parallel_done);
+	}
+	image_trace_thread_finalize();
+	return 0;
+}
+
+void
+image_parallel_initialize(void) {
+	semaphore_initialize(&image_parallel_wake, 0);
+	semaphore_initialize(&image_parallel_done, 0);
+	atomic_store32(&image_parallel_running, 1, memory_order_release);
+
+	// The thread calling a loop takes part in it, so one hardware thread needs no worker
+	size_t thread_count = system_hardware_threads();
+	if (thread_count > IMAGE_PARALLEL_MAX_THREADS)
+		thread_count = IMAGE_PARALLEL_MAX_THREADS;
+	size_t worker_count = thread_count ? thread_count - 1 : 0;
+	size_t started = 0;
+	for (size_t ithread = 0; ithread < worker_count; ++ithread) {
+		thread_t* thread = image_parallel_thread_pool + started;
+		thread_initialize(thread, image_parallel_thread, 0, STRING_CONST("image_parallel"), THREAD_PRIORITY_NORMAL,
+		                  0);
+		// Loops distribute chunks dynamically, a worker that failed to start only leaves
+		// more of each loop to the calling thread and the other workers
+		if (thread_start(thread)) {
+			++started;
+		} else {
+			log_warn(HASH_IMAGE, WARNING_SYSTEM_CALL_FAIL, STRING_CONST("Unable to start parallel worker thread"));
+			thread_finalize(thread);
+		}
+	}
+	image_parallel_thread_count = started;
+	atomic_store32(&image_parallel_busy, 0, memory_order_release);
+}
+
+void
+image_parallel_finalize(void) {
+	// Wait for a loop in progress to release the pool and keep it owned while stopping
+	while (!atomic_cas32(&image_parallel_busy, 1, 0, memory_order_acquire, memory_order_relaxed))
+		thread_yield();
+	atomic_store32(&image_parallel_running, 0, memory_order_release);
+	for (size_t ithread = 0; ithread < image_parallel_thread_count; ++ithread)
+		semaphore_post(&image_parallel_wake);
+	for (size_t ithread = 0; ithread < image_parallel_thread_count; ++ithread) {
+		thread_join(&image_parallel_thread_pool[ithread]);
+		thread_finalize(&image_parallel_thread_pool[ithread]);
+	}
+	image_parallel_thread_count = 0;
+	semaphore_finalize(&image_parallel_wake);
+	semaphore_finalize(&image_parallel_done);
+	atomic_store32(&image_parallel_busy, 0, memory_order_release);
+}
+
+void
+image_parallel_for(size_t count, size_t grain, image_parallel_fn fn, void* arg) {
+	if (!count)
+		return;
+
+	size_t thread_count = system_hardware_threads();
+	if (thread_count > IMAGE_PARALLEL_MAX_THREADS)
+		thread_count = IMAGE_PARALLEL_MAX_THREADS;
+	if (!thread_count)
+		thread_count = 1;
+	if (!grain) {
+		// Aim for a few chunks per thread to balance uneven work
+		grain = count / (thread_count * 4);
+		if (!grain)
+			grain = 1;
+	}
+	size_t chunk_count = (count + grain - 1) / grain;
+
+	image_parallel_loop_t loop;
+	loop.fn = fn;
+	loop.arg = arg;
+	loop.count = count;
+	loop.grain = grain;
+	atomic_store64(&loop.next, 0, memory_order_release);
+
+	// Nested loops, loops issued from async or batch workers and loops issued while the
+	// pool is taken by another loop stay on the calling thread, since the hardware threads
+	// are already occupied
+	if ((chunk_count <= 1) || get_thread_image_parallel_worker() ||
+	    !atomic_cas32(&image_parallel_busy, 1, 0, memory_order_acquire, memory_order_relaxed)) {
+		image_parallel_execute(&loop);
+		return;
+	}
+
+	size_t wake_count = image_parallel_thread_count;
+	if (wake_count > chunk_count - 1)
+		wake_count = chunk_count - 1;
+	atomic_storeptr(&image_parallel_loop, &loop, memory_order_release);
+	for (size_t ithread = 0; ithread < wake_count; ++ithread)
+		semaphore_post(&image_parallel_wake);
+
+	set_thread_image_parallel_worker(1);
+	image_parallel_execute(&loop);
+	set_thread_image_parallel_worker(0);
+
+	// Woken workers reference the loop on this stack until they report back
+	for (size_t ithread = 0; ithread < wake_count; ++ithread)
+		semaphore_wait(&image_parallel_done);
+	atomic_store32(&image_parallel_busy, 0, memory_order_release);
+}
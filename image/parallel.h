@@ -0,0 +1,39 @@
+/* parallel.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file parallel.h
+    Data parallel execution of image processing loops */
+
+#include <image/types.h>
+
+/*! Function processing the half-open range [begin, end) of a parallel loop */
+typedef void (*image_parallel_fn)(void* arg, size_t begin, size_t end);
+
+/*! Execute a loop over [0, count) in parallel, split into chunks of grain
+iterations distributed over the worker threads the module starts on initialization.
+The calling thread participates in the work and the function returns once all
+iterations are done. Loops issued while another loop owns the workers, or from
+within a worker, run on the calling thread only.
+\param count Number of iterations
+\param grain Number of iterations per chunk, zero for automatic
+\param fn    Function processing a range of iterations
+\param arg   Argument passed to function */
+IMAGE_API void
+image_parallel_for(size_t count, size_t grain, image_parallel_fn fn, void* arg);
@@ -0,0 +1,293 @@
+/* pixel.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "pixel.h"
+
+void
+image_pixelformat_initialize(image_pixelformat_t* pixelformat, image_datatype_t data_type,
+                             unsigned int bits_per_channel, unsigned int channels_count,
+                             image_colorspace_t colorspace) {
+	memset(pixelformat, 0, sizeof(image_pixelformat_t));
+	if (channels_count > 4)
+		channels_count = 4;
+	pixelformat->compression = IMAGE_COMPRESSION_NONE;
+	pixelformat->colorspace = colorspace;
+	pixelformat->premultiplied_alpha = false;
+	pixelformat->bits_per_pixel = bits_per_channel * channels_count;
+	pixelformat->channels_count = channels_count;
+	for (unsigned int ich = 0; ich < channels_count; ++ich) {
+		pixelformat->channel[ich].data_type = data_type;
+		pixelformat->channel[ich].bits_per_pixel = bits_per_channel;
+		pixelformat->channel[ich].offset = bits_per_channel * ich;
+	}
+}
+
+bool
+image_pixelformat_is_uniform(const image_pixelformat_t* pixelformat, image_datatype_t* data_type,
+                             unsigned int* bits_per_channel) {
+	if ((pixelformat->compression != IMAGE_COMPRESSION_NONE) || pixelformat->block_width ||
+	    !pixelformat->channels_count || (pixelformat->channels_count > 4))
+		return false;
+	const image_channel_format_t* first = pixelformat->channel;
+	if (!first->bits_per_pixel || (pixelformat->bits_per_pixel != first->bits_per_pixel * pixelformat->channels_count))
+		return false;
+	for (unsigned int ich = 0; ich < pixelformat->channels_count; ++ich) {
+		const image_channel_format_t* channel = pixelformat->channel + ich;
+		if ((channel->data_type != first->data_type) || (channel->bits_per_pixel != first->bits_per_pixel) ||
+		    (channel->offset != first->bits_per_pixel * ich))
+			return false;
+	}
+	if (data_type)
+		*data_type = first->data_type;
+	if (bits_per_channel)
+		*bits_per_channel = first->bits_per_pixel;
+	return true;
+}
+
+float32_t
+image_half_to_float(uint16_t value) {
+	uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+	uint32_t bits;
+	if (exponent == 0x1F) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	} else if (exponent) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if (mantissa) {
+		// Denormalized half, normalize into single precision
+		exponent = 113;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	} else {
+		bits = sign;
+	}
+	float32_t result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+uint16_t
+image_float_to_half(float32_t value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t exponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if (exponent == 0xFF)
+		return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+	int half_exponent = (int)exponent - 112;
+	if (half_exponent >= 0x1F)
+		return sign | 0x7C00;
+	if (half_exponent <= 0) {
+		if (half_exponent < -10)
+			return sign;
+		mantissa |= 0x800000;
+		unsigned int shift = (unsigned int)(14 - half_exponent);
+		uint32_t half_mantissa = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1U << shift) - 1);
+		uint32_t halfway = 1U << (shift - 1);
+		if ((remainder > halfway) || ((remainder == halfway) && (half_mantissa & 1)))
+			++half_mantissa;
+		return sign | (uint16_t)half_mantissa;
+	}
+	// Round to nearest even, a carry out of the mantissa correctly bumps the exponent
+	uint32_t half = ((uint32_t)half_exponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	if ((remainder > 0x1000) || ((remainder == 0x1000) && (half & 1)))
+		++half;
+	return sign | (uint16_t)half;
+}
+
+static uint64_t
+image_pixel_bits_read(const uint8_t* pixel, unsigned int offset, unsigned int bits) {
+	const uint8_t* source = pixel + (offset >> 3);
+	unsigned int shift = offset & 7;
+	unsigned int bytes = (shift + bits + 7) >> 3;
+	uint64_t value = 0;
+	for (unsigned int ibyte = 0; (ibyte < bytes) && (ibyte < 8); ++ibyte)
+		value |= (uint64_t)source[ibyte] << (ibyte * 8);
+	value >>= shift;
+	if (bits < 64)
+		value &= ((uint64_t)1 << bits) - 1;
+	return value;
+}
+
+static void
+image_pixel_bits_write(uint8_t* pixel, unsigned int offset, unsigned int bits, uint64_t value) {
+	uint8_t* dest = pixel + (offset >> 3);
+	unsigned int shift = offset & 7;
+	unsigned int bytes = (shift + bits + 7) >> 3;
+	uint64_t mask = (bits < 64) ? (((uint64_t)1 << bits) - 1) : ~(uint64_t)0;
+	value &= mask;
+	mask <<= shift;
+	value <<= shift;
+	for (unsigned int ibyte = 0; (ibyte < bytes) && (ibyte < 8); ++ibyte) {
+		uint8_t byte_mask = (uint8_t)(mask >> (ibyte * 8));
+		dest[ibyte] = (uint8_t)((dest[ibyte] & ~byte_mask) | ((uint8_t)(value >> (ibyte * 8)) & byte_mask));
+	}
+}
+
+static float32_t
+image_pixel_channel_read(const uint8_t* pixel, const image_channel_format_t* channel) {
+	unsigned int bits = channel->bits_per_pixel;
+	if (channel->data_type == IMAGE_DATATYPE_FLOAT) {
+		const uint8_t* source = pixel + (channel->offset >> 3);
+		if (bits == 32) {
+			float32_t value;
+			memcpy(&value, source, sizeof(value));
+			return value;
+		}
+		if (bits == 16) {
+			uint16_t value;
+			memcpy(&value, source, sizeof(value));
+			return image_half_to_float(value);
+		}
+		if (bits == 64) {
+			float64_t value;
+			memcpy(&value, source, sizeof(value));
+			return (float32_t)value;
+		}
+		return 0;
+	}
+
+	uint64_t raw;
+	if (!(channel->offset & 7) && (bits == 8))
+		raw = pixel[channel->offset >> 3];
+	else
+		raw = image_pixel_bits_read(pixel, channel->offset, bits);
+
+	if (channel->data_type == IMAGE_DATATYPE_INT) {
+		int64_t max_value = ((int64_t)1 << (bits - 1)) - 1;
+		int64_t value = (int64_t)(raw << (64 - bits)) >> (64 - bits);
+		float32_t normalized = (float32_t)((float64_t)value / (float64_t)max_value);
+		return (normalized < -1.0f) ? -1.0f : normalized;
+	}
+	if (bits == 8)
+		return (float32_t)raw * (1.0f / 255.0f);
+	uint64_t max_value = (bits < 64) ? (((uint64_t)1 << bits) - 1) : ~(uint64_t)0;
+	return (float32_t)((float64_t)raw / (float64_t)max_value);
+}
+
+static void
+image_pixel_channel_write(uint8_t* pixel, const image_channel_format_t* channel, float32_t value) {
+	unsigned int bits = channel->bits_per_pixel;
+	if (channel->data_type == IMAGE_DATATYPE_FLOAT) {
+		uint8_t* dest = pixel + (channel->offset >> 3);
+		if (bits == 32) {
+			memcpy(dest, &value, sizeof(value));
+		} else if (bits == 16) {
+			uint16_t half = image_float_to_half(value);
+			memcpy(dest, &half, sizeof(half));
+		} else if (bits == 64) {
+			float64_t wide = value;
+			memcpy(dest, &wide, sizeof(wide));
+		}
+		return;
+	}
+
+	uint64_t raw;
+	if (channel->data_type == IMAGE_DATATYPE_INT) {
+		int64_t max_value = ((int64_t)1 << (bits - 1)) - 1;
+		float64_t clamped = (value < -1.0f) ? -1.0 : ((value > 1.0f) ? 1.0 : (float64_t)value);
+		float64_t scaled = clamped * (float64_t)max_value;
+		raw = (uint64_t)(int64_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+	} else {
+		uint64_t max_value = (bits < 64) ? (((uint64_t)1 << bits) - 1) : ~(uint64_t)0;
+		float64_t clamped = (value < 0.0f) ? 0.0 : ((value > 1.0f) ? 1.0 : (float64_t)value);
+		raw = (uint64_t)(clamped * (float64_t)max_value + 0.5);
+	}
+
+	if (!(channel->offset & 7) && (bits == 8))
+		pixel[channel->offset >> 3] = (uint8_t)raw;
+	else
+		image_pixel_bits_write(pixel, channel->offset, bits, raw);
+}
+
+static bool
+image_pixelformat_is_rgba8(const image_pixelformat_t* pixelformat) {
+	if ((pixelformat->bits_per_pixel != 24) && (pixelformat->bits_per_pixel != 32))
+		return false;
+	unsigned int channels = pixelformat->bits_per_pixel / 8;
+	for (unsigned int ich = 0; ich < channels; ++ich) {
+		const image_channel_format_t* channel = pixelformat->channel + ich;
+		if ((channel->data_type != IMAGE_DATATYPE_UNSIGNED_INT) || (channel->bits_per_pixel != 8) ||
+		    (channel->offset != ich * 8))
+			return false;
+	}
+	return true;
+}
+
+void
+image_pixel_read(const image_pixelformat_t* pixelformat, const void* source, size_t count, float32_t* rgba) {
+	const uint8_t* pixel = source;
+	size_t pixel_size = pixelformat->bits_per_pixel / 8;
+
+	if (image_pixelformat_is_rgba8(pixelformat)) {
+		const float32_t scale = 1.0f / 255.0f;
+		bool has_alpha = (pixel_size == 4);
+		for (size_t ipix = 0; ipix < count; ++ipix, pixel += pixel_size, rgba += 4) {
+			rgba[0] = (float32_t)pixel[0] * scale;
+			rgba[1] = (float32_t)pixel[1] * scale;
+			rgba[2] = (float32_t)pixel[2] * scale;
+			rgba[3] = has_alpha ? (float32_t)pixel[3] * scale : 1.0f;
+		}
+		return;
+	}
+
+	for (size_t ipix = 0; ipix < count; ++ipix, pixel += pixel_size, rgba += 4) {
+		for (unsigned int ich = 0; ich < 4; ++ich) {
+			const image_channel_format_t* channel = pixelformat->channel + ich;
+			if (channel->bits_per_pixel)
+				rgba[ich] = image_pixel_channel_read(pixel, channel);
+			else
+				rgba[ich] = (ich == IMAGE_CHANNEL_ALPHA) ? 1.0f : 0.0f;
+		}
+	}
+}
+
+void
+image_pixel_write(const image_pixelformat_t* pixelformat, void* destination, size_t count, const float32_t* rgba) {
+	uint8_t* pixel = destination;
+	size_t pixel_size = pixelformat->bits_per_pixel / 8;
+
+	if (image_pixelformat_is_rgba8(pixelformat)) {
+		for (size_t ipix = 0; ipix < count; ++ipix, pixel += pixel_size, rgba += 4) {
+			for (size_t ich = 0; ich < pixel_size; ++ich) {
+				float32_t value = rgba[ich];
+				value = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+				pixel[ich] = (uint8_t)(value * 255.0f + 0.5f);
+			}
+		}
+		return;
+	}
+
+	for (size_t ipix = 0; ipix < count; ++ipix, pixel += pixel_size, rgba += 4) {
+		for (unsigned int ich = 0; ich < 4; ++ich) {
+			const image_channel_format_t* channel = pixelformat->channel + ich;
+			if (channel->bits_per_pixel)
+				image_pixel_channel_write(pixel, channel, rgba[ich]);
+		}
+	}
+}
@@ -0,0 +1,75 @@
+/* pixel.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file pixel.h
+    Pixel format setup and conversion of uncompressed pixel data */
+
+#include <image/types.h>
+
+/*! Initialize an uncompressed pixel format with the given number of tightly
+packed channels in RGBA order, all of the same data type and bit depth
+\param pixelformat      Pixel format to initialize
+\param data_type        Channel data type
+\param bits_per_channel Bits per channel
+\param channels_count   Number of channels (1-4)
+\param colorspace       Color space */
+IMAGE_API void
+image_pixelformat_initialize(image_pixelformat_t* pixelformat, image_datatype_t data_type,
+                             unsigned int bits_per_channel, unsigned int channels_count, image_colorspace_t colorspace);
+
+/*! Query if a pixel format is uncompressed with tightly packed channels in RGBA
+order, all of the same data type and bit depth
+\param pixelformat      Pixel format
+\param data_type        Receives channel data type, can be null
+\param bits_per_channel Receives bits per channel, can be null
+\return                 true if uniform, false if not */
+IMAGE_API bool
+image_pixelformat_is_uniform(const image_pixelformat_t* pixelformat, image_datatype_t* data_type,
+                             unsigned int* bits_per_channel);
+
+/*! Read pixels in the given uncompressed format and convert to normalized floating
+point RGBA. Missing color channels are read as zero, a missing alpha channel as one.
+Unsigned integer channels map to [0,1], signed integer channels to [-1,1].
+\param pixelformat Source pixel format, must have a bit depth that is a multiple of 8
+\param source      Source pixel data
+\param count       Number of pixels to read
+\param rgba        Destination buffer receiving 4 * count values */
+IMAGE_API void
+image_pixel_read(const image_pixelformat_t* pixelformat, const void* source, size_t count, float32_t* rgba);
+
+/*! Convert normalized floating point RGBA values to the given uncompressed format
+\param pixelformat Destination pixel format, must have a bit depth that is a multiple of 8
+\param destination Destination pixel data
+\param count       Number of pixels to write
+\param rgba        Source buffer of 4 * count values */
+IMAGE_API void
+image_pixel_write(const image_pixelformat_t* pixelformat, void* destination, size_t count, const float32_t* rgba);
+
+/*! Convert a 16-bit half precision float to single precision
+\param value Half precision value
+\return      Single precision value */
+IMAGE_API float32_t
+image_half_to_float(uint16_t value);
+
+/*! Convert a single precision float to 16-bit half precision, rounding to nearest
+\param value Single precision value
+\return      Half precision value */
+IMAGE_API uint16_t
+image_float_to_half(float32_t value);
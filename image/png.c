@@ -0,0 +1,343 @@
+/* png.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "png.h"
+#include "pixel.h"
+#include "parallel.h"
+#include "deflate.h"
+
+#define PNG_COLOR_GRAY 0
+#define PNG_COLOR_RGB 2
+#define PNG_COLOR_RGBA 6
+
+#define PNG_FILTER_COUNT 5
+#define PNG_DEFAULT_LEVEL 6
+//! Minimum amount of filtered data per independently compressed block
+#define PNG_BLOCK_MIN_SIZE (128 * 1024)
+
+typedef struct png_block_t png_block_t;
+typedef struct png_writer_t png_writer_t;
+
+//! Independently compressed block of rows, stored as a single IDAT chunk
+struct png_block_t {
+	uint8_t* data;
+	size_t size;
+	size_t raw_size;
+	uint32_t adler;
+	uint32_t crc;
+};
+
+struct png_writer_t {
+	const image_t* image;
+	const uint8_t* pixels;
+	image_pixelformat_t format;
+	bool convert;
+	unsigned int channels;
+	unsigned int bit_depth;
+	size_t row_size;
+	unsigned int block_rows;
+	unsigned int level;
+	bool filter;
+	png_block_t* block;
+};
+
+static void
+png_uint32_store(uint8_t* dest, uint32_t value) {
+	dest[0] = (uint8_t)(value >> 24);
+	dest[1] = (uint8_t)(value >> 16);
+	dest[2] = (uint8_t)(value >> 8);
+	dest[3] = (uint8_t)value;
+}
+
+//! Convert a row to the output format, PNG stores multi-byte samples big endian
+static void
+png_row_convert(const png_writer_t* writer, unsigned int y, float32_t* rgba, uint8_t* row) {
+	const image_t* image = writer->image;
+	size_t source_size = ((size_t)image->format.bits_per_pixel * image->width) / 8;
+	const uint8_t* source = writer->pixels + source_size * y;
+	if (writer->convert) {
+		image_pixel_read(&image->format, source, image->width, rgba);
+		image_pixel_write(&writer->format, row, image->width, rgba);
+	} else {
+		memcpy(row, source, writer->row_size);
+	}
+	if (writer->bit_depth == 16) {
+		for (size_t ibyte = 0; ibyte < writer->row_size; ibyte += 2) {
+			uint8_t low = row[ibyte];
+			row[ibyte] = row[ibyte + 1];
+			row[ibyte + 1] = low;
+		}
+	}
+}
+
+static unsigned int
+png_paeth(unsigned int a, unsigned int b, unsigned int c) {
+	int p = (int)a + (int)b - (int)c;
+	int pa = (p > (int)a) ? p - (int)a : (int)a - p;
+	int pb = (p > (int)b) ? p - (int)b : (int)b - p;
+	int pc = (p > (int)c) ? p - (int)c : (int)c - p;
+	if ((pa <= pb) && (pa <= pc))
+		return a;
+	return (pb <= pc) ? b : c;
+}
+
+static void
+png_row_filter(unsigned int filter, const uint8_t* row, const uint8_t* prev, size_t size, size_t bpp,
+               uint8_t* out) {
+	for (size_t ibyte = 0; ibyte < size; ++ibyte) {
+		unsigned int a = (ibyte >= bpp) ? row[ibyte - bpp] : 0;
+		unsigned int b = prev ? prev[ibyte] : 0;
+		unsigned int c = (prev && (ibyte >= bpp)) ? prev[ibyte - bpp] : 0;
+		unsigned int predict;
+		switch (filter) {
+			case 1:
+				predict = a;
+				break;
+			case 2:
+				predict = b;
+				break;
+			case 3:
+				predict = (a + b) >> 1;
+				break;
+			case 4:
+				predict = png_paeth(a, b, c);
+				break;
+			default:
+				predict = 0;
+				break;
+		}
+		out[ibyte] = (uint8_t)(row[ibyte] - predict);
+	}
+}
+
+static size_t
+png_filter_cost(const uint8_t* data, size_t size) {
+	// Sum of absolute values of the filtered bytes interpreted as signed
+	size_t cost = 0;
+	for (size_t ibyte = 0; ibyte < size; ++ibyte)
+		cost += (data[ibyte] < 128) ? data[ibyte] : 256 - data[ibyte];
+	return cost;
+}
+
+static void
+png_compress_blocks(void* arg, size_t begin, size_t end) {
+	png_writer_t* writer = arg;
+	const image_t* image = writer->image;
+	size_t row_size = writer->row_size;
+	size_t bpp = (writer->channels * writer->bit_depth) / 8;
+
+	uint8_t* rows = memory_allocate(HASH_IMAGE, row_size * 2 + (row_size + 1) * PNG_FILTER_COUNT, 0,
+	                                MEMORY_PERSISTENT);
+	uint8_t* candidate = rows + row_size * 2;
+	float32_t* rgba =
+	    writer->convert ? memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * image->width, 0, MEMORY_PERSISTENT) : 0;
+
+	image_trace_begin(IMAGE_TRACE_COMPRESS);
+	for (size_t iblock = begin; iblock < end; ++iblock) {
+		png_block_t* block = writer->block + iblock;
+		unsigned int first_row = (unsigned int)iblock * writer->block_rows;
+		unsigned int last_row = first_row + writer->block_rows;
+		if (last_row > image->height)
+			last_row = image->height;
+
+		block->raw_size = (size_t)(last_row - first_row) * (row_size + 1);
+		uint8_t* filtered = memory_allocate(HASH_IMAGE, block->raw_size, 0, MEMORY_PERSISTENT);
+		uint8_t* current = rows;
+		uint8_t* prev = rows + row_size;
+		bool have_prev = (first_row > 0);
+		if (have_prev)
+			png_row_convert(writer, first_row - 1, rgba, prev);
+
+		uint8_t* out = filtered;
+		for (unsigned int y = first_row; y < last_row; ++y) {
+			png_row_convert(writer, y, rgba, current);
+			unsigned int best_filter = 0;
+			if (writer->filter) {
+				// Adaptive filter selection by minimum sum of absolute differences
+				size_t best_cost = 0;
+				for (unsigned int ifilter = 0; ifilter < PNG_FILTER_COUNT; ++ifilter) {
+					uint8_t* dest = candidate + ifilter * (row_size + 1);
+					png_row_filter(ifilter, current, have_prev ? prev : 0, row_size, bpp, dest);
+					size_t cost = png_filter_cost(dest, row_size);
+					if (!ifilter || (cost < best_cost)) {
+						best_cost = cost;
+						best_filter = ifilter;
+					}
+				}
+				memcpy(out + 1, candidate + best_filter * (row_size + 1), row_size);
+			} else {
+				memcpy(out + 1, current, row_size);
+			}
+			out[0] = (uint8_t)best_filter;
+			out += row_size + 1;
+
+			uint8_t* swap = prev;
+			prev = current;
+			current = swap;
+			have_prev = true;
+		}
+
+		// First block carries the zlib stream header
+		size_t header_size = iblock ? 0 : 2;
+		bool final = (last_row == image->height);
+		block->data = memory_allocate(HASH_IMAGE, 4 + header_size + image_deflate_bound(block->raw_size), 0,
+		                              MEMORY_PERSISTENT);
+		memcpy(block->data, "IDAT", 4);
+		if (header_size) {
+			block->data[4] = 0x78;
+			// Compression level hint in the flags, check bits make the header a multiple of 31
+			if (writer->level <= 1)
+				block->data[5] = 0x01;
+			else if (writer->level <= 5)
+				block->data[5] = 0x5E;
+			else if (writer->level == 6)
+				block->data[5] = 0x9C;
+			else
+				block->data[5] = 0xDA;
+		}
+		block->size = header_size + image_deflate(filtered, block->raw_size, writer->level, final,
+		                                          block->data + 4 + header_size);
+		block->adler = image_adler32(1, filtered, block->raw_size);
+		block->crc = image_crc32(0, block->data, 4 + block->size);
+
+		memory_deallocate(filtered);
+	}
+	image_trace_end(IMAGE_TRACE_COMPRESS);
+
+	if (rgba)
+		memory_deallocate(rgba);
+	memory_deallocate(rows);
+}
+
+static void
+png_chunk_write(stream_t* stream, const char* type, const void* data, size_t size) {
+	uint8_t header[8];
+	uint8_t footer[4];
+	png_uint32_store(header, (uint32_t)size);
+	memcpy(header + 4, type, 4);
+	uint32_t crc = image_crc32(0, header + 4, 4);
+	crc = image_crc32(crc, data, size);
+	png_uint32_store(footer, crc);
+	stream_write(stream, header, sizeof(header));
+	if (size)
+		stream_write(stream, data, size);
+	stream_write(stream, footer, sizeof(footer));
+}
+
+bool
+image_png_save(const image_t* image, stream_t* stream, const image_save_options_t* options) {
+	if ((image->format.compression != IMAGE_COMPRESSION_NONE) || image->format.block_width ||
+	    (image->format.bits_per_pixel % 8) || !image->format.channels_count) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("PNG output requires uncompressed image data"));
+		return false;
+	}
+	if (!image->width || !image->height || (image->width > 0x7FFFFFFF) || (image->height > 0x7FFFFFFF)) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported PNG image dimensions: %ux%u"),
+		          image->width, image->height);
+		return false;
+	}
+
+	png_writer_t writer;
+	memset(&writer, 0, sizeof(writer));
+	writer.image = image;
+	writer.pixels = image->data;
+	writer.channels = image->format.channels_count;
+	if (writer.channels == 2)
+		writer.channels = 3;
+	else if (writer.channels > 4)
+		writer.channels = 4;
+
+	image_datatype_t data_type = IMAGE_DATATYPE_UNSIGNED_INT;
+	unsigned int bits_per_channel = 0;
+	bool uniform = image_pixelformat_is_uniform(&image->format, &data_type, &bits_per_channel);
+	writer.bit_depth = (uniform && (data_type == IMAGE_DATATYPE_UNSIGNED_INT) && (bits_per_channel <= 8)) ? 8 : 16;
+	writer.convert = !uniform || (data_type != IMAGE_DATATYPE_UNSIGNED_INT) ||
+	                 (bits_per_channel != writer.bit_depth) || (image->format.channels_count != writer.channels);
+	image_pixelformat_initialize(&writer.format, IMAGE_DATATYPE_UNSIGNED_INT, writer.bit_depth, writer.channels,
+	                             image->format.colorspace);
+	writer.row_size = ((size_t)image->width * writer.channels * writer.bit_depth) / 8;
+	writer.level = options->compression_level ? options->compression_level : PNG_DEFAULT_LEVEL;
+	if (writer.level > 9)
+		writer.level = 9;
+	if (options->uncompressed)
+		writer.level = 0;
+	writer.filter = (writer.level > 0);
+
+	writer.block_rows = options->block_rows;
+	if (!writer.block_rows) {
+		// Enough blocks to balance load over the hardware threads while keeping
+		// each block large enough for compression not to suffer
+		size_t thread_count = system_hardware_threads();
+		size_t min_rows = (PNG_BLOCK_MIN_SIZE + writer.row_size) / (writer.row_size + 1);
+		size_t rows = (image->height + thread_count * 4 - 1) / (thread_count * 4);
+		writer.block_rows = (unsigned int)((rows > min_rows) ? rows : min_rows);
+	}
+	if (writer.block_rows > image->height)
+		writer.block_rows = image->height;
+	size_t block_count = (image->height + writer.block_rows - 1) / writer.block_rows;
+	writer.block = memory_allocate(HASH_IMAGE, sizeof(png_block_t) * block_count, 0, MEMORY_PERSISTENT);
+
+	image_parallel_for(block_count, 1, png_compress_blocks, &writer);
+
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	stream_write(stream, signature, sizeof(signature));
+
+	uint8_t header[13];
+	png_uint32_store(header, image->width);
+	png_uint32_store(header + 4, image->height);
+	header[8] = (uint8_t)writer.bit_depth;
+	header[9] = (writer.channels == 1) ? PNG_COLOR_GRAY : ((writer.channels == 3) ? PNG_COLOR_RGB : PNG_COLOR_RGBA);
+	header[10] = 0;
+	header[11] = 0;
+	header[12] = 0;
+	png_chunk_write(stream, "IHDR", header, sizeof(header));
+
+	if (image->format.colorspace == IMAGE_COLORSPACE_sRGB) {
+		uint8_t intent = 0;
+		png_chunk_write(stream, "sRGB", &intent, 1);
+	} else if (image->format.colorspace == IMAGE_COLORSPACE_LINEAR) {
+		uint8_t gamma[4];
+		png_uint32_store(gamma, 100000);
+		png_chunk_write(stream, "gAMA", gamma, sizeof(gamma));
+	}
+
+	uint32_t adler = 1;
+	for (size_t iblock = 0; iblock < block_count; ++iblock) {
+		png_block_t* block = writer.block + iblock;
+		uint8_t length[4];
+		uint8_t crc[4];
+		png_uint32_store(length, (uint32_t)block->size);
+		png_uint32_store(crc, block->crc);
+		stream_write(stream, length, sizeof(length));
+		stream_write(stream, block->data, 4 + block->size);
+		stream_write(stream, crc, sizeof(crc));
+		adler = image_adler32_combine(adler, block->adler, block->raw_size);
+		memory_deallocate(block->data);
+	}
+	memory_deallocate(writer.block);
+
+	uint8_t checksum[4];
+	png_uint32_store(checksum, adler);
+	png_chunk_write(stream, "IDAT", checksum, sizeof(checksum));
+	png_chunk_write(stream, "IEND", 0, 0);
+
+	return true;
+}
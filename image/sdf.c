@@ -0,0 +1,364 @@
+/* sdf.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include <math.h>
+
+#include "image.h"
+#include "sdf.h"
+
+//! Minimum number of bytes processed per parallel chunk
+#define IMAGE_SDF_CHUNK_SIZE (64 * 1024)
+//! Number of columns scanned together along rows
+#define IMAGE_SDF_COLUMN_BAND 256
+//! Squared distance of texels without any feature in reach
+#define IMAGE_SDF_INFINITY 1e20f
+//! Column distance of texels without any feature in reach
+#define IMAGE_SDF_OUT_OF_REACH 0xFFFF
+
+typedef struct image_sdf_job_t image_sdf_job_t;
+typedef struct image_sdf_scratch_t image_sdf_scratch_t;
+
+struct image_sdf_job_t {
+	const image_pixelformat_t* source_format;
+	const uint8_t* source;
+	size_t source_pitch;
+	//! Coverage is read from the alpha channel, otherwise red
+	bool alpha;
+	float32_t threshold;
+	//! Stride and offset of 8-bit coverage read without conversion, zero stride to convert rows
+	size_t byte_stride;
+	size_t byte_offset;
+	//! Smallest 8-bit coverage passing the threshold, 256 if none does
+	unsigned int byte_threshold;
+	unsigned int width;
+	unsigned int height;
+	//! Inside flag of each mask texel
+	uint8_t* mask;
+	//! Distance to the nearest texel of the other kind in the same column, for the sampled
+	//! rows only. The distance to the own kind is zero.
+	uint16_t* column;
+	unsigned int downsample;
+	unsigned int sdf_width;
+	unsigned int sdf_height;
+	const image_pixelformat_t* format;
+	uint8_t* data;
+	size_t pitch;
+	//! Scale from mask texel distance to normalized distance
+	float32_t scale;
+	//! Column distance beyond which every field value is clamped, treated as out of reach
+	uint16_t reach;
+	bool biased;
+};
+
+//! Lower envelope of parabolas for one line
+struct image_sdf_scratch_t {
+	unsigned int* vertex;
+	float32_t* boundary;
+};
+
+//! Mask position of a field texel, the texel nearest the center of its block
+static unsigned int
+image_sdf_sample_position(unsigned int index, unsigned int first, unsigned int step, unsigned int count) {
+	unsigned int position = first + step * index;
+	return (position < count) ? position : count - 1;
+}
+
+//! Squared Euclidean distance transform of one line in linear time (Felzenszwalb and
+//! Huttenlocher). Builds the lower envelope of the parabolas rooted at each finite sample,
+//! then evaluates it at the non-decreasing positions first + step * i clamped to the line.
+//! Zeros inside a run of zeros are skipped, as the run ends are closer everywhere outside
+//! the run, which leaves results inside such runs inexact. Callers know those are zero.
+static void
+image_sdf_transform(const float32_t* f, unsigned int count, float32_t* d, unsigned int first, unsigned int step,
+                    unsigned int query_count, image_sdf_scratch_t* scratch) {
+	unsigned int* vertex = scratch->vertex;
+	float32_t* boundary = scratch->boundary;
+	int k = -1;
+	for (unsigned int q = 0; q < count; ++q) {
+		float32_t value = f[q];
+		if ((value >= IMAGE_SDF_INFINITY) || (!value && q && (q + 1 < count) && !f[q - 1] && !f[q + 1]))
+			continue;
+		// Intersection of the parabolas at q and v, written as the midpoint plus a correction
+		// so single precision stays accurate for large coordinates
+		float32_t s = 0;
+		while (k >= 0) {
+			unsigned int v = vertex[k];
+			s = 0.5f * ((float32_t)(q + v) + (value - f[v]) / (float32_t)(q - v));
+			if (s > boundary[k])
+				break;
+			--k;
+		}
+		++k;
+		vertex[k] = q;
+		boundary[k] = k ? s : -FLT_MAX;
+		boundary[k + 1] = FLT_MAX;
+	}
+	if (k < 0) {
+		for (unsigned int iquery = 0; iquery < query_count; ++iquery)
+			d[iquery] = IMAGE_SDF_INFINITY;
+		return;
+	}
+	int j = 0;
+	for (unsigned int iquery = 0; iquery < query_count; ++iquery) {
+		unsigned int position = image_sdf_sample_position(iquery, first, step, count);
+		while (boundary[j + 1] < (float32_t)position)
+			++j;
+		float32_t offset = (float32_t)position - (float32_t)vertex[j];
+		d[iquery] = offset * offset + f[vertex[j]];
+	}
+}
+
+static void
+image_sdf_scratch_initialize(image_sdf_scratch_t* scratch, unsigned int count) {
+	scratch->vertex = memory_allocate(HASH_IMAGE, sizeof(unsigned int) * count, 0, MEMORY_PERSISTENT);
+	scratch->boundary = memory_allocate(HASH_IMAGE, sizeof(float32_t) * (count + 1), 0, MEMORY_PERSISTENT);
+}
+
+static void
+image_sdf_scratch_finalize(image_sdf_scratch_t* scratch) {
+	memory_deallocate(scratch->boundary);
+	memory_deallocate(scratch->vertex);
+}
+
+//! Threshold coverage of mask rows
+static void
+image_sdf_gather(void* arg, size_t begin, size_t end) {
+	const image_sdf_job_t* job = arg;
+	if (job->byte_stride) {
+		// 8-bit coverage is compared directly against the smallest value passing the threshold
+		for (size_t irow = begin; irow < end; ++irow) {
+			const uint8_t* coverage = job->source + irow * job->source_pitch + job->byte_offset;
+			uint8_t* inside = job->mask + irow * job->width;
+			for (unsigned int x = 0; x < job->width; ++x)
+				inside[x] = (coverage[x * job->byte_stride] >= job->byte_threshold) ? 1 : 0;
+		}
+		return;
+	}
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * job->width, 0, MEMORY_PERSISTENT);
+	const float32_t* coverage = rgba + (job->alpha ? 3 : 0);
+	for (size_t irow = begin; irow < end; ++irow) {
+		image_pixel_read(job->source_format, job->source + irow * job->source_pitch, job->width, rgba);
+		uint8_t* inside = job->mask + irow * job->width;
+		for (unsigned int x = 0; x < job->width; ++x)
+			inside[x] = (coverage[x * 4] >= job->threshold) ? 1 : 0;
+	}
+	memory_deallocate(rgba);
+}
+
+//! Distance transform of bands of columns, evaluated at the sampled rows only. Mask columns
+//! are binary, so the distance to the nearest texel of the other kind is the smaller of the
+//! distances counted in a downward and an upward scan, both running along rows.
+static void
+image_sdf_columns(void* arg, size_t begin, size_t end) {
+	const image_sdf_job_t* job = arg;
+	unsigned int height = job->height;
+	unsigned int first = job->downsample / 2;
+	uint16_t reach = job->reach;
+	uint16_t inside[IMAGE_SDF_COLUMN_BAND];
+	uint16_t outside[IMAGE_SDF_COLUMN_BAND];
+	for (size_t iband = begin; iband < end; ++iband) {
+		unsigned int x0 = (unsigned int)iband * IMAGE_SDF_COLUMN_BAND;
+		unsigned int columns = job->width - x0;
+		if (columns > IMAGE_SDF_COLUMN_BAND)
+			columns = IMAGE_SDF_COLUMN_BAND;
+
+		// Counts start out of reach and saturate there
+		for (unsigned int column = 0; column < columns; ++column) {
+			inside[column] = reach;
+			outside[column] = reach;
+		}
+		unsigned int sample = 0;
+		for (unsigned int y = 0; (y < height) && (sample < job->sdf_height); ++y) {
+			const uint8_t* mask = job->mask + (size_t)y * job->width + x0;
+			for (unsigned int column = 0; column < columns; ++column) {
+				inside[column] = mask[column] ? 0 : (uint16_t)(inside[column] + (inside[column] < reach));
+				outside[column] = mask[column] ? (uint16_t)(outside[column] + (outside[column] < reach)) : 0;
+			}
+			if (y != image_sdf_sample_position(sample, first, job->downsample, height))
+				continue;
+			uint16_t* distance = job->column + (size_t)sample * job->width + x0;
+			for (unsigned int column = 0; column < columns; ++column)
+				distance[column] = mask[column] ? outside[column] : inside[column];
+			++sample;
+		}
+
+		for (unsigned int column = 0; column < columns; ++column) {
+			inside[column] = reach;
+			outside[column] = reach;
+		}
+		sample = job->sdf_height;
+		for (unsigned int y = height; sample && (y-- > 0);) {
+			const uint8_t* mask = job->mask + (size_t)y * job->width + x0;
+			for (unsigned int column = 0; column < columns; ++column) {
+				inside[column] = mask[column] ? 0 : (uint16_t)(inside[column] + (inside[column] < reach));
+				outside[column] = mask[column] ? (uint16_t)(outside[column] + (outside[column] < reach)) : 0;
+			}
+			if (y != image_sdf_sample_position(sample - 1, first, job->downsample, height))
+				continue;
+			--sample;
+			uint16_t* distance = job->column + (size_t)sample * job->width + x0;
+			for (unsigned int column = 0; column < columns; ++column) {
+				uint16_t upward = mask[column] ? outside[column] : inside[column];
+				distance[column] = (upward < distance[column]) ? upward : distance[column];
+			}
+		}
+	}
+}
+
+//! Transform sampled rows and store the signed distances
+static void
+image_sdf_rows(void* arg, size_t begin, size_t end) {
+	const image_sdf_job_t* job = arg;
+	unsigned int sdf_width = job->sdf_width;
+	size_t width = job->width;
+	float32_t* distance =
+	    memory_allocate(HASH_IMAGE, sizeof(float32_t) * (6 * sdf_width + 2 * width), 0, MEMORY_PERSISTENT);
+	float32_t* inside = distance;
+	float32_t* outside = distance + sdf_width;
+	float32_t* rgba = distance + sdf_width * 2;
+	float32_t* column_inside = rgba + sdf_width * 4;
+	float32_t* column_outside = column_inside + width;
+	image_sdf_scratch_t scratch;
+	image_sdf_scratch_initialize(&scratch, job->width);
+	unsigned int first = job->downsample / 2;
+	float32_t scale = job->scale;
+	float32_t bias = job->biased ? 0.5f : 0.0f;
+	float32_t range = job->biased ? 0.5f : 1.0f;
+	for (size_t irow = begin; irow < end; ++irow) {
+		// Squared column distances to either kind, one of which is zero for each texel
+		const uint16_t* column = job->column + irow * width;
+		unsigned int mask_row = image_sdf_sample_position((unsigned int)irow, first, job->downsample, job->height);
+		const uint8_t* mask = job->mask + (size_t)mask_row * width;
+		for (size_t x = 0; x < width; ++x) {
+			float32_t squared =
+			    (column[x] < job->reach) ? (float32_t)column[x] * (float32_t)column[x] : IMAGE_SDF_INFINITY;
+			column_inside[x] = mask[x] ? 0 : squared;
+			column_outside[x] = mask[x] ? squared : 0;
+		}
+		image_sdf_transform(column_inside, job->width, inside, first, job->downsample, sdf_width, &scratch);
+		image_sdf_transform(column_outside, job->width, outside, first, job->downsample, sdf_width, &scratch);
+		for (unsigned int x = 0; x < sdf_width; ++x) {
+			// The edge lies half a texel before the nearest texel of the other kind
+			unsigned int position = image_sdf_sample_position(x, first, job->downsample, job->width);
+			float32_t signed_distance =
+			    mask[position] ? (sqrtf(outside[x]) - 0.5f) : (0.5f - sqrtf(inside[x]));
+			float32_t value = signed_distance * scale;
+			value = (value < 1.0f) ? ((value > -1.0f) ? value : -1.0f) : 1.0f;
+			rgba[x * 4 + 0] = value * range + bias;
+			rgba[x * 4 + 1] = 0;
+			rgba[x * 4 + 2] = 0;
+			rgba[x * 4 + 3] = 1.0f;
+		}
+		image_pixel_write(job->format, job->data + irow * job->pitch, sdf_width, rgba);
+	}
+	image_sdf_scratch_finalize(&scratch);
+	memory_deallocate(distance);
+}
+
+static size_t
+image_sdf_grain(size_t unit_size) {
+	size_t grain = IMAGE_SDF_CHUNK_SIZE / (unit_size ? unit_size : 1);
+	return grain ? grain : 1;
+}
+
+bool
+image_sdf_from_alpha(image_t* sdf, const image_t* mask, unsigned int level, const image_sdf_options_t* options) {
+	const image_pixelformat_t* source_format = &mask->format;
+	if (sdf == mask) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Distance field must not be the mask"));
+		return false;
+	}
+	if (!mask->data || (level >= mask->levels) || (source_format->compression != IMAGE_COMPRESSION_NONE) ||
+	    source_format->block_width || !source_format->bits_per_pixel || (source_format->bits_per_pixel % 8)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Distance field generation requires an uncompressed byte aligned mask level"));
+		return false;
+	}
+
+	image_sdf_options_t defaults;
+	memset(&defaults, 0, sizeof(defaults));
+	if (!options)
+		options = &defaults;
+	image_pixelformat_t format = options->format;
+	if (!format.bits_per_pixel)
+		image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 1, IMAGE_COLORSPACE_LINEAR);
+	if ((format.compression != IMAGE_COMPRESSION_NONE) || format.block_width || (format.bits_per_pixel % 8) ||
+	    (format.channels_count != 1)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Distance fields require an uncompressed byte aligned single channel format"));
+		return false;
+	}
+	if (options->spread < 0) {
+		log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Invalid distance field spread: %f"),
+		          (double)options->spread);
+		return false;
+	}
+
+	image_sdf_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.source_format = source_format;
+	job.source = image_buffer((image_t*)mask, level);
+	job.width = image_width(mask, level);
+	job.height = image_height(mask, level);
+	job.source_pitch = (size_t)job.width * (source_format->bits_per_pixel / 8);
+	job.alpha = (source_format->channel[IMAGE_CHANNEL_ALPHA].bits_per_pixel != 0);
+	job.threshold = (options->threshold > 0) ? options->threshold : 0.5f;
+	const image_channel_format_t* coverage =
+	    source_format->channel + (job.alpha ? IMAGE_CHANNEL_ALPHA : IMAGE_CHANNEL_RED);
+	if ((coverage->data_type == IMAGE_DATATYPE_UNSIGNED_INT) && (coverage->bits_per_pixel == 8) &&
+	    !(coverage->offset % 8)) {
+		job.byte_stride = source_format->bits_per_pixel / 8;
+		job.byte_offset = coverage->offset / 8;
+		job.byte_threshold = 0;
+		while ((job.byte_threshold < 256) && ((float32_t)job.byte_threshold / 255.0f < job.threshold))
+			++job.byte_threshold;
+	}
+	job.downsample = (options->downsample > 1) ? options->downsample : 1;
+	job.sdf_width = (job.width + job.downsample - 1) / job.downsample;
+	job.sdf_height = (job.height + job.downsample - 1) / job.downsample;
+	float32_t spread = (options->spread > 0) ? options->spread : 4.0f;
+	job.scale = 1.0f / (spread * (float32_t)job.downsample);
+	// Column distances beyond the spread only ever produce clamped values
+	float32_t reach = spread * (float32_t)job.downsample + 1.0f;
+	job.reach = (reach < (float32_t)IMAGE_SDF_OUT_OF_REACH) ? (uint16_t)reach : IMAGE_SDF_OUT_OF_REACH;
+	job.biased = (format.channel[IMAGE_CHANNEL_RED].data_type == IMAGE_DATATYPE_UNSIGNED_INT);
+
+	image_allocate_storage(sdf, &format, job.sdf_width, job.sdf_height, 1, 1);
+	job.format = &sdf->format;
+	job.data = sdf->data;
+	job.pitch = (size_t)job.sdf_width * (format.bits_per_pixel / 8);
+
+	size_t texel_count = (size_t)job.width * job.height;
+	size_t sampled_count = (size_t)job.width * job.sdf_height;
+	job.mask = memory_allocate(HASH_IMAGE, texel_count, 0, MEMORY_PERSISTENT);
+	job.column = memory_allocate(HASH_IMAGE, sizeof(uint16_t) * sampled_count, 0, MEMORY_PERSISTENT);
+
+	// Separable transform, columns first to the sampled rows, then the sampled rows
+	size_t bands = (job.width + IMAGE_SDF_COLUMN_BAND - 1) / IMAGE_SDF_COLUMN_BAND;
+	image_parallel_for(job.height, image_sdf_grain(job.width * 4 * sizeof(float32_t)), image_sdf_gather, &job);
+	image_parallel_for(bands, image_sdf_grain((size_t)IMAGE_SDF_COLUMN_BAND * job.height * 2 * sizeof(uint16_t)),
+	                   image_sdf_columns, &job);
+	image_parallel_for(job.sdf_height, image_sdf_grain(job.width * 2 * sizeof(float32_t)), image_sdf_rows, &job);
+
+	memory_deallocate(job.column);
+	memory_deallocate(job.mask);
+
+	return true;
+}
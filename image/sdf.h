@@ -0,0 +1,40 @@
+/* sdf.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file sdf.h
+    Signed distance field generation */
+
+#include <image/types.h>
+
+/*! Generate a signed distance field from the coverage of a mask level, the alpha channel if
+the mask has one and the red channel otherwise. Distances within the spread are exact
+Euclidean distances between texel centers computed by a separable linear time transform,
+corrected by half a texel to place the edge between inside and outside texels. Distances are positive inside,
+divided by the spread and clamped to [-1,1], then biased to [0,1] with the edge at 0.5 when
+stored in unsigned formats. When downsampling, each field texel takes the distance at the
+mask texel nearest the center of its block. Volume images use the first depth slice. Any
+previous storage of the distance field is released.
+\param sdf     Distance field receiving a single level
+\param mask    Coverage mask, must be uncompressed with byte aligned pixels
+\param level   Mask mip level
+\param options Generation options, null for an 8-bit field with a spread of 4 texels
+\return        true if successful, false if the format is not supported */
+IMAGE_API bool
+image_sdf_from_alpha(image_t* sdf, const image_t* mask, unsigned int level, const image_sdf_options_t* options);
@@ -0,0 +1,328 @@
+/* statistics.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "statistics.h"
+
+#define IMAGE_STATISTICS_DEFAULT_BINS 256
+#define IMAGE_STATISTICS_MAX_CHUNKS 64
+
+typedef struct image_statistics_partial_t image_statistics_partial_t;
+typedef struct image_statistics_job_t image_statistics_job_t;
+
+//! Results of one chunk of rows. Chunks are merged in order after the parallel pass so
+//! floating point sums do not depend on thread scheduling
+struct image_statistics_partial_t {
+	float64_t min[4];
+	float64_t max[4];
+	float64_t sum[4];
+	float64_t sum_squares[4];
+	uint64_t nan[4];
+	uint64_t inf[4];
+	uint64_t* histogram;
+};
+
+struct image_statistics_job_t {
+	const image_pixelformat_t* format;
+	const uint8_t* data;
+	size_t row_size;
+	size_t width;
+	size_t grain;
+	unsigned int bins;
+	float32_t histogram_min;
+	float32_t histogram_scale;
+	//! Number of channels stored as 8-bit unsigned values, zero to convert rows through float
+	unsigned int byte_channels;
+	//! Histogram bin of each 8-bit value
+	unsigned int byte_bin[256];
+	image_statistics_partial_t* partial;
+};
+
+static unsigned int
+image_statistics_bin(const image_statistics_job_t* job, float32_t value) {
+	float32_t offset = (value - job->histogram_min) * job->histogram_scale;
+	if (!(offset > 0))
+		return 0;
+	if (offset >= (float32_t)job->bins)
+		return job->bins - 1;
+	return (unsigned int)offset;
+}
+
+static void
+image_statistics_partial_clear(image_statistics_partial_t* partial) {
+	for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+		partial->min[ichannel] = FLT_MAX;
+		partial->max[ichannel] = -FLT_MAX;
+		partial->sum[ichannel] = 0;
+		partial->sum_squares[ichannel] = 0;
+		partial->nan[ichannel] = 0;
+		partial->inf[ichannel] = 0;
+	}
+}
+
+//! Check a row of RGBA values for NaN and infinity without branches so the loop vectorizes
+static bool
+image_statistics_row_is_finite(const float32_t* rgba, size_t width) {
+	float32_t check[4] = {0, 0, 0, 0};
+	for (size_t ipixel = 0; ipixel < width; ++ipixel, rgba += 4) {
+		for (unsigned int ichannel = 0; ichannel < 4; ++ichannel)
+			check[ichannel] += rgba[ichannel] - rgba[ichannel];
+	}
+	return (check[0] == 0) && (check[1] == 0) && (check[2] == 0) && (check[3] == 0);
+}
+
+static void
+image_statistics_rows_float(image_statistics_job_t* job, image_statistics_partial_t* partial, size_t begin,
+                            size_t end) {
+	float32_t* rgba = memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * job->width, 0, MEMORY_PERSISTENT);
+	uint64_t* histogram = partial->histogram;
+	unsigned int bins = job->bins;
+	for (size_t irow = begin; irow < end; ++irow) {
+		image_pixel_read(job->format, job->data + job->row_size * irow, job->width, rgba);
+		if (image_statistics_row_is_finite(rgba, job->width)) {
+			float64_t min[4], max[4], sum[4], sum_squares[4];
+			for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+				min[ichannel] = partial->min[ichannel];
+				max[ichannel] = partial->max[ichannel];
+				sum[ichannel] = 0;
+				sum_squares[ichannel] = 0;
+			}
+			const float32_t* value = rgba;
+			for (size_t ipixel = 0; ipixel < job->width; ++ipixel, value += 4) {
+				for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+					float64_t channel = value[ichannel];
+					min[ichannel] = (channel < min[ichannel]) ? channel : min[ichannel];
+					max[ichannel] = (channel > max[ichannel]) ? channel : max[ichannel];
+					sum[ichannel] += channel;
+					sum_squares[ichannel] += channel * channel;
+				}
+			}
+			for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+				partial->min[ichannel] = min[ichannel];
+				partial->max[ichannel] = max[ichannel];
+				partial->sum[ichannel] += sum[ichannel];
+				partial->sum_squares[ichannel] += sum_squares[ichannel];
+			}
+			value = rgba;
+			for (size_t ipixel = 0; ipixel < job->width; ++ipixel, value += 4) {
+				for (unsigned int ichannel = 0; ichannel < 4; ++ichannel)
+					++histogram[ichannel * bins + image_statistics_bin(job, value[ichannel])];
+			}
+			continue;
+		}
+
+		const float32_t* value = rgba;
+		for (size_t ipixel = 0; ipixel < job->width; ++ipixel, value += 4) {
+			for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+				float32_t channel = value[ichannel];
+				if (channel != channel) {
+					++partial->nan[ichannel];
+					continue;
+				}
+				if (channel - channel != 0) {
+					++partial->inf[ichannel];
+					continue;
+				}
+				if (channel < partial->min[ichannel])
+					partial->min[ichannel] = channel;
+				if (channel > partial->max[ichannel])
+					partial->max[ichannel] = channel;
+				partial->sum[ichannel] += channel;
+				partial->sum_squares[ichannel] += (float64_t)channel * channel;
+				++histogram[ichannel * bins + image_statistics_bin(job, channel)];
+			}
+		}
+	}
+	memory_deallocate(rgba);
+}
+
+static void
+image_statistics_rows_byte(image_statistics_job_t* job, image_statistics_partial_t* partial, size_t begin,
+                           size_t end) {
+	unsigned int channels = job->byte_channels;
+	unsigned int bins = job->bins;
+	uint64_t* histogram = partial->histogram;
+	uint8_t min[4] = {255, 255, 255, 255};
+	uint8_t max[4] = {0, 0, 0, 0};
+	uint64_t sum[4] = {0, 0, 0, 0};
+	uint64_t sum_squares[4] = {0, 0, 0, 0};
+	for (size_t irow = begin; irow < end; ++irow) {
+		const uint8_t* value = job->data + job->row_size * irow;
+		for (size_t ipixel = 0; ipixel < job->width; ++ipixel, value += channels) {
+			for (unsigned int ichannel = 0; ichannel < channels; ++ichannel) {
+				uint8_t channel = value[ichannel];
+				min[ichannel] = (channel < min[ichannel]) ? channel : min[ichannel];
+				max[ichannel] = (channel > max[ichannel]) ? channel : max[ichannel];
+				sum[ichannel] += channel;
+				sum_squares[ichannel] += (uint64_t)channel * channel;
+				++histogram[ichannel * bins + job->byte_bin[channel]];
+			}
+		}
+	}
+
+	// Integer sums are exact, normalize once per chunk
+	uint64_t pixels = (uint64_t)(end - begin) * job->width;
+	for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+		if (ichannel < channels) {
+			partial->min[ichannel] = (float64_t)min[ichannel] / 255.0;
+			partial->max[ichannel] = (float64_t)max[ichannel] / 255.0;
+			partial->sum[ichannel] = (float64_t)sum[ichannel] / 255.0;
+			partial->sum_squares[ichannel] = (float64_t)sum_squares[ichannel] / (255.0 * 255.0);
+		} else {
+			// Missing color channels read as zero and missing alpha as one
+			float32_t channel = (ichannel == 3) ? 1.0f : 0.0f;
+			partial->min[ichannel] = channel;
+			partial->max[ichannel] = channel;
+			partial->sum[ichannel] = (float64_t)channel * (float64_t)pixels;
+			partial->sum_squares[ichannel] = partial->sum[ichannel];
+			histogram[ichannel * bins + image_statistics_bin(job, channel)] += pixels;
+		}
+	}
+}
+
+static void
+image_statistics_rows(void* arg, size_t begin, size_t end) {
+	image_statistics_job_t* job = arg;
+	image_statistics_partial_t* partial = job->partial + (begin / job->grain);
+	if (job->byte_channels)
+		image_statistics_rows_byte(job, partial, begin, end);
+	else
+		image_statistics_rows_float(job, partial, begin, end);
+}
+
+void
+image_statistics_initialize(image_statistics_t* statistics, unsigned int bins, float32_t histogram_min,
+                            float32_t histogram_max) {
+	memset(statistics, 0, sizeof(image_statistics_t));
+	statistics->bins = bins ? bins : IMAGE_STATISTICS_DEFAULT_BINS;
+	statistics->histogram_min = histogram_min;
+	statistics->histogram_max = histogram_max;
+	if (!(histogram_max > histogram_min)) {
+		statistics->histogram_min = 0;
+		statistics->histogram_max = 1;
+	}
+	statistics->histogram = memory_allocate(HASH_IMAGE, sizeof(uint64_t) * 4 * statistics->bins, 0,
+	                                        MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+}
+
+void
+image_statistics_finalize(image_statistics_t* statistics) {
+	if (statistics->histogram)
+		memory_deallocate(statistics->histogram);
+	statistics->histogram = 0;
+}
+
+static bool
+image_statistics_compute(const image_t* image, unsigned int level, image_statistics_t* statistics) {
+	const image_pixelformat_t* format = &image->format;
+	size_t width = image_width(image, level);
+	// Depth slices and layers of a level are consecutive, so they are accumulated as additional rows
+	size_t rows = (size_t)image_height(image, level) * image_depth(image, level) * image_layers(image);
+
+	image_statistics_job_t job;
+	job.format = format;
+	job.data = image_buffer((image_t*)image, level);
+	job.row_size = ((size_t)format->bits_per_pixel * width) / 8;
+	job.width = width;
+	job.bins = statistics->bins;
+	job.histogram_min = statistics->histogram_min;
+	job.histogram_scale = (float32_t)statistics->bins / (statistics->histogram_max - statistics->histogram_min);
+	job.byte_channels = 0;
+
+	image_datatype_t data_type;
+	unsigned int bits_per_channel;
+	if (image_pixelformat_is_uniform(format, &data_type, &bits_per_channel) &&
+	    (data_type == IMAGE_DATATYPE_UNSIGNED_INT) && (bits_per_channel == 8)) {
+		job.byte_channels = format->channels_count;
+		for (unsigned int ivalue = 0; ivalue < 256; ++ivalue)
+			job.byte_bin[ivalue] = image_statistics_bin(&job, (float32_t)ivalue / 255.0f);
+	}
+
+	size_t chunk_count = (rows < IMAGE_STATISTICS_MAX_CHUNKS) ? rows : IMAGE_STATISTICS_MAX_CHUNKS;
+	job.grain = (rows + chunk_count - 1) / chunk_count;
+	chunk_count = (rows + job.grain - 1) / job.grain;
+	size_t histogram_size = (size_t)4 * job.bins;
+	job.partial = memory_allocate(HASH_IMAGE, sizeof(image_statistics_partial_t) * chunk_count, 0, MEMORY_PERSISTENT);
+	uint64_t* histogram = memory_allocate(HASH_IMAGE, sizeof(uint64_t) * histogram_size * chunk_count, 0,
+	                                      MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+	for (size_t ichunk = 0; ichunk < chunk_count; ++ichunk) {
+		image_statistics_partial_clear(job.partial + ichunk);
+		job.partial[ichunk].histogram = histogram + histogram_size * ichunk;
+	}
+
+	image_parallel_for(rows, job.grain, image_statistics_rows, &job);
+
+	image_statistics_partial_t total;
+	image_statistics_partial_clear(&total);
+	memset(statistics->histogram, 0, sizeof(uint64_t) * histogram_size);
+	for (size_t ichunk = 0; ichunk < chunk_count; ++ichunk) {
+		const image_statistics_partial_t* partial = job.partial + ichunk;
+		for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+			if (partial->min[ichannel] < total.min[ichannel])
+				total.min[ichannel] = partial->min[ichannel];
+			if (partial->max[ichannel] > total.max[ichannel])
+				total.max[ichannel] = partial->max[ichannel];
+			total.sum[ichannel] += partial->sum[ichannel];
+			total.sum_squares[ichannel] += partial->sum_squares[ichannel];
+			total.nan[ichannel] += partial->nan[ichannel];
+			total.inf[ichannel] += partial->inf[ichannel];
+		}
+		for (size_t ibin = 0; ibin < histogram_size; ++ibin)
+			statistics->histogram[ibin] += partial->histogram[ibin];
+	}
+
+	statistics->pixels = (uint64_t)rows * width;
+	for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+		bool finite = (total.nan[ichannel] + total.inf[ichannel]) < statistics->pixels;
+		statistics->min[ichannel] = finite ? total.min[ichannel] : 0;
+		statistics->max[ichannel] = finite ? total.max[ichannel] : 0;
+		statistics->sum[ichannel] = total.sum[ichannel];
+		statistics->sum_squares[ichannel] = total.sum_squares[ichannel];
+		statistics->nan[ichannel] = total.nan[ichannel];
+		statistics->inf[ichannel] = total.inf[ichannel];
+	}
+
+	memory_deallocate(histogram);
+	memory_deallocate(job.partial);
+	return true;
+}
+
+bool
+image_statistics(const image_t* image, unsigned int level, image_statistics_t* statistics) {
+	if (!image->data || (level >= image->levels) || !statistics->histogram)
+		return false;
+
+	const image_pixelformat_t* format = &image->format;
+	if ((format->compression == IMAGE_COMPRESSION_ASTC_LDR) || (format->compression == IMAGE_COMPRESSION_ASTC_HDR)) {
+		image_t decoded;
+		image_initialize(&decoded);
+		bool success = image_astc_decode(&decoded, image) && image_statistics_compute(&decoded, level, statistics);
+		image_finalize(&decoded);
+		return success;
+	}
+	if ((format->compression != IMAGE_COMPRESSION_NONE) || (format->bits_per_pixel % 8) ||
+	    !format->bits_per_pixel) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED,
+		          STRING_CONST("Unsupported image format for statistics (compression %u)"),
+		          (unsigned int)format->compression);
+		return false;
+	}
+	return image_statistics_compute(image, level, statistics);
+}
@@ -0,0 +1,53 @@
+/* statistics.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file statistics.h
+    Per channel image statistics. Minimum, maximum, sum, sum of squares and a histogram
+    are computed for each channel in a single multithreaded pass over a mip level.
+    Channel values are normalized as by #image_pixel_read, unsigned integer channels
+    to [0,1], signed integer channels to [-1,1], and missing channels are read as zero
+    for color and one for alpha. */
+
+#include <image/types.h>
+
+/*! Initialize a statistics structure and allocate the histogram
+\param statistics    Statistics structure
+\param bins          Number of histogram bins per channel, zero for 256
+\param histogram_min Lower bound of histogram range
+\param histogram_max Upper bound of histogram range, equal to lower bound for [0,1] */
+IMAGE_API void
+image_statistics_initialize(image_statistics_t* statistics, unsigned int bins, float32_t histogram_min,
+                            float32_t histogram_max);
+
+/*! Finalize a statistics structure and free the histogram
+\param statistics Statistics structure */
+IMAGE_API void
+image_statistics_finalize(image_statistics_t* statistics);
+
+/*! Compute statistics for a mip level of an uncompressed or ASTC compressed image,
+replacing any previous results in the statistics structure. The mean of a channel is
+sum / (pixels - nan - inf) and the variance follows from the sum of squares. All depth
+slices and layers of the level are included.
+\param image      Source image
+\param level      Mip level
+\param statistics Initialized statistics structure receiving the results
+\return           true if successful, false if the image format is not supported */
+IMAGE_API bool
+image_statistics(const image_t* image, unsigned int level, image_statistics_t* statistics);
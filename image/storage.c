@@ -0,0 +1,131 @@
+/* storage.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "storage.h"
+
+typedef struct image_storage_atomic_t image_storage_atomic_t;
+
+struct image_storage_atomic_t {
+	atomic64_t live;
+	atomic64_t peak;
+	atomic64_t count;
+};
+
+static image_storage_atomic_t image_storage_total;
+static image_storage_atomic_t image_storage_compression[IMAGE_COMPRESSION_COUNT];
+static image_storage_atomic_t image_storage_datatype[IMAGE_DATATYPE_COUNT];
+static image_storage_atomic_t image_storage_bitdepth[IMAGE_STORAGE_BITDEPTH_COUNT];
+
+static void
+image_storage_classify(const image_pixelformat_t* pixelformat, unsigned int* compression, unsigned int* datatype,
+                       unsigned int* bitdepth) {
+	image_datatype_t data_type = pixelformat->channel[0].data_type;
+	unsigned int bits_per_channel = 0;
+	bool uniform = image_pixelformat_is_uniform(pixelformat, &data_type, &bits_per_channel);
+
+	*compression = (unsigned int)pixelformat->compression;
+	if (*compression >= IMAGE_COMPRESSION_COUNT)
+		*compression = IMAGE_COMPRESSION_NONE;
+	*datatype = ((unsigned int)data_type < IMAGE_DATATYPE_COUNT) ? (unsigned int)data_type : 0;
+	*bitdepth = IMAGE_STORAGE_BITDEPTH_OTHER;
+	if (uniform && (pixelformat->compression == IMAGE_COMPRESSION_NONE)) {
+		if (bits_per_channel == 8)
+			*bitdepth = IMAGE_STORAGE_BITDEPTH_8;
+		else if (bits_per_channel == 16)
+			*bitdepth = IMAGE_STORAGE_BITDEPTH_16;
+		else if (bits_per_channel == 32)
+			*bitdepth = IMAGE_STORAGE_BITDEPTH_32;
+	}
+}
+
+static void
+image_storage_add(image_storage_atomic_t* counter, int64_t size, int64_t count) {
+	int64_t live = atomic_add64(&counter->live, size, memory_order_relaxed);
+	atomic_add64(&counter->count, count, memory_order_relaxed);
+	if (size <= 0)
+		return;
+	int64_t peak = atomic_load64(&counter->peak, memory_order_relaxed);
+	while ((live > peak) && !atomic_cas64(&counter->peak, live, peak, memory_order_relaxed, memory_order_relaxed))
+		peak = atomic_load64(&counter->peak, memory_order_relaxed);
+}
+
+static void
+image_storage_update(const image_pixelformat_t* pixelformat, int64_t size, int64_t count) {
+	unsigned int compression, datatype, bitdepth;
+	image_storage_classify(pixelformat, &compression, &datatype, &bitdepth);
+	image_storage_add(&image_storage_total, size, count);
+	image_storage_add(image_storage_compression + compression, size, count);
+	image_storage_add(image_storage_datatype + datatype, size, count);
+	image_storage_add(image_storage_bitdepth + bitdepth, size, count);
+}
+
+void
+image_storage_track(const image_pixelformat_t* pixelformat, size_t size) {
+	image_storage_update(pixelformat, (int64_t)size, 1);
+}
+
+void
+image_storage_untrack(const image_pixelformat_t* pixelformat, size_t size) {
+	image_storage_update(pixelformat, -(int64_t)size, -1);
+}
+
+static void
+image_storage_load(image_storage_counter_t* counter, image_storage_atomic_t* source) {
+	int64_t live = atomic_load64(&source->live, memory_order_relaxed);
+	int64_t peak = atomic_load64(&source->peak, memory_order_relaxed);
+	int64_t count = atomic_load64(&source->count, memory_order_relaxed);
+	counter->live = (live > 0) ? (size_t)live : 0;
+	counter->peak = (peak > live) ? (size_t)peak : counter->live;
+	counter->count = (count > 0) ? (size_t)count : 0;
+}
+
+void
+image_storage_statistics(image_storage_statistics_t* statistics) {
+	image_storage_load(&statistics->total, &image_storage_total);
+	for (unsigned int icomp = 0; icomp < IMAGE_COMPRESSION_COUNT; ++icomp)
+		image_storage_load(statistics->compression + icomp, image_storage_compression + icomp);
+	for (unsigned int itype = 0; itype < IMAGE_DATATYPE_COUNT; ++itype)
+		image_storage_load(statistics->datatype + itype, image_storage_datatype + itype);
+	for (unsigned int idepth = 0; idepth < IMAGE_STORAGE_BITDEPTH_COUNT; ++idepth)
+		image_storage_load(statistics->bitdepth + idepth, image_storage_bitdepth + idepth);
+}
+
+size_t
+image_storage_live(void) {
+	int64_t live = atomic_load64(&image_storage_total.live, memory_order_relaxed);
+	return (live > 0) ? (size_t)live : 0;
+}
+
+static void
+image_storage_peak_reset(image_storage_atomic_t* counter) {
+	atomic_store64(&counter->peak, atomic_load64(&counter->live, memory_order_relaxed), memory_order_relaxed);
+}
+
+void
+image_storage_reset_peak(void) {
+	image_storage_peak_reset(&image_storage_total);
+	for (unsigned int icomp = 0; icomp < IMAGE_COMPRESSION_COUNT; ++icomp)
+		image_storage_peak_reset(image_storage_compression + icomp);
+	for (unsigned int itype = 0; itype < IMAGE_DATATYPE_COUNT; ++itype)
+		image_storage_peak_reset(image_storage_datatype + itype);
+	for (unsigned int idepth = 0; idepth < IMAGE_STORAGE_BITDEPTH_COUNT; ++idepth)
+		image_storage_peak_reset(image_storage_bitdepth + idepth);
+}
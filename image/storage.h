@@ -0,0 +1,49 @@
+/* storage.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file storage.h
+    Live memory accounting of image storage. Every allocation made by
+    #image_allocate_storage and released by #image_finalize is tracked with lock free
+    counters, in total and broken down by compression format, channel data type and
+    channel bit depth. Memory mapped image data is not counted. */
+
+#include <image/types.h>
+
+/*! Take a snapshot of the image storage counters. Counters are updated independently,
+so a snapshot taken while other threads allocate or release storage can be off by the
+allocations in flight.
+\param statistics Statistics structure to fill */
+IMAGE_API void
+image_storage_statistics(image_storage_statistics_t* statistics);
+
+/*! Query the number of bytes of image storage currently allocated
+\return Live bytes */
+IMAGE_API size_t
+image_storage_live(void);
+
+/*! Reset all peak counters to the current live values */
+IMAGE_API void
+image_storage_reset_peak(void);
+
+void
+image_storage_track(const image_pixelformat_t* pixelformat, size_t size);
+
+void
+image_storage_untrack(const image_pixelformat_t* pixelformat, size_t size);
@@ -0,0 +1,139 @@
+/* tga.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "tga.h"
+#include "pixel.h"
+
+#define TGA_TYPE_TRUECOLOR 2
+#define TGA_TYPE_GRAYSCALE 3
+#define TGA_TYPE_RLE 8
+#define TGA_DESCRIPTOR_TOP_LEFT 0x20
+#define TGA_RUN_MAX 128
+
+//! Encode a row with run length packets, packets never cross rows
+static size_t
+tga_row_rle(const uint8_t* row, unsigned int width, unsigned int pixel_size, uint8_t* out) {
+	size_t size = 0;
+	unsigned int x = 0;
+	while (x < width) {
+		unsigned int run = 1;
+		while ((x + run < width) && (run < TGA_RUN_MAX) &&
+		       !memcmp(row + x * pixel_size, row + (x + run) * pixel_size, pixel_size))
+			++run;
+		if (run > 1) {
+			out[size++] = (uint8_t)(0x80 | (run - 1));
+			memcpy(out + size, row + x * pixel_size, pixel_size);
+			size += pixel_size;
+			x += run;
+			continue;
+		}
+		// Raw packet up to the start of the next run of at least two equal pixels
+		unsigned int count = 1;
+		while ((x + count < width) && (count < TGA_RUN_MAX)) {
+			if ((x + count + 1 < width) &&
+			    !memcmp(row + (x + count) * pixel_size, row + (x + count + 1) * pixel_size, pixel_size))
+				break;
+			++count;
+		}
+		out[size++] = (uint8_t)(count - 1);
+		memcpy(out + size, row + x * pixel_size, count * pixel_size);
+		size += count * pixel_size;
+		x += count;
+	}
+	return size;
+}
+
+bool
+image_tga_save(const image_t* image, stream_t* stream, const image_save_options_t* options) {
+	if ((image->format.compression != IMAGE_COMPRESSION_NONE) || image->format.block_width ||
+	    (image->format.bits_per_pixel % 8) || !image->format.channels_count) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("TGA output requires uncompressed image data"));
+		return false;
+	}
+	if (!image->width || !image->height || (image->width > 0xFFFF) || (image->height > 0xFFFF)) {
+		log_warnf(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Unsupported TGA image dimensions: %ux%u"),
+		          image->width, image->height);
+		return false;
+	}
+
+	unsigned int channels = image->format.channels_count;
+	if (channels == 2)
+		channels = 3;
+	else if (channels > 4)
+		channels = 4;
+	bool rle = !options->uncompressed;
+
+	uint8_t header[18];
+	memset(header, 0, sizeof(header));
+	header[2] = (uint8_t)(((channels == 1) ? TGA_TYPE_GRAYSCALE : TGA_TYPE_TRUECOLOR) | (rle ? TGA_TYPE_RLE : 0));
+	header[12] = (uint8_t)(image->width & 0xFF);
+	header[13] = (uint8_t)(image->width >> 8);
+	header[14] = (uint8_t)(image->height & 0xFF);
+	header[15] = (uint8_t)(image->height >> 8);
+	header[16] = (uint8_t)(channels * 8);
+	header[17] = (uint8_t)(TGA_DESCRIPTOR_TOP_LEFT | ((channels == 4) ? 8 : 0));
+	stream_write(stream, header, sizeof(header));
+
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, channels, image->format.colorspace);
+	image_datatype_t data_type;
+	unsigned int bits_per_channel;
+	bool convert = !image_pixelformat_is_uniform(&image->format, &data_type, &bits_per_channel) ||
+	               (data_type != IMAGE_DATATYPE_UNSIGNED_INT) || (bits_per_channel != 8) ||
+	               (image->format.channels_count != channels);
+
+	size_t source_row_size = ((size_t)image->format.bits_per_pixel * image->width) / 8;
+	size_t row_size = (size_t)image->width * channels;
+	// Worst case run length encoding adds one byte per raw packet
+	size_t buffer_size = row_size + (rle ? (row_size + image->width) : 0);
+	uint8_t* row = memory_allocate(HASH_IMAGE, buffer_size, 0, MEMORY_PERSISTENT);
+	uint8_t* encoded = row + row_size;
+	float32_t* rgba =
+	    convert ? memory_allocate(HASH_IMAGE, sizeof(float32_t) * 4 * image->width, 0, MEMORY_PERSISTENT) : 0;
+
+	for (unsigned int y = 0; y < image->height; ++y) {
+		const uint8_t* source = image->data + source_row_size * y;
+		if (convert) {
+			image_pixel_read(&image->format, source, image->width, rgba);
+			image_pixel_write(&format, row, image->width, rgba);
+		} else {
+			memcpy(row, source, row_size);
+		}
+		// TGA stores color channels in BGR order
+		if (channels >= 3) {
+			for (size_t ipixel = 0; ipixel < row_size; ipixel += channels) {
+				uint8_t red = row[ipixel];
+				row[ipixel] = row[ipixel + 2];
+				row[ipixel + 2] = red;
+			}
+		}
+		if (rle)
+			stream_write(stream, encoded, tga_row_rle(row, image->width, channels, encoded));
+		else
+			stream_write(stream, row, row_size);
+	}
+
+	if (rgba)
+		memory_deallocate(rgba);
+	memory_deallocate(row);
+
+	return true;
+}
@@ -0,0 +1,342 @@
+/* trace.c    -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "trace.h"
+
+//! Events per thread ring buffer, must be a power of two
+#define IMAGE_TRACE_CAPACITY 8192
+#define IMAGE_TRACE_MAX_RINGS 256
+//! Nesting depth of stages tracked per thread to pair end events with begin events
+#define IMAGE_TRACE_MAX_DEPTH 64
+//! Low bit of the ring owner value, set while the owner is writing an event
+#define IMAGE_TRACE_OWNER_BUSY 1
+
+typedef struct image_trace_event_t image_trace_event_t;
+typedef struct image_trace_ring_t image_trace_ring_t;
+
+struct image_trace_event_t {
+	tick_t timestamp;
+	uint64_t thread;
+	uint32_t stage;
+	uint32_t end;
+};
+
+//! Single producer, single consumer ring. The producer is the thread owning the ring,
+//! the consumer is the flushing thread
+struct image_trace_ring_t {
+	//! Token of the owning thread, zero if the ring is free
+	atomic32_t owner;
+	//! Timestamp of the last recorded event, used to select a ring to reclaim
+	atomic64_t last;
+	atomic64_t write;
+	atomic64_t read;
+	image_trace_event_t event[IMAGE_TRACE_CAPACITY];
+};
+
+static atomicptr_t image_trace_ring[IMAGE_TRACE_MAX_RINGS];
+static atomic32_t image_trace_enabled;
+static atomic32_t image_trace_ready;
+//! Number of threads accessing rings, finalization waits for this to reach zero
+static atomic32_t image_trace_active;
+//! Source of ring owner tokens, never reset so tokens cached by threads that outlive
+//! the module never match a ring of a later initialization
+static atomic32_t image_trace_token;
+static atomic64_t image_trace_dropped_count;
+static tick_t image_trace_base;
+static mutex_t* image_trace_lock;
+
+//! Ring slot index plus one of the calling thread, zero if no ring is assigned
+FOUNDATION_DECLARE_THREAD_LOCAL(uint32_t, image_trace_slot, 0)
+//! Owner token of the calling thread
+FOUNDATION_DECLARE_THREAD_LOCAL(uint32_t, image_trace_owner, 0)
+//! Number of stages begun but not ended on the calling thread
+FOUNDATION_DECLARE_THREAD_LOCAL(uint32_t, image_trace_depth, 0)
+//! Bit per begun stage, innermost in the low bit, set if the begin event was recorded
+FOUNDATION_DECLARE_THREAD_LOCAL(uint64_t, image_trace_accepted, 0)
+//! Number of recorded begin events still waiting for their end event
+FOUNDATION_DECLARE_THREAD_LOCAL(uint32_t, image_trace_pending, 0)
+
+static const string_const_t image_trace_stage_name[IMAGE_TRACE_STAGE_COUNT] = {
+    {STRING_CONST("load")},   {STRING_CONST("probe")},   {STRING_CONST("decode")}, {STRING_CONST("allocate")},
+    {STRING_CONST("repack")}, {STRING_CONST("convert")}, {STRING_CONST("mip")},    {STRING_CONST("compress")}};
+
+void
+image_trace_initialize(void);
+
+void
+image_trace_finalize(void);
+
+void
+image_trace_initialize(void) {
+	image_trace_base = time_current();
+	image_trace_lock = mutex_allocate(STRING_CONST("image_trace"));
+	atomic_store64(&image_trace_dropped_count, 0, memory_order_relaxed);
+	atomic_store32(&image_trace_ready, 1, memory_order_release);
+}
+
+void
+image_trace_finalize(void) {
+	atomic_store32(&image_trace_enabled, 0, memory_order_release);
+	// Wait for threads still writing to a ring, later calls see the module as not ready
+	// and never touch the rings, so they can be released
+	atomic_store32(&image_trace_ready, 0, memory_order_seq_cst);
+	while (atomic_load32(&image_trace_active, memory_order_seq_cst))
+		thread_yield();
+	for (unsigned int iring = 0; iring < IMAGE_TRACE_MAX_RINGS; ++iring) {
+		image_trace_ring_t* ring = atomic_loadptr(&image_trace_ring[iring], memory_order_acquire);
+		atomic_storeptr(&image_trace_ring[iring], 0, memory_order_release);
+		if (ring)
+			memory_deallocate(ring);
+	}
+	mutex_deallocate(image_trace_lock);
+	image_trace_lock = 0;
+}
+
+//! Claim the ring of the calling thread for writing an event. Assigns a free ring if the
+//! thread has none, or reclaims the ring idle for the longest time if all rings are
+//! assigned, since threads that exit without calling #image_trace_thread_finalize never
+//! release their ring. An owner losing its ring to reclamation is assigned another ring
+//! on its next event. Returns null if all rings are being written.
+static image_trace_ring_t*
+image_trace_ring_claim(void) {
+	uint32_t slot = get_thread_image_trace_slot();
+	uint32_t owner = get_thread_image_trace_owner();
+	if (slot) {
+		image_trace_ring_t* ring = atomic_loadptr(&image_trace_ring[slot - 1], memory_order_acquire);
+		if (ring && atomic_cas32(&ring->owner, (int32_t)(owner | IMAGE_TRACE_OWNER_BUSY), (int32_t)owner,
+		                         memory_order_acquire, memory_order_relaxed))
+			return ring;
+		set_thread_image_trace_slot(0);
+	}
+
+	owner = (uint32_t)atomic_incr32(&image_trace_token, memory_order_relaxed) << 1;
+	if (!owner)
+		owner = (uint32_t)atomic_incr32(&image_trace_token, memory_order_relaxed) << 1;
+	set_thread_image_trace_owner(owner);
+	int32_t claimed = (int32_t)(owner | IMAGE_TRACE_OWNER_BUSY);
+
+	unsigned int idle_slot = IMAGE_TRACE_MAX_RINGS;
+	int64_t idle_last = 0;
+	for (unsigned int iring = 0; iring < IMAGE_TRACE_MAX_RINGS; ++iring) {
+		image_trace_ring_t* ring = atomic_loadptr(&image_trace_ring[iring], memory_order_acquire);
+		if (!ring) {
+			image_trace_ring_t* created = memory_allocate(HASH_IMAGE, sizeof(image_trace_ring_t), 0,
+			                                              MEMORY_PERSISTENT | MEMORY_ZERO_INITIALIZED);
+			atomic_store32(&created->owner, claimed, memory_order_relaxed);
+			if (atomic_casptr(&image_trace_ring[iring], created, 0, memory_order_release, memory_order_acquire)) {
+				set_thread_image_trace_slot(iring + 1);
+				return created;
+			}
+			memory_deallocate(created);
+			ring = atomic_loadptr(&image_trace_ring[iring], memory_order_acquire);
+		}
+		// Rings released by exited threads are reused, acquire pairs with the release by the
+		// previous owner so its writes are visible
+		int32_t current = atomic_load32(&ring->owner, memory_order_relaxed);
+		if (!current && atomic_cas32(&ring->owner, claimed, 0, memory_order_acquire, memory_order_relaxed)) {
+			set_thread_image_trace_slot(iring + 1);
+			return ring;
+		}
+		int64_t last = atomic_load64(&ring->last, memory_order_relaxed);
+		if (!(current & IMAGE_TRACE_OWNER_BUSY) && ((idle_slot == IMAGE_TRACE_MAX_RINGS) || (last < idle_last))) {
+			idle_slot = iring;
+			idle_last = last;
+		}
+	}
+
+	if (idle_slot < IMAGE_TRACE_MAX_RINGS) {
+		image_trace_ring_t* ring = atomic_loadptr(&image_trace_ring[idle_slot], memory_order_acquire);
+		int32_t current = atomic_load32(&ring->owner, memory_order_relaxed);
+		if (!(current & IMAGE_TRACE_OWNER_BUSY) &&
+		    atomic_cas32(&ring->owner, claimed, current, memory_order_acquire, memory_order_relaxed)) {
+			set_thread_image_trace_slot(idle_slot + 1);
+			return ring;
+		}
+	}
+	return 0;
+}
+
+static void
+image_trace_ring_release(image_trace_ring_t* ring) {
+	atomic_store32(&ring->owner, (int32_t)get_thread_image_trace_owner(), memory_order_release);
+}
+
+//! Push a begun stage on the nesting stack of the calling thread
+static void
+image_trace_push(bool recorded) {
+	uint32_t depth = get_thread_image_trace_depth();
+	uint64_t accepted = get_thread_image_trace_accepted();
+	uint32_t pending = get_thread_image_trace_pending();
+	// Stages left open when tracing was disabled are forgotten once the stack is full
+	if (depth == IMAGE_TRACE_MAX_DEPTH) {
+		if ((accepted >> (IMAGE_TRACE_MAX_DEPTH - 1)) & 1)
+			--pending;
+	} else {
+		++depth;
+	}
+	set_thread_image_trace_accepted((accepted << 1) | (recorded ? 1 : 0));
+	set_thread_image_trace_depth(depth);
+	set_thread_image_trace_pending(recorded ? pending + 1 : pending);
+}
+
+//! Pop the innermost stage from the nesting stack of the calling thread, returns true if
+//! its begin event was recorded
+static bool
+image_trace_pop(void) {
+	uint32_t depth = get_thread_image_trace_depth();
+	if (!depth)
+		return false;
+	uint64_t accepted = get_thread_image_trace_accepted();
+	bool recorded = (accepted & 1) != 0;
+	set_thread_image_trace_accepted(accepted >> 1);
+	set_thread_image_trace_depth(depth - 1);
+	if (recorded)
+		set_thread_image_trace_pending(get_thread_image_trace_pending() - 1);
+	return recorded;
+}
+
+static void
+image_trace_write(image_trace_stage_t stage, uint32_t end) {
+	// An end event is only recorded if its begin event was, keeping the pairs balanced. Ends
+	// of stages begun while tracing was disabled are not counted as dropped.
+	bool begun = false;
+	if (end) {
+		bool open = get_thread_image_trace_depth() != 0;
+		begun = image_trace_pop();
+		if (!begun) {
+			if (open)
+				atomic_incr64(&image_trace_dropped_count, memory_order_relaxed);
+			return;
+		}
+	}
+
+	image_trace_ring_t* ring = image_trace_ring_claim();
+	bool recorded = false;
+	if (ring) {
+		// A begin event reserves space for its own end event and those of all enclosing
+		// stages, so an accepted begin event always gets its end event recorded
+		int64_t required = end ? 1 : (int64_t)get_thread_image_trace_pending() + 2;
+		int64_t write = atomic_load64(&ring->write, memory_order_relaxed);
+		int64_t read = atomic_load64(&ring->read, memory_order_acquire);
+		if (write - read + required <= IMAGE_TRACE_CAPACITY) {
+			image_trace_event_t* event = ring->event + (write & (IMAGE_TRACE_CAPACITY - 1));
+			event->timestamp = time_current();
+			event->thread = thread_id();
+			event->stage = (uint32_t)stage;
+			event->end = end;
+			atomic_store64(&ring->last, event->timestamp, memory_order_relaxed);
+			atomic_store64(&ring->write, write + 1, memory_order_release);
+			recorded = true;
+		}
+		image_trace_ring_release(ring);
+	}
+	if (!recorded)
+		atomic_incr64(&image_trace_dropped_count, memory_order_relaxed);
+	if (!end)
+		image_trace_push(recorded);
+}
+
+static void
+image_trace_record(image_trace_stage_t stage, uint32_t end) {
+	if (!atomic_load32(&image_trace_enabled, memory_order_relaxed))
+		return;
+	atomic_incr32(&image_trace_active, memory_order_seq_cst);
+	if (atomic_load32(&image_trace_ready, memory_order_seq_cst))
+		image_trace_write(stage, end);
+	atomic_decr32(&image_trace_active, memory_order_release);
+}
+
+void
+image_trace_enable(bool enable) {
+	atomic_store32(&image_trace_enabled, enable ? 1 : 0, memory_order_release);
+}
+
+bool
+image_trace_is_enabled(void) {
+	return atomic_load32(&image_trace_enabled, memory_order_acquire) != 0;
+}
+
+void
+image_trace_begin(image_trace_stage_t stage) {
+	image_trace_record(stage, 0);
+}
+
+void
+image_trace_end(image_trace_stage_t stage) {
+	image_trace_record(stage, 1);
+}
+
+void
+image_trace_thread_finalize(void) {
+	uint32_t slot = get_thread_image_trace_slot();
+	set_thread_image_trace_slot(0);
+	set_thread_image_trace_depth(0);
+	set_thread_image_trace_accepted(0);
+	set_thread_image_trace_pending(0);
+	if (!slot)
+		return;
+	atomic_incr32(&image_trace_active, memory_order_seq_cst);
+	if (atomic_load32(&image_trace_ready, memory_order_seq_cst)) {
+		// Fails if the ring was reclaimed by another thread or belongs to a later initialization
+		image_trace_ring_t* ring = atomic_loadptr(&image_trace_ring[slot - 1], memory_order_acquire);
+		if (ring)
+			atomic_cas32(&ring->owner, 0, (int32_t)get_thread_image_trace_owner(), memory_order_release,
+			             memory_order_relaxed);
+	}
+	atomic_decr32(&image_trace_active, memory_order_release);
+}
+
+size_t
+image_trace_flush(stream_t* stream) {
+	if (!image_trace_lock)
+		return 0;
+
+	size_t count = 0;
+	double ticks_per_us = (double)time_ticks_per_second() / 1000000.0;
+	mutex_lock(image_trace_lock);
+	stream_write_string(stream, STRING_CONST("{\"traceEvents\":["));
+	for (unsigned int iring = 0; iring < IMAGE_TRACE_MAX_RINGS; ++iring) {
+		image_trace_ring_t* ring = atomic_loadptr(&image_trace_ring[iring], memory_order_acquire);
+		if (!ring)
+			continue;
+		int64_t read = atomic_load64(&ring->read, memory_order_relaxed);
+		int64_t write = atomic_load64(&ring->write, memory_order_acquire);
+		for (; read < write; ++read, ++count) {
+			const image_trace_event_t* event = ring->event + (read & (IMAGE_TRACE_CAPACITY - 1));
+			double timestamp = (double)time_diff(image_trace_base, event->timestamp) / ticks_per_us;
+			stream_write_format(stream,
+			                    STRING_CONST("%s\n{\"name\":\"%.*s\",\"cat\":\"image\",\"ph\":\"%c\",\"pid\":1,"
+			                                 "\"tid\":%" PRIu64 ",\"ts\":%.3f}"),
+			                    count ? "," : "", STRING_FORMAT(image_trace_stage_name[event->stage]),
+			                    event->end ? 'E' : 'B', event->thread, timestamp);
+		}
+		// Release the consumed slots back to the producer
+		atomic_store64(&ring->read, write, memory_order_release);
+	}
+	stream_write_string(stream, STRING_CONST("\n],\"displayTimeUnit\":\"ms\"}\n"));
+	mutex_unlock(image_trace_lock);
+	return count;
+}
+
+size_t
+image_trace_dropped(void) {
+	return (size_t)atomic_load64(&image_trace_dropped_count, memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+/* trace.h    -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file trace.h
+    Trace recorder for image operations. When enabled, begin and end events for each
+    stage are recorded with timestamp and thread id into a per-thread ring buffer without
+    taking any locks. Recorded events are written as Chrome trace event JSON by
+    #image_trace_flush, viewable in chrome://tracing or other timeline viewers. Events
+    are dropped if a ring buffer fills up before it is flushed. A recorded begin event
+    reserves space for its end event, so begin and end events are dropped in pairs.
+    If all ring buffers are assigned, the ring buffer idle for the longest time is
+    reclaimed from its thread. */
+
+#include <image/types.h>
+
+/*! Enable or disable trace recording
+\param enable true to enable, false to disable */
+IMAGE_API void
+image_trace_enable(bool enable);
+
+/*! Query if trace recording is enabled
+\return true if enabled, false if not */
+IMAGE_API bool
+image_trace_is_enabled(void);
+
+/*! Record the beginning of a stage on the calling thread
+\param stage Stage */
+IMAGE_API void
+image_trace_begin(image_trace_stage_t stage);
+
+/*! Record the end of a stage on the calling thread
+\param stage Stage */
+IMAGE_API void
+image_trace_end(image_trace_stage_t stage);
+
+/*! Write all recorded events as Chrome trace event JSON and remove them from the
+ring buffers. Safe to call while other threads are recording.
+\param stream Destination stream
+\return       Number of events written */
+IMAGE_API size_t
+image_trace_flush(stream_t* stream);
+
+/*! Query number of events dropped because a ring buffer was full or no ring buffer
+was available since the module was initialized
+\return Number of dropped events */
+IMAGE_API size_t
+image_trace_dropped(void);
+
+/*! Release the ring buffer of the calling thread for reuse by other threads. Recorded
+events remain until flushed. Called by library owned threads before they exit, and
+should be called by other short lived threads that record events. Ring buffers of
+threads that exit without calling this are reclaimed when no free ring buffer remains. */
+IMAGE_API void
+image_trace_thread_finalize(void);
@@ -0,0 +1,562 @@
+/* transform.c  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#include <foundation/foundation.h>
+
+#include "image.h"
+#include "transform.h"
+
+#if FOUNDATION_ARCH_SSE2
+#include <emmintrin.h>
+#elif FOUNDATION_ARCH_NEON
+#include <arm_neon.h>
+#endif
+
+//! Edge length in pixels of the tiles transposed as a unit
+#define IMAGE_TRANSFORM_TILE 32
+//! Minimum number of bytes processed per parallel chunk
+#define IMAGE_TRANSFORM_CHUNK_SIZE (64 * 1024)
+
+typedef struct image_transform_job_t image_transform_job_t;
+
+struct image_transform_job_t {
+	//! Destination slice, also the source for in place operations
+	uint8_t* dest;
+	//! Source slice for transposes
+	const uint8_t* source;
+	//! Destination row pitch in bytes
+	size_t dest_pitch;
+	//! Source row pitch in bytes
+	size_t source_pitch;
+	//! Width in pixels of the slice read
+	unsigned int width;
+	//! Height in pixels of the slice read
+	unsigned int height;
+	//! Bytes per pixel
+	unsigned int pixel_size;
+	//! Number of source rows or tile rows per parallel chunk
+	size_t grain;
+	image_transform_t op;
+};
+
+static FOUNDATION_FORCEINLINE void
+image_transform_pixel_copy(uint8_t* dest, const uint8_t* source, unsigned int pixel_size) {
+	// Constant sizes let the compiler turn the copies into single loads and stores
+	switch (pixel_size) {
+		case 1:
+			*dest = *source;
+			break;
+		case 2:
+			memcpy(dest, source, 2);
+			break;
+		case 4:
+			memcpy(dest, source, 4);
+			break;
+		case 8:
+			memcpy(dest, source, 8);
+			break;
+		case 16:
+			memcpy(dest, source, 16);
+			break;
+		default:
+			memcpy(dest, source, pixel_size);
+			break;
+	}
+}
+
+static FOUNDATION_FORCEINLINE void
+image_transform_pixel_swap(uint8_t* first, uint8_t* second, unsigned int pixel_size) {
+	switch (pixel_size) {
+		case 1: {
+			uint8_t value = *first;
+			*first = *second;
+			*second = value;
+			break;
+		}
+		case 2: {
+			uint16_t value[2];
+			memcpy(value, first, 2);
+			memcpy(value + 1, second, 2);
+			memcpy(first, value + 1, 2);
+			memcpy(second, value, 2);
+			break;
+		}
+		case 4: {
+			uint32_t value[2];
+			memcpy(value, first, 4);
+			memcpy(value + 1, second, 4);
+			memcpy(first, value + 1, 4);
+			memcpy(second, value, 4);
+			break;
+		}
+		case 8: {
+			uint64_t value[2];
+			memcpy(value, first, 8);
+			memcpy(value + 1, second, 8);
+			memcpy(first, value + 1, 8);
+			memcpy(second, value, 8);
+			break;
+		}
+		default:
+			for (unsigned int ibyte = 0; ibyte < pixel_size; ++ibyte) {
+				uint8_t value = first[ibyte];
+				first[ibyte] = second[ibyte];
+				second[ibyte] = value;
+			}
+			break;
+	}
+}
+
+#if FOUNDATION_ARCH_SSE2
+
+//! Transpose an 8x8 block of 8-bit pixels in registers
+static void
+image_transform_transpose_8x8_u8(uint8_t* dest, size_t dest_pitch, const uint8_t* source, size_t source_pitch) {
+	__m128i r0 = _mm_loadl_epi64((const __m128i*)(const void*)source);
+	__m128i r1 = _mm_loadl_epi64((const __m128i*)(const void*)(source + source_pitch));
+	__m128i r2 = _mm_loadl_epi64((const __m128i*)(const void*)(source + source_pitch * 2));
+	__m128i r3 = _mm_loadl_epi64((const __m128i*)(const void*)(source + source_pitch * 3));
+	__m128i r4 = _mm_loadl_epi64((const __m128i*)(const void*)(source + source_pitch * 4));
+	__m128i r5 = _mm_loadl_epi64((const __m128i*)(const void*)(source + source_pitch * 5));
+	__m128i r6 = _mm_loadl_epi64((const __m128i*)(const void*)(source + source_pitch * 6));
+	__m128i r7 = _mm_loadl_epi64((const __m128i*)(const void*)(source + source_pitch * 7));
+	// Interleave pairs of rows, then pairs of pairs, until each register holds two columns
+	__m128i t0 = _mm_unpacklo_epi8(r0, r1);
+	__m128i t1 = _mm_unpacklo_epi8(r2, r3);
+	__m128i t2 = _mm_unpacklo_epi8(r4, r5);
+	__m128i t3 = _mm_unpacklo_epi8(r6, r7);
+	__m128i u0 = _mm_unpacklo_epi16(t0, t1);
+	__m128i u1 = _mm_unpackhi_epi16(t0, t1);
+	__m128i u2 = _mm_unpacklo_epi16(t2, t3);
+	__m128i u3 = _mm_unpackhi_epi16(t2, t3);
+	__m128i c01 = _mm_unpacklo_epi32(u0, u2);
+	__m128i c23 = _mm_unpackhi_epi32(u0, u2);
+	__m128i c45 = _mm_unpacklo_epi32(u1, u3);
+	__m128i c67 = _mm_unpackhi_epi32(u1, u3);
+	_mm_storel_epi64((__m128i*)(void*)dest, c01);
+	_mm_storel_epi64((__m128i*)(void*)(dest + dest_pitch), _mm_unpackhi_epi64(c01, c01));
+	_mm_storel_epi64((__m128i*)(void*)(dest + dest_pitch * 2), c23);
+	_mm_storel_epi64((__m128i*)(void*)(dest + dest_pitch * 3), _mm_unpackhi_epi64(c23, c23));
+	_mm_storel_epi64((__m128i*)(void*)(dest + dest_pitch * 4), c45);
+	_mm_storel_epi64((__m128i*)(void*)(dest + dest_pitch * 5), _mm_unpackhi_epi64(c45, c45));
+	_mm_storel_epi64((__m128i*)(void*)(dest + dest_pitch * 6), c67);
+	_mm_storel_epi64((__m128i*)(void*)(dest + dest_pitch * 7), _mm_unpackhi_epi64(c67, c67));
+}
+
+//! Transpose an 8x8 block of 16-bit pixels in registers
+static void
+image_transform_transpose_8x8_u16(uint8_t* dest, size_t dest_pitch, const uint8_t* source, size_t source_pitch) {
+	__m128i r0 = _mm_loadu_si128((const __m128i*)(const void*)source);
+	__m128i r1 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch));
+	__m128i r2 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch * 2));
+	__m128i r3 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch * 3));
+	__m128i r4 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch * 4));
+	__m128i r5 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch * 5));
+	__m128i r6 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch * 6));
+	__m128i r7 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch * 7));
+	__m128i t0 = _mm_unpacklo_epi16(r0, r1);
+	__m128i t1 = _mm_unpackhi_epi16(r0, r1);
+	__m128i t2 = _mm_unpacklo_epi16(r2, r3);
+	__m128i t3 = _mm_unpackhi_epi16(r2, r3);
+	__m128i t4 = _mm_unpacklo_epi16(r4, r5);
+	__m128i t5 = _mm_unpackhi_epi16(r4, r5);
+	__m128i t6 = _mm_unpacklo_epi16(r6, r7);
+	__m128i t7 = _mm_unpackhi_epi16(r6, r7);
+	__m128i u0 = _mm_unpacklo_epi32(t0, t2);
+	__m128i u1 = _mm_unpackhi_epi32(t0, t2);
+	__m128i u2 = _mm_unpacklo_epi32(t1, t3);
+	__m128i u3 = _mm_unpackhi_epi32(t1, t3);
+	__m128i u4 = _mm_unpacklo_epi32(t4, t6);
+	__m128i u5 = _mm_unpackhi_epi32(t4, t6);
+	__m128i u6 = _mm_unpacklo_epi32(t5, t7);
+	__m128i u7 = _mm_unpackhi_epi32(t5, t7);
+	_mm_storeu_si128((__m128i*)(void*)dest, _mm_unpacklo_epi64(u0, u4));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch), _mm_unpackhi_epi64(u0, u4));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch * 2), _mm_unpacklo_epi64(u1, u5));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch * 3), _mm_unpackhi_epi64(u1, u5));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch * 4), _mm_unpacklo_epi64(u2, u6));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch * 5), _mm_unpackhi_epi64(u2, u6));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch * 6), _mm_unpacklo_epi64(u3, u7));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch * 7), _mm_unpackhi_epi64(u3, u7));
+}
+
+//! Transpose a 4x4 block of 32-bit pixels in registers
+static void
+image_transform_transpose_4x4_u32(uint8_t* dest, size_t dest_pitch, const uint8_t* source, size_t source_pitch) {
+	__m128i r0 = _mm_loadu_si128((const __m128i*)(const void*)source);
+	__m128i r1 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch));
+	__m128i r2 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch * 2));
+	__m128i r3 = _mm_loadu_si128((const __m128i*)(const void*)(source + source_pitch * 3));
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+	__m128i t1 = _mm_unpackhi_epi32(r0, r1);
+	__m128i t2 = _mm_unpacklo_epi32(r2, r3);
+	__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+	_mm_storeu_si128((__m128i*)(void*)dest, _mm_unpacklo_epi64(t0, t2));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch), _mm_unpackhi_epi64(t0, t2));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch * 2), _mm_unpacklo_epi64(t1, t3));
+	_mm_storeu_si128((__m128i*)(void*)(dest + dest_pitch * 3), _mm_unpackhi_epi64(t1, t3));
+}
+
+#elif FOUNDATION_ARCH_NEON
+
+//! Transpose a 4x4 block of 32-bit pixels in registers
+static void
+image_transform_transpose_4x4_u32(uint8_t* dest, size_t dest_pitch, const uint8_t* source, size_t source_pitch) {
+	uint32x4x2_t p0 =
+	    vtrnq_u32(vreinterpretq_u32_u8(vld1q_u8(source)), vreinterpretq_u32_u8(vld1q_u8(source + source_pitch)));
+	uint32x4x2_t p1 = vtrnq_u32(vreinterpretq_u32_u8(vld1q_u8(source + source_pitch * 2)),
+	                            vreinterpretq_u32_u8(vld1q_u8(source + source_pitch * 3)));
+	vst1q_u8(dest, vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(p0.val[0]), vget_low_u32(p1.val[0]))));
+	vst1q_u8(dest + dest_pitch, vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(p0.val[1]), vget_low_u32(p1.val[1]))));
+	vst1q_u8(dest + dest_pitch * 2,
+	         vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(p0.val[0]), vget_high_u32(p1.val[0]))));
+	vst1q_u8(dest + dest_pitch * 3,
+	         vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(p0.val[1]), vget_high_u32(p1.val[1]))));
+}
+
+#endif
+
+//! Transpose a block of at most one tile, using register kernels for whole kernel sized blocks
+static void
+image_transform_transpose_tile(const image_transform_job_t* job, unsigned int x0, unsigned int y0, unsigned int width,
+                               unsigned int height) {
+	unsigned int pixel_size = job->pixel_size;
+	size_t source_pitch = job->source_pitch;
+	size_t dest_pitch = job->dest_pitch;
+	unsigned int kernel = 0;
+#if FOUNDATION_ARCH_SSE2
+	if ((pixel_size == 1) || (pixel_size == 2))
+		kernel = 8;
+	else if (pixel_size == 4)
+		kernel = 4;
+#elif FOUNDATION_ARCH_NEON
+	if (pixel_size == 4)
+		kernel = 4;
+#endif
+	unsigned int kernel_width = kernel ? (width - (width % kernel)) : 0;
+	unsigned int kernel_height = kernel ? (height - (height % kernel)) : 0;
+
+#if FOUNDATION_ARCH_SSE2 || FOUNDATION_ARCH_NEON
+	for (unsigned int y = 0; y < kernel_height; y += kernel) {
+		for (unsigned int x = 0; x < kernel_width; x += kernel) {
+			const uint8_t* source = job->source + (size_t)(y0 + y) * source_pitch + (size_t)(x0 + x) * pixel_size;
+			uint8_t* dest = job->dest + (size_t)(x0 + x) * dest_pitch + (size_t)(y0 + y) * pixel_size;
+#if FOUNDATION_ARCH_SSE2
+			if (pixel_size == 1)
+				image_transform_transpose_8x8_u8(dest, dest_pitch, source, source_pitch);
+			else if (pixel_size == 2)
+				image_transform_transpose_8x8_u16(dest, dest_pitch, source, source_pitch);
+			else
+#endif
+				image_transform_transpose_4x4_u32(dest, dest_pitch, source, source_pitch);
+		}
+	}
+#endif
+
+	// Pixels outside whole kernel blocks, or all pixels if there is no kernel for the pixel size
+	for (unsigned int y = 0; y < height; ++y) {
+		const uint8_t* source = job->source + (size_t)(y0 + y) * source_pitch;
+		uint8_t* dest = job->dest + (size_t)(y0 + y) * pixel_size;
+		for (unsigned int x = (y < kernel_height) ? kernel_width : 0; x < width; ++x)
+			image_transform_pixel_copy(dest + (size_t)(x0 + x) * dest_pitch, source + (size_t)(x0 + x) * pixel_size,
+			                           pixel_size);
+	}
+}
+
+//! Transpose a block by recursively halving the longer edge until it fits a tile, which keeps
+//! both source rows and destination columns of each tile in cache at every level of the hierarchy
+static void
+image_transform_transpose_block(const image_transform_job_t* job, unsigned int x0, unsigned int y0,
+                                unsigned int width, unsigned int height) {
+	while ((width > IMAGE_TRANSFORM_TILE) || (height > IMAGE_TRANSFORM_TILE)) {
+		// Split at multiples of 8 pixels to keep register kernel blocks whole
+		if (width >= height) {
+			unsigned int half = ((width / 2) + 7) & ~7U;
+			image_transform_transpose_block(job, x0, y0, half, height);
+			x0 += half;
+			width -= half;
+		} else {
+			unsigned int half = ((height / 2) + 7) & ~7U;
+			image_transform_transpose_block(job, x0, y0, width, half);
+			y0 += half;
+			height -= half;
+		}
+	}
+	image_transform_transpose_tile(job, x0, y0, width, height);
+}
+
+static void
+image_transform_transpose_rows(void* arg, size_t begin, size_t end) {
+	const image_transform_job_t* job = arg;
+	unsigned int y0 = (unsigned int)begin * IMAGE_TRANSFORM_TILE;
+	unsigned int y1 = (unsigned int)end * IMAGE_TRANSFORM_TILE;
+	if (y1 > job->height)
+		y1 = job->height;
+	image_transform_transpose_block(job, 0, y0, job->width, y1 - y0);
+}
+
+static void
+image_transform_row_reverse(uint8_t* row, unsigned int width, unsigned int pixel_size) {
+	uint8_t* first = row;
+	uint8_t* last = row + (size_t)(width - 1) * pixel_size;
+	for (unsigned int ipixel = 0; ipixel < width / 2; ++ipixel, first += pixel_size, last -= pixel_size)
+		image_transform_pixel_swap(first, last, pixel_size);
+}
+
+static void
+image_transform_rows(void* arg, size_t begin, size_t end) {
+	const image_transform_job_t* job = arg;
+	unsigned int pixel_size = job->pixel_size;
+	unsigned int width = job->width;
+	unsigned int height = job->height;
+	size_t pitch = job->dest_pitch;
+	for (size_t irow = begin; irow < end; ++irow) {
+		uint8_t* row = job->dest + irow * pitch;
+		uint8_t* mirror = job->dest + (height - 1 - irow) * pitch;
+		if (job->op == IMAGE_TRANSFORM_FLIP_HORIZONTAL) {
+			image_transform_row_reverse(row, width, pixel_size);
+		} else if (job->op == IMAGE_TRANSFORM_FLIP_VERTICAL) {
+			uint8_t buffer[256];
+			for (size_t offset = 0; offset < pitch; offset += sizeof(buffer)) {
+				size_t size = ((pitch - offset) < sizeof(buffer)) ? (pitch - offset) : sizeof(buffer);
+				memcpy(buffer, row + offset, size);
+				memcpy(row + offset, mirror + offset, size);
+				memcpy(mirror + offset, buffer, size);
+			}
+		} else if (row == mirror) {
+			image_transform_row_reverse(row, width, pixel_size);
+		} else {
+			uint8_t* last = mirror + (size_t)(width - 1) * pixel_size;
+			for (unsigned int ipixel = 0; ipixel < width; ++ipixel, row += pixel_size, last -= pixel_size)
+				image_transform_pixel_swap(row, last, pixel_size);
+		}
+	}
+}
+
+static size_t
+image_transform_grain(size_t unit_size) {
+	size_t grain = IMAGE_TRANSFORM_CHUNK_SIZE / (unit_size ? unit_size : 1);
+	return grain ? grain : 1;
+}
+
+//! Flip or rotate a slice 180 degrees in place, processing mirrored row pairs in parallel
+static void
+image_transform_slice(uint8_t* data, unsigned int width, unsigned int height, unsigned int pixel_size,
+                      image_transform_t op) {
+	image_transform_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.dest = data;
+	job.dest_pitch = (size_t)width * pixel_size;
+	job.width = width;
+	job.height = height;
+	job.pixel_size = pixel_size;
+	job.op = op;
+	// Horizontal flips process every row, the others a row and its mirror row together
+	size_t count = height;
+	if (op == IMAGE_TRANSFORM_FLIP_VERTICAL)
+		count = height / 2;
+	else if (op == IMAGE_TRANSFORM_ROTATE_180)
+		count = (height + 1) / 2;
+	image_parallel_for(count, image_transform_grain(job.dest_pitch), image_transform_rows, &job);
+}
+
+//! Transpose a slice into another buffer, processing bands of tile rows in parallel
+static void
+image_transform_slice_transpose(uint8_t* dest, const uint8_t* source, unsigned int width, unsigned int height,
+                                unsigned int pixel_size) {
+	image_transform_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.dest = dest;
+	job.source = source;
+	job.source_pitch = (size_t)width * pixel_size;
+	job.dest_pitch = (size_t)height * pixel_size;
+	job.width = width;
+	job.height = height;
+	job.pixel_size = pixel_size;
+	size_t bands = (height + IMAGE_TRANSFORM_TILE - 1) / IMAGE_TRANSFORM_TILE;
+	image_parallel_for(bands, image_transform_grain(job.source_pitch * IMAGE_TRANSFORM_TILE),
+	                   image_transform_transpose_rows, &job);
+}
+
+static bool
+image_transform_validate(const image_t* image, image_transform_t op) {
+	if ((unsigned int)op >= IMAGE_TRANSFORM_COUNT) {
+		log_warnf(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Invalid image transform: %u"), (unsigned int)op);
+		return false;
+	}
+	const image_pixelformat_t* format = &image->format;
+	if ((format->compression != IMAGE_COMPRESSION_NONE) || format->block_width || !format->bits_per_pixel ||
+	    (format->bits_per_pixel % 8)) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED,
+		         STRING_CONST("Image transform requires uncompressed byte aligned pixel formats"));
+		return false;
+	}
+	if (!image->data) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Image transform requires image data"));
+		return false;
+	}
+	if (image_layers(image) > 1) {
+		log_warn(HASH_IMAGE, WARNING_UNSUPPORTED, STRING_CONST("Image transform does not support array layers"));
+		return false;
+	}
+	return true;
+}
+
+bool
+image_transform_swaps_dimensions(image_transform_t op) {
+	return (op == IMAGE_TRANSFORM_ROTATE_90) || (op == IMAGE_TRANSFORM_ROTATE_270) ||
+	       (op == IMAGE_TRANSFORM_TRANSPOSE) || (op == IMAGE_TRANSFORM_TRANSVERSE);
+}
+
+bool
+image_transform(image_t* image, image_transform_t op) {
+	if (!image_transform_validate(image, op))
+		return false;
+	if (op == IMAGE_TRANSFORM_NONE)
+		return true;
+
+	// Mapped data might be read only, and transposes cannot be done in place for non square
+	// images, so transform into new storage and swap it in
+	if (image->mapping || image_transform_swaps_dimensions(op)) {
+		image_t transformed;
+		image_initialize(&transformed);
+		if (!image_transform_copy(&transformed, image, op))
+			return false;
+		image_finalize(image);
+		memcpy(image, &transformed, sizeof(image_t));
+		return true;
+	}
+
+	unsigned int pixel_size = image->format.bits_per_pixel / 8;
+	for (unsigned int level = 0; level < image->levels; ++level) {
+		unsigned int width = image_width(image, level);
+		unsigned int height = image_height(image, level);
+		unsigned int depth = image_depth(image, level);
+		uint8_t* data = image_buffer(image, level);
+		size_t slice_size = (size_t)width * height * pixel_size;
+		for (unsigned int slice = 0; slice < depth; ++slice)
+			image_transform_slice(data + slice_size * slice, width, height, pixel_size, op);
+	}
+	return true;
+}
+
+bool
+image_transform_copy(image_t* dst, const image_t* src, image_transform_t op) {
+	if (dst == src) {
+		log_warn(HASH_IMAGE, WARNING_INVALID_VALUE, STRING_CONST("Image transform copy requires distinct images"));
+		return false;
+	}
+	if (!image_transform_validate(src, op))
+		return false;
+
+	bool swap = image_transform_swaps_dimensions(op);
+	image_pixelformat_t format = src->format;
+	image_allocate_storage(dst, &format, swap ? src->height : src->width, swap ? src->width : src->height,
+	                       src->depth, src->levels);
+	if (!swap) {
+		memcpy(dst->data, src->data, dst->storage_size);
+		return image_transform(dst, op);
+	}
+
+	// Rotations and the anti diagonal mirror are a transpose followed by a row local pass
+	image_transform_t post = IMAGE_TRANSFORM_NONE;
+	if (op == IMAGE_TRANSFORM_ROTATE_90)
+		post = IMAGE_TRANSFORM_FLIP_HORIZONTAL;
+	else if (op == IMAGE_TRANSFORM_ROTATE_270)
+		post = IMAGE_TRANSFORM_FLIP_VERTICAL;
+	else if (op == IMAGE_TRANSFORM_TRANSVERSE)
+		post = IMAGE_TRANSFORM_ROTATE_180;
+
+	unsigned int pixel_size = format.bits_per_pixel / 8;
+	for (unsigned int level = 0; level < src->levels; ++level) {
+		unsigned int width = image_width(src, level);
+		unsigned int height = image_height(src, level);
+		unsigned int depth = image_depth(src, level);
+		const uint8_t* source = image_buffer((image_t*)src, level);
+		uint8_t* dest = image_buffer(dst, level);
+		size_t slice_size = (size_t)width * height * pixel_size;
+		for (unsigned int slice = 0; slice < depth; ++slice) {
+			uint8_t* dest_slice = dest + slice_size * slice;
+			image_transform_slice_transpose(dest_slice, source + slice_size * slice, width, height, pixel_size);
+			if (post != IMAGE_TRANSFORM_NONE)
+				image_transform_slice(dest_slice, height, width, pixel_size, post);
+		}
+	}
+	return true;
+}
+
+image_transform_t
+image_transform_orientation(unsigned int orientation) {
+	// Indexed by tag value, where 2-4 are mirrors and half turns, 5 and 7 mirror around
+	// the diagonals and 6 and 8 are quarter turns
+	static const image_transform_t orientation_transform[9] = {
+	    IMAGE_TRANSFORM_NONE,       IMAGE_TRANSFORM_NONE,          IMAGE_TRANSFORM_FLIP_HORIZONTAL,
+	    IMAGE_TRANSFORM_ROTATE_180, IMAGE_TRANSFORM_FLIP_VERTICAL, IMAGE_TRANSFORM_TRANSPOSE,
+	    IMAGE_TRANSFORM_ROTATE_90,  IMAGE_TRANSFORM_TRANSVERSE,    IMAGE_TRANSFORM_ROTATE_270};
+	return (orientation < 9) ? orientation_transform[orientation] : IMAGE_TRANSFORM_NONE;
+}
+
+void
+image_transform_mapping(image_transform_t op, unsigned int width, unsigned int height, int64_t* origin,
+                        int64_t* step_x, int64_t* step_y) {
+	int64_t last_x = (int64_t)width - 1;
+	int64_t last_y = (int64_t)height - 1;
+	switch (op) {
+		case IMAGE_TRANSFORM_FLIP_HORIZONTAL:
+			*origin = last_x;
+			*step_x = -1;
+			*step_y = width;
+			break;
+		case IMAGE_TRANSFORM_FLIP_VERTICAL:
+			*origin = last_y * width;
+			*step_x = 1;
+			*step_y = -(int64_t)width;
+			break;
+		case IMAGE_TRANSFORM_ROTATE_180:
+			*origin = last_y * width + last_x;
+			*step_x = -1;
+			*step_y = -(int64_t)width;
+			break;
+		case IMAGE_TRANSFORM_ROTATE_90:
+			*origin = last_y;
+			*step_x = height;
+			*step_y = -1;
+			break;
+		case IMAGE_TRANSFORM_ROTATE_270:
+			*origin = last_x * height;
+			*step_x = -(int64_t)height;
+			*step_y = 1;
+			break;
+		case IMAGE_TRANSFORM_TRANSPOSE:
+			*origin = 0;
+			*step_x = height;
+			*step_y = 1;
+			break;
+		case IMAGE_TRANSFORM_TRANSVERSE:
+			*origin = last_x * height + last_y;
+			*step_x = -(int64_t)height;
+			*step_y = -1;
+			break;
+		case IMAGE_TRANSFORM_NONE:
+		default:
+			*origin = 0;
+			*step_x = 1;
+			*step_y = width;
+			break;
+	}
+}
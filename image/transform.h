@@ -0,0 +1,72 @@
+/* transform.h  -  Image library  -  Public Domain  -  2018 Mattias Jansson
+ *
+ * This library provides a cross-platform image loading library in C11 for projects
+ * based on our foundation library.
+ *
+ * The latest source code maintained by Mattias Jansson is always available at
+ *
+ * https://github.com/mjansson/image_lib
+ *
+ * This library is built on top of the foundation library available at
+ *
+ * https://github.com/mjansson/foundation_lib
+ *
+ * This library is put in the public domain; you can redistribute it and/or modify it without any
+ * restrictions.
+ *
+ */
+
+#pragma once
+
+/*! \file transform.h
+    Lossless flips, rotations and transposes of images */
+
+#include <image/types.h>
+
+/*! Apply a flip, rotation or transpose to all mip levels of an image in place.
+Flips and 180 degree rotations reorder pixels within the existing storage, while
+operations swapping width and height transform into new storage which replaces the
+old, leaving mip levels with swapped dimensions. Depth slices of volume images are
+transformed individually. Memory mapped images are always transformed into newly
+allocated storage. Block compressed formats and formats with pixel sizes not a
+multiple of 8 bits are not supported.
+\param image Image to transform
+\param op    Transform operation
+\return      true if successful, false if the pixel format is not supported */
+IMAGE_API bool
+image_transform(image_t* image, image_transform_t op);
+
+/*! Apply a flip, rotation or transpose to all mip levels of an image, storing the
+result in another image. Any previous storage of the destination image is released.
+\param dst Destination image, must not be the source image
+\param src Source image
+\param op  Transform operation
+\return    true if successful, false if the pixel format is not supported */
+IMAGE_API bool
+image_transform_copy(image_t* dst, const image_t* src, image_transform_t op);
+
+/*! Query if a transform swaps the width and height of an image
+\param op Transform operation
+\return   true if the transform is a quarter turn or a diagonal mirror, false if not */
+IMAGE_API bool
+image_transform_swaps_dimensions(image_transform_t op);
+
+/*! Get the transform which displays an image with the given EXIF orientation tag value
+upright, as stored by cameras in JPEG and TIFF metadata.
+\param orientation EXIF orientation tag value in [1, 8]
+\return            Transform operation, #IMAGE_TRANSFORM_NONE for unknown values */
+IMAGE_API image_transform_t
+image_transform_orientation(unsigned int orientation);
+
+/*! Get the linear pixel index mapping of a transform, for loaders folding a transform into
+their own copy loops. Source pixel (x, y) ends up at pixel index origin + x * step_x + y * step_y
+in the transformed image, counted in pixels from the start of the transformed slice.
+\param op     Transform operation
+\param width  Source width in pixels
+\param height Source height in pixels
+\param origin Destination index of source pixel (0, 0)
+\param step_x Destination index increment per source column
+\param step_y Destination index increment per source row */
+IMAGE_API void
+image_transform_mapping(image_transform_t op, unsigned int width, unsigned int height, int64_t* origin,
+                        int64_t* step_x, int64_t* step_y);
@@ -82,19 +82,206 @@ typedef enum image_compression_t {
 	IMAGE_COMPRESSION_PVRTC2_4BPP,
 	IMAGE_COMPRESSION_ETC1,
 	IMAGE_COMPRESSION_ETC2,
+	IMAGE_COMPRESSION_ASTC_LDR,
+	IMAGE_COMPRESSION_ASTC_HDR,
 
 	IMAGE_COMPRESSION_COUNT
 } image_compression_t;
 
+typedef enum image_file_format_t {
+	IMAGE_FILE_FORMAT_PNG = 0,
+	IMAGE_FILE_FORMAT_TGA,
+	IMAGE_FILE_FORMAT_DDS,
+	IMAGE_FILE_FORMAT_KTX,
+	IMAGE_FILE_FORMAT_NATIVE,
+
+	IMAGE_FILE_FORMAT_COUNT
+} image_file_format_t;
+
+typedef enum image_load_flag_t {
+	//! Try memory mapping native image files before decoding
+	IMAGE_LOAD_MAPPED = 0x0001,
+	//! Deallocate the source stream once loading has finished
+	IMAGE_LOAD_ADOPT_STREAM = 0x0002,
+	//! Convert channels of uncompressed images to 8-bit unsigned integers once decoded
+	IMAGE_LOAD_CONVERT_UINT8 = 0x0004,
+	//! Convert channels of uncompressed images to 32-bit floats once decoded, takes
+	//! precedence over IMAGE_LOAD_CONVERT_UINT8
+	IMAGE_LOAD_CONVERT_FLOAT32 = 0x0008
+} image_load_flag_t;
+
+typedef enum image_dedup_flag_t {
+	//! Also match images whose perceptual hashes are within the distance threshold
+	IMAGE_DEDUP_PERCEPTUAL = 0x0001,
+	//! Release the storage of exact duplicates, leaving the pixel data in the first image only
+	IMAGE_DEDUP_RELEASE = 0x0002
+} image_dedup_flag_t;
+
+typedef enum image_transform_t {
+	IMAGE_TRANSFORM_NONE = 0,
+	//! Mirror around the vertical axis, reversing the pixel order of each row
+	IMAGE_TRANSFORM_FLIP_HORIZONTAL,
+	//! Mirror around the horizontal axis, reversing the row order
+	IMAGE_TRANSFORM_FLIP_VERTICAL,
+	//! Rotate 90 degrees clockwise
+	IMAGE_TRANSFORM_ROTATE_90,
+	IMAGE_TRANSFORM_ROTATE_180,
+	//! Rotate 270 degrees clockwise (90 degrees counter clockwise)
+	IMAGE_TRANSFORM_ROTATE_270,
+	//! Mirror around the main diagonal, pixel (x, y) moves to (y, x)
+	IMAGE_TRANSFORM_TRANSPOSE,
+	//! Mirror around the anti diagonal
+	IMAGE_TRANSFORM_TRANSVERSE,
+
+	IMAGE_TRANSFORM_COUNT
+} image_transform_t;
+
+typedef enum image_edge_t {
+	//! Repeat the edge pixel
+	IMAGE_EDGE_CLAMP = 0,
+	//! Continue from the opposite edge, for tiling images
+	IMAGE_EDGE_WRAP,
+	//! Reflect around the edge pixel without repeating it
+	IMAGE_EDGE_MIRROR
+} image_edge_t;
+
+typedef enum image_normalmap_filter_t {
+	//! 3x3 Sobel gradient, weights 1-2-1
+	IMAGE_NORMALMAP_SOBEL = 0,
+	//! 3x3 Scharr gradient, weights 3-10-3, more rotationally symmetric
+	IMAGE_NORMALMAP_SCHARR
+} image_normalmap_filter_t;
+
+typedef enum image_mipmap_mode_t {
+	//! Average blocks of 2x2 texels, 2x2x2 for volumes, in linear space for sRGB images
+	IMAGE_MIPMAP_BOX = 0,
+	//! Average decoded normals and renormalize each texel
+	IMAGE_MIPMAP_NORMALMAP
+} image_mipmap_mode_t;
+
+typedef enum image_mipmap_flag_t {
+	//! Store the normal variance for Toksvig specular antialiasing in the alpha channel
+	IMAGE_MIPMAP_TOKSVIG_ALPHA = 0x0001
+} image_mipmap_flag_t;
+
+typedef enum image_async_status_t {
+	IMAGE_ASYNC_PENDING = 0,
+	IMAGE_ASYNC_RUNNING,
+	IMAGE_ASYNC_COMPLETE,
+	IMAGE_ASYNC_FAILED,
+	IMAGE_ASYNC_CANCELLED
+} image_async_status_t;
+
+typedef enum image_load_format_t {
+	IMAGE_LOAD_FORMAT_UNKNOWN = 0,
+	//! Loaded by the custom loader in the module config
+	IMAGE_LOAD_FORMAT_CUSTOM,
+	IMAGE_LOAD_FORMAT_NATIVE,
+	IMAGE_LOAD_FORMAT_PNG,
+	IMAGE_LOAD_FORMAT_JPEG,
+	IMAGE_LOAD_FORMAT_BMP,
+	IMAGE_LOAD_FORMAT_TGA,
+	IMAGE_LOAD_FORMAT_TIFF,
+	IMAGE_LOAD_FORMAT_DDS,
+	IMAGE_LOAD_FORMAT_GIF,
+	IMAGE_LOAD_FORMAT_PSD,
+	IMAGE_LOAD_FORMAT_HDR,
+	IMAGE_LOAD_FORMAT_EXR,
+	//! Any other format decoded by FreeImage
+	IMAGE_LOAD_FORMAT_OTHER,
+
+	IMAGE_LOAD_FORMAT_COUNT
+} image_load_format_t;
+
+typedef enum image_load_stage_t {
+	//! Identifying the file format and reading headers
+	IMAGE_LOAD_STAGE_PROBE = 0,
+	//! Decoding the file into an intermediate representation
+	IMAGE_LOAD_STAGE_DECODE,
+	//! Allocating image storage
+	IMAGE_LOAD_STAGE_ALLOCATE,
+	//! Copying or reading pixel data into image storage
+	IMAGE_LOAD_STAGE_COPY,
+
+	IMAGE_LOAD_STAGE_COUNT
+} image_load_stage_t;
+
+typedef enum image_load_status_t {
+	IMAGE_LOAD_STATUS_OK = 0,
+	//! No loader recognized the source data
+	IMAGE_LOAD_STATUS_UNRECOGNIZED,
+	//! Source data was recognized but could not be decoded
+	IMAGE_LOAD_STATUS_DECODE_FAILED,
+	//! Source data was decoded but the pixel format is not supported
+	IMAGE_LOAD_STATUS_UNSUPPORTED,
+	//! Source data ended before all pixel data was read
+	IMAGE_LOAD_STATUS_TRUNCATED,
+
+	IMAGE_LOAD_STATUS_COUNT
+} image_load_status_t;
+
+typedef enum image_trace_stage_t {
+	IMAGE_TRACE_LOAD = 0,
+	IMAGE_TRACE_PROBE,
+	IMAGE_TRACE_DECODE,
+	IMAGE_TRACE_ALLOCATE,
+	IMAGE_TRACE_REPACK,
+	IMAGE_TRACE_CONVERT,
+	IMAGE_TRACE_MIP,
+	IMAGE_TRACE_COMPRESS,
+
+	IMAGE_TRACE_STAGE_COUNT
+} image_trace_stage_t;
+
+typedef enum image_storage_bitdepth_t {
+	IMAGE_STORAGE_BITDEPTH_8 = 0,
+	IMAGE_STORAGE_BITDEPTH_16,
+	IMAGE_STORAGE_BITDEPTH_32,
+	//! Block compressed formats and formats with mixed or other channel bit depths
+	IMAGE_STORAGE_BITDEPTH_OTHER,
+
+	IMAGE_STORAGE_BITDEPTH_COUNT
+} image_storage_bitdepth_t;
+
 typedef struct image_config_t image_config_t;
 typedef struct image_t image_t;
 typedef struct image_pixelformat_t image_pixelformat_t;
 typedef struct image_channel_format_t image_channel_format_t;
+typedef struct image_save_options_t image_save_options_t;
+typedef struct image_async_t image_async_t;
+typedef struct image_batch_result_t image_batch_result_t;
+typedef struct image_batch_statistics_t image_batch_statistics_t;
+typedef struct image_cache_statistics_t image_cache_statistics_t;
+typedef struct image_derived_params_t image_derived_params_t;
+typedef struct image_load_statistics_t image_load_statistics_t;
+typedef struct image_load_event_t image_load_event_t;
+typedef struct image_statistics_t image_statistics_t;
+typedef struct image_compare_metrics_t image_compare_metrics_t;
+typedef struct image_dedup_result_t image_dedup_result_t;
+typedef struct image_rect_t image_rect_t;
+typedef struct image_atlas_options_t image_atlas_options_t;
+typedef struct image_atlas_rect_t image_atlas_rect_t;
+typedef struct image_normalmap_options_t image_normalmap_options_t;
+typedef struct image_sdf_options_t image_sdf_options_t;
+typedef struct image_storage_counter_t image_storage_counter_t;
+typedef struct image_storage_statistics_t image_storage_statistics_t;
 
 typedef bool (*image_load_fn)(image_t*, stream_t*);
+typedef void (*image_load_callback_fn)(image_t* image, image_async_status_t status, void* userdata);
+typedef bool (*image_derive_fn)(image_t* result, const image_t* source, const image_derived_params_t* params,
+                                void* userdata);
 
 struct image_config_t {
 	image_load_fn loader;
+	//! Number of worker threads for asynchronous loading, zero for number of hardware threads
+	unsigned int load_thread_count;
+	//! Memory budget in bytes for the decoded image cache, zero to disable caching
+	size_t cache_budget;
+	//! Directory for the on-disk derived image cache, empty to disable. Must remain valid while the module is
+	//! initialized
+	string_const_t derived_cache_path;
+	//! Disk budget in bytes for the derived image cache, zero for unbounded
+	size_t derived_cache_budget;
 };
 
 struct image_channel_format_t {
@@ -114,6 +301,14 @@ struct image_pixelformat_t {
 	unsigned int bits_per_pixel;
 	//! Number of channels
 	unsigned int channels_count;
+	//! Block footprint width in pixels for block compressed formats, zero if not block compressed
+	unsigned int block_width;
+	//! Block footprint height in pixels for block compressed formats
+	unsigned int block_height;
+	//! Block footprint depth in pixels for block compressed formats
+	unsigned int block_depth;
+	//! Total number of bits per block for block compressed formats
+	unsigned int bits_per_block;
 	image_channel_format_t channel[IMAGE_CHANNEL_COUNT];
 };
 
@@ -123,5 +318,239 @@ struct image_t {
 	unsigned int height;
 	unsigned int depth;
 	unsigned int levels;
+	//! Number of array layers stored for each mip level, zero or one for plain images
+	unsigned int layers;
+	//! Layers are the six faces of a cubemap in +X, -X, +Y, -Y, +Z, -Z order
+	bool cubemap;
 	unsigned char* data;
+	//! Memory mapping backing the image data, null if data is allocated
+	void* mapping;
+	//! Size of memory mapping
+	size_t mapping_size;
+	//! Size of allocated storage in bytes, zero if data is mapped or not allocated
+	size_t storage_size;
+};
+
+struct image_rect_t {
+	unsigned int x;
+	unsigned int y;
+	unsigned int width;
+	unsigned int height;
+};
+
+struct image_atlas_options_t {
+	//! Pixel format of atlas pages, must be uncompressed
+	image_pixelformat_t format;
+	//! Dimensions of each atlas page
+	unsigned int page_width;
+	unsigned int page_height;
+	//! Pixels of padding around each image, filled by extruding the image edges
+	unsigned int padding;
+	//! Alignment in pixels of image slots, zero or one for no alignment
+	unsigned int alignment;
+	//! Block footprint of the compression format pages will be encoded to, zero if not block compressed
+	unsigned int block_width;
+	unsigned int block_height;
+	//! Number of mip levels pages will be generated with, slots are aligned so that no compression block
+	//! at any mip level is shared between images
+	unsigned int mip_levels;
+};
+
+struct image_atlas_rect_t {
+	//! Index of the page holding the image
+	unsigned int page;
+	//! Pixel rectangle of the image within the page, excluding padding
+	image_rect_t rect;
+	//! Texture coordinates of the image edges
+	float32_t u0;
+	float32_t v0;
+	float32_t u1;
+	float32_t v1;
+};
+
+struct image_normalmap_options_t {
+	//! Format of the normal map, zero initialized for 8-bit RGBA
+	image_pixelformat_t format;
+	image_normalmap_filter_t filter;
+	//! Scale of height differences relative to the pixel spacing, zero for 1
+	float32_t strength;
+	//! Addressing of pixels outside the height map, wrap for tiling textures
+	image_edge_t edge;
+	//! Store green pointing down the image (Direct3D convention) instead of up (OpenGL convention)
+	bool flip_y;
+};
+
+struct image_sdf_options_t {
+	//! Single channel format of the distance field, zero initialized for 8-bit unsigned
+	image_pixelformat_t format;
+	//! Distance in distance field texels mapped to the full output range on each side of the edge, zero for 4
+	float32_t spread;
+	//! Coverage separating inside from outside, zero for 0.5
+	float32_t threshold;
+	//! Integer factor the mask is reduced by, zero or one for a field with the mask dimensions
+	unsigned int downsample;
+};
+
+struct image_save_options_t {
+	//! Compression level for formats with lossless compression, 1 (fastest) to 9 (best), zero for default
+	unsigned int compression_level;
+	//! Store data without compression
+	bool uncompressed;
+	//! Number of rows per independently compressed block, zero for automatic
+	unsigned int block_rows;
+};
+
+struct image_batch_result_t {
+	//! true if image was loaded successfully
+	bool success;
+	//! Size of source file in bytes
+	size_t size;
+	//! Time spent loading the image across all stages
+	tick_t time;
+};
+
+struct image_batch_statistics_t {
+	//! Number of images loaded successfully
+	size_t loaded;
+	//! Number of images that failed to load
+	size_t failed;
+	//! Total size of source files in bytes
+	size_t size;
+	//! Number of worker threads used, including the calling thread
+	size_t threads;
+	//! Number of tasks executed on another thread than the one that queued it
+	size_t steals;
+	//! Wall clock time for the batch
+	tick_t time;
+	//! Images loaded per second
+	double images_per_second;
+	//! Source data processed in bytes per second
+	double bytes_per_second;
+};
+
+struct image_cache_statistics_t {
+	//! Number of loads served from the cache
+	size_t hits;
+	//! Number of loads that decoded the image
+	size_t misses;
+	//! Number of images evicted to stay within budget
+	size_t evictions;
+	//! Number of images currently in the cache
+	size_t count;
+	//! Memory used by images currently in the cache in bytes
+	size_t size;
+	//! Memory budget in bytes
+	size_t budget;
+};
+
+struct image_derived_params_t {
+	//! Identifier of the processing operation
+	hash_t operation;
+	//! Target pixel format
+	image_pixelformat_t format;
+	//! Mip filter, interpreted by the operation
+	unsigned int mip_filter;
+	//! Number of mip levels, interpreted by the operation
+	unsigned int mip_levels;
+	//! Compression quality, interpreted by the operation
+	unsigned int quality;
+};
+
+struct image_load_statistics_t {
+	//! Number of successful loads
+	uint64_t loads;
+	//! Number of failed loads
+	uint64_t failures;
+	//! Number of bytes read from source streams
+	uint64_t bytes_read;
+	//! Number of read calls on source streams
+	uint64_t read_calls;
+	//! Number of pixels produced, summed over all mip levels
+	uint64_t pixels;
+	//! Time spent in each load stage in nanoseconds
+	uint64_t stage_ns[IMAGE_LOAD_STAGE_COUNT];
+	//! Total time spent loading in nanoseconds
+	uint64_t total_ns;
+};
+
+struct image_load_event_t {
+	//! Source file format, unknown if not recognized
+	image_load_format_t format;
+	//! Status of the load
+	image_load_status_t status;
+	//! Dimensions of the loaded image, zero if the load failed
+	unsigned int width;
+	unsigned int height;
+	unsigned int levels;
+	//! Number of bytes read from the source stream
+	uint64_t bytes_read;
+	//! Duration of the load in nanoseconds
+	uint64_t duration_ns;
+	//! Id of the thread performing the load
+	uint64_t thread;
+	//! Timestamp at the end of the load
+	tick_t timestamp;
+};
+
+struct image_statistics_t {
+	//! Number of histogram bins per channel
+	unsigned int bins;
+	//! Value range covered by the histogram, values outside the range are counted in the first or last bin
+	float32_t histogram_min;
+	float32_t histogram_max;
+	//! Number of pixels examined
+	uint64_t pixels;
+	//! Per channel values in RGBA order, computed over finite normalized values only
+	float64_t min[4];
+	float64_t max[4];
+	float64_t sum[4];
+	float64_t sum_squares[4];
+	//! Per channel counts of NaN and infinite values, only nonzero for float data
+	uint64_t nan[4];
+	uint64_t inf[4];
+	//! Histogram of finite values, bins consecutive counts per channel in RGBA order
+	uint64_t* histogram;
+};
+
+struct image_compare_metrics_t {
+	//! Number of pixels compared
+	uint64_t pixels;
+	//! Per channel values in RGBA order, computed on normalized values
+	float64_t mse[4];
+	//! Peak signal to noise ratio in dB relative to a peak value of one, DBL_MAX for identical channels
+	float64_t psnr[4];
+	float64_t max_error[4];
+	//! Mean structural similarity over 8x8 windows at a stride of 4 pixels
+	float64_t ssim[4];
+};
+
+struct image_dedup_result_t {
+	//! Hash of pixel format, dimensions and pixel data, zero if the image has no data
+	hash_t content_hash;
+	//! Perceptual hash, zero if not computed
+	uint64_t perceptual_hash;
+	//! Index of the first image in the set this image duplicates, own index if unique
+	size_t duplicate_of;
+	//! true if the duplicate has identical pixel data, false if only perceptually similar
+	bool exact;
+};
+
+struct image_storage_counter_t {
+	//! Bytes currently allocated
+	size_t live;
+	//! Highest number of bytes allocated at any time since the last peak reset
+	size_t peak;
+	//! Number of allocations currently live
+	size_t count;
+};
+
+struct image_storage_statistics_t {
+	//! Totals across all images
+	image_storage_counter_t total;
+	//! Breakdown by compression format
+	image_storage_counter_t compression[IMAGE_COMPRESSION_COUNT];
+	//! Breakdown by channel data type
+	image_storage_counter_t datatype[IMAGE_DATATYPE_COUNT];
+	//! Breakdown by channel bit depth
+	image_storage_counter_t bitdepth[IMAGE_STORAGE_BITDEPTH_COUNT];
 };
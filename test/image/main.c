@@ -17,6 +17,8 @@
  */
 
 #include <image/image.h>
+#include <image/deflate.h>
+#include <image/native.h>
 
 #include <foundation/foundation.h>
 #include <test/test.h>
@@ -62,9 +64,2373 @@ DECLARE_TEST(image, create) {
 	return 0;
 }
 
+DECLARE_TEST(image, astc) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 37, 29, 1, 1);
+	for (unsigned int y = 0; y < source.height; ++y) {
+		for (unsigned int x = 0; x < source.width; ++x) {
+			unsigned char* pixel = source.data + (y * source.width + x) * 4;
+			unsigned int ramp = ((x + y) * 255) / (source.width + source.height);
+			pixel[0] = (unsigned char)ramp;
+			pixel[1] = (unsigned char)(255 - ramp);
+			pixel[2] = (unsigned char)(ramp / 2);
+			pixel[3] = 255;
+		}
+	}
+
+	image_pixelformat_t astc_format;
+	EXPECT_FALSE(image_astc_pixelformat(&astc_format, IMAGE_COMPRESSION_ASTC_LDR, IMAGE_COLORSPACE_LINEAR, 7, 7));
+	EXPECT_FALSE(image_astc_pixelformat(&astc_format, IMAGE_COMPRESSION_ASTC_HDR, IMAGE_COLORSPACE_sRGB, 4, 4));
+	EXPECT_TRUE(image_astc_pixelformat(&astc_format, IMAGE_COMPRESSION_ASTC_LDR, IMAGE_COLORSPACE_LINEAR, 6, 6));
+	EXPECT_EQ(image_buffer_size(&astc_format, 37, 29, 1, 1), 7 * 5 * 16);
+
+	image_t compressed;
+	image_t decompressed;
+	image_initialize(&compressed);
+	image_initialize(&decompressed);
+	EXPECT_TRUE(image_astc_encode(&compressed, &source, &astc_format, 50));
+	EXPECT_TRUE(image_astc_decode(&decompressed, &compressed));
+	EXPECT_EQ(decompressed.width, source.width);
+	EXPECT_EQ(decompressed.height, source.height);
+
+	unsigned int max_error = 0;
+	for (size_t ipx = 0; ipx < (size_t)source.width * source.height * 4; ++ipx) {
+		int diff = (int)source.data[ipx] - (int)decompressed.data[ipx];
+		unsigned int error = (unsigned int)(diff < 0 ? -diff : diff);
+		max_error = (error > max_error) ? error : max_error;
+	}
+	EXPECT_LE(max_error, 8);
+
+	image_finalize(&decompressed);
+	image_finalize(&compressed);
+	image_finalize(&source);
+
+	// Cubemap faces are encoded and decoded per level, keeping the layers and the cubemap flag
+	image_initialize(&source);
+	EXPECT_TRUE(image_allocate_cubemap_storage(&source, &format, 8, 2));
+	for (unsigned int level = 0; level < source.levels; ++level) {
+		for (unsigned int face = 0; face < 6; ++face) {
+			unsigned char* pixel = image_layer_buffer(&source, level, face);
+			for (unsigned int ipx = 0; ipx < image_width(&source, level) * image_height(&source, level); ++ipx) {
+				pixel[ipx * 4 + 0] = (unsigned char)(face * 40);
+				pixel[ipx * 4 + 1] = (unsigned char)(255 - face * 40);
+				pixel[ipx * 4 + 2] = (unsigned char)(level * 100);
+				pixel[ipx * 4 + 3] = 255;
+			}
+		}
+	}
+	EXPECT_TRUE(image_astc_pixelformat(&astc_format, IMAGE_COMPRESSION_ASTC_LDR, IMAGE_COLORSPACE_LINEAR, 4, 4));
+	image_initialize(&compressed);
+	image_initialize(&decompressed);
+	EXPECT_TRUE(image_astc_encode(&compressed, &source, &astc_format, 50));
+	EXPECT_EQ(image_layers(&compressed), 6);
+	EXPECT_TRUE(compressed.cubemap);
+	EXPECT_EQ(image_data_size(&compressed), 6 * (4 + 1) * 16);
+	EXPECT_TRUE(image_astc_decode(&decompressed, &compressed));
+	EXPECT_EQ(image_layers(&decompressed), 6);
+	EXPECT_TRUE(decompressed.cubemap);
+	EXPECT_EQ(decompressed.levels, 2);
+	for (unsigned int level = 0; level < source.levels; ++level) {
+		for (unsigned int face = 0; face < 6; ++face) {
+			const unsigned char* expect = image_layer_buffer(&source, level, face);
+			const unsigned char* pixel = image_layer_buffer(&decompressed, level, face);
+			for (unsigned int ic = 0; ic < 4; ++ic) {
+				int diff = (int)pixel[ic] - (int)expect[ic];
+				EXPECT_LE(diff < 0 ? -diff : diff, 2);
+			}
+		}
+	}
+
+	image_finalize(&decompressed);
+	image_finalize(&compressed);
+	image_finalize(&source);
+
+	// HDR round trip, error measured relative to the source magnitude
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 27, 19, 1, 1);
+	float32_t* texel = (float32_t*)source.data;
+	for (unsigned int y = 0; y < source.height; ++y) {
+		for (unsigned int x = 0; x < source.width; ++x, texel += 4) {
+			// Exponential ramp over ten stops, the range HDR data actually spans
+			float32_t stops = (float32_t)((x + y) * 10) / (float32_t)(source.width + source.height);
+			float32_t intensity = 0.5f * powf(2.0f, stops);
+			texel[0] = intensity;
+			texel[1] = intensity * 0.5f;
+			texel[2] = intensity * 0.25f;
+			texel[3] = 1.0f;
+		}
+	}
+
+	EXPECT_TRUE(image_astc_pixelformat(&astc_format, IMAGE_COMPRESSION_ASTC_HDR, IMAGE_COLORSPACE_LINEAR, 4, 4));
+	image_initialize(&compressed);
+	image_initialize(&decompressed);
+	EXPECT_TRUE(image_astc_encode(&compressed, &source, &astc_format, 50));
+	EXPECT_TRUE(image_astc_decode(&decompressed, &compressed));
+	EXPECT_EQ(decompressed.format.channel[0].data_type, IMAGE_DATATYPE_FLOAT);
+	EXPECT_EQ(decompressed.width, source.width);
+	EXPECT_EQ(decompressed.height, source.height);
+
+	const float32_t* original = (const float32_t*)source.data;
+	const float32_t* decoded = (const float32_t*)decompressed.data;
+	float32_t max_relative = 0;
+	for (size_t ipx = 0; ipx < (size_t)source.width * source.height; ++ipx) {
+		for (unsigned int ic = 0; ic < 3; ++ic) {
+			float32_t diff = decoded[ipx * 4 + ic] - original[ipx * 4 + ic];
+			float32_t relative = (diff < 0 ? -diff : diff) / original[ipx * 4 + ic];
+			max_relative = (relative > max_relative) ? relative : max_relative;
+		}
+	}
+	EXPECT_LT(max_relative, 0.125f);
+
+	image_finalize(&decompressed);
+	image_finalize(&compressed);
+	image_finalize(&source);
+
+	return 0;
+}
+
+static uint32_t
+test_uint32_load(const uint8_t* data) {
+	return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+DECLARE_TEST(image, save) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 67, 45, 1, 1);
+	for (unsigned int y = 0; y < source.height; ++y) {
+		for (unsigned int x = 0; x < source.width; ++x) {
+			unsigned char* pixel = source.data + (y * source.width + x) * 4;
+			pixel[0] = (unsigned char)(x * 3);
+			pixel[1] = (unsigned char)(y * 5);
+			pixel[2] = (unsigned char)((x < 32) ? 0 : 255);
+			pixel[3] = 255;
+		}
+	}
+
+	unsigned char header[18];
+
+	image_save_options_t options;
+	memset(&options, 0, sizeof(options));
+
+	// Load the written file back and compare pixels, with small independently compressed
+	// blocks, with automatic blocks at the best compression level and with filtering
+	// and compression disabled
+	stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	for (unsigned int ipass = 0; ipass < 3; ++ipass) {
+		options.block_rows = (ipass == 0) ? 7 : 0;
+		options.compression_level = (ipass == 1) ? 9 : 0;
+		options.uncompressed = (ipass == 2);
+		stream_truncate(stream, 0);
+		stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+		EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_PNG, &options));
+		size_t size = stream_tell(stream);
+		image_t loaded;
+		image_initialize(&loaded);
+		stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+		EXPECT_TRUE(image_load(&loaded, stream));
+		EXPECT_EQ(loaded.width, source.width);
+		EXPECT_EQ(loaded.height, source.height);
+		EXPECT_EQ(loaded.format.bits_per_pixel, 32);
+		EXPECT_EQ(memcmp(loaded.data, source.data, (size_t)source.width * source.height * 4), 0);
+		image_finalize(&loaded);
+		// A single flipped bit must fail the chunk checksum
+		unsigned char byte;
+		stream_seek(stream, (ssize_t)(size / 2), STREAM_SEEK_BEGIN);
+		stream_read(stream, &byte, 1);
+		byte ^= 0x10;
+		stream_seek(stream, (ssize_t)(size / 2), STREAM_SEEK_BEGIN);
+		stream_write(stream, &byte, 1);
+		stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+		EXPECT_FALSE(image_load(&loaded, stream));
+		image_finalize(&loaded);
+	}
+	stream_deallocate(stream);
+
+	stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	options.uncompressed = true;
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_TGA, &options));
+	EXPECT_EQ(stream_tell(stream), sizeof(header) + source.width * source.height * 4);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_read(stream, header, sizeof(header));
+	EXPECT_EQ(header[2], 2);
+	EXPECT_EQ(header[16], 32);
+	EXPECT_FALSE(image_save(&source, stream, IMAGE_FILE_FORMAT_COUNT, 0));
+	stream_deallocate(stream);
+
+	uint8_t container[4 + 124 + 20];
+	size_t data_size = (size_t)source.width * source.height * 4;
+
+	stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_DDS, 0));
+	EXPECT_EQ(stream_tell(stream), sizeof(container) + data_size);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_read(stream, container, sizeof(container));
+	EXPECT_EQ(memcmp(container, "DDS ", 4), 0);
+	EXPECT_EQ(test_uint32_load(container + 4), 124);
+	// Caps, height, width, pitch and pixel format
+	EXPECT_EQ(test_uint32_load(container + 8), 0x100F);
+	EXPECT_EQ(test_uint32_load(container + 12), source.height);
+	EXPECT_EQ(test_uint32_load(container + 16), source.width);
+	EXPECT_EQ(test_uint32_load(container + 20), source.width * 4);
+	EXPECT_EQ(test_uint32_load(container + 24), 0);
+	EXPECT_EQ(test_uint32_load(container + 28), 1);
+	EXPECT_EQ(test_uint32_load(container + 76), 32);
+	EXPECT_EQ(test_uint32_load(container + 80), 0x4);
+	EXPECT_EQ(memcmp(container + 84, "DX10", 4), 0);
+	EXPECT_EQ(test_uint32_load(container + 108), 0x1000);
+	EXPECT_EQ(test_uint32_load(container + 112), 0);
+	// DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, 2D texture, single layer
+	EXPECT_EQ(test_uint32_load(container + 128), 29);
+	EXPECT_EQ(test_uint32_load(container + 132), 3);
+	EXPECT_EQ(test_uint32_load(container + 136), 0);
+	EXPECT_EQ(test_uint32_load(container + 140), 1);
+	stream_deallocate(stream);
+
+	stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_KTX, 0));
+	EXPECT_EQ(stream_tell(stream), 64 + 4 + data_size);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_read(stream, container, 64 + 4);
+	static const uint8_t ktx_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+	EXPECT_EQ(memcmp(container, ktx_identifier, sizeof(ktx_identifier)), 0);
+	EXPECT_EQ(test_uint32_load(container + 12), 0x04030201);
+	// GL_UNSIGNED_BYTE, GL_RGBA with GL_SRGB8_ALPHA8 internal format
+	EXPECT_EQ(test_uint32_load(container + 16), 0x1401);
+	EXPECT_EQ(test_uint32_load(container + 20), 1);
+	EXPECT_EQ(test_uint32_load(container + 24), 0x1908);
+	EXPECT_EQ(test_uint32_load(container + 28), 0x8C43);
+	EXPECT_EQ(test_uint32_load(container + 32), 0x1908);
+	EXPECT_EQ(test_uint32_load(container + 36), source.width);
+	EXPECT_EQ(test_uint32_load(container + 40), source.height);
+	EXPECT_EQ(test_uint32_load(container + 44), 0);
+	EXPECT_EQ(test_uint32_load(container + 48), 0);
+	EXPECT_EQ(test_uint32_load(container + 52), 1);
+	EXPECT_EQ(test_uint32_load(container + 56), 1);
+	EXPECT_EQ(test_uint32_load(container + 60), 0);
+	EXPECT_EQ(test_uint32_load(container + 64), data_size);
+	stream_deallocate(stream);
+
+	image_finalize(&source);
+
+	return 0;
+}
+
+DECLARE_TEST(image, native) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 33, 17, 1, 3);
+	size_t data_size = image_buffer_size(&format, 33, 17, 1, 3);
+	for (size_t ibyte = 0; ibyte < data_size; ++ibyte)
+		source.data[ibyte] = (unsigned char)(ibyte * 7);
+
+	stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_NATIVE, 0));
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+
+	image_t loaded;
+	image_initialize(&loaded);
+	EXPECT_TRUE(image_load(&loaded, stream));
+	EXPECT_EQ(loaded.width, source.width);
+	EXPECT_EQ(loaded.height, source.height);
+	EXPECT_EQ(loaded.levels, source.levels);
+	EXPECT_EQ(memcmp(&loaded.format, &source.format, sizeof(image_pixelformat_t)), 0);
+	EXPECT_EQ(memcmp(loaded.data, source.data, data_size), 0);
+	image_finalize(&loaded);
+
+	string_const_t tmp_path = environment_temporary_directory();
+	string_t path = path_allocate_concat(STRING_ARGS(tmp_path), STRING_CONST("image_native_test.bin"));
+	stream_t* file = stream_open(STRING_ARGS(path), STREAM_OUT | STREAM_BINARY | STREAM_CREATE | STREAM_TRUNCATE);
+	EXPECT_NE(file, 0);
+	EXPECT_TRUE(image_save(&source, file, IMAGE_FILE_FORMAT_NATIVE, 0));
+	stream_deallocate(file);
+
+	image_t mapped;
+	image_initialize(&mapped);
+	EXPECT_TRUE(image_load_mapped(&mapped, STRING_ARGS(path)));
+	EXPECT_NE(mapped.mapping, 0);
+	EXPECT_EQ(((uintptr_t)mapped.data) & 4095, 0);
+	EXPECT_EQ(mapped.levels, source.levels);
+	EXPECT_EQ(memcmp(&mapped.format, &source.format, sizeof(image_pixelformat_t)), 0);
+	EXPECT_EQ(memcmp(mapped.data, source.data, data_size), 0);
+	EXPECT_EQ(memcmp(image_buffer(&mapped, 2), image_buffer(&source, 2), image_buffer_size(&format, 8, 4, 1, 1)),
+	          0);
+	image_finalize(&mapped);
+	EXPECT_EQ(mapped.mapping, 0);
+
+	// Version 1 headers without layer count and flags still load as single layer images
+	uint8_t header[4096];
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_EQ(stream_read(stream, header, sizeof(header)), sizeof(header));
+	EXPECT_EQ(test_uint32_load(header + 8), 2);
+	uint32_t header_size = test_uint32_load(header + 12);
+	uint32_t level_table = header_size - 3 * 8;
+	memmove(header + level_table - 8, header + level_table, 3 * 8);
+	memset(header + header_size - 8, 0, 8);
+	header_size -= 8;
+	uint32_t version = 1;
+	memcpy(header + 8, &version, sizeof(version));
+	memcpy(header + 12, &header_size, sizeof(header_size));
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_write(stream, header, sizeof(header));
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_TRUE(image_load(&loaded, stream));
+	EXPECT_EQ(image_layers(&loaded), 1);
+	EXPECT_FALSE(loaded.cubemap);
+	EXPECT_EQ(loaded.levels, source.levels);
+	EXPECT_EQ(memcmp(loaded.data, source.data, data_size), 0);
+	image_finalize(&loaded);
+
+	// A header claiming more data than the stream holds is rejected before allocating storage
+	stream_truncate(stream, sizeof(header) + data_size / 2);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_FALSE(image_native_load(&loaded, stream));
+	EXPECT_EQ(loaded.data, 0);
+	EXPECT_EQ(stream_tell(stream), 0);
+
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_write(stream, "JUNK", 4);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_FALSE(image_native_load(&loaded, stream));
+	EXPECT_EQ(stream_tell(stream), 0);
+
+	fs_remove_file(STRING_ARGS(path));
+	string_deallocate(path.str);
+	stream_deallocate(stream);
+	image_finalize(&source);
+
+	return 0;
+}
+
+static void
+test_image_async_callback(image_t* image, image_async_status_t status, void* userdata) {
+	FOUNDATION_UNUSED(image);
+	if (status == IMAGE_ASYNC_COMPLETE)
+		atomic_incr32(userdata, memory_order_relaxed);
+}
+
+DECLARE_TEST(image, async) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 64, 48, 1, 1);
+	size_t data_size = image_buffer_size(&format, 64, 48, 1, 1);
+	for (size_t ibyte = 0; ibyte < data_size; ++ibyte)
+		source.data[ibyte] = (unsigned char)(ibyte * 13);
+
+	string_const_t tmp_path = environment_temporary_directory();
+	string_t path = path_allocate_concat(STRING_ARGS(tmp_path), STRING_CONST("image_async_test.bin"));
+	stream_t* file = stream_open(STRING_ARGS(path), STREAM_OUT | STREAM_BINARY | STREAM_CREATE | STREAM_TRUNCATE);
+	EXPECT_NE(file, 0);
+	EXPECT_TRUE(image_save(&source, file, IMAGE_FILE_FORMAT_NATIVE, 0));
+	stream_deallocate(file);
+
+	atomic32_t completed;
+	atomic_store32(&completed, 0, memory_order_release);
+
+	image_t image[16];
+	image_async_t* async[16];
+	for (unsigned int iload = 0; iload < 16; ++iload) {
+		image_initialize(&image[iload]);
+		if (iload % 2) {
+			stream_t* stream = stream_open(STRING_ARGS(path), STREAM_IN | STREAM_BINARY);
+			async[iload] = image_load_async_stream(&image[iload], stream, IMAGE_LOAD_ADOPT_STREAM,
+			                                       test_image_async_callback, &completed);
+		} else {
+			async[iload] = image_load_async(&image[iload], STRING_ARGS(path), (iload % 4) ? IMAGE_LOAD_MAPPED : 0,
+			                                test_image_async_callback, &completed);
+		}
+		EXPECT_NE(async[iload], 0);
+	}
+
+	for (unsigned int iload = 0; iload < 16; ++iload) {
+		EXPECT_TRUE(image_async_wait(async[iload], 0));
+		EXPECT_TRUE(image_async_wait(async[iload], 1000));
+		EXPECT_EQ(image_async_status(async[iload]), IMAGE_ASYNC_COMPLETE);
+		EXPECT_FALSE(image_async_cancel(async[iload]));
+		EXPECT_EQ(image[iload].width, source.width);
+		EXPECT_EQ(memcmp(image[iload].data, source.data, data_size), 0);
+		image_async_release(async[iload]);
+		image_finalize(&image[iload]);
+	}
+	EXPECT_EQ(atomic_load32(&completed, memory_order_acquire), 16);
+
+	image_t missing;
+	image_initialize(&missing);
+	image_async_t* failed = image_load_async(&missing, STRING_CONST("/nonexisting/image.png"), 0, 0, 0);
+	EXPECT_TRUE(image_async_wait(failed, 0));
+	EXPECT_EQ(image_async_status(failed), IMAGE_ASYNC_FAILED);
+	image_async_release(failed);
+
+	// Loads rejected while the module is not initialized release the cloned path and
+	// an adopted stream instead of leaking them
+	image_config_t config = image_module_config();
+	image_module_finalize();
+#if BUILD_ENABLE_MEMORY_STATISTICS
+	memory_statistics_t before = memory_statistics();
+#endif
+	EXPECT_EQ(image_load_async(&missing, STRING_ARGS(path), 0, 0, 0), 0);
+	stream_t* stream = stream_open(STRING_ARGS(path), STREAM_IN | STREAM_BINARY);
+	EXPECT_NE(stream, 0);
+	EXPECT_EQ(image_load_async_stream(&missing, stream, IMAGE_LOAD_ADOPT_STREAM, 0, 0), 0);
+#if BUILD_ENABLE_MEMORY_STATISTICS
+	memory_statistics_t after = memory_statistics();
+	EXPECT_EQ(after.allocations_current, before.allocations_current);
+#endif
+	EXPECT_EQ(image_module_initialize(config), 0);
+
+	fs_remove_file(STRING_ARGS(path));
+	string_deallocate(path.str);
+	image_finalize(&source);
+
+	return 0;
+}
+
+DECLARE_TEST(image, batch) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	string_const_t tmp_path = environment_temporary_directory();
+	string_t path[33];
+	string_const_t path_const[33];
+	image_t image[33];
+	image_batch_result_t result[33];
+	for (unsigned int ifile = 0; ifile < 32; ++ifile) {
+		char name[64];
+		string_t filename = string_format(name, sizeof(name), STRING_CONST("image_batch_test_%u.bin"), ifile);
+		path[ifile] = path_allocate_concat(STRING_ARGS(tmp_path), STRING_ARGS(filename));
+		path_const[ifile] = string_to_const(path[ifile]);
+
+		// Mix a few large images with many small ones
+		image_t source;
+		image_initialize(&source);
+		unsigned int dim = (ifile % 8) ? 16 + ifile : 512;
+		image_allocate_storage(&source, &format, dim, dim, 1, 1);
+		memset(source.data, (int)ifile, image_buffer_size(&format, dim, dim, 1, 1));
+		stream_t* file =
+		    stream_open(STRING_ARGS(path[ifile]), STREAM_OUT | STREAM_BINARY | STREAM_CREATE | STREAM_TRUNCATE);
+		EXPECT_NE(file, 0);
+		EXPECT_TRUE(image_save(&source, file, IMAGE_FILE_FORMAT_NATIVE, 0));
+		stream_deallocate(file);
+		image_finalize(&source);
+	}
+	path[32] = path_allocate_concat(STRING_ARGS(tmp_path), STRING_CONST("image_batch_test_missing.bin"));
+	path_const[32] = string_to_const(path[32]);
+
+	// Plain, mapped and mapped with a convert stage to float channels
+	static const unsigned int batch_flags[3] = {0, IMAGE_LOAD_MAPPED, IMAGE_LOAD_MAPPED | IMAGE_LOAD_CONVERT_FLOAT32};
+	for (unsigned int iflags = 0; iflags < 3; ++iflags) {
+		for (unsigned int ifile = 0; ifile < 33; ++ifile)
+			image_initialize(&image[ifile]);
+
+		image_batch_statistics_t statistics;
+		size_t loaded = image_load_batch(path_const, image, 33, batch_flags[iflags], result, &statistics);
+		EXPECT_EQ(loaded, 32);
+		EXPECT_EQ(statistics.loaded, 32);
+		EXPECT_EQ(statistics.failed, 1);
+		EXPECT_GE(statistics.threads, 1);
+		EXPECT_FALSE(result[32].success);
+
+		for (unsigned int ifile = 0; ifile < 32; ++ifile) {
+			unsigned int dim = (ifile % 8) ? 16 + ifile : 512;
+			EXPECT_TRUE(result[ifile].success);
+			EXPECT_GT(result[ifile].size, 0);
+			EXPECT_EQ(image[ifile].width, dim);
+			if (batch_flags[iflags] & IMAGE_LOAD_CONVERT_FLOAT32) {
+				// Converted images are copied out of the mapping
+				const float32_t* value = (const float32_t*)image[ifile].data;
+				EXPECT_EQ(image[ifile].format.channel[0].data_type, IMAGE_DATATYPE_FLOAT);
+				EXPECT_LT(math_abs(value[dim * dim * 4 - 1] - (float32_t)ifile / 255.0f), 0.00001f);
+				EXPECT_EQ(image[ifile].mapping, 0);
+			} else {
+				EXPECT_EQ(image[ifile].data[dim * dim * 4 - 1], ifile);
+				EXPECT_EQ((image[ifile].mapping != 0), (iflags != 0));
+			}
+		}
+		for (unsigned int ifile = 0; ifile < 33; ++ifile)
+			image_finalize(&image[ifile]);
+	}
+
+	EXPECT_EQ(image_load_batch(path_const, image, 0, 0, 0, 0), 0);
+
+	for (unsigned int ifile = 0; ifile < 33; ++ifile) {
+		fs_remove_file(STRING_ARGS(path[ifile]));
+		string_deallocate(path[ifile].str);
+	}
+
+	return 0;
+}
+
+typedef struct test_image_stress_t test_image_stress_t;
+
+struct test_image_stress_t {
+	void* buffer;
+	size_t size;
+	unsigned int iterations;
+	unsigned int width;
+	unsigned int loaded;
+};
+
+static void*
+test_image_stress_thread(void* arg) {
+	test_image_stress_t* stress = arg;
+	stream_t* stream =
+	    buffer_stream_allocate(stress->buffer, STREAM_IN | STREAM_BINARY, stress->size, stress->size, false, false);
+	image_t image;
+	image_initialize(&image);
+	for (unsigned int iload = 0; iload < stress->iterations; ++iload) {
+		stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+		if (image_load(&image, stream) && (image.width == stress->width))
+			++stress->loaded;
+	}
+	image_finalize(&image);
+	stream_deallocate(stream);
+	return 0;
+}
+
+typedef struct test_image_module_race_t test_image_module_race_t;
+
+struct test_image_module_race_t {
+	image_config_t config;
+	unsigned int iterations;
+};
+
+static void*
+test_image_module_race_thread(void* arg) {
+	test_image_module_race_t* race = arg;
+	for (unsigned int iloop = 0; iloop < race->iterations; ++iloop) {
+		image_module_initialize(race->config);
+		image_module_is_initialized();
+		image_module_finalize();
+	}
+	return 0;
+}
+
+static tick_t
+test_image_stress_run(test_image_stress_t* stress, size_t thread_count) {
+	thread_t thread[16];
+	tick_t start = time_current();
+	for (size_t ithread = 0; ithread < thread_count; ++ithread) {
+		thread_initialize(&thread[ithread], test_image_stress_thread, stress + ithread, STRING_CONST("image_stress"),
+		                  THREAD_PRIORITY_NORMAL, 0);
+		thread_start(&thread[ithread]);
+	}
+	for (size_t ithread = 0; ithread < thread_count; ++ithread) {
+		thread_join(&thread[ithread]);
+		thread_finalize(&thread[ithread]);
+	}
+	return time_diff(start, time_current());
+}
+
+DECLARE_TEST(image, stress) {
+	EXPECT_TRUE(image_module_is_initialized());
+	EXPECT_EQ(image_module_initialize(image_module_config()), 0);
+
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 256, 256, 1, 1);
+	for (size_t ibyte = 0; ibyte < 256 * 256 * 4; ++ibyte)
+		source.data[ibyte] = (unsigned char)((ibyte * 31) ^ (ibyte >> 9));
+
+	// Concurrent loads decode PNG through FreeImage
+	stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_PNG, 0));
+	image_t probe;
+	image_initialize(&probe);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_TRUE(image_load(&probe, stream));
+	EXPECT_EQ(probe.width, source.width);
+	image_finalize(&probe);
+
+	size_t size = stream_tell(stream);
+	void* buffer = memory_allocate(HASH_IMAGE, size, 0, MEMORY_PERSISTENT);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_EQ(stream_read(stream, buffer, size), size);
+	stream_deallocate(stream);
+
+	// Always run concurrent loads, scaling is only checked with enough hardware threads
+	size_t hardware_threads = system_hardware_threads();
+	size_t thread_count = hardware_threads;
+	if (thread_count > 16)
+		thread_count = 16;
+	if (thread_count < 2)
+		thread_count = 2;
+
+	test_image_stress_t stress[16];
+	for (size_t ithread = 0; ithread < thread_count; ++ithread) {
+		stress[ithread].buffer = buffer;
+		stress[ithread].size = size;
+		stress[ithread].iterations = 32;
+		stress[ithread].width = source.width;
+		stress[ithread].loaded = 0;
+	}
+
+	// Each thread performs the same number of loads, so perfect scaling keeps the time constant
+	tick_t single_time = test_image_stress_run(stress, 1);
+	tick_t multi_time = test_image_stress_run(stress, thread_count);
+	EXPECT_EQ(stress[0].loaded, 64);
+	for (size_t ithread = 1; ithread < thread_count; ++ithread)
+		EXPECT_EQ(stress[ithread].loaded, 32);
+
+	double speedup = multi_time ? ((double)single_time * (double)thread_count) / (double)multi_time : 0;
+	log_infof(HASH_IMAGE, STRING_CONST("Concurrent load scaling: %.2fx speedup on %u threads (%.1f%% efficiency)"),
+	          speedup, (unsigned int)thread_count, (speedup * 100.0) / (double)thread_count);
+	// With a hardware thread per loading thread, loads must run concurrently for at least
+	// half the ideal speedup. With fewer cores the result is left to the scheduler and only logged
+	if (hardware_threads >= 4)
+		EXPECT_TRUE(speedup >= 0.5 * (double)thread_count);
+
+	memory_deallocate(buffer);
+	image_finalize(&source);
+
+	// Racing module initialization and finalization must leave the module in a consistent
+	// state, with no double finalization or leaked resources
+	image_config_t config = image_module_config();
+	test_image_module_race_t race;
+	race.config = config;
+	race.iterations = 64;
+	thread_t thread[16];
+	for (size_t ithread = 0; ithread < thread_count; ++ithread) {
+		thread_initialize(&thread[ithread], test_image_module_race_thread, &race, STRING_CONST("image_race"),
+		                  THREAD_PRIORITY_NORMAL, 0);
+		thread_start(&thread[ithread]);
+	}
+	for (size_t ithread = 0; ithread < thread_count; ++ithread) {
+		thread_join(&thread[ithread]);
+		thread_finalize(&thread[ithread]);
+	}
+	image_module_finalize();
+	EXPECT_FALSE(image_module_is_initialized());
+	EXPECT_EQ(image_module_initialize(config), 0);
+	EXPECT_TRUE(image_module_is_initialized());
+
+	// The module is fully functional again after the race
+	image_t restored;
+	image_initialize(&restored);
+	image_async_t* async = image_load_async_stream(
+	    &restored, buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true),
+	    IMAGE_LOAD_ADOPT_STREAM, 0, 0);
+	EXPECT_NE(async, 0);
+	EXPECT_TRUE(image_async_wait(async, 0));
+	EXPECT_EQ(image_async_status(async), IMAGE_ASYNC_FAILED);
+	image_async_release(async);
+	image_finalize(&restored);
+
+	return 0;
+}
+
+DECLARE_TEST(image, cache) {
+	// Restart module with a cache budget that fits three images
+	image_config_t config = image_module_config();
+	image_config_t cache_config = config;
+	cache_config.cache_budget = 3 * (64 * 64 * 4 + 1024);
+	image_module_finalize();
+	EXPECT_EQ(image_module_initialize(cache_config), 0);
+
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	stream_t* stream[4];
+	for (unsigned int istream = 0; istream < 4; ++istream) {
+		image_t source;
+		image_initialize(&source);
+		image_allocate_storage(&source, &format, 64, 64, 1, 1);
+		memset(source.data, (int)istream + 1, 64 * 64 * 4);
+		stream[istream] = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+		EXPECT_TRUE(image_save(&source, stream[istream], IMAGE_FILE_FORMAT_NATIVE, 0));
+		image_finalize(&source);
+	}
+
+	stream_seek(stream[0], 0, STREAM_SEEK_BEGIN);
+	image_t* first = image_cache_load_stream(stream[0]);
+	stream_seek(stream[0], 0, STREAM_SEEK_BEGIN);
+	image_t* second = image_cache_load_stream(stream[0]);
+	EXPECT_NE(first, 0);
+	EXPECT_EQ(first, second);
+	EXPECT_EQ(first->data[0], 1);
+
+	image_cache_statistics_t statistics;
+	image_cache_statistics(&statistics);
+	EXPECT_EQ(statistics.hits, 1);
+	EXPECT_EQ(statistics.misses, 1);
+	EXPECT_EQ(statistics.count, 1);
+	image_cache_release(second);
+
+	// Loading three more images evicts the least recently used one, which stays valid while referenced
+	for (unsigned int istream = 1; istream < 4; ++istream) {
+		stream_seek(stream[istream], 0, STREAM_SEEK_BEGIN);
+		image_t* image = image_cache_load_stream(stream[istream]);
+		EXPECT_NE(image, 0);
+		EXPECT_EQ(image->data[100], istream + 1);
+		image_cache_release(image);
+	}
+	image_cache_statistics(&statistics);
+	EXPECT_EQ(statistics.evictions, 1);
+	EXPECT_EQ(statistics.count, 3);
+	EXPECT_LE(statistics.size, statistics.budget);
+	EXPECT_EQ(first->data[64 * 64 * 4 - 1], 1);
+
+	stream_seek(stream[0], 0, STREAM_SEEK_BEGIN);
+	second = image_cache_load_stream(stream[0]);
+	EXPECT_NE(second, first);
+	EXPECT_EQ(memcmp(first->data, second->data, 64 * 64 * 4), 0);
+	image_cache_release(second);
+	image_cache_release(first);
+
+	string_const_t tmp_path = environment_temporary_directory();
+	string_t path = path_allocate_concat(STRING_ARGS(tmp_path), STRING_CONST("image_cache_test.bin"));
+	stream_t* file = stream_open(STRING_ARGS(path), STREAM_OUT | STREAM_BINARY | STREAM_CREATE | STREAM_TRUNCATE);
+	EXPECT_NE(file, 0);
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 64, 64, 1, 1);
+	memset(source.data, 3, 64 * 64 * 4);
+	EXPECT_TRUE(image_save(&source, file, IMAGE_FILE_FORMAT_NATIVE, 0));
+	image_finalize(&source);
+	stream_deallocate(file);
+
+	first = image_cache_load(STRING_ARGS(path));
+	second = image_cache_retain(image_cache_load(STRING_ARGS(path)));
+	EXPECT_NE(first, 0);
+	EXPECT_EQ(first, second);
+	image_cache_clear();
+	image_cache_statistics(&statistics);
+	EXPECT_EQ(statistics.count, 0);
+	EXPECT_EQ(statistics.size, 0);
+	EXPECT_EQ(second->data[0], 3);
+	image_cache_release(first);
+	image_cache_release(second);
+	image_cache_release(second);
+
+	fs_remove_file(STRING_ARGS(path));
+	string_deallocate(path.str);
+	for (unsigned int istream = 0; istream < 4; ++istream)
+		stream_deallocate(stream[istream]);
+
+	image_module_finalize();
+	EXPECT_EQ(image_module_initialize(config), 0);
+
+	return 0;
+}
+
+static bool
+test_image_derive(image_t* result, const image_t* source, const image_derived_params_t* params, void* userdata) {
+	image_allocate_storage(result, &params->format, source->width, source->height, 1, 1);
+	size_t size = image_buffer_size(&params->format, source->width, source->height, 1, 1);
+	for (size_t ibyte = 0; ibyte < size; ++ibyte)
+		result->data[ibyte] = (unsigned char)(255 - source->data[ibyte] + params->quality);
+	atomic_incr32(userdata, memory_order_relaxed);
+	return true;
+}
+
+DECLARE_TEST(image, derived) {
+	image_config_t config = image_module_config();
+	string_const_t tmp_path = environment_temporary_directory();
+	string_t cache_path = path_allocate_concat(STRING_ARGS(tmp_path), STRING_CONST("image_derived_test"));
+	fs_remove_directory(STRING_ARGS(cache_path));
+
+	// Restart module with a disk budget that fits two entries
+	image_config_t derived_config = config;
+	derived_config.derived_cache_path = string_to_const(cache_path);
+	derived_config.derived_cache_budget = 2 * (4096 + 16 * 16 * 4) + 1024;
+	image_module_finalize();
+	EXPECT_EQ(image_module_initialize(derived_config), 0);
+
+	image_derived_params_t params;
+	memset(&params, 0, sizeof(params));
+	params.operation = HASH_IMAGE;
+	image_pixelformat_initialize(&params.format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &params.format, 16, 16, 1, 1);
+	for (size_t ibyte = 0; ibyte < 16 * 16 * 4; ++ibyte)
+		source.data[ibyte] = (unsigned char)ibyte;
+	stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_NATIVE, 0));
+
+	size_t size = stream_tell(stream);
+	void* buffer = memory_allocate(HASH_IMAGE, size, 0, MEMORY_PERSISTENT);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_EQ(stream_read(stream, buffer, size), size);
+
+	atomic32_t computed;
+	atomic_store32(&computed, 0, memory_order_release);
+	hash_t key[3];
+	for (unsigned int iquality = 0; iquality < 3; ++iquality) {
+		params.quality = iquality;
+		key[iquality] = image_derived_key(buffer, size, &params);
+		for (unsigned int ipass = 0; ipass < 2; ++ipass) {
+			image_t result;
+			image_initialize(&result);
+			stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+			EXPECT_TRUE(image_derived_process(&result, stream, &params, test_image_derive, &computed));
+			EXPECT_EQ(atomic_load32(&computed, memory_order_acquire), (int32_t)iquality + 1);
+			EXPECT_EQ(result.width, source.width);
+			EXPECT_EQ(result.data[1], (unsigned char)(254 + iquality));
+			// Second pass is served from the cache file
+			EXPECT_EQ((result.mapping != 0), (ipass != 0));
+			image_finalize(&result);
+		}
+		thread_sleep(20);
+	}
+	EXPECT_NE(key[0], key[1]);
+
+	// Disk budget only fits two of the three entries
+	unsigned int found = 0;
+	for (unsigned int iquality = 0; iquality < 3; ++iquality) {
+		image_t result;
+		image_initialize(&result);
+		if (image_derived_lookup(&result, key[iquality]))
+			++found;
+		image_finalize(&result);
+	}
+	EXPECT_EQ(found, 2);
+
+	memory_deallocate(buffer);
+	stream_deallocate(stream);
+	image_finalize(&source);
+
+	image_module_finalize();
+	EXPECT_EQ(image_module_initialize(config), 0);
+	fs_remove_directory(STRING_ARGS(cache_path));
+	string_deallocate(cache_path.str);
+
+	return 0;
+}
+
+DECLARE_TEST(image, metrics) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 64, 32, 1, 2);
+	size_t data_size = image_buffer_size(&format, 64, 32, 1, 2);
+	memset(source.data, 0x5A, data_size);
+	stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_NATIVE, 0));
+
+	image_load_statistics_reset();
+	for (unsigned int iload = 0; iload < 4; ++iload) {
+		image_t loaded;
+		image_initialize(&loaded);
+		stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+		EXPECT_TRUE(image_load(&loaded, stream));
+		image_finalize(&loaded);
+	}
+
+	image_load_statistics_t statistics;
+	image_load_statistics(IMAGE_LOAD_FORMAT_NATIVE, &statistics);
+	EXPECT_EQ(statistics.loads, 4);
+	EXPECT_EQ(statistics.failures, 0);
+	EXPECT_EQ(statistics.pixels, 4 * (64 * 32 + 32 * 16));
+	EXPECT_GE(statistics.bytes_read, 4 * data_size);
+	EXPECT_GE(statistics.read_calls, 4 * 3);
+	uint64_t stage_ns = 0;
+	for (int istage = 0; istage < IMAGE_LOAD_STAGE_COUNT; ++istage)
+		stage_ns += statistics.stage_ns[istage];
+	EXPECT_GE(statistics.total_ns, stage_ns);
+	EXPECT_EQ(statistics.stage_ns[IMAGE_LOAD_STAGE_DECODE], 0);
+
+	// Unrecognized data is counted as a failure of unknown format
+	image_t loaded;
+	image_initialize(&loaded);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_write(stream, "JUNK", 4);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_FALSE(image_load(&loaded, stream));
+	image_finalize(&loaded);
+
+	image_load_statistics(IMAGE_LOAD_FORMAT_UNKNOWN, &statistics);
+	EXPECT_EQ(statistics.loads, 0);
+	EXPECT_EQ(statistics.failures, 1);
+	image_load_statistics(IMAGE_LOAD_FORMAT_COUNT, &statistics);
+	EXPECT_EQ(statistics.loads, 4);
+	EXPECT_EQ(statistics.failures, 1);
+	EXPECT_CONSTSTRINGEQ(image_load_format_name(IMAGE_LOAD_FORMAT_NATIVE), string_const(STRING_CONST("native")));
+
+	image_load_statistics_reset();
+	image_load_statistics(IMAGE_LOAD_FORMAT_COUNT, &statistics);
+	EXPECT_EQ(statistics.loads + statistics.failures + statistics.bytes_read, 0);
+
+	stream_deallocate(stream);
+	image_finalize(&source);
+
+	return 0;
+}
+
+DECLARE_TEST(image, storage) {
+	image_storage_statistics_t before;
+	image_storage_statistics_t statistics;
+	image_storage_statistics(&before);
+	image_storage_reset_peak();
+
+	image_pixelformat_t format_rgba8;
+	image_pixelformat_t format_float;
+	image_pixelformat_t format_bc1;
+	image_pixelformat_initialize(&format_rgba8, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+	image_pixelformat_initialize(&format_float, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+	memset(&format_bc1, 0, sizeof(format_bc1));
+	format_bc1.compression = IMAGE_COMPRESSION_BC1;
+	format_bc1.channels_count = 3;
+	format_bc1.block_width = 4;
+	format_bc1.block_height = 4;
+	format_bc1.block_depth = 1;
+	format_bc1.bits_per_block = 64;
+
+	image_t image[3];
+	for (unsigned int iimage = 0; iimage < 3; ++iimage)
+		image_initialize(&image[iimage]);
+	image_allocate_storage(&image[0], &format_rgba8, 64, 64, 1, 1);
+	image_allocate_storage(&image[1], &format_float, 32, 32, 1, 1);
+	image_allocate_storage(&image[2], &format_bc1, 64, 64, 1, 1);
+	size_t size_rgba8 = 64 * 64 * 4;
+	size_t size_float = 32 * 32 * 16;
+	size_t size_bc1 = 16 * 16 * 8;
+
+	image_storage_statistics(&statistics);
+	EXPECT_EQ(statistics.total.live - before.total.live, size_rgba8 + size_float + size_bc1);
+	EXPECT_EQ(statistics.total.count - before.total.count, 3);
+	EXPECT_EQ(image_storage_live(), statistics.total.live);
+	EXPECT_EQ(statistics.compression[IMAGE_COMPRESSION_BC1].live - before.compression[IMAGE_COMPRESSION_BC1].live,
+	          size_bc1);
+	EXPECT_EQ(statistics.datatype[IMAGE_DATATYPE_FLOAT].live - before.datatype[IMAGE_DATATYPE_FLOAT].live,
+	          size_float);
+	EXPECT_EQ(statistics.bitdepth[IMAGE_STORAGE_BITDEPTH_8].live - before.bitdepth[IMAGE_STORAGE_BITDEPTH_8].live,
+	          size_rgba8);
+	EXPECT_EQ(statistics.bitdepth[IMAGE_STORAGE_BITDEPTH_32].live - before.bitdepth[IMAGE_STORAGE_BITDEPTH_32].live,
+	          size_float);
+	EXPECT_GE(statistics.total.peak, statistics.total.live);
+
+	// Reallocating storage releases the previous allocation
+	image_allocate_storage(&image[0], &format_rgba8, 16, 16, 1, 1);
+	for (unsigned int iimage = 1; iimage < 3; ++iimage)
+		image_finalize(&image[iimage]);
+	image_storage_statistics(&statistics);
+	EXPECT_EQ(statistics.total.live - before.total.live, 16 * 16 * 4);
+	EXPECT_EQ(statistics.total.count - before.total.count, 1);
+	EXPECT_GE(statistics.total.peak, before.total.live + size_rgba8 + size_float + size_bc1);
+	EXPECT_EQ(statistics.compression[IMAGE_COMPRESSION_BC1].live, before.compression[IMAGE_COMPRESSION_BC1].live);
+
+	image_finalize(&image[0]);
+	image_storage_reset_peak();
+	image_storage_statistics(&statistics);
+	EXPECT_EQ(statistics.total.live, before.total.live);
+	EXPECT_EQ(statistics.total.peak, statistics.total.live);
+
+	return 0;
+}
+
+static void*
+test_image_trace_thread(void* arg) {
+	FOUNDATION_UNUSED(arg);
+	// Exits without releasing its ring buffer
+	image_trace_begin(IMAGE_TRACE_CONVERT);
+	image_trace_end(IMAGE_TRACE_CONVERT);
+	return 0;
+}
+
+DECLARE_TEST(image, trace) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 64, 64, 1, 1);
+	memset(source.data, 0x3C, image_buffer_size(&format, 64, 64, 1, 1));
+	stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_NATIVE, 0));
+
+	// Discard events recorded by earlier tests
+	stream_t* trace = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	image_trace_flush(trace);
+	stream_truncate(trace, 0);
+	stream_seek(trace, 0, STREAM_SEEK_BEGIN);
+
+	image_trace_enable(true);
+	EXPECT_TRUE(image_trace_is_enabled());
+	image_t loaded;
+	image_initialize(&loaded);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_TRUE(image_load(&loaded, stream));
+	EXPECT_TRUE(image_convert_channels(&loaded, IMAGE_DATATYPE_FLOAT, 32));
+	image_finalize(&loaded);
+	image_trace_enable(false);
+	EXPECT_FALSE(image_trace_is_enabled());
+
+	// Load, probe, allocate, repack and convert stages each record a begin and end event
+	EXPECT_GE(image_trace_flush(trace), 10);
+	EXPECT_EQ(image_trace_dropped(), 0);
+	size_t size = (size_t)stream_tell(trace);
+	EXPECT_GT(size, 0);
+	char* json = memory_allocate(HASH_IMAGE, size, 0, MEMORY_PERSISTENT);
+	stream_seek(trace, 0, STREAM_SEEK_BEGIN);
+	stream_read(trace, json, size);
+	EXPECT_NE(string_find_string(json, size, STRING_CONST("\"traceEvents\""), 0), STRING_NPOS);
+	EXPECT_NE(string_find_string(json, size, STRING_CONST("\"name\":\"repack\""), 0), STRING_NPOS);
+	EXPECT_NE(string_find_string(json, size, STRING_CONST("\"name\":\"convert\""), 0), STRING_NPOS);
+	memory_deallocate(json);
+
+	// Flushed events are removed from the ring buffers
+	stream_truncate(trace, 0);
+	stream_seek(trace, 0, STREAM_SEEK_BEGIN);
+	EXPECT_EQ(image_trace_flush(trace), 0);
+
+	// Overflowing the ring buffer drops events in pairs and keeps the space for the end
+	// event of the enclosing stage
+	image_trace_enable(true);
+	image_trace_begin(IMAGE_TRACE_LOAD);
+	for (unsigned int ievent = 0; ievent < 8192; ++ievent) {
+		image_trace_begin(IMAGE_TRACE_CONVERT);
+		image_trace_end(IMAGE_TRACE_CONVERT);
+	}
+	image_trace_end(IMAGE_TRACE_LOAD);
+	image_trace_enable(false);
+	size_t recorded = image_trace_flush(trace);
+	EXPECT_GT(recorded, 0);
+	EXPECT_EQ(recorded % 2, 0);
+	EXPECT_EQ(image_trace_dropped(), 2 * 8192 + 2 - recorded);
+	size = (size_t)stream_tell(trace);
+	json = memory_allocate(HASH_IMAGE, size, 0, MEMORY_PERSISTENT);
+	stream_seek(trace, 0, STREAM_SEEK_BEGIN);
+	stream_read(trace, json, size);
+	EXPECT_NE(string_find_string(json, size, STRING_CONST("\"name\":\"load\",\"cat\":\"image\",\"ph\":\"E\""), 0),
+	          STRING_NPOS);
+	memory_deallocate(json);
+	stream_truncate(trace, 0);
+	stream_seek(trace, 0, STREAM_SEEK_BEGIN);
+
+	// Ring buffers of threads exiting without releasing them are reclaimed, more threads
+	// than there are ring buffers all get their events recorded
+	size_t dropped = image_trace_dropped();
+	image_trace_enable(true);
+	for (unsigned int ithread = 0; ithread < 300; ++ithread) {
+		thread_t thread;
+		thread_initialize(&thread, test_image_trace_thread, 0, STRING_CONST("image_trace"), THREAD_PRIORITY_NORMAL,
+		                  0);
+		thread_start(&thread);
+		thread_join(&thread);
+		thread_finalize(&thread);
+	}
+	image_trace_enable(false);
+	EXPECT_EQ(image_trace_flush(trace), 600);
+	EXPECT_EQ(image_trace_dropped(), dropped);
+
+	stream_deallocate(trace);
+	stream_deallocate(stream);
+	image_finalize(&source);
+
+	return 0;
+}
+
+DECLARE_TEST(image, loadevent) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 48, 24, 1, 1);
+	memset(source.data, 0x11, image_buffer_size(&format, 48, 24, 1, 1));
+	stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_TRUE(image_save(&source, stream, IMAGE_FILE_FORMAT_NATIVE, 0));
+	size_t native_size = (size_t)stream_tell(stream);
+
+	// Discard events recorded by earlier tests
+	image_load_event_t events[4];
+	while (image_load_event_drain(events, 4))
+		;
+
+	image_t loaded;
+	image_initialize(&loaded);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_TRUE(image_load(&loaded, stream));
+	image_finalize(&loaded);
+
+	// Truncated native data is reported with a truncated status
+	stream_truncate(stream, native_size - 16);
+	image_initialize(&loaded);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_FALSE(image_load(&loaded, stream));
+	image_finalize(&loaded);
+
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_write(stream, "JUNK", 4);
+	image_initialize(&loaded);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_FALSE(image_load(&loaded, stream));
+	image_finalize(&loaded);
+
+#if IMAGE_ENABLE_LOAD_EVENTS
+	EXPECT_EQ(image_load_event_drain(events, 4), 3);
+	EXPECT_EQ(events[0].format, IMAGE_LOAD_FORMAT_NATIVE);
+	EXPECT_EQ(events[0].status, IMAGE_LOAD_STATUS_OK);
+	EXPECT_EQ(events[0].width, 48);
+	EXPECT_EQ(events[0].height, 24);
+	EXPECT_EQ(events[0].levels, 1);
+	EXPECT_GE(events[0].bytes_read, 48 * 24 * 4);
+	EXPECT_EQ(events[1].format, IMAGE_LOAD_FORMAT_NATIVE);
+	EXPECT_EQ(events[1].status, IMAGE_LOAD_STATUS_TRUNCATED);
+	EXPECT_EQ(events[1].width, 0);
+	EXPECT_EQ(events[2].format, IMAGE_LOAD_FORMAT_UNKNOWN);
+	EXPECT_EQ(events[2].status, IMAGE_LOAD_STATUS_UNRECOGNIZED);
+	EXPECT_EQ(image_load_event_drain(events, 4), 0);
+
+	// Events are formatted only when written
+	image_initialize(&loaded);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_FALSE(image_load(&loaded, stream));
+	image_finalize(&loaded);
+	stream_t* output = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	EXPECT_EQ(image_load_event_write(output), 1);
+	size_t size = (size_t)stream_tell(output);
+	char* text = memory_allocate(HASH_IMAGE, size, 0, MEMORY_PERSISTENT);
+	stream_seek(output, 0, STREAM_SEEK_BEGIN);
+	stream_read(output, text, size);
+	EXPECT_TRUE(string_equal(text, 20, STRING_CONST("unknown unrecognized")));
+	memory_deallocate(text);
+	stream_deallocate(output);
+#else
+	EXPECT_EQ(image_load_event_drain(events, 4), 0);
+#endif
+	EXPECT_EQ(image_load_event_dropped(), 0);
+	EXPECT_CONSTSTRINGEQ(image_load_status_name(IMAGE_LOAD_STATUS_TRUNCATED), string_const(STRING_CONST("truncated")));
+
+	stream_deallocate(stream);
+	image_finalize(&source);
+
+	return 0;
+}
+
+DECLARE_TEST(image, statistics) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 3, IMAGE_COLORSPACE_LINEAR);
+
+	image_t image;
+	image_initialize(&image);
+	image_allocate_storage(&image, &format, 16, 8, 1, 1);
+	for (unsigned int y = 0; y < 8; ++y) {
+		for (unsigned int x = 0; x < 16; ++x) {
+			uint8_t* pixel = image.data + (y * 16 + x) * 3;
+			pixel[0] = (uint8_t)(x * 17);
+			pixel[1] = 51;
+			pixel[2] = (uint8_t)y;
+		}
+	}
+
+	image_statistics_t statistics;
+	image_statistics_initialize(&statistics, 0, 0, 0);
+	EXPECT_EQ(statistics.bins, 256);
+	EXPECT_TRUE(image_statistics(&image, 0, &statistics));
+	EXPECT_EQ(statistics.pixels, 16 * 8);
+	EXPECT_REALEQ((real)statistics.min[0], 0);
+	EXPECT_REALEQ((real)statistics.max[0], 1);
+	EXPECT_REALEQ((real)(statistics.sum[1] / 128.0), (real)0.2);
+	EXPECT_REALEQ((real)statistics.max[2], (real)(7.0 / 255.0));
+	// Missing alpha channel reads as one
+	EXPECT_REALEQ((real)statistics.min[3], 1);
+	EXPECT_REALEQ((real)statistics.sum[3], 128);
+	EXPECT_EQ(statistics.nan[0], 0);
+	uint64_t total = 0;
+	for (unsigned int ibin = 0; ibin < statistics.bins; ++ibin)
+		total += statistics.histogram[ibin];
+	EXPECT_EQ(total, 16 * 8);
+	EXPECT_EQ(statistics.histogram[0], 8);
+	EXPECT_EQ(statistics.histogram[255], 8);
+	EXPECT_EQ(statistics.histogram[256 + 51], 128);
+	EXPECT_EQ(statistics.histogram[3 * 256 + 255], 128);
+
+	// Same data converted through float gives the same results
+	image_t converted;
+	image_pixelformat_t format_float;
+	image_pixelformat_initialize(&format_float, IMAGE_DATATYPE_FLOAT, 32, 3, IMAGE_COLORSPACE_LINEAR);
+	image_initialize(&converted);
+	image_allocate_storage(&converted, &format_float, 16, 8, 1, 1);
+	float32_t rgba[16 * 8 * 4];
+	image_pixel_read(&format, image.data, 16 * 8, rgba);
+	image_pixel_write(&format_float, converted.data, 16 * 8, rgba);
+	image_statistics_t statistics_float;
+	image_statistics_initialize(&statistics_float, 0, 0, 0);
+	EXPECT_TRUE(image_statistics(&converted, 0, &statistics_float));
+	for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+		EXPECT_REALEQ((real)statistics_float.sum[ichannel], (real)statistics.sum[ichannel]);
+		EXPECT_REALEQ((real)statistics_float.sum_squares[ichannel], (real)statistics.sum_squares[ichannel]);
+	}
+	EXPECT_EQ(memcmp(statistics_float.histogram, statistics.histogram, sizeof(uint64_t) * 4 * 256), 0);
+	image_statistics_finalize(&statistics_float);
+	image_finalize(&converted);
+	image_statistics_finalize(&statistics);
+
+	// Float data with NaN and infinity, histogram over [-1,1]
+	image_pixelformat_initialize(&format_float, IMAGE_DATATYPE_FLOAT, 32, 1, IMAGE_COLORSPACE_LINEAR);
+	image_allocate_storage(&image, &format_float, 8, 4, 1, 1);
+	float32_t* value = (float32_t*)image.data;
+	for (unsigned int ivalue = 0; ivalue < 32; ++ivalue)
+		value[ivalue] = -1.0f + (float32_t)ivalue / 16.0f;
+	const uint32_t nan_bits = 0x7FC00000;
+	const uint32_t inf_bits = 0x7F800000;
+	memcpy(value + 5, &nan_bits, sizeof(nan_bits));
+	memcpy(value + 9, &inf_bits, sizeof(inf_bits));
+	value[31] = 4.0f;
+
+	image_statistics_initialize(&statistics, 4, -1, 1);
+	EXPECT_TRUE(image_statistics(&image, 0, &statistics));
+	EXPECT_EQ(statistics.nan[0], 1);
+	EXPECT_EQ(statistics.inf[0], 1);
+	EXPECT_REALEQ((real)statistics.min[0], -1);
+	EXPECT_REALEQ((real)statistics.max[0], 4);
+	EXPECT_EQ(statistics.histogram[0] + statistics.histogram[1] + statistics.histogram[2] + statistics.histogram[3],
+	          30);
+	// Values above the range are counted in the last bin
+	EXPECT_EQ(statistics.histogram[3], 8);
+	EXPECT_EQ(statistics.nan[3], 0);
+	EXPECT_REALEQ((real)statistics.sum[3], 32);
+	image_statistics_finalize(&statistics);
+
+	// All cubemap faces of a level are included
+	EXPECT_TRUE(image_allocate_cubemap_storage(&image, &format, 4, 2));
+	for (unsigned int face = 0; face < 6; ++face) {
+		uint8_t* pixel = image_layer_buffer(&image, 1, face);
+		memset(pixel, (int)(face * 51), 2 * 2 * 3);
+	}
+	image_statistics_initialize(&statistics, 0, 0, 0);
+	EXPECT_TRUE(image_statistics(&image, 1, &statistics));
+	EXPECT_EQ(statistics.pixels, 6 * 2 * 2);
+	EXPECT_REALEQ((real)statistics.min[0], 0);
+	EXPECT_REALEQ((real)statistics.max[0], 1);
+	EXPECT_EQ(statistics.histogram[0], 4);
+	EXPECT_EQ(statistics.histogram[255], 4);
+	image_statistics_finalize(&statistics);
+
+	image_finalize(&image);
+
+	return 0;
+}
+
+DECLARE_TEST(image, compare) {
+	image_pixelformat_t format;
+	image_pixelformat_t format_float;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+	image_pixelformat_initialize(&format_float, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t source;
+	image_t other;
+	image_initialize(&source);
+	image_initialize(&other);
+	image_allocate_storage(&source, &format, 37, 29, 1, 1);
+	image_allocate_storage(&other, &format_float, 37, 29, 1, 1);
+	for (unsigned int ipixel = 0; ipixel < 37 * 29; ++ipixel) {
+		for (unsigned int ichannel = 0; ichannel < 4; ++ichannel)
+			source.data[ipixel * 4 + ichannel] = (uint8_t)(((ipixel * 7 + ichannel * 31) % 200) + 20);
+	}
+
+	// Identical content in a different format
+	float32_t* rgba = (float32_t*)other.data;
+	image_pixel_read(&format, source.data, 37 * 29, rgba);
+	image_compare_metrics_t metrics;
+	EXPECT_TRUE(image_compare(&source, &other, 0, &metrics));
+	EXPECT_EQ(metrics.pixels, 37 * 29);
+	for (unsigned int ichannel = 0; ichannel < 4; ++ichannel) {
+		EXPECT_REALEQ((real)metrics.mse[ichannel], 0);
+		EXPECT_TRUE(metrics.psnr[ichannel] == DBL_MAX);
+		EXPECT_REALEQ((real)metrics.ssim[ichannel], 1);
+	}
+
+	// Constant offset on red only
+	for (unsigned int ipixel = 0; ipixel < 37 * 29; ++ipixel)
+		rgba[ipixel * 4] += 20.0f / 255.0f;
+	EXPECT_TRUE(image_compare(&source, &other, 0, &metrics));
+	EXPECT_REALEQ((real)metrics.max_error[0], (real)(20.0 / 255.0));
+	EXPECT_REALEQ((real)metrics.mse[0], (real)((20.0 / 255.0) * (20.0 / 255.0)));
+	EXPECT_REALEQ((real)metrics.psnr[0], (real)(20.0 * log10(255.0 / 20.0)));
+	EXPECT_LT(metrics.ssim[0], 1);
+	EXPECT_GT(metrics.ssim[0], 0.5);
+	EXPECT_REALEQ((real)metrics.ssim[1], 1);
+
+	// Structural changes lower SSIM more than a brightness offset of similar error
+	image_compare_metrics_t offset = metrics;
+	image_pixel_read(&format, source.data, 37 * 29, rgba);
+	for (unsigned int ipixel = 0; ipixel < 37 * 29; ++ipixel)
+		rgba[ipixel * 4] += ((ipixel % 2) ? 20.0f : -20.0f) / 255.0f;
+	EXPECT_TRUE(image_compare(&source, &other, 0, &metrics));
+	EXPECT_REALEQ((real)metrics.mse[0], (real)offset.mse[0]);
+	EXPECT_LT(metrics.ssim[0], offset.ssim[0]);
+
+	// Mismatched dimensions
+	image_allocate_storage(&other, &format_float, 36, 29, 1, 1);
+	EXPECT_FALSE(image_compare(&source, &other, 0, &metrics));
+
+	// Cubemaps are compared over all faces, an error in one face is included
+	EXPECT_TRUE(image_allocate_cubemap_storage(&source, &format, 16, 1));
+	EXPECT_TRUE(image_allocate_cubemap_storage(&other, &format, 16, 1));
+	memset(source.data, 0x40, image_data_size(&source));
+	memset(other.data, 0x40, image_data_size(&other));
+	uint8_t* face = image_layer_buffer(&other, 0, 5);
+	face[0] = 0x40 + 51;
+	EXPECT_TRUE(image_compare(&source, &other, 0, &metrics));
+	EXPECT_EQ(metrics.pixels, 6 * 16 * 16);
+	EXPECT_REALEQ((real)metrics.max_error[0], (real)0.2);
+	EXPECT_REALEQ((real)metrics.mse[1], 0);
+
+	// Mismatched layer counts
+	EXPECT_TRUE(image_allocate_array_storage(&other, &format, 16, 16, 2, 1));
+	EXPECT_FALSE(image_compare(&source, &other, 0, &metrics));
+
+	image_finalize(&other);
+	image_finalize(&source);
+
+	return 0;
+}
+
+DECLARE_TEST(image, dedup) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 3, IMAGE_COLORSPACE_sRGB);
+
+	// Smooth pattern, an exact copy, a copy with slight noise, a 2x upscale and an inverted copy
+	image_t image[5];
+	for (unsigned int iimage = 0; iimage < 5; ++iimage)
+		image_initialize(&image[iimage]);
+	for (unsigned int iimage = 0; iimage < 5; ++iimage) {
+		unsigned int scale = (iimage == 3) ? 2 : 1;
+		image_allocate_storage(&image[iimage], &format, 64 * scale, 48 * scale, 1, 1);
+		for (unsigned int y = 0; y < 48 * scale; ++y) {
+			for (unsigned int x = 0; x < 64 * scale; ++x) {
+				unsigned int sx = x / scale;
+				unsigned int sy = y / scale;
+				unsigned int value = (sx * 3 + sy * 2 + ((sx / 16 + sy / 12) % 2) * 60) % 256;
+				if (iimage == 2)
+					value = (value + ((sx * 7 + sy * 13) % 3)) % 256;
+				else if (iimage == 4)
+					value = 255 - value;
+				uint8_t* pixel = image[iimage].data + ((size_t)y * 64 * scale + x) * 3;
+				pixel[0] = (uint8_t)value;
+				pixel[1] = (uint8_t)(value / 2);
+				pixel[2] = (uint8_t)(255 - value / 3);
+			}
+		}
+	}
+
+	EXPECT_EQ(image_content_hash(&image[0]), image_content_hash(&image[1]));
+	EXPECT_NE(image_content_hash(&image[0]), image_content_hash(&image[2]));
+
+	uint64_t hash[5];
+	for (unsigned int iimage = 0; iimage < 5; ++iimage)
+		EXPECT_TRUE(image_perceptual_hash(&image[iimage], &hash[iimage]));
+	EXPECT_EQ(hash[0], hash[1]);
+	EXPECT_LE(image_perceptual_distance(hash[0], hash[2]), 4);
+	EXPECT_LE(image_perceptual_distance(hash[0], hash[3]), 4);
+	EXPECT_GE(image_perceptual_distance(hash[0], hash[4]), 20);
+
+	image_dedup_result_t result[5];
+	EXPECT_EQ(image_dedup(image, 5, IMAGE_DEDUP_PERCEPTUAL | IMAGE_DEDUP_RELEASE, 4, result), 3);
+	EXPECT_EQ(result[0].duplicate_of, 0);
+	EXPECT_EQ(result[1].duplicate_of, 0);
+	EXPECT_TRUE(result[1].exact);
+	EXPECT_EQ(result[2].duplicate_of, 0);
+	EXPECT_FALSE(result[2].exact);
+	EXPECT_EQ(result[3].duplicate_of, 0);
+	EXPECT_EQ(result[4].duplicate_of, 4);
+	EXPECT_EQ(result[2].perceptual_hash, hash[2]);
+	// Only exact duplicates release their storage
+	EXPECT_EQ(image[1].data, 0);
+	EXPECT_NE(image[2].data, 0);
+
+	for (unsigned int iimage = 0; iimage < 5; ++iimage)
+		image_finalize(&image[iimage]);
+
+	return 0;
+}
+
+DECLARE_TEST(image, blit) {
+	image_pixelformat_t format_rgb8;
+	image_pixelformat_t format_rgba8;
+	image_pixelformat_t format_float;
+	image_pixelformat_initialize(&format_rgb8, IMAGE_DATATYPE_UNSIGNED_INT, 8, 3, IMAGE_COLORSPACE_sRGB);
+	image_pixelformat_initialize(&format_rgba8, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+	image_pixelformat_initialize(&format_float, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+
+	image_t source;
+	image_t dest;
+	image_initialize(&source);
+	image_initialize(&dest);
+	image_allocate_storage(&source, &format_rgb8, 8, 8, 1, 1);
+	for (unsigned int ipixel = 0; ipixel < 64; ++ipixel) {
+		source.data[ipixel * 3 + 0] = (uint8_t)ipixel;
+		source.data[ipixel * 3 + 1] = (uint8_t)(ipixel * 2);
+		source.data[ipixel * 3 + 2] = (uint8_t)(255 - ipixel);
+	}
+
+	// Channel remapping from RGB8 to RGBA8
+	image_allocate_storage(&dest, &format_rgba8, 16, 16, 1, 1);
+	memset(dest.data, 0, 16 * 16 * 4);
+	image_rect_t rect = {2, 3, 4, 4};
+	EXPECT_TRUE(image_blit(&dest, 0, 5, 6, &source, 0, &rect));
+	for (unsigned int y = 0; y < 16; ++y) {
+		for (unsigned int x = 0; x < 16; ++x) {
+			const uint8_t* pixel = dest.data + (y * 16 + x) * 4;
+			bool inside = (x >= 5) && (x < 9) && (y >= 6) && (y < 10);
+			unsigned int source_pixel = (y - 6 + 3) * 8 + (x - 5 + 2);
+			EXPECT_EQ(pixel[0], inside ? source_pixel : 0);
+			EXPECT_EQ(pixel[2], inside ? 255 - source_pixel : 0);
+			EXPECT_EQ(pixel[3], inside ? 255 : 0);
+		}
+	}
+
+	// Clipping at the destination edge with conversion to float
+	image_t converted;
+	image_initialize(&converted);
+	image_allocate_storage(&converted, &format_float, 4, 4, 1, 1);
+	memset(converted.data, 0, 4 * 4 * 16);
+	EXPECT_TRUE(image_blit(&converted, 0, 2, 2, &source, 0, 0));
+	const float32_t* value = (const float32_t*)converted.data;
+	EXPECT_REALEQ((real)value[0], 0);
+	EXPECT_REALEQ((real)value[(2 * 4 + 2) * 4 + 1], 0);
+	EXPECT_REALEQ((real)value[(3 * 4 + 3) * 4 + 0], (real)(9.0f / 255.0f));
+	EXPECT_REALEQ((real)value[(3 * 4 + 3) * 4 + 3], 1);
+	image_finalize(&converted);
+
+	// Overlapping copy within the same image
+	image_allocate_storage(&dest, &format_rgb8, 8, 8, 1, 1);
+	memcpy(dest.data, source.data, 8 * 8 * 3);
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = 6;
+	rect.height = 6;
+	EXPECT_TRUE(image_blit(&dest, 0, 2, 2, &dest, 0, &rect));
+	for (unsigned int y = 0; y < 6; ++y) {
+		for (unsigned int x = 0; x < 6; ++x)
+			EXPECT_EQ(dest.data[((y + 2) * 8 + x + 2) * 3], source.data[(y * 8 + x) * 3]);
+	}
+
+	// Block compressed copies must be block aligned
+	image_pixelformat_t format_bc1;
+	memset(&format_bc1, 0, sizeof(format_bc1));
+	format_bc1.compression = IMAGE_COMPRESSION_BC1;
+	format_bc1.channels_count = 3;
+	format_bc1.block_width = 4;
+	format_bc1.block_height = 4;
+	format_bc1.block_depth = 1;
+	format_bc1.bits_per_block = 64;
+	image_t blocks;
+	image_initialize(&blocks);
+	image_allocate_storage(&blocks, &format_bc1, 8, 8, 1, 1);
+	for (unsigned int ibyte = 0; ibyte < 32; ++ibyte)
+		blocks.data[ibyte] = (uint8_t)ibyte;
+	image_allocate_storage(&dest, &format_bc1, 16, 8, 1, 1);
+	memset(dest.data, 0, 64);
+	rect.x = 4;
+	rect.y = 0;
+	rect.width = 4;
+	rect.height = 8;
+	EXPECT_TRUE(image_blit(&dest, 0, 8, 0, &blocks, 0, &rect));
+	EXPECT_EQ(memcmp(dest.data + 16, blocks.data + 8, 8), 0);
+	EXPECT_EQ(memcmp(dest.data + 48, blocks.data + 24, 8), 0);
+	EXPECT_EQ(dest.data[0], 0);
+	EXPECT_FALSE(image_blit(&dest, 0, 2, 0, &blocks, 0, &rect));
+	EXPECT_FALSE(image_blit(&source, 0, 0, 0, &blocks, 0, 0));
+	image_finalize(&blocks);
+
+	// Array and cubemap images are rejected rather than copied from their first layer
+	image_t cubemap;
+	image_initialize(&cubemap);
+	EXPECT_TRUE(image_allocate_cubemap_storage(&cubemap, &format_rgb8, 8, 1));
+	EXPECT_FALSE(image_blit(&source, 0, 0, 0, &cubemap, 0, 0));
+	EXPECT_FALSE(image_blit(&cubemap, 0, 0, 0, &source, 0, 0));
+	image_finalize(&cubemap);
+
+	image_finalize(&dest);
+	image_finalize(&source);
+
+	return 0;
+}
+
+DECLARE_TEST(image, convert) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+
+	// Mip chain converted as one run of pixels keeping the layout
+	image_t image;
+	image_initialize(&image);
+	image_allocate_storage(&image, &format, 8, 8, 1, 4);
+	size_t pixel_count = image_data_size(&image) / 4;
+	EXPECT_EQ(pixel_count, 64 + 16 + 4 + 1);
+	for (size_t ibyte = 0; ibyte < pixel_count * 4; ++ibyte)
+		image.data[ibyte] = (uint8_t)((ibyte * 37) >> 2);
+
+	uint8_t* original = memory_allocate(HASH_IMAGE, pixel_count * 4, 0, MEMORY_PERSISTENT);
+	memcpy(original, image.data, pixel_count * 4);
+	EXPECT_TRUE(image_convert_channels(&image, IMAGE_DATATYPE_UNSIGNED_INT, 8));
+	EXPECT_EQ(memcmp(image.data, original, pixel_count * 4), 0);
+
+	EXPECT_TRUE(image_convert_channels(&image, IMAGE_DATATYPE_FLOAT, 32));
+	EXPECT_EQ(image.format.bits_per_pixel, 128);
+	EXPECT_EQ(image.format.channels_count, 4);
+	EXPECT_EQ(image.format.channel[3].data_type, IMAGE_DATATYPE_FLOAT);
+	EXPECT_EQ(image.levels, 4);
+	EXPECT_EQ(image_data_size(&image), pixel_count * 16);
+	const float32_t* value = (const float32_t*)image.data;
+	for (size_t ivalue = 0; ivalue < pixel_count * 4; ++ivalue)
+		EXPECT_LT(math_abs(value[ivalue] - (float32_t)original[ivalue] / 255.0f), 0.00001f);
+	const float32_t* level = image_buffer(&image, 2);
+	EXPECT_LT(math_abs(level[0] - (float32_t)original[(64 + 16) * 4] / 255.0f), 0.00001f);
+
+	// Back through 16-bit channels to the original bytes
+	EXPECT_TRUE(image_convert_channels(&image, IMAGE_DATATYPE_UNSIGNED_INT, 16));
+	EXPECT_EQ(((const uint16_t*)image.data)[1], original[1] * 257);
+	EXPECT_TRUE(image_convert_channels(&image, IMAGE_DATATYPE_UNSIGNED_INT, 8));
+	EXPECT_EQ(memcmp(image.data, original, pixel_count * 4), 0);
+
+	EXPECT_FALSE(image_convert_channels(&image, IMAGE_DATATYPE_FLOAT, 8));
+	EXPECT_FALSE(image_convert_channels(&image, IMAGE_DATATYPE_INT, 12));
+	memory_deallocate(original);
+
+	// Cubemap with a mip chain keeps its faces, levels and layout
+	EXPECT_TRUE(image_allocate_cubemap_storage(&image, &format, 8, 4));
+	pixel_count = image_data_size(&image) / 4;
+	EXPECT_EQ(pixel_count, 6 * (64 + 16 + 4 + 1));
+	for (size_t ibyte = 0; ibyte < pixel_count * 4; ++ibyte)
+		image.data[ibyte] = (uint8_t)((ibyte * 37) >> 2);
+	original = memory_allocate(HASH_IMAGE, pixel_count * 4, 0, MEMORY_PERSISTENT);
+	memcpy(original, image.data, pixel_count * 4);
+	EXPECT_TRUE(image_convert_channels(&image, IMAGE_DATATYPE_FLOAT, 32));
+	EXPECT_EQ(image.layers, 6);
+	EXPECT_TRUE(image.cubemap);
+	EXPECT_EQ(image.levels, 4);
+	EXPECT_EQ(image_data_size(&image), pixel_count * 16);
+	const float32_t* face = image_layer_buffer(&image, 2, 5);
+	EXPECT_LT(math_abs(face[0] - (float32_t)original[(6 * (64 + 16) + 5 * 4) * 4] / 255.0f), 0.00001f);
+	EXPECT_TRUE(image_convert_channels(&image, IMAGE_DATATYPE_UNSIGNED_INT, 8));
+	EXPECT_EQ(memcmp(image.data, original, pixel_count * 4), 0);
+	memory_deallocate(original);
+
+	image_pixelformat_t astc_format;
+	EXPECT_TRUE(image_astc_pixelformat(&astc_format, IMAGE_COMPRESSION_ASTC_LDR, IMAGE_COLORSPACE_LINEAR, 4, 4));
+	image_allocate_storage(&image, &astc_format, 8, 8, 1, 1);
+	EXPECT_FALSE(image_convert_channels(&image, IMAGE_DATATYPE_FLOAT, 32));
+	image_finalize(&image);
+
+	return 0;
+}
+
+DECLARE_TEST(image, atlas) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+
+	image_t image[40];
+	for (unsigned int iimage = 0; iimage < 40; ++iimage) {
+		unsigned int width = 3 + (iimage * 7) % 20;
+		unsigned int height = 2 + (iimage * 11) % 17;
+		image_initialize(&image[iimage]);
+		image_allocate_storage(&image[iimage], &format, width, height, 1, 1);
+		for (unsigned int ipixel = 0; ipixel < width * height; ++ipixel) {
+			uint8_t* pixel = image[iimage].data + ipixel * 4;
+			pixel[0] = (uint8_t)(iimage + 1);
+			pixel[1] = (uint8_t)(ipixel % width);
+			pixel[2] = (uint8_t)(ipixel / width);
+			pixel[3] = 0xFF;
+		}
+	}
+
+	image_atlas_options_t options;
+	memset(&options, 0, sizeof(options));
+	options.format = format;
+	options.page_width = 64;
+	options.page_height = 64;
+	options.padding = 1;
+
+	image_t page[8];
+	for (unsigned int ipage = 0; ipage < 8; ++ipage)
+		image_initialize(&page[ipage]);
+	image_atlas_rect_t rect[40];
+	size_t page_count = image_atlas_build(image, 40, &options, page, 8, rect);
+	EXPECT_GT(page_count, 0);
+	EXPECT_LE(page_count, 8);
+
+	for (unsigned int iimage = 0; iimage < 40; ++iimage) {
+		const image_atlas_rect_t* placement = rect + iimage;
+		EXPECT_LT(placement->page, page_count);
+		EXPECT_GE(placement->rect.x, 1);
+		EXPECT_GE(placement->rect.y, 1);
+		EXPECT_LE(placement->rect.x + placement->rect.width + 1, 64);
+		EXPECT_LE(placement->rect.y + placement->rect.height + 1, 64);
+		EXPECT_REALEQ((real)placement->u0, (real)placement->rect.x / 64);
+		EXPECT_REALEQ((real)placement->v1, (real)(placement->rect.y + placement->rect.height) / 64);
+		// Padded slots never overlap
+		for (unsigned int iother = 0; iother < iimage; ++iother) {
+			const image_atlas_rect_t* other = rect + iother;
+			bool overlap = (other->page == placement->page) &&
+			               (placement->rect.x < other->rect.x + other->rect.width + 2) &&
+			               (other->rect.x < placement->rect.x + placement->rect.width + 2) &&
+			               (placement->rect.y < other->rect.y + other->rect.height + 2) &&
+			               (other->rect.y < placement->rect.y + placement->rect.height + 2);
+			EXPECT_FALSE(overlap);
+		}
+		// Image content and extruded corners
+		const image_t* atlas = page + placement->page;
+		unsigned int x = placement->rect.x;
+		unsigned int y = placement->rect.y;
+		unsigned int width = placement->rect.width;
+		unsigned int height = placement->rect.height;
+		const uint8_t* pixel = atlas->data + ((y + height - 1) * 64 + x + width - 1) * 4;
+		EXPECT_EQ(pixel[0], iimage + 1);
+		EXPECT_EQ(pixel[1], width - 1);
+		EXPECT_EQ(pixel[2], height - 1);
+		const uint8_t* corner = atlas->data + ((y + height) * 64 + x + width) * 4;
+		EXPECT_EQ(memcmp(corner, pixel, 4), 0);
+		corner = atlas->data + ((y - 1) * 64 + x - 1) * 4;
+		EXPECT_EQ(memcmp(corner, atlas->data + (y * 64 + x) * 4, 4), 0);
+	}
+	for (unsigned int ipage = 0; ipage < 8; ++ipage)
+		image_finalize(&page[ipage]);
+
+	// Slots for block compressed targets with three mip levels align to 16 pixels
+	options.padding = 0;
+	options.block_width = 4;
+	options.block_height = 4;
+	options.mip_levels = 3;
+	page_count = image_atlas_build(image, 10, &options, page, 8, rect);
+	EXPECT_GT(page_count, 0);
+	for (unsigned int iimage = 0; iimage < 10; ++iimage) {
+		EXPECT_EQ(rect[iimage].rect.x % 16, 0);
+		EXPECT_EQ(rect[iimage].rect.y % 16, 0);
+	}
+	for (unsigned int ipage = 0; ipage < 8; ++ipage)
+		image_finalize(&page[ipage]);
+
+	// Images larger than a page do not fit
+	options.page_width = 16;
+	options.page_height = 16;
+	EXPECT_EQ(image_atlas_build(image, 40, &options, page, 8, rect), 0);
+
+	for (unsigned int iimage = 0; iimage < 40; ++iimage)
+		image_finalize(&image[iimage]);
+
+	return 0;
+}
+
+static uint8_t
+test_transform_value(unsigned int x, unsigned int y, unsigned int slice, unsigned int level, unsigned int byte) {
+	return (uint8_t)(x * 7 + y * 131 + slice * 53 + level * 3 + byte * 29);
+}
+
+DECLARE_TEST(image, transform) {
+	// Pixel sizes of 1, 2, 3, 4, 8 and 16 bytes
+	const unsigned int bits[6] = {8, 8, 8, 8, 16, 32};
+	const unsigned int channels[6] = {1, 2, 3, 4, 4, 4};
+	for (unsigned int iformat = 0; iformat < 6; ++iformat) {
+		image_pixelformat_t format;
+		image_datatype_t data_type = (bits[iformat] == 32) ? IMAGE_DATATYPE_FLOAT : IMAGE_DATATYPE_UNSIGNED_INT;
+		image_pixelformat_initialize(&format, data_type, bits[iformat], channels[iformat], IMAGE_COLORSPACE_LINEAR);
+		unsigned int pixel_size = format.bits_per_pixel / 8;
+
+		image_t source;
+		image_initialize(&source);
+		image_allocate_storage(&source, &format, 75, 45, 2, 3);
+		for (unsigned int level = 0; level < 3; ++level) {
+			unsigned int width = image_width(&source, level);
+			unsigned int height = image_height(&source, level);
+			uint8_t* data = image_buffer(&source, level);
+			for (unsigned int slice = 0; slice < image_depth(&source, level); ++slice) {
+				for (unsigned int y = 0; y < height; ++y) {
+					for (unsigned int x = 0; x < width; ++x) {
+						for (unsigned int ibyte = 0; ibyte < pixel_size; ++ibyte)
+							*data++ = test_transform_value(x, y, slice, level, ibyte);
+					}
+				}
+			}
+		}
+
+		for (unsigned int op = IMAGE_TRANSFORM_NONE; op < IMAGE_TRANSFORM_COUNT; ++op) {
+			image_t transformed;
+			image_initialize(&transformed);
+			EXPECT_TRUE(image_transform_copy(&transformed, &source, (image_transform_t)op));
+			bool swap = (op == IMAGE_TRANSFORM_ROTATE_90) || (op == IMAGE_TRANSFORM_ROTATE_270) ||
+			            (op == IMAGE_TRANSFORM_TRANSPOSE) || (op == IMAGE_TRANSFORM_TRANSVERSE);
+			EXPECT_EQ(transformed.width, swap ? 45 : 75);
+			EXPECT_EQ(transformed.height, swap ? 75 : 45);
+			EXPECT_EQ(transformed.levels, 3);
+
+			bool match = true;
+			for (unsigned int level = 0; level < 3; ++level) {
+				unsigned int width = image_width(&source, level);
+				unsigned int height = image_height(&source, level);
+				unsigned int dest_width = swap ? height : width;
+				const uint8_t* data = image_buffer(&transformed, level);
+				for (unsigned int slice = 0; slice < image_depth(&source, level); ++slice) {
+					for (unsigned int ty = 0; ty < (swap ? width : height); ++ty) {
+						for (unsigned int tx = 0; tx < dest_width; ++tx) {
+							unsigned int x = tx;
+							unsigned int y = ty;
+							if (op == IMAGE_TRANSFORM_FLIP_HORIZONTAL) {
+								x = width - 1 - tx;
+							} else if (op == IMAGE_TRANSFORM_FLIP_VERTICAL) {
+								y = height - 1 - ty;
+							} else if (op == IMAGE_TRANSFORM_ROTATE_90) {
+								x = ty;
+								y = height - 1 - tx;
+							} else if (op == IMAGE_TRANSFORM_ROTATE_180) {
+								x = width - 1 - tx;
+								y = height - 1 - ty;
+							} else if (op == IMAGE_TRANSFORM_ROTATE_270) {
+								x = width - 1 - ty;
+								y = tx;
+							} else if (op == IMAGE_TRANSFORM_TRANSPOSE) {
+								x = ty;
+								y = tx;
+							} else if (op == IMAGE_TRANSFORM_TRANSVERSE) {
+								x = width - 1 - ty;
+								y = height - 1 - tx;
+							}
+							const uint8_t* pixel =
+							    data + (((size_t)slice * (swap ? width : height) + ty) * dest_width + tx) * pixel_size;
+							for (unsigned int ibyte = 0; ibyte < pixel_size; ++ibyte)
+								match &= (pixel[ibyte] == test_transform_value(x, y, slice, level, ibyte));
+						}
+					}
+				}
+			}
+			EXPECT_TRUE(match);
+
+			// In place transforms match the copies
+			image_t inplace;
+			image_initialize(&inplace);
+			image_allocate_storage(&inplace, &format, 75, 45, 2, 3);
+			memcpy(inplace.data, source.data, source.storage_size);
+			EXPECT_TRUE(image_transform(&inplace, (image_transform_t)op));
+			EXPECT_EQ(inplace.width, transformed.width);
+			EXPECT_EQ(inplace.height, transformed.height);
+			EXPECT_EQ(memcmp(inplace.data, transformed.data, source.storage_size), 0);
+			image_finalize(&inplace);
+			image_finalize(&transformed);
+		}
+
+		// Four quarter turns restore the original
+		image_t rotated;
+		image_initialize(&rotated);
+		EXPECT_TRUE(image_transform_copy(&rotated, &source, IMAGE_TRANSFORM_ROTATE_90));
+		for (unsigned int iturn = 0; iturn < 3; ++iturn)
+			EXPECT_TRUE(image_transform(&rotated, IMAGE_TRANSFORM_ROTATE_90));
+		EXPECT_EQ(rotated.width, 75);
+		EXPECT_EQ(memcmp(rotated.data, source.data, source.storage_size), 0);
+		image_finalize(&rotated);
+		image_finalize(&source);
+	}
+
+	// Block compressed formats are not supported
+	image_pixelformat_t compressed;
+	memset(&compressed, 0, sizeof(compressed));
+	compressed.compression = IMAGE_COMPRESSION_BC1;
+	compressed.block_width = 4;
+	compressed.block_height = 4;
+	compressed.bits_per_block = 64;
+	image_t block;
+	image_initialize(&block);
+	image_allocate_storage(&block, &compressed, 8, 8, 1, 1);
+	EXPECT_FALSE(image_transform(&block, IMAGE_TRANSFORM_ROTATE_90));
+	image_finalize(&block);
+
+	return 0;
+}
+
+DECLARE_TEST(image, orientation) {
+	EXPECT_EQ(image_transform_orientation(0), IMAGE_TRANSFORM_NONE);
+	EXPECT_EQ(image_transform_orientation(1), IMAGE_TRANSFORM_NONE);
+	EXPECT_EQ(image_transform_orientation(3), IMAGE_TRANSFORM_ROTATE_180);
+	EXPECT_EQ(image_transform_orientation(6), IMAGE_TRANSFORM_ROTATE_90);
+	EXPECT_EQ(image_transform_orientation(8), IMAGE_TRANSFORM_ROTATE_270);
+	EXPECT_EQ(image_transform_orientation(9), IMAGE_TRANSFORM_NONE);
+
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+	image_t source;
+	image_initialize(&source);
+	image_allocate_storage(&source, &format, 13, 7, 1, 1);
+	for (unsigned int ipixel = 0; ipixel < 13 * 7; ++ipixel)
+		memcpy(source.data + ipixel * 4, &ipixel, 4);
+
+	// Pixels scattered through the index mapping, as loaders do, match the transformed image
+	for (unsigned int value = 1; value <= 8; ++value) {
+		image_transform_t op = image_transform_orientation(value);
+		image_t transformed;
+		image_initialize(&transformed);
+		EXPECT_TRUE(image_transform_copy(&transformed, &source, op));
+		EXPECT_EQ(image_transform_swaps_dimensions(op), transformed.width == 7);
+
+		int64_t origin, step_x, step_y;
+		image_transform_mapping(op, 13, 7, &origin, &step_x, &step_y);
+		uint32_t mapped[13 * 7];
+		for (unsigned int y = 0; y < 7; ++y) {
+			for (unsigned int x = 0; x < 13; ++x) {
+				int64_t index = origin + step_x * x + step_y * y;
+				EXPECT_GE(index, 0);
+				EXPECT_LT(index, 13 * 7);
+				mapped[index] = y * 13 + x;
+			}
+		}
+		EXPECT_EQ(memcmp(mapped, transformed.data, sizeof(mapped)), 0);
+		image_finalize(&transformed);
+	}
+	image_finalize(&source);
+
+	return 0;
+}
+
+DECLARE_TEST(image, convolve) {
+	image_pixelformat_t format_float;
+	image_pixelformat_t format_rgba8;
+	image_pixelformat_initialize(&format_float, IMAGE_DATATYPE_FLOAT, 32, 1, IMAGE_COLORSPACE_LINEAR);
+	image_pixelformat_initialize(&format_rgba8, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+
+	// Box blur spreads an impulse evenly over the window
+	image_t impulse;
+	image_initialize(&impulse);
+	image_allocate_storage(&impulse, &format_float, 64, 48, 1, 1);
+	float32_t* value = (float32_t*)impulse.data;
+	memset(value, 0, sizeof(float32_t) * 64 * 48);
+	value[20 * 64 + 20] = 1.0f;
+	EXPECT_TRUE(image_box_blur(&impulse, 0, 1, IMAGE_EDGE_CLAMP));
+	real sum = 0;
+	for (unsigned int ipixel = 0; ipixel < 64 * 48; ++ipixel) {
+		unsigned int x = ipixel % 64;
+		unsigned int y = ipixel / 64;
+		bool inside = (x >= 19) && (x <= 21) && (y >= 19) && (y <= 21);
+		EXPECT_REALEQ(value[ipixel], inside ? 1.0f / 9.0f : 0.0f);
+		sum += value[ipixel];
+	}
+	EXPECT_REALONE(sum);
+
+	// Small Gaussians match the equivalent separable kernel
+	image_t reference;
+	image_initialize(&reference);
+	image_allocate_storage(&reference, &format_float, 64, 48, 1, 1);
+	for (unsigned int ipixel = 0; ipixel < 64 * 48; ++ipixel)
+		value[ipixel] = (float32_t)((ipixel * 37) % 101) / 100.0f;
+	memcpy(reference.data, impulse.data, sizeof(float32_t) * 64 * 48);
+	float32_t kernel[7];
+	float32_t kernel_sum = 0;
+	for (int itap = 0; itap < 7; ++itap) {
+		kernel[itap] = (float32_t)math_exp(-(real)((itap - 3) * (itap - 3)) / 2.0f);
+		kernel_sum += kernel[itap];
+	}
+	for (unsigned int itap = 0; itap < 7; ++itap)
+		kernel[itap] /= kernel_sum;
+	EXPECT_TRUE(image_gaussian_blur(&impulse, 0, 1.0f, IMAGE_EDGE_MIRROR));
+	EXPECT_TRUE(image_convolve_separable(&reference, 0, kernel, 7, kernel, 7, IMAGE_EDGE_MIRROR));
+	const float32_t* expected = (const float32_t*)reference.data;
+	real max_error = 0;
+	for (unsigned int ipixel = 0; ipixel < 64 * 48; ++ipixel) {
+		real error = math_abs(value[ipixel] - expected[ipixel]);
+		max_error = (error > max_error) ? error : max_error;
+	}
+	EXPECT_LT(max_error, 0.0001f);
+
+	// Large Gaussians use the recursive filter, which preserves the total and approximates the peak
+	memset(value, 0, sizeof(float32_t) * 64 * 48);
+	value[24 * 64 + 32] = 1.0f;
+	EXPECT_TRUE(image_gaussian_blur(&impulse, 0, 5.0f, IMAGE_EDGE_WRAP));
+	sum = 0;
+	for (unsigned int ipixel = 0; ipixel < 64 * 48; ++ipixel)
+		sum += value[ipixel];
+	EXPECT_GT(sum, 0.98f);
+	EXPECT_LT(sum, 1.02f);
+	real peak = 1.0f / (2.0f * REAL_PI * 25.0f);
+	EXPECT_GT(value[24 * 64 + 32], peak * 0.9f);
+	EXPECT_LT(value[24 * 64 + 32], peak * 1.1f);
+	EXPECT_LT(math_abs(value[24 * 64 + 27] - value[24 * 64 + 37]), peak * 0.01f);
+	EXPECT_LT(math_abs(value[19 * 64 + 32] - value[29 * 64 + 32]), peak * 0.01f);
+	image_finalize(&reference);
+	image_finalize(&impulse);
+
+	// Non-separable kernels on 8-bit data, an identity leaves the image unchanged and a
+	// single off center weight shifts it
+	image_t image;
+	image_t original;
+	image_initialize(&image);
+	image_initialize(&original);
+	image_allocate_storage(&image, &format_rgba8, 37, 23, 1, 1);
+	image_allocate_storage(&original, &format_rgba8, 37, 23, 1, 1);
+	for (unsigned int ibyte = 0; ibyte < 37 * 23 * 4; ++ibyte)
+		image.data[ibyte] = (uint8_t)((ibyte * 13) % 251);
+	memcpy(original.data, image.data, 37 * 23 * 4);
+	float32_t identity[9] = {0, 0, 0, 0, 1, 0, 0, 0, 0};
+	EXPECT_TRUE(image_convolve(&image, 0, identity, 3, IMAGE_EDGE_CLAMP));
+	EXPECT_EQ(memcmp(image.data, original.data, 37 * 23 * 4), 0);
+	float32_t shift[9] = {0, 0, 0, 1, 0, 0, 0, 0, 0};
+	EXPECT_TRUE(image_convolve(&image, 0, shift, 3, IMAGE_EDGE_CLAMP));
+	for (unsigned int y = 0; y < 23; ++y) {
+		EXPECT_EQ(memcmp(image.data + y * 37 * 4, original.data + y * 37 * 4, 4), 0);
+		EXPECT_EQ(memcmp(image.data + (y * 37 + 1) * 4, original.data + y * 37 * 4, 36 * 4), 0);
+	}
+
+	// Constant images are unchanged by blurs
+	memset(image.data, 0x80, 37 * 23 * 4);
+	memcpy(original.data, image.data, 37 * 23 * 4);
+	EXPECT_TRUE(image_box_blur(&image, 0, 5, IMAGE_EDGE_MIRROR));
+	EXPECT_TRUE(image_gaussian_blur(&image, 0, 8.0f, IMAGE_EDGE_CLAMP));
+	EXPECT_EQ(memcmp(image.data, original.data, 37 * 23 * 4), 0);
+
+	EXPECT_FALSE(image_convolve_separable(&image, 0, kernel, 6, kernel, 7, IMAGE_EDGE_CLAMP));
+	EXPECT_FALSE(image_convolve(&image, 1, identity, 3, IMAGE_EDGE_CLAMP));
+	image_finalize(&original);
+	image_finalize(&image);
+
+	// Cubemap faces are filtered individually, without bleeding into neighbouring faces
+	image_t cubemap;
+	image_initialize(&cubemap);
+	EXPECT_TRUE(image_allocate_cubemap_storage(&cubemap, &format_float, 8, 1));
+	value = (float32_t*)cubemap.data;
+	for (unsigned int face = 0; face < 6; ++face) {
+		for (unsigned int ipixel = 0; ipixel < 8 * 8; ++ipixel)
+			value[face * 64 + ipixel] = (float32_t)face;
+	}
+	value[2 * 64 + 3 * 8 + 3] = 8.0f;
+	EXPECT_TRUE(image_box_blur(&cubemap, 0, 1, IMAGE_EDGE_CLAMP));
+	EXPECT_REALEQ(value[2 * 64 + 3 * 8 + 3], (real)(2.0 + 6.0 / 9.0));
+	for (unsigned int face = 0; face < 6; ++face) {
+		EXPECT_REALEQ(value[face * 64], (real)face);
+		EXPECT_REALEQ(value[face * 64 + 63], (real)face);
+	}
+	EXPECT_TRUE(image_gaussian_blur(&cubemap, 0, 4.0f, IMAGE_EDGE_CLAMP));
+	EXPECT_REALEQ(value[64 + 63], 1);
+	EXPECT_REALEQ(value[4 * 64], 4);
+	image_finalize(&cubemap);
+
+	return 0;
+}
+
+DECLARE_TEST(image, mipmap) {
+	image_pixelformat_t format_rgba8;
+	image_pixelformat_t format_srgb8;
+	image_pixelformat_initialize(&format_rgba8, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+	image_pixelformat_initialize(&format_srgb8, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_sRGB);
+
+	// Checkerboard averages to mid gray, in linear space for sRGB images
+	image_t image;
+	image_initialize(&image);
+	for (unsigned int iformat = 0; iformat < 2; ++iformat) {
+		image_allocate_storage(&image, iformat ? &format_srgb8 : &format_rgba8, 8, 4, 1, 1);
+		for (unsigned int ipixel = 0; ipixel < 8 * 4; ++ipixel) {
+			uint8_t value = ((ipixel % 8 + ipixel / 8) & 1) ? 0xFF : 0;
+			memset(image.data + ipixel * 4, value, 3);
+			image.data[ipixel * 4 + 3] = 0xFF;
+		}
+		EXPECT_TRUE(image_mipmap_generate(&image, IMAGE_MIPMAP_BOX, 0));
+		EXPECT_EQ(image.levels, 4);
+		EXPECT_EQ(image_width(&image, 1), 4);
+		EXPECT_EQ(image_height(&image, 1), 2);
+		EXPECT_EQ(image_width(&image, 3), 1);
+		EXPECT_EQ(image_height(&image, 3), 1);
+		for (unsigned int level = 1; level < 4; ++level) {
+			const uint8_t* pixel = image_buffer(&image, level);
+			EXPECT_GE(pixel[0], iformat ? 187 : 127);
+			EXPECT_LE(pixel[0], iformat ? 188 : 128);
+			EXPECT_EQ(pixel[3], 0xFF);
+		}
+	}
+
+	// Odd sized levels repeat the last texel
+	image_allocate_storage(&image, &format_rgba8, 5, 3, 1, 1);
+	memset(image.data, 0x40, 5 * 3 * 4);
+	EXPECT_TRUE(image_mipmap_generate(&image, IMAGE_MIPMAP_BOX, 0));
+	EXPECT_EQ(image.levels, 3);
+	EXPECT_EQ(image_width(&image, 1), 2);
+	EXPECT_EQ(image_height(&image, 1), 1);
+	const uint8_t* last = image_buffer(&image, 2);
+	EXPECT_EQ(last[0], 0x40);
+	EXPECT_EQ(last[3], 0x40);
+
+	// Normals alternating between two tilts average to a shortened upright normal, which is
+	// renormalized and leaves the spread as Toksvig variance
+	image_allocate_storage(&image, &format_rgba8, 4, 4, 1, 1);
+	for (unsigned int ipixel = 0; ipixel < 4 * 4; ++ipixel) {
+		float32_t normal[4] = {(ipixel & 1) ? -0.6f : 0.6f, 0, 0.8f, 1};
+		for (unsigned int ich = 0; ich < 3; ++ich)
+			normal[ich] = normal[ich] * 0.5f + 0.5f;
+		image_pixel_write(&image.format, image.data + ipixel * 4, 1, normal);
+	}
+	EXPECT_FALSE(image_mipmap_generate(&image, IMAGE_MIPMAP_BOX, IMAGE_MIPMAP_TOKSVIG_ALPHA));
+	EXPECT_TRUE(image_mipmap_generate(&image, IMAGE_MIPMAP_NORMALMAP, IMAGE_MIPMAP_TOKSVIG_ALPHA));
+	EXPECT_EQ(image.levels, 3);
+	EXPECT_EQ(image.data[3], 0);
+	for (unsigned int level = 1; level < 3; ++level) {
+		const uint8_t* pixel = image_buffer(&image, level);
+		EXPECT_GE(pixel[0], 127);
+		EXPECT_LE(pixel[0], 128);
+		EXPECT_GE(pixel[1], 127);
+		EXPECT_LE(pixel[1], 128);
+		EXPECT_EQ(pixel[2], 0xFF);
+		// Variance of (1 - 0.8) / 0.8
+		EXPECT_GE(pixel[3], 62);
+		EXPECT_LE(pixel[3], 66);
+	}
+	image_finalize(&image);
+
+	return 0;
+}
+
+DECLARE_TEST(image, normalmap) {
+	image_pixelformat_t format_height;
+	image_pixelformat_initialize(&format_height, IMAGE_DATATYPE_FLOAT, 32, 1, IMAGE_COLORSPACE_LINEAR);
+	image_t height;
+	image_t normalmap;
+	image_initialize(&height);
+	image_initialize(&normalmap);
+	image_allocate_storage(&height, &format_height, 16, 12, 1, 1);
+	float32_t* value = (float32_t*)height.data;
+
+	// Flat height maps give upright normals, biased in the default 8-bit format
+	memset(value, 0, sizeof(float32_t) * 16 * 12);
+	EXPECT_TRUE(image_normalmap_from_height(&normalmap, &height, 0, 0));
+	EXPECT_EQ(normalmap.width, 16);
+	EXPECT_EQ(normalmap.height, 12);
+	EXPECT_EQ(normalmap.format.bits_per_pixel, 32);
+	EXPECT_GE(normalmap.data[0], 127);
+	EXPECT_LE(normalmap.data[0], 128);
+	EXPECT_EQ(normalmap.data[2], 0xFF);
+	EXPECT_EQ(normalmap.data[3], 0xFF);
+
+	// Linear ramps give the same interior slope for both filters, and green follows the convention
+	image_normalmap_options_t options;
+	memset(&options, 0, sizeof(options));
+	image_pixelformat_initialize(&options.format, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+	options.strength = 2.0f;
+	float32_t slope = 0.2f / sqrtf(1.04f);
+	for (unsigned int ifilter = 0; ifilter < 2; ++ifilter) {
+		options.filter = ifilter ? IMAGE_NORMALMAP_SCHARR : IMAGE_NORMALMAP_SOBEL;
+		for (unsigned int ipixel = 0; ipixel < 16 * 12; ++ipixel)
+			value[ipixel] = 0.1f * (float32_t)(ipixel % 16);
+		options.flip_y = false;
+		EXPECT_TRUE(image_normalmap_from_height(&normalmap, &height, 0, &options));
+		const float32_t* normal = (const float32_t*)normalmap.data + (5 * 16 + 7) * 4;
+		EXPECT_REALEQ(normal[0], -slope);
+		EXPECT_REALZERO(normal[1]);
+		EXPECT_REALEQ(normal[2], 1.0f / sqrtf(1.04f));
+
+		for (unsigned int ipixel = 0; ipixel < 16 * 12; ++ipixel)
+			value[ipixel] = 0.1f * (float32_t)(ipixel / 16);
+		EXPECT_TRUE(image_normalmap_from_height(&normalmap, &height, 0, &options));
+		normal = (const float32_t*)normalmap.data + (5 * 16 + 7) * 4;
+		EXPECT_REALEQ(normal[1], slope);
+		options.flip_y = true;
+		EXPECT_TRUE(image_normalmap_from_height(&normalmap, &height, 0, &options));
+		normal = (const float32_t*)normalmap.data + (5 * 16 + 7) * 4;
+		EXPECT_REALEQ(normal[1], -slope);
+		EXPECT_REALZERO(normal[0]);
+	}
+
+	// Clamped edges see half the slope across the border, wrapped edges see the jump back to zero
+	options.flip_y = false;
+	for (unsigned int ipixel = 0; ipixel < 16 * 12; ++ipixel)
+		value[ipixel] = 0.1f * (float32_t)(ipixel % 16);
+	EXPECT_TRUE(image_normalmap_from_height(&normalmap, &height, 0, &options));
+	const float32_t* edge = (const float32_t*)normalmap.data;
+	EXPECT_REALEQ(edge[0], -0.1f / sqrtf(1.01f));
+	options.edge = IMAGE_EDGE_WRAP;
+	EXPECT_TRUE(image_normalmap_from_height(&normalmap, &height, 0, &options));
+	edge = (const float32_t*)normalmap.data;
+	EXPECT_GT(edge[0], 0.5f);
+
+	EXPECT_FALSE(image_normalmap_from_height(&height, &height, 0, &options));
+	image_finalize(&normalmap);
+	image_finalize(&height);
+
+	return 0;
+}
+
+DECLARE_TEST(image, cubemap) {
+	image_pixelformat_t format;
+	image_pixelformat_initialize(&format, IMAGE_DATATYPE_FLOAT, 32, 4, IMAGE_COLORSPACE_LINEAR);
+	image_t equirect;
+	image_t cubemap;
+	image_t filtered;
+	image_initialize(&equirect);
+	image_initialize(&cubemap);
+	image_initialize(&filtered);
+	image_allocate_storage(&equirect, &format, 64, 32, 1, 1);
+	float32_t* texel = (float32_t*)equirect.data;
+
+	// Constant environments stay constant through every conversion and filter
+	const float32_t constant[4] = {0.5f, 0.25f, 0.75f, 1.0f};
+	for (unsigned int ipixel = 0; ipixel < 64 * 32; ++ipixel)
+		memcpy(texel + ipixel * 4, constant, sizeof(constant));
+	EXPECT_TRUE(image_cubemap_from_equirect(&cubemap, &equirect, 0));
+	EXPECT_TRUE(cubemap.cubemap);
+	EXPECT_EQ(image_layers(&cubemap), 6);
+	EXPECT_EQ(cubemap.width, 16);
+	EXPECT_EQ(image_data_size(&cubemap), 6 * 16 * 16 * 16);
+	EXPECT_EQ((uint8_t*)image_layer_buffer(&cubemap, 0, 5) - cubemap.data, 5 * 16 * 16 * 16);
+	EXPECT_EQ(image_layer_buffer(&cubemap, 0, 6), 0);
+	const float32_t* face = (const float32_t*)cubemap.data;
+	for (unsigned int ipixel = 0; ipixel < 6 * 16 * 16; ++ipixel) {
+		for (unsigned int ich = 0; ich < 4; ++ich)
+			EXPECT_LT(math_abs(face[ipixel * 4 + ich] - constant[ich]), 0.0001f);
+	}
+	EXPECT_TRUE(image_cubemap_prefilter(&filtered, &cubemap, 0, 0, 32));
+	EXPECT_EQ(filtered.levels, 5);
+	for (unsigned int level = 0; level < filtered.levels; ++level) {
+		unsigned int size = image_width(&filtered, level);
+		face = image_buffer(&filtered, level);
+		for (unsigned int ipixel = 0; ipixel < 6 * size * size; ++ipixel) {
+			for (unsigned int ich = 0; ich < 4; ++ich)
+				EXPECT_LT(math_abs(face[ipixel * 4 + ich] - constant[ich]), 0.0001f);
+		}
+	}
+	EXPECT_TRUE(image_cubemap_irradiance(&filtered, &cubemap, 8));
+	face = (const float32_t*)filtered.data;
+	for (unsigned int ipixel = 0; ipixel < 6 * 8 * 8; ++ipixel) {
+		for (unsigned int ich = 0; ich < 3; ++ich)
+			EXPECT_LT(math_abs(face[ipixel * 4 + ich] - constant[ich]), 0.001f);
+	}
+	float32_t sh[27];
+	EXPECT_TRUE(image_cubemap_irradiance_sh(&cubemap, sh));
+	EXPECT_LT(math_abs(sh[0] - 3.5449077f * constant[0]), 0.001f);
+	EXPECT_LT(math_abs(sh[3 * 6 + 1]), 0.001f);
+	EXPECT_TRUE(image_cubemap_to_equirect(&equirect, &cubemap, 32, 0));
+	EXPECT_EQ(equirect.height, 16);
+	texel = (float32_t*)equirect.data;
+	EXPECT_LT(math_abs(texel[(7 * 32 + 9) * 4 + 2] - constant[2]), 0.0001f);
+
+	// Upper half red and a blue band centered on +X identify face orientation
+	image_allocate_storage(&equirect, &format, 64, 32, 1, 1);
+	texel = (float32_t*)equirect.data;
+	for (unsigned int y = 0; y < 32; ++y) {
+		for (unsigned int x = 0; x < 64; ++x, texel += 4) {
+			texel[0] = (y < 16) ? 1.0f : 0.0f;
+			texel[1] = 0;
+			texel[2] = ((x >= 40) && (x < 56)) ? 1.0f : 0.0f;
+			texel[3] = 1.0f;
+		}
+	}
+	EXPECT_TRUE(image_cubemap_from_equirect(&cubemap, &equirect, 16));
+	const size_t center = (8 * 16 + 8) * 4;
+	EXPECT_REALEQ(((const float32_t*)image_layer_buffer(&cubemap, 0, 2))[center], 1.0f);
+	EXPECT_REALEQ(((const float32_t*)image_layer_buffer(&cubemap, 0, 3))[center], 0.0f);
+	EXPECT_REALEQ(((const float32_t*)image_layer_buffer(&cubemap, 0, 0))[center + 2], 1.0f);
+	EXPECT_REALEQ(((const float32_t*)image_layer_buffer(&cubemap, 0, 1))[center + 2], 0.0f);
+	EXPECT_REALEQ(((const float32_t*)image_layer_buffer(&cubemap, 0, 4))[(2 * 16 + 8) * 4], 1.0f);
+	EXPECT_REALEQ(((const float32_t*)image_layer_buffer(&cubemap, 0, 4))[(13 * 16 + 8) * 4], 0.0f);
+
+	// The first prefiltered level reproduces the source, rougher levels blur across faces
+	EXPECT_TRUE(image_cubemap_prefilter(&filtered, &cubemap, 0, 3, 0));
+	for (unsigned int ivalue = 0; ivalue < 6 * 16 * 16 * 4; ++ivalue)
+		EXPECT_LT(math_abs(((const float32_t*)filtered.data)[ivalue] - ((const float32_t*)cubemap.data)[ivalue]),
+		          0.0001f);
+	const float32_t* rough = image_layer_buffer(&filtered, 2, 2);
+	EXPECT_LT(rough[(2 * 4 + 2) * 4], 1.0f);
+	EXPECT_GT(rough[(2 * 4 + 2) * 4], 0.5f);
+
+	// DDS stores the full chain of each face in turn, KTX all faces of each level
+	stream_t* stream = buffer_stream_allocate(0, STREAM_IN | STREAM_OUT | STREAM_BINARY, 0, 0, true, true);
+	size_t face_size = (16 * 16 + 8 * 8 + 4 * 4) * 16;
+	uint8_t container[4 + 124 + 20];
+	uint8_t face_data[16 * 16 * 16];
+	EXPECT_TRUE(image_save(&filtered, stream, IMAGE_FILE_FORMAT_DDS, 0));
+	EXPECT_EQ(stream_tell(stream), sizeof(container) + 6 * face_size);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_read(stream, container, sizeof(container));
+	EXPECT_EQ(test_uint32_load(container + 12), 16);
+	EXPECT_EQ(test_uint32_load(container + 16), 16);
+	EXPECT_EQ(test_uint32_load(container + 28), 3);
+	// Complex mipmapped texture with all six cubemap faces
+	EXPECT_EQ(test_uint32_load(container + 108), 0x401008);
+	EXPECT_EQ(test_uint32_load(container + 112), 0xFE00);
+	// DXGI_FORMAT_R32G32B32A32_FLOAT, 2D texture, cube flag and a single cube
+	EXPECT_EQ(test_uint32_load(container + 128), 2);
+	EXPECT_EQ(test_uint32_load(container + 132), 3);
+	EXPECT_EQ(test_uint32_load(container + 136), 0x4);
+	EXPECT_EQ(test_uint32_load(container + 140), 1);
+	stream_seek(stream, (ssize_t)(sizeof(container) + 3 * face_size), STREAM_SEEK_BEGIN);
+	stream_read(stream, face_data, sizeof(face_data));
+	EXPECT_EQ(memcmp(face_data, image_layer_buffer(&filtered, 0, 3), sizeof(face_data)), 0);
+	stream_truncate(stream, 0);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_TRUE(image_save(&filtered, stream, IMAGE_FILE_FORMAT_KTX, 0));
+	EXPECT_EQ(stream_tell(stream), 64 + 3 * 4 + 6 * face_size);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	stream_read(stream, container, 64 + 4);
+	EXPECT_EQ(test_uint32_load(container + 36), 16);
+	EXPECT_EQ(test_uint32_load(container + 40), 16);
+	// Not an array, six faces and three levels, image size of a non-array cubemap counts one face
+	EXPECT_EQ(test_uint32_load(container + 48), 0);
+	EXPECT_EQ(test_uint32_load(container + 52), 6);
+	EXPECT_EQ(test_uint32_load(container + 56), 3);
+	EXPECT_EQ(test_uint32_load(container + 64), sizeof(face_data));
+	stream_seek(stream, (ssize_t)(64 + 4 + 3 * sizeof(face_data)), STREAM_SEEK_BEGIN);
+	stream_read(stream, face_data, sizeof(face_data));
+	EXPECT_EQ(memcmp(face_data, image_layer_buffer(&filtered, 0, 3), sizeof(face_data)), 0);
+
+	// The native format stores all faces with the cubemap flag
+	stream_truncate(stream, 0);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_TRUE(image_save(&filtered, stream, IMAGE_FILE_FORMAT_NATIVE, 0));
+	image_t loaded;
+	image_initialize(&loaded);
+	stream_seek(stream, 0, STREAM_SEEK_BEGIN);
+	EXPECT_TRUE(image_load(&loaded, stream));
+	EXPECT_TRUE(loaded.cubemap);
+	EXPECT_EQ(image_layers(&loaded), 6);
+	EXPECT_EQ(loaded.levels, 3);
+	EXPECT_EQ(image_data_size(&loaded), image_data_size(&filtered));
+	EXPECT_EQ(memcmp(loaded.data, filtered.data, image_data_size(&filtered)), 0);
+	image_finalize(&loaded);
+	stream_deallocate(stream);
+	EXPECT_TRUE(image_cubemap_irradiance(&filtered, &cubemap, 4));
+	const float32_t* up = image_layer_buffer(&filtered, 0, 2);
+	const float32_t* down = image_layer_buffer(&filtered, 0, 3);
+	EXPECT_GT(up[(2 * 4 + 2) * 4], down[(2 * 4 + 2) * 4] + 0.5f);
+
+	EXPECT_FALSE(image_cubemap_prefilter(&filtered, &equirect, 0, 0, 0));
+	EXPECT_FALSE(image_cubemap_prefilter(&filtered, &cubemap, 16, 6, 0));
+
+	// Each face gets its own mip chain
+	EXPECT_TRUE(image_mipmap_generate(&cubemap, IMAGE_MIPMAP_BOX, 0));
+	EXPECT_TRUE(cubemap.cubemap);
+	EXPECT_EQ(image_layers(&cubemap), 6);
+	EXPECT_EQ(cubemap.levels, 5);
+	for (unsigned int iface = 0; iface < 6; ++iface) {
+		const float32_t* source = image_layer_buffer(&cubemap, 0, iface);
+		const float32_t* mip = image_layer_buffer(&cubemap, 1, iface);
+		for (unsigned int ich = 0; ich < 4; ++ich) {
+			float32_t average = 0.25f * (source[ich] + source[4 + ich] + source[16 * 4 + ich] + source[17 * 4 + ich]);
+			EXPECT_LT(math_abs(mip[ich] - average), 0.0001f);
+		}
+	}
+	image_finalize(&filtered);
+	image_finalize(&cubemap);
+	image_finalize(&equirect);
+
+	return 0;
+}
+
+DECLARE_TEST(image, sdf) {
+	image_pixelformat_t format_mask;
+	image_pixelformat_initialize(&format_mask, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+	image_t mask;
+	image_t sdf;
+	image_t reduced;
+	image_initialize(&mask);
+	image_initialize(&sdf);
+	image_initialize(&reduced);
+	image_allocate_storage(&mask, &format_mask, 32, 16, 1, 1);
+
+	// Half plane edge with the default 8-bit field and a spread of four texels
+	for (unsigned int ipixel = 0; ipixel < 32 * 16; ++ipixel) {
+		memset(mask.data + ipixel * 4, 0, 3);
+		mask.data[ipixel * 4 + 3] = ((ipixel % 32) < 16) ? 255 : 0;
+	}
+	EXPECT_TRUE(image_sdf_from_alpha(&sdf, &mask, 0, 0));
+	EXPECT_EQ(sdf.width, 32);
+	EXPECT_EQ(sdf.height, 16);
+	EXPECT_EQ(sdf.format.bits_per_pixel, 8);
+	EXPECT_EQ(sdf.data[5 * 32 + 0], 255);
+	EXPECT_GE(sdf.data[5 * 32 + 15], 143);
+	EXPECT_LE(sdf.data[5 * 32 + 15], 144);
+	EXPECT_GE(sdf.data[5 * 32 + 16], 111);
+	EXPECT_LE(sdf.data[5 * 32 + 16], 112);
+	EXPECT_EQ(sdf.data[5 * 32 + 31], 0);
+
+	// Random masks match brute force distances between texel centers
+	image_sdf_options_t options;
+	memset(&options, 0, sizeof(options));
+	image_pixelformat_initialize(&options.format, IMAGE_DATATYPE_FLOAT, 32, 1, IMAGE_COLORSPACE_LINEAR);
+	options.spread = 100.0f;
+	uint32_t seed = 1234;
+	for (unsigned int ipixel = 0; ipixel < 32 * 16; ++ipixel) {
+		seed = seed * 1664525U + 1013904223U;
+		mask.data[ipixel * 4 + 3] = ((seed >> 24) < 40) ? 255 : 0;
+	}
+	EXPECT_TRUE(image_sdf_from_alpha(&sdf, &mask, 0, &options));
+	const float32_t* distance = (const float32_t*)sdf.data;
+	for (unsigned int ipixel = 0; ipixel < 32 * 16; ++ipixel) {
+		bool inside = (mask.data[ipixel * 4 + 3] != 0);
+		float32_t nearest = 1e20f;
+		for (unsigned int iother = 0; iother < 32 * 16; ++iother) {
+			if ((mask.data[iother * 4 + 3] != 0) == inside)
+				continue;
+			float32_t dx = (float32_t)(ipixel % 32) - (float32_t)(iother % 32);
+			float32_t dy = (float32_t)(ipixel / 32) - (float32_t)(iother / 32);
+			float32_t length2 = dx * dx + dy * dy;
+			nearest = (length2 < nearest) ? length2 : nearest;
+		}
+		float32_t expected = (sqrtf(nearest) - 0.5f) / 100.0f;
+		EXPECT_LT(math_abs(distance[ipixel] - (inside ? expected : -expected)), 0.00001f);
+	}
+
+	// Reduced fields sample the full resolution field at block centers, with the spread in reduced texels
+	options.spread = 25.0f;
+	options.downsample = 4;
+	EXPECT_TRUE(image_sdf_from_alpha(&reduced, &mask, 0, &options));
+	EXPECT_EQ(reduced.width, 8);
+	EXPECT_EQ(reduced.height, 4);
+	const float32_t* sampled = (const float32_t*)reduced.data;
+	for (unsigned int y = 0; y < 4; ++y) {
+		for (unsigned int x = 0; x < 8; ++x)
+			EXPECT_LT(math_abs(sampled[y * 8 + x] - distance[(y * 4 + 2) * 32 + x * 4 + 2]), 0.00001f);
+	}
+
+	// Masks without alpha use the red channel
+	image_pixelformat_initialize(&format_mask, IMAGE_DATATYPE_UNSIGNED_INT, 8, 1, IMAGE_COLORSPACE_LINEAR);
+	image_allocate_storage(&mask, &format_mask, 8, 8, 1, 1);
+	memset(mask.data, 0, 8 * 8);
+	mask.data[3 * 8 + 3] = 255;
+	EXPECT_TRUE(image_sdf_from_alpha(&sdf, &mask, 0, &options));
+	EXPECT_EQ(sdf.width, 2);
+	EXPECT_REALEQ(((const float32_t*)sdf.data)[0], (0.5f - sqrtf(2.0f)) / 100.0f);
+
+	image_pixelformat_initialize(&options.format, IMAGE_DATATYPE_UNSIGNED_INT, 8, 4, IMAGE_COLORSPACE_LINEAR);
+	EXPECT_FALSE(image_sdf_from_alpha(&sdf, &mask, 0, &options));
+	EXPECT_FALSE(image_sdf_from_alpha(&mask, &mask, 0, 0));
+	image_finalize(&reduced);
+	image_finalize(&sdf);
+	image_finalize(&mask);
+
+	return 0;
+}
+
 static void
 test_image_declare(void) {
 	ADD_TEST(image, create);
+	ADD_TEST(image, astc);
+	ADD_TEST(image, save);
+	ADD_TEST(image, native);
+	ADD_TEST(image, async);
+	ADD_TEST(image, batch);
+	ADD_TEST(image, stress);
+	ADD_TEST(image, cache);
+	ADD_TEST(image, derived);
+	ADD_TEST(image, metrics);
+	ADD_TEST(image, storage);
+	ADD_TEST(image, trace);
+	ADD_TEST(image, loadevent);
+	ADD_TEST(image, statistics);
+	ADD_TEST(image, compare);
+	ADD_TEST(image, dedup);
+	ADD_TEST(image, blit);
+	ADD_TEST(image, convert);
+	ADD_TEST(image, atlas);
+	ADD_TEST(image, transform);
+	ADD_TEST(image, orientation);
+	ADD_TEST(image, convolve);
+	ADD_TEST(image, mipmap);
+	ADD_TEST(image, normalmap);
+	ADD_TEST(image, cubemap);
+	ADD_TEST(image, sdf);
 }
 
 static test_suite_t test_image_suite = {test_image_application,